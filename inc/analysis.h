@@ -0,0 +1,112 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "csoundlib.h"
+
+/*
+
+offline analysis runs as three stages joined by bounded queues:
+
+    open        decode_threads workers take the next path, read its header and, for an
+                mp3, index its packets
+    analyze     analysis_threads workers decode each opened file hop frames at a time
+                and stream it through the measures
+    write       the calling thread writes each result and hands it to the callback
+
+no file is ever decoded whole. the opened queue holds at most queue_depth files, so
+however long the list or the files, memory stays at (decode_threads + queue_depth +
+analysis_threads) open files plus a stft and the per frame measures of each file being
+analyzed. both worker stages run on one thread pool.
+
+per file, with every channel mixed to mono:
+
+    onsets      spectral flux of the log compressed stft magnitudes. a frame is an onset
+                when it is the largest within ANALYSIS_ONSET_PEAK_SECONDS and clears the
+                mean around it by ANALYSIS_ONSET_DELTA times the mean of the whole file
+    tempo       autocorrelation of the flux less its local mean between 40 and 240 bpm,
+                weighted towards 120 bpm by a log gaussian one octave wide
+    loudness    integrated loudness per ITU-R BS.1770-4: k weighting, 400 ms blocks every
+                100 ms, -70 LUFS absolute gate then a gate 10 LU under the mean
+
+*/
+#define ANALYSIS_DEFAULT_FFT_SIZE                 2048
+#define ANALYSIS_DEFAULT_HOP                      512
+#define ANALYSIS_QUEUE_PER_THREAD                 2 // default decoded files waiting per analysis thread
+#define ANALYSIS_LOG_GAIN                         100.0f // log(1 + gain * magnitude) compression before the flux
+#define ANALYSIS_ONSET_PEAK_SECONDS               0.03 // onsets are at least this far apart
+#define ANALYSIS_ONSET_MEAN_SECONDS               0.1 // each side of a frame for the local mean
+#define ANALYSIS_ONSET_DELTA                      0.5
+#define ANALYSIS_MIN_BPM                          40.0
+#define ANALYSIS_MAX_BPM                          240.0
+#define ANALYSIS_CENTER_BPM                       120.0
+#define ANALYSIS_MIN_BEAT_ONSETS                  4 // no tempo from fewer onsets than this
+#define ANALYSIS_STEP_SECONDS                     0.1 // loudness block hop
+#define ANALYSIS_BLOCK_STEPS                      4 // loudness block length in steps
+#define ANALYSIS_ABSOLUTE_GATE                    -70.0
+#define ANALYSIS_RELATIVE_GATE                    -10.0
+#define ANALYSIS_MAX_CHANNELS                     8
+#define ANALYSIS_FILE_MAGIC                       "CSLANLYS"
+#define ANALYSIS_FILE_VERSION                     1
+
+/* one second order section, transposed direct form ii */
+typedef struct _analysisBiquad {
+    double b0, b1, b2, a1, a2;
+    double z1[ANALYSIS_MAX_CHANNELS];
+    double z2[ANALYSIS_MAX_CHANNELS];
+} analysisBiquad;
+
+/* a growable array of doubles, one entry per stft frame or loudness block */
+typedef struct _analysisSeries {
+    double* values;
+    int count;
+    int capacity;
+} analysisSeries;
+
+/* an opened file, read a few frames at a time */
+typedef struct _analysisSource {
+    FILE* wav; // positioned in the data chunk, NULL for an mp3
+    size_t wav_bytes_left; // of the data chunk
+    CslMp3Stream* mp3;
+    CslDataType data_type;
+    int num_channels;
+    CslSampleRate sample_rate;
+    unsigned char* bytes; // one read of the file's own samples
+} analysisSource;
+
+/* one file travelling through the stages */
+typedef struct _analysisJob {
+    int index;
+    const char* path;
+    analysisSource source;
+    CslAnalysisResult result;
+    analysisSeries onsets;
+} analysisJob;
+
+typedef struct _analysisQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    analysisJob** jobs;
+    int capacity;
+    int head;
+    int count;
+    int producers; // stages still pushing, the queue is drained and closed when this reaches 0
+} analysisQueue;
+
+/* shared by every worker of one soundlib_analyze_files call */
+typedef struct _analysisRun {
+    const char* const* paths;
+    int num_paths;
+    int next_path; // atomic
+    bool failed; // atomic, out of memory somewhere, stop taking new paths
+    int fft_size;
+    int hop;
+    analysisQueue opened;
+    analysisQueue finished;
+} analysisRun;
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef CLIP_H
+#define CLIP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "csoundlib.h"
+#include "clip_codec.h"
+
+/*
+
+a loaded file shared by any number of tracks. the samples are owned by the clip (allocated
+at exactly the decoded size or mapped from the decode cache) and freed with the last reference.
+
+while nothing has the clip pinned its samples may be evicted to free memory, the clip then
+keeps only its path and metadata and loads the samples again on the next pin.
+
+*/
+struct _cslClip {
+    int refcount; // atomic
+    int pins; // guarded by the registry lock
+    char* path;
+    CslFileInfo info; // info.data is NULL while evicted or compressed
+    clipCodec* compressed; // samples when the clip is kept compressed, NULL otherwise
+    bool compress; // compress the samples whenever they are loaded
+    uint64_t last_used; // registry clock value of the last pin or unpin
+    struct _cslClip* prev;
+    struct _cslClip* next;
+};
+
+/* reads frames of a pinned clip, decoding compressed clips a block at a time */
+typedef struct _clipReader {
+    const CslClip* clip;
+    int cached_block; // block held in block, -1 for none
+    unsigned char* block;
+} clipReader;
+
+int clip_reader_init(clipReader* reader, CslClip* clip);
+void clip_reader_destroy(clipReader* reader);
+
+/* interleaved floats, returns the number of frames read. never allocates */
+int clip_read_frames(clipReader* reader, int64_t frame, int num_frames, float* out);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef CLIP_CODEC_H
+#define CLIP_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csoundlib.h"
+
+/*
+
+lossless in-memory compression for integer pcm clips. every block of CLIP_CODEC_BLOCK_FRAMES
+frames is coded on its own (so any block can be decoded without the ones before it):
+
+    stereo blocks of up to 24 bits: 1 bit, set when the right channel is coded as left - right
+    per channel: 3 bit mode
+        mode 0-4: fixed polynomial predictor of that order
+            order warmup samples, 32 bits each
+            per partition of CLIP_CODEC_PARTITION_FRAMES: 5 bit rice parameter k, then
+            zigzagged residuals as unary quotient + k bit remainder. a quotient of
+            CLIP_CODEC_ESCAPE_ZEROS or more is written as that many zeros, a one and the
+            raw residual in CLIP_CODEC_ESCAPE_BITS bits.
+        mode 7: verbatim, every sample in bit depth bits (one more for left - right)
+
+blocks start on a byte boundary and block_offsets gives where.
+
+*/
+#define CLIP_CODEC_BLOCK_FRAMES                   4096
+#define CLIP_CODEC_PARTITION_FRAMES               256
+#define CLIP_CODEC_MAX_ORDER                      4
+#define CLIP_CODEC_VERBATIM                       7
+#define CLIP_CODEC_MODE_BITS                      3
+#define CLIP_CODEC_RICE_BITS                      5
+#define CLIP_CODEC_MAX_RICE                       31
+#define CLIP_CODEC_ESCAPE_ZEROS                   32
+#define CLIP_CODEC_ESCAPE_BITS                    40
+#define CLIP_CODEC_WARMUP_BITS                    32
+
+typedef struct _clipCodec {
+    unsigned char* bytes;
+    size_t num_bytes;
+    uint64_t* block_offsets;
+    int num_blocks;
+    CslDataType data_type;
+    int num_channels;
+    int64_t num_frames;
+} clipCodec;
+
+/* compress the samples of info, which must be an integer pcm type */
+int clip_codec_encode(const CslFileInfo* info, clipCodec* codec);
+
+/*
+decode one block back to exactly the bytes it was made from. out needs room for
+CLIP_CODEC_BLOCK_FRAMES frames; returns the number of frames in the block.
+never allocates, safe on the audio thread.
+*/
+int clip_codec_decode_block(const clipCodec* codec, int block, unsigned char* out);
+
+void clip_codec_free(clipCodec* codec);
+
+/* memory used by a compressed clip */
+size_t clip_codec_bytes(const clipCodec* codec);
+
+#endif
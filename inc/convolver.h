@@ -0,0 +1,126 @@
+#ifndef CONVOLVER_H
+#define CONVOLVER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "csoundlib.h"
+
+#define CONVOLVER_MIN_BLOCK                       16
+#define CONVOLVER_MAX_BLOCK                       8192
+#define CONVOLVER_MAX_CHANNELS                    8
+
+/*
+
+uniformly partitioned overlap-save. the impulse response is cut into num_partitions blocks
+of block_size and each is transformed at 2 * block_size. every block_size input samples:
+
+    the last two input blocks are transformed into the newest slot of the frequency
+    domain delay line (fdl), which holds the spectra of the last num_partitions blocks
+    Y = sum over p of fdl[newest - p] * ir[p]
+    the second half of the inverse transform of Y is the next block of output
+
+so output lags input by block_size samples. spectra are stored split (reals, then
+imaginaries) with padded_bins entries each so the multiply-accumulate runs four bins at
+a time with no tail. the bins past num_bins stay zero.
+
+*/
+typedef struct _convolverChannel {
+    float* input; // 2 * block_size, the previous block then the one being filled
+    float* output; // block_size, the last block out of the inverse transform
+    float* fdl_re; // num_partitions * padded_bins
+    float* fdl_im;
+} convolverChannel;
+
+/*
+
+a convolver is a list of uniform segments, each covering a stretch of the response that
+starts at ir_start. a segment run on the audio thread lags by block_size, one run on the
+worker lags by 2 * block_size: the worker gets a whole block period to turn each block round.
+so a segment's ir_start is its lag minus the convolver's latency.
+
+the uniform convolver is one audio thread segment starting at 0, latency block_size.
+
+the non-uniform one has latency 0. the first head_block taps are a direct form fir, then:
+
+    audio thread   block h     from h       up to 16h
+    worker         block 8h    from 16h     up to 128h
+    worker         block 64h   from 128h    ...
+
+each segment growing eightfold until CONVOLVER_MAX_BLOCK, which takes the rest. every segment
+ends where the next one's lag starts, so nothing needs an extra delay line, and the audio
+thread only ever does the fir plus 15 small partitions whatever the response length.
+
+a worker block travels through CONVOLVER_POST_SLOTS slots each way. the audio thread posts
+block k into posted[k % slots] and at the next boundary takes the result out of
+ready[(k - 1) % slots]. when the result isn't done it plays silence for that block and counts
+a missed deadline rather than wait.
+
+the worker runs blocks strictly in order, since every one of them is a slot of the fdl and
+the overlap half of the next. it marks the block it is reading in working_block, then checks
+slot_block still says the slot holds it. the audio thread invalidates slot_block before it
+looks at working_block, and drops its own block rather than overwrite one being read. a block
+that was dropped, or overwritten before the worker got to it, is run as silence: its fdl slot
+is the previous block followed by zeros and the next block overlaps zeros, so the delay line
+stays in step and the block is just left out of the tail.
+
+*/
+#define CONVOLVER_MAX_SEGMENTS                    8
+#define CONVOLVER_GROWTH                          8 // block size ratio between neighbouring segments
+#define CONVOLVER_WORKER_POLL_NS                  1000000 // worker wakes this often in case a signal was missed
+#define CONVOLVER_POST_SLOTS                      4 // blocks the worker can fall behind before one is lost
+
+typedef struct _convolverSegment {
+    int block_size;
+    int ir_start; // first frame of the response this segment covers
+    bool background; // run on the worker thread
+    int num_bins; // block_size + 1
+    int padded_bins; // num_bins rounded up to 4
+    int num_partitions;
+    CslFftPlan* plan; // real, 2 * block_size
+    float* ir_re; // ir_channels * num_partitions * padded_bins
+    float* ir_im;
+    convolverChannel channels[CONVOLVER_MAX_CHANNELS];
+    int newest; // fdl slot the next block is transformed into
+    float* spectrum; // num_bins complex values, interleaved like the fft wants them
+    float* acc_re; // padded_bins
+    float* acc_im;
+    float* time; // 2 * block_size
+    float* playing[CONVOLVER_MAX_CHANNELS]; // block_size each, read by the audio thread. the channel outputs for foreground segments
+    float* playback; // num_channels * block_size, backs playing for background segments
+    float* posted[CONVOLVER_POST_SLOTS]; // num_channels * block_size, input blocks for the worker
+    float* ready[CONVOLVER_POST_SLOTS]; // num_channels * block_size, results from the worker
+    int posted_channels[CONVOLVER_POST_SLOTS]; // channels in each posted block
+    int64_t slot_block[CONVOLVER_POST_SLOTS]; // atomic, block held by each posted slot, -1 while written
+    int64_t posted_block; // atomic, newest block handed to the worker, -1 for none
+    int64_t working_block; // atomic, block the worker is reading
+    int64_t done_block; // atomic, newest block the worker finished, it runs them in order
+} convolverSegment;
+
+struct _cslConvolver {
+    int num_channels;
+    int ir_channels; // 1, or num_channels
+    int latency;
+    int tail; // ir_frames, the output keeps coming that long after the latency
+    int run; // smallest block, every boundary falls on a multiple of it
+    int head_taps; // direct form taps, 0 for none
+    float* head; // ir_channels * head_taps, reversed for the dot product
+    float* recent[CONVOLVER_MAX_CHANNELS]; // head_taps - 1 samples of history then up to run new ones
+    int recent_keep; // head_taps - 1, or 0 without a head
+    int history_size; // power of two, the largest block
+    float* history[CONVOLVER_MAX_CHANNELS]; // ring of the last history_size input samples
+    int64_t position; // frames processed
+    float* wet_run; // run, the convolved signal of one channel
+    int num_segments;
+    convolverSegment segments[CONVOLVER_MAX_SEGMENTS];
+    bool has_worker;
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool quit; // under lock
+    int64_t missed_deadlines; // atomic
+    float wet; // atomic
+    float dry; // atomic
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef CSL_SIMD_H
+#define CSL_SIMD_H
+
+/*
+
+four lane float vectors. NEON on arm64, SSE on x86, plain structs everywhere else.
+loads and stores are unaligned so callers can point them anywhere in a buffer.
+
+*/
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+#define CSL_SIMD_NEON 1
+typedef float32x4_t cslVec4;
+
+static inline cslVec4 csl_vec4_load(const float* p) { return vld1q_f32(p); }
+static inline void csl_vec4_store(float* p, cslVec4 a) { vst1q_f32(p, a); }
+static inline cslVec4 csl_vec4_set1(float x) { return vdupq_n_f32(x); }
+static inline cslVec4 csl_vec4_add(cslVec4 a, cslVec4 b) { return vaddq_f32(a, b); }
+static inline cslVec4 csl_vec4_sub(cslVec4 a, cslVec4 b) { return vsubq_f32(a, b); }
+static inline cslVec4 csl_vec4_mul(cslVec4 a, cslVec4 b) { return vmulq_f32(a, b); }
+static inline cslVec4 csl_vec4_min(cslVec4 a, cslVec4 b) { return vminq_f32(a, b); }
+static inline cslVec4 csl_vec4_max(cslVec4 a, cslVec4 b) { return vmaxq_f32(a, b); }
+/* a + b * c */
+static inline cslVec4 csl_vec4_madd(cslVec4 a, cslVec4 b, cslVec4 c) { return vmlaq_f32(a, b, c); }
+/* a - b * c */
+static inline cslVec4 csl_vec4_msub(cslVec4 a, cslVec4 b, cslVec4 c) { return vmlsq_f32(a, b, c); }
+static inline float csl_vec4_hsum(cslVec4 a) { return vaddvq_f32(a); }
+/* rows become columns */
+static inline void csl_vec4_transpose(cslVec4* r0, cslVec4* r1, cslVec4* r2, cslVec4* r3) {
+    float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+    float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+    *r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+/* p[0] p[2] p[4] p[6] into even, p[1] p[3] p[5] p[7] into odd */
+static inline void csl_vec4_load_deinterleave(const float* p, cslVec4* even, cslVec4* odd) {
+    float32x4x2_t v = vld2q_f32(p);
+    *even = v.val[0];
+    *odd = v.val[1];
+}
+/* a[0] b[0] a[1] b[1] ... into p[0..7] */
+static inline void csl_vec4_store_interleave(float* p, cslVec4 a, cslVec4 b) {
+    float32x4x2_t v = {{a, b}};
+    vst2q_f32(p, v);
+}
+static inline cslVec4 csl_vec4_reverse(cslVec4 a) {
+    float32x4_t r = vrev64q_f32(a);
+    return vcombine_f32(vget_high_f32(r), vget_low_f32(r));
+}
+
+#elif defined(__SSE__) || defined(_M_X64)
+
+#include <xmmintrin.h>
+#define CSL_SIMD_SSE 1
+typedef __m128 cslVec4;
+
+static inline cslVec4 csl_vec4_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void csl_vec4_store(float* p, cslVec4 a) { _mm_storeu_ps(p, a); }
+static inline cslVec4 csl_vec4_set1(float x) { return _mm_set1_ps(x); }
+static inline cslVec4 csl_vec4_add(cslVec4 a, cslVec4 b) { return _mm_add_ps(a, b); }
+static inline cslVec4 csl_vec4_sub(cslVec4 a, cslVec4 b) { return _mm_sub_ps(a, b); }
+static inline cslVec4 csl_vec4_mul(cslVec4 a, cslVec4 b) { return _mm_mul_ps(a, b); }
+static inline cslVec4 csl_vec4_min(cslVec4 a, cslVec4 b) { return _mm_min_ps(a, b); }
+static inline cslVec4 csl_vec4_max(cslVec4 a, cslVec4 b) { return _mm_max_ps(a, b); }
+static inline cslVec4 csl_vec4_madd(cslVec4 a, cslVec4 b, cslVec4 c) { return _mm_add_ps(a, _mm_mul_ps(b, c)); }
+static inline cslVec4 csl_vec4_msub(cslVec4 a, cslVec4 b, cslVec4 c) { return _mm_sub_ps(a, _mm_mul_ps(b, c)); }
+static inline float csl_vec4_hsum(cslVec4 a) {
+    __m128 shuf = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(a, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+static inline void csl_vec4_transpose(cslVec4* r0, cslVec4* r1, cslVec4* r2, cslVec4* r3) {
+    _MM_TRANSPOSE4_PS(*r0, *r1, *r2, *r3);
+}
+static inline void csl_vec4_load_deinterleave(const float* p, cslVec4* even, cslVec4* odd) {
+    __m128 lo = _mm_loadu_ps(p), hi = _mm_loadu_ps(p + 4);
+    *even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+static inline void csl_vec4_store_interleave(float* p, cslVec4 a, cslVec4 b) {
+    _mm_storeu_ps(p, _mm_unpacklo_ps(a, b));
+    _mm_storeu_ps(p + 4, _mm_unpackhi_ps(a, b));
+}
+static inline cslVec4 csl_vec4_reverse(cslVec4 a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+#else
+
+typedef struct { float v[4]; } cslVec4;
+
+static inline cslVec4 csl_vec4_load(const float* p) { cslVec4 r = {{p[0], p[1], p[2], p[3]}}; return r; }
+static inline void csl_vec4_store(float* p, cslVec4 a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+static inline cslVec4 csl_vec4_set1(float x) { cslVec4 r = {{x, x, x, x}}; return r; }
+#define CSL_VEC4_BINARY(name, expr) \
+    static inline cslVec4 name(cslVec4 a, cslVec4 b) { cslVec4 r; for (int i = 0; i < 4; i++) r.v[i] = (expr); return r; }
+CSL_VEC4_BINARY(csl_vec4_add, a.v[i] + b.v[i])
+CSL_VEC4_BINARY(csl_vec4_sub, a.v[i] - b.v[i])
+CSL_VEC4_BINARY(csl_vec4_mul, a.v[i] * b.v[i])
+CSL_VEC4_BINARY(csl_vec4_min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+CSL_VEC4_BINARY(csl_vec4_max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#undef CSL_VEC4_BINARY
+static inline cslVec4 csl_vec4_madd(cslVec4 a, cslVec4 b, cslVec4 c) { return csl_vec4_add(a, csl_vec4_mul(b, c)); }
+static inline cslVec4 csl_vec4_msub(cslVec4 a, cslVec4 b, cslVec4 c) { return csl_vec4_sub(a, csl_vec4_mul(b, c)); }
+static inline float csl_vec4_hsum(cslVec4 a) { return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]); }
+static inline void csl_vec4_transpose(cslVec4* r0, cslVec4* r1, cslVec4* r2, cslVec4* r3) {
+    cslVec4* rows[4] = {r0, r1, r2, r3};
+    for (int i = 0; i < 4; i++) {
+        for (int j = i + 1; j < 4; j++) {
+            float t = rows[i]->v[j];
+            rows[i]->v[j] = rows[j]->v[i];
+            rows[j]->v[i] = t;
+        }
+    }
+}
+static inline void csl_vec4_load_deinterleave(const float* p, cslVec4* even, cslVec4* odd) {
+    for (int i = 0; i < 4; i++) {
+        even->v[i] = p[2 * i];
+        odd->v[i] = p[2 * i + 1];
+    }
+}
+static inline void csl_vec4_store_interleave(float* p, cslVec4 a, cslVec4 b) {
+    for (int i = 0; i < 4; i++) {
+        p[2 * i] = a.v[i];
+        p[2 * i + 1] = b.v[i];
+    }
+}
+static inline cslVec4 csl_vec4_reverse(cslVec4 a) { cslVec4 r = {{a.v[3], a.v[2], a.v[1], a.v[0]}}; return r; }
+
+#endif
+
+static inline cslVec4 csl_vec4_zero(void) { return csl_vec4_set1(0.0f); }
+
+/*
+flush denormals to zero until csl_denormals_restore. recursive filters decaying towards
+silence otherwise spend most of their time on denormal arithmetic.
+*/
+static inline unsigned long csl_denormals_off(void) {
+#if defined(CSL_SIMD_SSE)
+    unsigned long old = _mm_getcsr();
+    _mm_setcsr((unsigned int)old | 0x8040); // flush to zero and denormals are zero
+    return old;
+#elif defined(CSL_SIMD_NEON) && defined(__aarch64__)
+    unsigned long old;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(old));
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(old | (1UL << 24))); // FZ
+    return old;
+#else
+    return 0;
+#endif
+}
+
+static inline void csl_denormals_restore(unsigned long state) {
+#if defined(CSL_SIMD_SSE)
+    _mm_setcsr((unsigned int)state);
+#elif defined(CSL_SIMD_NEON) && defined(__aarch64__)
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(state));
+#else
+    (void)state;
+#endif
+}
+
+#endif
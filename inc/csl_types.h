@@ -40,11 +40,13 @@ typedef struct _inputDtype {
 #define CSL_BYTES_IN_SAMPLE_16        2
 #define CSL_BYTES_IN_SAMPLE_24        3
 #define CSL_BYTES_IN_SAMPLE_32        4
+#define CSL_BYTES_IN_SAMPLE_64        8
 
 #define CSL_BYTES_IN_BUFFER_8         1
 #define CSL_BYTES_IN_BUFFER_16        2
 #define CSL_BYTES_IN_BUFFER_24        4
 #define CSL_BYTES_IN_BUFFER_32        4
+#define CSL_BYTES_IN_BUFFER_64        8
 
 InputDtype get_dtype(CslDataType in);
 
@@ -57,5 +59,6 @@ InputDtype CSL_S24_t;
 InputDtype CSL_U32_t;
 InputDtype CSL_S32_t;
 InputDtype CSL_FL32_t;
+InputDtype CSL_FL64_t;
 
 #endif
\ No newline at end of file
@@ -12,12 +12,23 @@ float envelope_follower(float input, float attack, float release, float prev_env
 
 void add_and_scale_audio(const uint8_t *source, uint8_t *destination, float volume, int num_samples);
 
+/* destination += source * gain, unlike add_and_scale_audio the destination keeps its level */
+void accumulate_audio(const uint8_t *source, uint8_t *destination, float gain, int num_samples);
+
 void scale_audio(uint8_t *source, float volume, int num_samples);
 
 float calculate_rms_level(const unsigned char* source, int num_bytes);
 
+#define SILENCE_THRESHOLD                         1e-6f // -120 dBFS, quieter samples count as silence
+
+/* true when every sample in the buffer is below SILENCE_THRESHOLD, stops at the first one that isn't */
+bool is_silent_audio(const unsigned char* source, int num_bytes);
+
 float log_to_mag(float log);
 
+/* room in a user allocated CslFileInfo buffer, for files loaded into it */
+size_t user_data_capacity(const CslFileInfo* info);
+
 float mag_to_log(float mag);
 
 #endif
\ No newline at end of file
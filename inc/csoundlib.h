@@ -57,6 +57,13 @@ extern "C" {
 #define CSLErrorLoadingOutputDevices              29
 #define CSLErrorSettingSampleRate                 30
 #define CSLErrorSettingBitDepth                   31
+#define CSLErrorDecodingFile                      32
+#define CSLErrorUnsupportedFormat                 33
+#define CSLErrorLoadCancelled                     34
+#define CSLErrorBufferTooSmall                    35
+#define CSLErrorBusNotFound                       36
+#define CSLErrorRoutingCycle                      37
+#define CSLErrorEventQueueFull                    38
 
 /**
  * @enum CslDataType
@@ -106,12 +113,17 @@ enum SoundIoFormat {
  * @enum CslSampleRate
  * @brief Sample rates supported by the library.
  *
- * defines the sample rates for audio processing. Currently, it 
- * supports only 44.1 kHz and 48 kHz.
+ * defines the sample rates for audio processing. Sessions and files may use
+ * any of them, files at a different rate than the session can be converted
+ * with the resampler.
  */
 typedef enum {
     CSL_SR44100,
-    CSL_SR48000
+    CSL_SR48000,
+    CSL_SR22050,
+    CSL_SR88200,
+    CSL_SR96000,
+    CSL_SR192000
 } CslSampleRate;
 
 /**
@@ -185,6 +197,22 @@ typedef void (*MasterAudioAvailableCallback) (
     size_t num_channels
 );
 
+/**
+ * @typedef CslLoadProgressCallback
+ * @brief Callback reporting how far along a file load is.
+ *
+ * May be called from a decoder thread rather than the thread that started the load.
+ *
+ * @param path The path of the file being loaded.
+ * @param progress Fraction of the file decoded so far, between 0 and 1.
+ * @param user Pointer passed in by the user when the load was started.
+ */
+typedef void (*CslLoadProgressCallback) (
+    const char* path,
+    float progress,
+    void* user
+);
+
 /**
  * @struct CslDeviceInfo
  * @brief Represents an audio input or output device.
@@ -197,6 +225,20 @@ typedef struct {
     int index;
 } CslDeviceInfo;
 
+/**
+ * @enum CslDataStorage
+ * @brief who owns the sample data of a CslFileInfo.
+ *      USER data was allocated by the user before loading.
+ *      ALLOCATED data was allocated by the library at exactly the decoded size.
+ *      MAPPED data is a read-only mapping of a decode cache file.
+ *      Release ALLOCATED and MAPPED data with soundlib_release_file_data.
+ */
+typedef enum {
+    CSL_DATA_USER,
+    CSL_DATA_ALLOCATED,
+    CSL_DATA_MAPPED
+} CslDataStorage;
+
 /**
  * @struct CslFileInfo
  * @brief Represents info about an audio file
@@ -209,7 +251,9 @@ typedef struct {
     const char* path;
     int num_frames;
     int num_channels;
-    unsigned char* data; // max size is 10 min of 48k 64 bit audio
+    unsigned char* data; // NULL before loading lets the library allocate exactly the decoded size
+    size_t data_bytes; // before loading: size of a user allocated data buffer, 0 means MAX_AUDIO_FILE_SIZE_BYTES
+    CslDataStorage data_storage;
 } CslFileInfo;
 
 
@@ -339,6 +383,17 @@ void soundlib_set_num_channels_audio_file(uint8_t channels);
  */
 float soundlib_get_track_output_rms(int trackId);
 
+/**
+ * @brief Whether a track was skipped in the last period
+ *
+ * a track is idle once its input has been silent for longer than the tails of its effects,
+ * it then costs next to nothing: its effects aren't run and it isn't mixed
+ *
+ * @param trackId The ID of the track.
+ * @return true if idle, false if it is sounding or not found
+ */
+bool soundlib_track_is_idle(int trackId);
+
 /**
  * @brief Solo this track
  *
@@ -533,11 +588,206 @@ int soundlib_get_num_formats_of_output_device(int deviceIndex);
  */
 void soundlib_set_master_volume(float logVolume);
 
+/* routing */
+
+#define CSL_MASTER_BUS                            -1
+
+/**
+ * @brief Add a bus. Tracks and other buses route into it through their output or
+ * sends, its effects run once on the sum. It goes to the master bus until told otherwise.
+ *
+ * @param busId unique id for the bus, separate from track ids, not CSL_MASTER_BUS
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_add_bus(int busId);
+
+/**
+ * @brief Delete a bus. Everything that output to it goes to the master bus instead
+ * and sends to it are removed. Its effects are taken off but not destroyed.
+ *
+ * @param busId bus id
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_delete_bus(int busId);
+
+/**
+ * @brief Set volume for a bus
+ *
+ * @param busId bus id
+ * @param logVolume Log value of the desired volume
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_set_bus_volume(int busId, float logVolume);
+
+/**
+ * @brief Mute a bus, its output and sends
+ *
+ * @param busId bus id
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_mute_enable(int busId);
+
+/**
+ * @brief Unmute a bus
+ *
+ * @param busId bus id
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_mute_disable(int busId);
+
+/**
+ * @brief get output rms value of a bus
+ *
+ * @param busId bus id
+ * @return rms level of the bus after its volume, 0 if not found
+ */
+float soundlib_get_bus_output_rms(int busId);
+
+/**
+ * @brief Whether a bus was skipped in the last period, like soundlib_track_is_idle
+ *
+ * @param busId bus id
+ * @return true if idle, false if it is sounding or not found
+ */
+bool soundlib_bus_is_idle(int busId);
+
+/**
+ * @brief Route a track's output, after its volume, to a bus
+ *
+ * @param trackId track id
+ * @param busId destination bus, or CSL_MASTER_BUS
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_set_output(int trackId, int busId);
+
+/**
+ * @brief Route a bus's output, after its volume, to another bus
+ *
+ * @param busId bus id
+ * @param destBusId destination bus, or CSL_MASTER_BUS
+ * @return SoundIoErrorNone (0) on success, CSLErrorRoutingCycle if the bus would feed itself.
+ */
+int soundlib_bus_set_output(int busId, int destBusId);
+
+/**
+ * @brief Add a send from a track to a bus, or change the one already there
+ *
+ * @param trackId track id
+ * @param busId destination bus
+ * @param logLevel Log value of the send level
+ * @param pre_fader take the send before the track's volume instead of after
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_set_send(int trackId, int busId, float logLevel, bool pre_fader);
+
+/**
+ * @brief Remove a send from a track
+ *
+ * @param trackId track id
+ * @param busId bus the send goes to
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_remove_send(int trackId, int busId);
+
+/**
+ * @brief Add a send from a bus to another bus, or change the one already there
+ *
+ * @param busId bus id
+ * @param destBusId destination bus
+ * @param logLevel Log value of the send level
+ * @param pre_fader take the send before the bus's volume instead of after
+ * @return SoundIoErrorNone (0) on success, CSLErrorRoutingCycle if the bus would feed itself.
+ */
+int soundlib_bus_set_send(int busId, int destBusId, float logLevel, bool pre_fader);
+
+/**
+ * @brief Remove a send from a bus
+ *
+ * @param busId bus id
+ * @param destBusId bus the send goes to
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_remove_send(int busId, int destBusId);
+
+/**
+ * @brief Process independent tracks and buses on worker threads alongside the audio thread.
+ * With threads set, the registered effects and output ready callbacks of different tracks
+ * may run at the same time, so they must not share unguarded state. Workers take on the
+ * audio thread's real time priority where the process is allowed to; when they fall behind
+ * anyway, the rest of that period is processed on the audio thread alone.
+ *
+ * @param num_threads 0 to 8 workers, 0 processes everything on the audio thread
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_set_graph_threads(int num_threads);
+
+/**
+ * @brief Latency of the mix, from the track inputs to the master output
+ *
+ * convolvers and effect descriptors report their latency. every path from a track to the
+ * master bus is delayed to line up with the slowest one, so this is that path's latency
+ * plus the latency of the master effects
+ *
+ * @return latency in frames
+ */
+int soundlib_get_graph_latency(void);
+
+/**
+ * @enum CslGraphEvent
+ * @brief what a scheduled event changes
+ */
+typedef enum {
+    CSL_EVENT_TRACK_VOLUME, /**< value is the log volume, as soundlib_set_track_volume */
+    CSL_EVENT_TRACK_MUTE, /**< value non-zero mutes, zero unmutes */
+    CSL_EVENT_BUS_VOLUME,
+    CSL_EVENT_BUS_MUTE,
+    CSL_EVENT_MASTER_VOLUME /**< id is ignored */
+} CslGraphEvent;
+
+/**
+ * @brief Set how many frames the graph processes at a time.
+ * Every period is cut into blocks of this size and every track, bus and the master effects
+ * run one block before the next starts, so the working set of a block stays in cache.
+ * Smaller blocks cost more calls into each effect, and more handoffs with graph threads set.
+ *
+ * @param num_frames 16 to 256, 64 by default
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_set_graph_block_size(int num_frames);
+
+/**
+ * @brief Frames the graph has processed since it started, the clock events are scheduled on
+ *
+ * @return the frame the next period starts at
+ */
+int64_t soundlib_get_graph_frame(void);
+
+/**
+ * @brief Change a volume or mute at an exact frame.
+ * The block that reaches the frame is cut short there, so the change lands on that
+ * sample. Events for a frame already processed happen at the start of the next period,
+ * events for a track or bus that is gone by then are dropped.
+ *
+ * @param type what to change
+ * @param id track or bus id
+ * @param value new value, see CslGraphEvent
+ * @param frame when, on the soundlib_get_graph_frame clock
+ * @return SoundIoErrorNone (0) on success, CSLErrorEventQueueFull when too many are waiting.
+ */
+int soundlib_schedule_event(CslGraphEvent type, int id, float value, int64_t frame);
+
 /* callbacks */
 
 /**
  * @brief Register a callback function that serves as an audio effect for a specific track
  *
+ * The period is processed in blocks (64 frames unless soundlib_set_graph_block_size says
+ * otherwise, shorter where a scheduled event lands), so the effect is called several times
+ * a period, each time with a pointer into the track's buffer at that block and its length.
+ * Anything the effect works out once a period has to be kept across those calls. With
+ * soundlib_set_graph_threads set, effects of different tracks run at the same time on
+ * worker threads, so state shared between tracks must be guarded.
+ *
  * @param trackId put the effect on track with this id
  * @param effect function pointer described by TrackAudioAvailableCallback
  * @return SoundIoErrorNone (0) on success, non-zero on failure.
@@ -575,95 +825,1584 @@ int soundlib_register_master_output_ready_callback(MasterAudioAvailableCallback
 /**
  * @brief Register a callback function that serves as an audio effect for a the master buffer
  *
+ * Like track effects it is called once a block rather than once a period, each time with
+ * a pointer into the master buffer at that block and its length. Master effects always
+ * run on the audio thread, once every track and bus of the block is done, so they never
+ * run alongside track effects even with soundlib_set_graph_threads set.
+ *
  * @param effect function pointer described by MasterAudioAvailableCallback
  * @return SoundIoErrorNone (0) on success, non-zero on failure.
  */
 int soundlib_register_master_effect(MasterAudioAvailableCallback effect);
 
+#define CSL_EFFECT_INFINITE_TAIL                  -1
+
+/**
+ * @struct CslEffectDescriptor
+ * @brief Describes an effect that keeps its own state, so one process function can
+ * serve any number of independent instances.
+ *
+ *      create is called once with the user pointer and returns the instance every other
+ *      function gets. Leave it NULL to use the user pointer as the instance.
+ *      process runs on the audio thread over interleaved floats in place, at most
+ *      256 frames and 8 channels at a time. It must not block or allocate.
+ *      reset clears the instance's history (delay lines, filter state), may be NULL.
+ *      destroy frees the instance, may be NULL.
+ */
+typedef struct {
+    void* (*create)(void* user, int sample_rate);
+    void (*process)(void* instance, float* samples, int num_frames, int num_channels);
+    void (*reset)(void* instance);
+    void (*destroy)(void* instance);
+    int latency; // frames the output lags the input by
+    int tail; // frames the effect keeps sounding once its input is silent, CSL_EFFECT_INFINITE_TAIL for no limit
+} CslEffectDescriptor;
+
+/**
+ * @struct CslEffect
+ * @brief an instance of a CslEffectDescriptor
+ */
+typedef struct _cslEffect CslEffect;
+
+/**
+ * @brief create an effect instance
+ *
+ * @param descriptor effect functions and properties, copied
+ * @param sample_rate rate of the bus it will run on in Hz, passed to create
+ * @param user passed to create
+ * @return the effect, NULL on failure
+ */
+CslEffect* soundlib_effect_create(const CslEffectDescriptor* descriptor, int sample_rate, void* user);
+
+/**
+ * @brief destroy an effect instance, remove it from every track and the master bus first
+ *
+ * @param effect effect to destroy, may be NULL
+ */
+void soundlib_effect_destroy(CslEffect* effect);
+
+/**
+ * @brief clear an effect's history. Safe while it is running, the reset happens
+ * on the audio thread before the next block it processes.
+ *
+ * @param effect effect
+ */
+void soundlib_effect_reset(CslEffect* effect);
+
+/**
+ * @brief the latency the effect's descriptor declared
+ *
+ * @param effect effect
+ * @return latency in frames
+ */
+int soundlib_effect_get_latency(const CslEffect* effect);
+
+/**
+ * @brief the tail the effect's descriptor declared
+ *
+ * @param effect effect
+ * @return tail in frames, CSL_EFFECT_INFINITE_TAIL for no limit
+ */
+int soundlib_effect_get_tail(const CslEffect* effect);
+
+/**
+ * @brief run an effect instance on a track after its registered effects
+ *
+ * @param trackId track id
+ * @param effect effect, owned by the caller. Only put one instance on one track or bus
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_add_effect(int trackId, CslEffect* effect);
+
+/**
+ * @brief take an effect instance off a track, waits for the audio thread to let go of it
+ *
+ * @param trackId track id
+ * @param effect effect given to soundlib_track_add_effect
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_remove_effect(int trackId, CslEffect* effect);
+
+/**
+ * @brief run an effect instance on the master bus after its registered effects
+ *
+ * @param effect effect, owned by the caller
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_add_effect(CslEffect* effect);
+
+/**
+ * @brief take an effect instance off the master bus, waits for the audio thread to let go of it
+ *
+ * @param effect effect given to soundlib_master_add_effect
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_remove_effect(CslEffect* effect);
+
+/**
+ * @brief run an effect instance on a bus, once on everything routed into it
+ *
+ * @param busId bus id
+ * @param effect effect, owned by the caller
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_add_effect(int busId, CslEffect* effect);
+
+/**
+ * @brief take an effect instance off a bus, waits for the audio thread to let go of it
+ *
+ * @param busId bus id
+ * @param effect effect instance given to soundlib_bus_add_effect
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_remove_effect(int busId, CslEffect* effect);
+
 /* audio file functions */
 
 /**
  * @brief open a wav file and return info about it for the user 
  *
+ * If info->data is NULL the library allocates exactly the size of the samples, release
+ * them with soundlib_release_file_data. Otherwise info->data_bytes gives the size of the
+ * user's buffer and files that don't fit fail with CSLErrorBufferTooSmall.
+ *
  * @param path string of the wav file path
  * @param info CslFileInfo struct to be populated by this function
  * @return SoundIoErrorNone (0) on success, non-zero on failure.
  */
 int open_wav_file(const char* path, CslFileInfo* info);
 
-void open_mp3_file(const char *path, CslFileInfo* info);
+/**
+ * @brief open an mp3 file on the calling thread and return info about it for the user 
+ *
+ * Output is 44.1 kHz stereo CSL_S16.
+ *
+ * @param path string of the mp3 file path
+ * @param info CslFileInfo struct to be populated by this function
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int open_mp3_file(const char *path, CslFileInfo* info);
 
-/* utilities */
+/**
+ * @brief decode an mp3 file on several threads at once
+ *
+ * The file is split into evenly spaced segments which are decoded in parallel and 
+ * stitched together sample accurately. Output is the same as open_mp3_file 
+ * (44.1 kHz stereo CSL_S16).
+ *
+ * @param path string of the mp3 file path
+ * @param info CslFileInfo struct to be populated by this function
+ * @param num_threads number of decoder threads, 0 to use one per core
+ * @param progress optional callback reporting decode progress, may be NULL
+ * @param user pointer handed back to the progress callback
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int open_mp3_file_parallel(const char *path, CslFileInfo* info, int num_threads, CslLoadProgressCallback progress, void* user);
 
-float bytes_to_sample_audio_file(const unsigned char* bytes, CslDataType data_type);
-float bytes_to_sample(const unsigned char* bytes, CslDataType data_type);
-size_t get_bytes_in_sample(CslDataType in);
-size_t get_bytes_in_buffer(CslDataType in, bool audio_file);
-uint8_t get_bit_depth(CslDataType in);
-int32_t get_max_value(CslDataType in);
-int32_t get_min_value(CslDataType in);
-bool is_signed_type(CslDataType in);
-int get_sample_rate(CslSampleRate in);
+/**
+ * @struct CslMp3Stream
+ * @brief an mp3 file decoded on demand from any position
+ */
+typedef struct _cslMp3Stream CslMp3Stream;
 
 /**
- * @brief Turn a buffer of bytes into a buffer of floats
+ * @brief open an mp3 file for seeking and reading without decoding all of it
  *
- * @param byte_buffer input byte buffer to be transformed 
- * @param float_buffer pointer to a user allocated array of floats, to be filled in by the function
- * @param data_type tell the function what the data type is for converting
- * @return number of samples in float buffer
+ * Frames come out exactly as open_mp3_file gives them (stereo S16 at 44.1 kHz, encoder
+ * delay and padding removed). Opening scans the packets of the file once to index them,
+ * with the decode cache on the index is kept there and later opens skip the scan.
+ *
+ * @param path string of the mp3 file path
+ * @param stream set to the new stream
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
  */
-int byte_buffer_to_float_buffer(const unsigned char* byte_buffer, float* float_buffer, size_t num_bytes, size_t input_max_samples, CslDataType data_type, bool audio_file);
+int soundlib_mp3_stream_open(const char* path, CslMp3Stream** stream);
 
 /**
- * @brief Low pass filter of the mag of a value
+ * @brief close a stream
  *
- * @param input 
- * @param attack how quickly the envelope reacts to onset changes
- * @param release how quickly the envelope decays 
- * @param prev_envelope continue to pass in the previous value to get the evolving envelope
- * @return current value
+ * @param stream stream to close, may be NULL
  */
-float envelope_follower(float input, float attack, float release, float prev_envelope);
+void soundlib_mp3_stream_close(CslMp3Stream* stream);
 
-/* from pocket fft */
-///
-/// Apply forward 1D FFT for real-typed array of 1D signal
-/// Repeat 1D FFT `nrows` times. Assume input signal has a shape of [nrows *
-/// nsamples]
-///
-/// @param[in] input Input signal(real-value)
-/// @param[in] fft_len FFT length
-/// @param[in] nsamples The number of samples
-/// @param[in] nrows The number of rows
-/// @param[in] norm_factor Normalization factor(usually 1.0 or
-/// `1/sqrt(nsamples)` )
-/// @param[out] output Output signal(complex-value). The layout of elemens are:
-/// `nrows * ((fft_len / 2) + 1) * 2(real, img)`
-/// @return The number of FFTs processed(i.e. nrows = success). Zero or negative
-/// value = error.
-///
-int rfft_forward_1d_array(const double *input, const int fft_len,
-                          const int nsamples, const int nrows,
-                          const float norm_factor, double *output);
+/**
+ * @brief number of frames in the stream
+ *
+ * @param stream open stream
+ * @return frames, the same as num_frames from open_mp3_file
+ */
+int64_t soundlib_mp3_stream_get_num_frames(const CslMp3Stream* stream);
 
-///
-/// Apply backword 1D FFT for complex-typed array
-/// Repeat 1D IFFT `m` times. Assume input signal has a shape of [nrows *
-/// nsamples]
-///
-/// @param[in] input Input signal(complex-value)
-/// @param[in] nsamples The number of samples
-/// @param[in] nrows The number of rows
-/// @param[in] norm_factor Normalization factor(usually `1/nsamples` )
-/// @param[out] output Output signal(complex-value). The shape of elements are
-/// same as input.
-/// @return The number of FFTs processed(i.e. nrows = success). Zero or negative
-/// value = error.
-///
-int cfft_backward_1d_array(const double *input, const int nsamples,
-                           const int nrows, const float norm_factor,
-                           double *output);
+/**
+ * @brief move a stream to a frame
+ *
+ * Finds the packet by binary search and decodes only the packets the frame depends on
+ * (its bit reservoir and the packet before it) ahead of it.
+ *
+ * @param stream open stream
+ * @param frame frame the next read starts at
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_mp3_stream_seek(CslMp3Stream* stream, int64_t frame);
+
+/**
+ * @brief decode the next frames of a stream
+ *
+ * @param stream open stream
+ * @param out room for num_frames * 4 bytes
+ * @param num_frames frames to read
+ * @return frames read, short at the end of the stream or on a decode error
+ */
+int soundlib_mp3_stream_read(CslMp3Stream* stream, unsigned char* out, int num_frames);
+
+/**
+ * @brief keep decoded audio of compressed files in an on-disk cache
+ *
+ * Decoded samples are stored as wav files named after a hash of the source file
+ * contents and the decode parameters. Loading the same file again maps the cached 
+ * samples instead of decoding. If info->data is NULL when loading, info->data is set
+ * to the mapping (or to a buffer of exactly the decoded size on a miss) and must be
+ * released with soundlib_release_file_data. Packet indexes of mp3 files are kept there
+ * too so streams open without scanning the file.
+ *
+ * @param directory directory to keep cache files in, created if missing. NULL turns the cache off
+ * @param max_bytes size the cache may grow to before least recently used files are deleted
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_set_decode_cache(const char* directory, size_t max_bytes);
+
+/**
+ * @brief free or unmap sample data that the library provided for a CslFileInfo
+ *
+ * Does nothing if the data was allocated by the user.
+ *
+ * @param info CslFileInfo struct populated by one of the open functions
+ */
+void soundlib_release_file_data(CslFileInfo* info);
+
+/**
+ * @typedef CslLoadCompleteCallback
+ * @brief Callback for the end of an asynchronous file load.
+ *
+ * Called once per load on a loader thread, whether it succeeded, failed or was cancelled.
+ * info is only valid during the call, copy it to keep it.
+ *
+ * @param err SoundIoErrorNone (0) on success, CSLErrorLoadCancelled if cancelled, other errors on failure.
+ * @param info the loaded file, the same as the open functions fill in.
+ * @param user Pointer passed in by the user when the load was started.
+ */
+typedef void (*CslLoadCompleteCallback) (
+    int err,
+    CslFileInfo* info,
+    void* user
+);
+
+/**
+ * @struct CslLoadOptions
+ * @brief Options for an asynchronous file load.
+ */
+typedef struct {
+    unsigned char* data; // user allocated buffer to load into, NULL lets the library allocate
+    size_t data_bytes; // size of data, 0 means MAX_AUDIO_FILE_SIZE_BYTES
+    int decode_threads; // threads decoding this one file, 0 for one per core
+    CslLoadProgressCallback progress; // may be NULL
+} CslLoadOptions;
+
+/**
+ * @brief load a wav or mp3 file on a background thread
+ *
+ * Loads run in parallel on a shared pool of loader threads, the file type comes from the
+ * extension. path must stay valid until the callback has run.
+ *
+ * @param path string of the file path
+ * @param options load options, NULL for defaults
+ * @param callback called when the load finishes
+ * @param user pointer handed back to the progress and completion callbacks
+ * @param load_id set to an id that can be passed to soundlib_cancel_load, may be NULL
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_load_file_async(const char* path, const CslLoadOptions* options, CslLoadCompleteCallback callback, void* user, int* load_id);
+
+/**
+ * @brief stop a load started with soundlib_load_file_async
+ *
+ * Its callback still runs, with CSLErrorLoadCancelled.
+ *
+ * @param load_id id from soundlib_load_file_async
+ * @return SoundIoErrorNone (0) on success, non-zero if the load has already finished.
+ */
+int soundlib_cancel_load(int load_id);
+
+/**
+ * @brief wait for every pending load and stop the loader threads
+ *
+ * @param cancel_pending cancel loads that have not finished instead of waiting for them
+ */
+void soundlib_loader_shutdown(bool cancel_pending);
+
+/* clips */
+
+/**
+ * @struct CslClip
+ * @brief a loaded file whose samples are owned by the library and shared by reference
+ */
+typedef struct _cslClip CslClip;
+
+/**
+ * @brief load a wav or mp3 file into a new clip
+ *
+ * The samples are allocated at exactly their size (or mapped from the decode cache).
+ * The clip starts with one reference, owned by the caller.
+ *
+ * @param path string of the file path
+ * @param clip set to the new clip
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_clip_load(const char* path, CslClip** clip);
+
+/**
+ * @brief move the library owned samples of a loaded CslFileInfo into a new clip
+ *
+ * info is left without data. Fails for data allocated by the user.
+ *
+ * @param info CslFileInfo struct loaded with data NULL
+ * @param clip set to the new clip
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_clip_from_file_info(CslFileInfo* info, CslClip** clip);
+
+/**
+ * @brief add a reference to a clip
+ *
+ * @param clip clip to keep alive
+ */
+void soundlib_clip_retain(CslClip* clip);
+
+/**
+ * @brief drop a reference to a clip, the last one frees it and its samples
+ *
+ * @param clip clip to release, may be NULL
+ */
+void soundlib_clip_release(CslClip* clip);
+
+/**
+ * @brief metadata of a clip
+ *
+ * data is NULL while the clip is evicted or compressed, pin the clip and read it with
+ * soundlib_clip_read_frames.
+ *
+ * @param clip clip to describe
+ * @return info about the clip, valid as long as the clip is
+ */
+const CslFileInfo* soundlib_clip_get_info(const CslClip* clip);
+
+/**
+ * @brief make sure the samples of a clip are in memory and keep them there
+ *
+ * Loads the file again if the clip was evicted. Pins are counted, unpin once per pin.
+ *
+ * @param clip clip to pin
+ * @param info set to the clip info with its samples, may be NULL
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_clip_pin(CslClip* clip, const CslFileInfo** info);
+
+/**
+ * @brief let the samples of a clip be evicted again
+ *
+ * @param clip clip to unpin
+ */
+void soundlib_clip_unpin(CslClip* clip);
+
+/**
+ * @brief cap the memory used by clip samples
+ *
+ * Whenever clips use more than this, unpinned clips are evicted least recently used first.
+ *
+ * @param max_bytes memory limit, 0 for no limit
+ */
+void soundlib_clip_set_memory_limit(size_t max_bytes);
+
+/**
+ * @brief evict unpinned clips until clip samples use at most target_bytes
+ *
+ * For use on memory pressure warnings from the OS.
+ *
+ * @param target_bytes memory to get down to
+ * @return bytes of clip samples still in memory
+ */
+size_t soundlib_clip_trim_memory(size_t target_bytes);
+
+/**
+ * @brief keep the samples of a clip losslessly compressed in memory
+ *
+ * Integer pcm clips only. Blocks of 4096 frames are coded with a fixed polynomial predictor
+ * and rice codes, and decoded one block at a time as they are read, so seeking stays cheap.
+ * The clip must not be pinned, by soundlib_clip_pin or by a timeline region that plays it,
+ * since pinned samples are read from the audio thread. An evicted clip is compressed when
+ * it is next loaded.
+ *
+ * @param clip clip to compress
+ * @return SoundIoErrorNone (0) on success, CSLErrorUnsupportedFormat for float clips,
+ * SoundIoErrorInvalid when the clip is pinned or gets pinned while it is being encoded,
+ * other non-zero on failure.
+ */
+int soundlib_clip_compress(CslClip* clip);
+
+/**
+ * @brief memory currently used by the samples of a clip
+ *
+ * @param clip clip to measure
+ * @return bytes in memory, 0 while evicted
+ */
+size_t soundlib_clip_get_memory_bytes(const CslClip* clip);
+
+/**
+ * @brief read frames of a clip as interleaved floats, compressed or not
+ *
+ * Allocates a block buffer per call, not for use on the audio thread.
+ *
+ * @param clip pinned clip to read
+ * @param frame first frame to read
+ * @param num_frames number of frames to read
+ * @param out room for num_frames * num_channels floats
+ * @return number of frames read
+ */
+int soundlib_clip_read_frames(CslClip* clip, int64_t frame, int num_frames, float* out);
+
+/* timeline */
+
+/**
+ * @struct CslClipRegion
+ * @brief a stretch of a clip placed on a track's timeline, positions are frames at the session rate
+ */
+typedef struct {
+    CslClip* clip; // must be at the session sample rate
+    int64_t start; // timeline frame the region starts at
+    int64_t source_offset; // first frame of the clip to play
+    int64_t length; // frames to play
+    float gain; // linear gain
+    int64_t fade_in; // frames of linear fade from the start, 0 for none
+    int64_t fade_out; // frames of linear fade to the end, 0 for none
+} CslClipRegion;
+
+/**
+ * @brief place a region of a clip on a track's timeline
+ *
+ * Played by CSL_AUDIO_FILE sessions while the timeline is started, mixed sample
+ * accurately into the track's input buffer ahead of its effects. The track keeps a
+ * reference and a pin on the clip. Regions may overlap, they are summed.
+ *
+ * @param trackId id of the track
+ * @param region region to add, copied
+ * @param region_id set to an id for removing the region, may be NULL
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_add_region(int trackId, const CslClipRegion* region, int* region_id);
+
+/**
+ * @brief take a region off a track's timeline
+ *
+ * @param trackId id of the track
+ * @param region_id id given by soundlib_track_add_region
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_remove_region(int trackId, int region_id);
+
+/**
+ * @brief take every region off a track's timeline
+ *
+ * @param trackId id of the track
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_clear_regions(int trackId);
+
+/**
+ * @brief number of regions on a track's timeline
+ *
+ * @param trackId id of the track
+ * @return number of regions, 0 if the track does not exist
+ */
+int soundlib_track_get_num_regions(int trackId);
+
+/**
+ * @brief play the timeline from the current position
+ */
+void soundlib_start_timeline(void);
+
+/**
+ * @brief stop the timeline, the position stays where it is
+ */
+void soundlib_stop_timeline(void);
+
+/**
+ * @brief move the timeline to a frame
+ *
+ * @param frame timeline frame to play next
+ */
+void soundlib_set_timeline_position(int64_t frame);
+
+/**
+ * @brief where the timeline is
+ *
+ * @return timeline frame that plays next
+ */
+int64_t soundlib_get_timeline_position(void);
+
+/* waveform peaks */
+
+/**
+ * @struct CslPeaks
+ * @brief min/max/rms summaries of audio at power of two zoom levels
+ */
+typedef struct _cslPeaks CslPeaks;
+
+/**
+ * @struct CslPeak
+ * @brief summary of the samples under one pixel
+ */
+typedef struct {
+    float min;
+    float max;
+    float rms;
+} CslPeak;
+
+/**
+ * @brief create an empty peak pyramid to append samples to
+ *
+ * @param num_channels number of interleaved channels (up to 8)
+ * @param reserve_frames number of frames to allocate room for up front
+ * @return the new pyramid or NULL on failure
+ */
+CslPeaks* soundlib_peaks_create(int num_channels, int64_t reserve_frames);
+
+/**
+ * @brief free a peak pyramid
+ *
+ * @param peaks pyramid from soundlib_peaks_create, soundlib_peaks_build or soundlib_peaks_load
+ */
+void soundlib_peaks_destroy(CslPeaks* peaks);
+
+/**
+ * @brief add interleaved float samples to the end of a pyramid
+ *
+ * @param peaks pyramid to update
+ * @param samples interleaved samples in the range -1 to 1
+ * @param num_frames number of frames in samples
+ * @return SoundIoErrorNone (0) on success, SoundIoErrorNoMem when the pyramid is attached
+ * to a track and its reserve is used up, only the frames that fit are added.
+ */
+int soundlib_peaks_append(CslPeaks* peaks, const float* samples, int num_frames);
+
+/**
+ * @brief summarise the last partial block of every level
+ *
+ * Call once no more samples will be appended so the end of the audio shows up in queries.
+ *
+ * @param peaks pyramid to finish
+ */
+void soundlib_peaks_finish(CslPeaks* peaks);
+
+/**
+ * @brief build the peak pyramid of a loaded audio file in one pass
+ *
+ * @param info CslFileInfo struct populated by one of the open functions
+ * @param peaks set to the new pyramid, free it with soundlib_peaks_destroy
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_peaks_build(const CslFileInfo* info, CslPeaks** peaks);
+
+/**
+ * @brief get one min/max/rms summary per pixel for a range of frames
+ *
+ * Uses the coarsest level that still has at least one summary per pixel.
+ *
+ * @param peaks pyramid to read
+ * @param channel channel to read
+ * @param start_frame first frame of the range
+ * @param end_frame frame after the last frame of the range
+ * @param width number of pixels, out must hold this many entries
+ * @param out filled with one summary per pixel
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_peaks_query(const CslPeaks* peaks, int channel, int64_t start_frame, int64_t end_frame, int width, CslPeak* out);
+
+/**
+ * @brief write a peak pyramid to a sidecar file
+ *
+ * @param peaks pyramid to save
+ * @param path string of the file path
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_peaks_save(const CslPeaks* peaks, const char* path);
+
+/**
+ * @brief read a peak pyramid from a sidecar file written by soundlib_peaks_save
+ *
+ * @param path string of the file path
+ * @param peaks set to the loaded pyramid, free it with soundlib_peaks_destroy
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_peaks_load(const char* path, CslPeaks** peaks);
+
+/**
+ * @brief keep a peak pyramid up to date with the audio recorded on a track
+ *
+ * The pyramid must have one channel and enough frames reserved for the recording,
+ * the audio thread never grows it. Samples past the reserved size are dropped.
+ * When this returns, the audio thread has let go of the previous pyramid and it
+ * can be destroyed.
+ *
+ * @param trackId id of the track
+ * @param peaks pyramid from soundlib_peaks_create, NULL to stop updating
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_record_peaks(int trackId, CslPeaks* peaks);
+
+/* sample rate conversion */
+
+/**
+ * @enum CslResampleQuality
+ * @brief trade off between filter length (cpu) and passband/stopband quality.
+ *      DRAFT has a short filter and a wide transition band, fine for previews.
+ *      NORMAL keeps the passband flat to about 94% of nyquist.
+ *      HIGH keeps the passband flat to about 97% of nyquist with deeper rejection.
+ */
+typedef enum {
+    CSL_RESAMPLE_DRAFT,
+    CSL_RESAMPLE_NORMAL,
+    CSL_RESAMPLE_HIGH
+} CslResampleQuality;
+
+/**
+ * @struct CslResampler
+ * @brief streaming sample rate converter that keeps its filter history between calls
+ */
+typedef struct _cslResampler CslResampler;
+
+/**
+ * @brief create a resampler between two rates
+ *
+ * All memory is allocated here, processing never allocates and is safe on the audio thread.
+ *
+ * @param in_rate sample rate of the input in Hz
+ * @param out_rate sample rate of the output in Hz
+ * @param num_channels number of interleaved channels (up to 8)
+ * @param quality filter quality preset
+ * @return the new resampler or NULL if the ratio or arguments are not supported
+ */
+CslResampler* soundlib_resampler_create(int in_rate, int out_rate, int num_channels, CslResampleQuality quality);
+
+/**
+ * @brief free a resampler
+ *
+ * @param resampler resampler from soundlib_resampler_create
+ */
+void soundlib_resampler_destroy(CslResampler* resampler);
+
+/**
+ * @brief forget the filter history, e.g. after a seek
+ *
+ * @param resampler resampler to reset
+ */
+void soundlib_resampler_reset(CslResampler* resampler);
+
+/**
+ * @brief convert a block of interleaved float samples
+ *
+ * Stops when either the input is used up or the output is full. Output frame n lines up
+ * with input time n * in_rate / out_rate, so the last half filter length of output only
+ * appears once more input (or silence) is pushed in behind it.
+ *
+ * @param resampler resampler to run
+ * @param input interleaved input samples
+ * @param in_frames number of frames in input
+ * @param in_used set to the number of input frames consumed, may be NULL
+ * @param output interleaved output samples
+ * @param out_frames number of frames output has room for
+ * @return number of frames written to output
+ */
+int soundlib_resampler_process(CslResampler* resampler, const float* input, int in_frames, int* in_used, float* output, int out_frames);
+
+/**
+ * @brief convert a whole loaded file to another sample rate
+ *
+ * out is filled in with CSL_FL32 samples allocated by the library, release them with
+ * soundlib_release_file_data.
+ *
+ * @param info CslFileInfo struct populated by one of the open functions
+ * @param sample_rate rate to convert to, usually the session rate
+ * @param quality filter quality preset
+ * @param out CslFileInfo struct to be populated with the converted audio
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_resample_file(const CslFileInfo* info, CslSampleRate sample_rate, CslResampleQuality quality, CslFileInfo* out);
+
+/* utilities */
+
+float bytes_to_sample_audio_file(const unsigned char* bytes, CslDataType data_type);
+float bytes_to_sample(const unsigned char* bytes, CslDataType data_type);
+size_t get_bytes_in_sample(CslDataType in);
+size_t get_bytes_in_buffer(CslDataType in, bool audio_file);
+uint8_t get_bit_depth(CslDataType in);
+int32_t get_max_value(CslDataType in);
+int32_t get_min_value(CslDataType in);
+bool is_signed_type(CslDataType in);
+int get_sample_rate(CslSampleRate in);
+bool get_csl_sample_rate(int rate, CslSampleRate* out);
+
+/**
+ * @brief Turn a buffer of bytes into a buffer of floats
+ *
+ * @param byte_buffer input byte buffer to be transformed 
+ * @param float_buffer pointer to a user allocated array of floats, to be filled in by the function
+ * @param data_type tell the function what the data type is for converting
+ * @return number of samples in float buffer
+ */
+int byte_buffer_to_float_buffer(const unsigned char* byte_buffer, float* float_buffer, size_t num_bytes, size_t input_max_samples, CslDataType data_type, bool audio_file);
+
+/**
+ * @brief Turn a buffer of floats into a buffer of bytes laid out like the device streams
+ *
+ * @param float_buffer input float buffer, full scale is 1.0
+ * @param byte_buffer pointer to a user allocated array of num_samples * get_bytes_in_buffer(data_type, false) bytes
+ * @param num_samples number of samples to convert
+ * @param data_type data type to convert to, samples past full scale are clipped
+ */
+void float_buffer_to_byte_buffer(const float* float_buffer, unsigned char* byte_buffer, size_t num_samples, CslDataType data_type);
+
+/**
+ * @brief Low pass filter of the mag of a value
+ *
+ * @param input 
+ * @param attack how quickly the envelope reacts to onset changes
+ * @param release how quickly the envelope decays 
+ * @param prev_envelope continue to pass in the previous value to get the evolving envelope
+ * @return current value
+ */
+float envelope_follower(float input, float attack, float release, float prev_envelope);
+
+/* from pocket fft */
+
+/**
+ * @enum CslFftType
+ * @brief real input transforms or complex input transforms
+ */
+typedef enum {
+    CSL_FFT_REAL,
+    CSL_FFT_COMPLEX
+} CslFftType;
+
+/**
+ * @struct CslFftPlan
+ * @brief a transform of one length with its own work memory, used by one thread at a time
+ */
+typedef struct _cslFftPlan CslFftPlan;
+
+/**
+ * @brief get a plan for transforms of one length
+ *
+ * Twiddles and factors are computed once per (length, type) and cached, later plans for
+ * the same transform only allocate their work memory. Call this outside the audio thread.
+ *
+ * @param length transform length in points
+ * @param type CSL_FFT_REAL or CSL_FFT_COMPLEX
+ * @return the plan, NULL on failure
+ */
+CslFftPlan* soundlib_fft_plan_create(int length, CslFftType type);
+
+/**
+ * @brief give back a plan, the cached twiddles stay
+ *
+ * @param plan plan to destroy, may be NULL
+ */
+void soundlib_fft_plan_destroy(CslFftPlan* plan);
+
+/**
+ * @brief length the plan transforms
+ *
+ * @param plan plan
+ * @return length in points
+ */
+int soundlib_fft_plan_length(const CslFftPlan* plan);
+
+/**
+ * @brief forward transform, never allocates
+ *
+ * Real plans take length reals and write (length / 2 + 1) complex values (real, imag).
+ * Complex plans take and write length complex values. output may be input for complex plans.
+ *
+ * @param plan plan from soundlib_fft_plan_create
+ * @param input signal
+ * @param output spectrum
+ * @param fct factor applied to the result, usually 1.0
+ * @return 0 on success, non-zero on failure.
+ */
+int soundlib_fft_forward(CslFftPlan* plan, const double* input, double* output, double fct);
+
+/**
+ * @brief backward transform, never allocates
+ *
+ * Real plans take (length / 2 + 1) complex values and write length reals. Complex plans
+ * take and write length complex values. output may be input for complex plans.
+ *
+ * @param plan plan from soundlib_fft_plan_create
+ * @param input spectrum
+ * @param output signal
+ * @param fct factor applied to the result, usually 1.0 / length
+ * @return 0 on success, non-zero on failure.
+ */
+int soundlib_fft_backward(CslFftPlan* plan, const double* input, double* output, double fct);
+
+/**
+ * @enum CslFftLayout
+ * @brief where a real transform done in place leaves its spectrum
+ */
+typedef enum {
+    CSL_FFT_HALFCOMPLEX, /**< pocketfft's own order in length values: r0, r1, i1, r2, i2 ... and r(n/2) last for even lengths */
+    CSL_FFT_PACKED /**< (length / 2 + 1) complex values (real, imag) from data[0], the signal sits at data[1] */
+} CslFftLayout;
+
+/**
+ * @brief forward transform in the caller's buffer, copies nothing and never allocates
+ *
+ * Complex plans transform length complex values in place and ignore layout. Real plans take
+ * length reals at data for CSL_FFT_HALFCOMPLEX, or at data + 1 for CSL_FFT_PACKED, so the
+ * spectrum comes out already packed like soundlib_fft_forward writes it. A packed buffer holds
+ * (length / 2 + 1) * 2 values.
+ *
+ * @param plan plan from soundlib_fft_plan_create
+ * @param data signal in, spectrum out
+ * @param layout CSL_FFT_HALFCOMPLEX or CSL_FFT_PACKED
+ * @param fct factor applied to the result, usually 1.0
+ * @return 0 on success, non-zero on failure.
+ */
+int soundlib_fft_forward_inplace(CslFftPlan* plan, double* data, CslFftLayout layout, double fct);
+
+/**
+ * @brief backward transform in the caller's buffer, copies nothing and never allocates
+ *
+ * The inverse of soundlib_fft_forward_inplace with the same layout: a packed spectrum comes
+ * back as length reals at data + 1, a halfcomplex one at data.
+ *
+ * @param plan plan from soundlib_fft_plan_create
+ * @param data spectrum in, signal out
+ * @param layout CSL_FFT_HALFCOMPLEX or CSL_FFT_PACKED
+ * @param fct factor applied to the result, usually 1.0 / length
+ * @return 0 on success, non-zero on failure.
+ */
+int soundlib_fft_backward_inplace(CslFftPlan* plan, double* data, CslFftLayout layout, double fct);
+
+/**
+ * @brief single precision forward transform, never allocates
+ *
+ * Same layouts as soundlib_fft_forward, output may be input given room for the spectrum.
+ * Power of two lengths run SIMD float kernels, other lengths go through the double transform.
+ *
+ * @param plan plan from soundlib_fft_plan_create
+ * @param input signal
+ * @param output spectrum
+ * @param fct factor applied to the result, usually 1.0
+ * @return 0 on success, non-zero on failure.
+ */
+int soundlib_fft_forward_float(CslFftPlan* plan, const float* input, float* output, float fct);
+
+/**
+ * @brief single precision backward transform, never allocates
+ *
+ * Same layouts as soundlib_fft_backward, output may be input. Power of two lengths run
+ * SIMD float kernels, other lengths go through the double transform.
+ *
+ * @param plan plan from soundlib_fft_plan_create
+ * @param input spectrum
+ * @param output signal
+ * @param fct factor applied to the result, usually 1.0 / length
+ * @return 0 on success, non-zero on failure.
+ */
+int soundlib_fft_backward_float(CslFftPlan* plan, const float* input, float* output, float fct);
+
+/**
+ * @brief free cached twiddles that no plan is using, and stop the threads the threaded
+ * batch transforms share. They start again on the next threaded call.
+ */
+void soundlib_fft_clear_plan_cache(void);
+
+/* spectrum analysis */
+
+/**
+ * @enum CslWindowType
+ * @brief window applied to every frame before the transform
+ */
+typedef enum {
+    CSL_WINDOW_RECTANGULAR,
+    CSL_WINDOW_HANN,
+    CSL_WINDOW_HAMMING,
+    CSL_WINDOW_BLACKMAN
+} CslWindowType;
+
+/**
+ * @struct CslStft
+ * @brief streaming short time fourier transform publishing magnitude spectra
+ */
+typedef struct _cslStft CslStft;
+
+/**
+ * @brief create a streaming spectrum analyzer
+ *
+ * Frames are mixed to mono. Once fft_size samples have come in, every hop samples the last
+ * fft_size are windowed and transformed. Magnitudes are scaled so a full scale sine reads
+ * about 1.0 in its bin.
+ *
+ * @param fft_size samples per transform, 16 to 65536. Powers of two take the fast float path
+ * @param hop samples between transforms
+ * @param window window applied before the transform
+ * @param averaging weight of the previous spectrum in the running average, 0.0 (none) to below 1.0
+ * @return the analyzer, NULL on failure
+ */
+CslStft* soundlib_stft_create(int fft_size, int hop, CslWindowType window, float averaging);
+
+/**
+ * @brief free an analyzer, detach it from its track or the master bus first
+ *
+ * @param stft analyzer to destroy, may be NULL
+ */
+void soundlib_stft_destroy(CslStft* stft);
+
+/**
+ * @brief magnitudes in every published spectrum
+ *
+ * @param stft analyzer
+ * @return fft_size / 2 + 1
+ */
+int soundlib_stft_get_num_bins(const CslStft* stft);
+
+/**
+ * @brief feed samples to an analyzer that isn't attached to anything, never allocates
+ *
+ * @param stft analyzer
+ * @param samples interleaved frames
+ * @param num_frames frames in samples
+ * @param num_channels channels in samples, mixed to mono
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_stft_push(CslStft* stft, const float* samples, int num_frames, int num_channels);
+
+/**
+ * @brief copy out the latest spectrum, never blocks the audio thread
+ *
+ * Only one thread may read an analyzer.
+ *
+ * @param stft analyzer
+ * @param magnitudes user allocated array of soundlib_stft_get_num_bins floats
+ * @param frame_count set to the number of transforms done when this spectrum was made, may be NULL
+ * @return true if the spectrum is new since the last read
+ */
+bool soundlib_stft_read(CslStft* stft, float* magnitudes, int64_t* frame_count);
+
+/**
+ * @brief analyze a track after its effects, before its volume
+ *
+ * An analyzer can only be attached to one track or the master bus at a time.
+ *
+ * @param trackId id of the track
+ * @param stft analyzer, NULL to detach. Waits for the audio thread to let go of the old one
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_attach_stft(int trackId, CslStft* stft);
+
+/**
+ * @brief analyze the master bus after master volume
+ *
+ * @param stft analyzer, NULL to detach. Waits for the audio thread to let go of the old one
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_attach_stft(CslStft* stft);
+
+/* convolution */
+
+/**
+ * @struct CslConvolver
+ * @brief partitioned fft convolution with an impulse response, for reverbs and cabinets
+ */
+typedef struct _cslConvolver CslConvolver;
+
+/**
+ * @brief create a convolver
+ *
+ * The response is split into partitions of block_size and convolved in the frequency domain,
+ * so the cost per sample grows with ir_frames / block_size and the output lags the input by
+ * block_size frames. Call this outside the audio thread.
+ *
+ * @param ir interleaved impulse response
+ * @param ir_frames frames in ir
+ * @param ir_channels 1 to use the same response on every channel, otherwise num_channels
+ * @param num_channels channels to convolve, up to 8. Extra channels given to process pass through
+ * @param block_size power of two from 16 to 8192
+ * @return the convolver, NULL on failure
+ */
+CslConvolver* soundlib_convolver_create(const float* ir, int ir_frames, int ir_channels, int num_channels, int block_size);
+
+/**
+ * @brief create a convolver from a loaded impulse response file
+ *
+ * @param ir file from open_wav_file, open_mp3_file or the loader, 1 or num_channels channels
+ * @param num_channels channels to convolve, up to 8
+ * @param block_size power of two from 16 to 8192
+ * @return the convolver, NULL on failure
+ */
+CslConvolver* soundlib_convolver_create_from_file(const CslFileInfo* ir, int num_channels, int block_size);
+
+/**
+ * @brief create a zero latency convolver for long responses
+ *
+ * The first head_block taps are applied directly, the next stretch in partitions of head_block
+ * on the audio thread, and the rest in partitions growing eightfold up to 8192 on a lower
+ * priority worker thread that has one of its own block periods to finish each block. The audio
+ * thread's share stays the same however long the response, so seconds long reverbs can run on
+ * many tracks. Call this outside the audio thread.
+ *
+ * @param ir interleaved impulse response
+ * @param ir_frames frames in ir
+ * @param ir_channels 1 to use the same response on every channel, otherwise num_channels
+ * @param num_channels channels to convolve, up to 8. Extra channels given to process pass through
+ * @param head_block power of two from 16 to 8192, 64 or 128 is usual
+ * @return the convolver, NULL on failure
+ */
+CslConvolver* soundlib_convolver_create_nonuniform(const float* ir, int ir_frames, int ir_channels, int num_channels, int head_block);
+
+/**
+ * @brief create a zero latency convolver from a loaded impulse response file
+ *
+ * @param ir file from open_wav_file, open_mp3_file or the loader, 1 or num_channels channels
+ * @param num_channels channels to convolve, up to 8
+ * @param head_block power of two from 16 to 8192
+ * @return the convolver, NULL on failure
+ */
+CslConvolver* soundlib_convolver_create_nonuniform_from_file(const CslFileInfo* ir, int num_channels, int head_block);
+
+/**
+ * @brief free a convolver, remove it from every track and the master bus first
+ *
+ * @param convolver convolver to destroy, may be NULL
+ */
+void soundlib_convolver_destroy(CslConvolver* convolver);
+
+/**
+ * @brief set the output mix, safe while the convolver is running
+ *
+ * @param convolver convolver
+ * @param wet gain of the convolved signal, 1.0 by default
+ * @param dry gain of the input, 0.0 by default
+ */
+void soundlib_convolver_set_mix(CslConvolver* convolver, float wet, float dry);
+
+/**
+ * @brief frames the wet signal lags the input
+ *
+ * @param convolver convolver
+ * @return block_size, 0 for a non-uniform convolver
+ */
+int soundlib_convolver_get_latency(const CslConvolver* convolver);
+
+/**
+ * @brief blocks the worker thread of a non-uniform convolver didn't finish in time
+ *
+ * Each one is a block of the response's tail played silent. When the worker falls several blocks
+ * behind, a block of input can also be left out of the tail, which then rings on without it.
+ * A count that keeps rising means the machine is overloaded, try a larger head_block or fewer
+ * convolvers.
+ *
+ * @param convolver convolver
+ * @return missed deadlines since creation, always 0 for a uniform convolver
+ */
+int64_t soundlib_convolver_get_missed_deadlines(const CslConvolver* convolver);
+
+/**
+ * @brief silence the convolver's history, not while it is on a track
+ *
+ * @param convolver convolver
+ */
+void soundlib_convolver_reset(CslConvolver* convolver);
+
+/**
+ * @brief convolve interleaved frames, never allocates
+ *
+ * @param convolver convolver
+ * @param input interleaved frames
+ * @param output interleaved frames, may be input
+ * @param num_frames frames to process, any number
+ * @param num_channels channels in input and output
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_convolver_process(CslConvolver* convolver, const float* input, float* output, int num_frames, int num_channels);
+
+/**
+ * @brief run a convolver on a track after its registered effects
+ *
+ * @param trackId id of the track
+ * @param convolver convolver, owned by the caller. Only put one convolver on one track or bus
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_add_convolver(int trackId, CslConvolver* convolver);
+
+/**
+ * @brief take a convolver off a track, waits for the audio thread to let go of it
+ *
+ * @param trackId id of the track
+ * @param convolver convolver given to soundlib_track_add_convolver
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_remove_convolver(int trackId, CslConvolver* convolver);
+
+/**
+ * @brief run a convolver on the master bus after its registered effects
+ *
+ * @param convolver convolver, owned by the caller
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_add_convolver(CslConvolver* convolver);
+
+/**
+ * @brief take a convolver off the master bus, waits for the audio thread to let go of it
+ *
+ * @param convolver convolver given to soundlib_master_add_convolver
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_remove_convolver(CslConvolver* convolver);
+
+/**
+ * @brief run a convolver on a bus, once on everything routed into it
+ *
+ * @param busId bus id
+ * @param convolver convolver, owned by the caller
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_add_convolver(int busId, CslConvolver* convolver);
+
+/**
+ * @brief take a convolver off a bus, waits for the audio thread to let go of it
+ *
+ * @param busId bus id
+ * @param convolver convolver given to soundlib_bus_add_convolver
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_remove_convolver(int busId, CslConvolver* convolver);
+
+/* native effects */
+
+/**
+ * @struct CslNativeEffect
+ * @brief a built-in effect that runs on the float bus with its own state.
+ *      every setter is safe while the effect is running, the audio thread
+ *      picks the change up at the start of its next period without locking.
+ */
+typedef struct _cslNativeEffect CslNativeEffect;
+
+/**
+ * @enum CslEqBandType
+ * @brief the response of one eq band
+ */
+typedef enum {
+    CSL_EQ_PEAK,
+    CSL_EQ_LOW_SHELF,
+    CSL_EQ_HIGH_SHELF,
+    CSL_EQ_LOW_PASS,
+    CSL_EQ_HIGH_PASS
+} CslEqBandType;
+
+/**
+ * @brief create a gain stage, changes are ramped over the next block the graph processes
+ *
+ * @param gain_db gain in dB
+ * @return the effect, NULL on failure
+ */
+CslNativeEffect* soundlib_gain_create(float gain_db);
+
+/**
+ * @brief change the gain of a gain stage
+ *
+ * @param fx effect from soundlib_gain_create
+ * @param gain_db gain in dB
+ */
+void soundlib_gain_set(CslNativeEffect* fx, float gain_db);
+
+/**
+ * @brief create an eq of biquad bands in series, every band starts disabled
+ *
+ * @param sample_rate rate of the bus it will run on in Hz
+ * @param num_bands 1 to 8
+ * @return the effect, NULL on failure
+ */
+CslNativeEffect* soundlib_eq_create(int sample_rate, int num_bands);
+
+/**
+ * @brief set and enable one band of an eq
+ *
+ * @param fx effect from soundlib_eq_create
+ * @param band band index
+ * @param type band response
+ * @param frequency center or corner frequency in Hz, below half the sample rate
+ * @param q band width, 0.707 for a flat pass or shelf
+ * @param gain_db boost or cut, ignored by the pass filters
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_eq_set_band(CslNativeEffect* fx, int band, CslEqBandType type, float frequency, float q, float gain_db);
+
+/**
+ * @brief create a compressor, a peak detector linked across channels
+ *
+ * @param sample_rate rate of the bus it will run on in Hz
+ * @param threshold_db level above which the signal is reduced
+ * @param ratio reduction above the threshold, at least 1
+ * @param attack_ms detector attack time, at least 0
+ * @param release_ms detector release time, at least 0
+ * @param makeup_db gain applied after the reduction
+ * @return the effect, NULL on failure
+ */
+CslNativeEffect* soundlib_compressor_create(int sample_rate, float threshold_db, float ratio, float attack_ms, float release_ms, float makeup_db);
+
+/**
+ * @brief create a noise gate
+ *
+ * @param sample_rate rate of the bus it will run on in Hz
+ * @param threshold_db level below which the signal is attenuated
+ * @param range_db attenuation when closed, at least 0
+ * @param attack_ms detector attack time, at least 0
+ * @param release_ms detector release time, at least 0
+ * @return the effect, NULL on failure
+ */
+CslNativeEffect* soundlib_gate_create(int sample_rate, float threshold_db, float range_db, float attack_ms, float release_ms);
+
+/**
+ * @brief change the settings of a compressor or gate
+ *
+ * @param fx effect from soundlib_compressor_create or soundlib_gate_create
+ * @param threshold_db threshold
+ * @param ratio_or_range ratio for a compressor, at least 1, range in dB for a gate, at least 0
+ * @param attack_ms detector attack time, at least 0
+ * @param release_ms detector release time, at least 0
+ * @return SoundIoErrorNone (0) on success, SoundIoErrorInvalid when a setting is out of range.
+ */
+int soundlib_dynamics_set(CslNativeEffect* fx, float threshold_db, float ratio_or_range, float attack_ms, float release_ms);
+
+/**
+ * @brief create a feedback delay
+ *
+ * @param sample_rate rate of the bus it will run on in Hz
+ * @param max_seconds longest delay it will be set to, the buffer is allocated here
+ * @param delay_seconds delay time
+ * @param feedback amount of the delayed signal fed back, below 1 to stay stable
+ * @param wet level of the delayed signal
+ * @param dry level of the input
+ * @return the effect, NULL on failure
+ */
+CslNativeEffect* soundlib_delay_create(int sample_rate, float max_seconds, float delay_seconds, float feedback, float wet, float dry);
+
+/**
+ * @brief change the settings of a delay
+ *
+ * @param fx effect from soundlib_delay_create
+ * @param delay_seconds delay time, clamped to max_seconds
+ * @param feedback feedback amount
+ * @param wet level of the delayed signal
+ * @param dry level of the input
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_delay_set(CslNativeEffect* fx, float delay_seconds, float feedback, float wet, float dry);
+
+/**
+ * @brief create an algorithmic reverb of parallel combs and series allpasses
+ *
+ * @param sample_rate rate of the bus it will run on in Hz
+ * @param room_size 0 to 1, longer decay as it grows
+ * @param damping 0 to 1, darker tail as it grows
+ * @param wet level of the reverb
+ * @param dry level of the input
+ * @return the effect, NULL on failure
+ */
+CslNativeEffect* soundlib_reverb_create(int sample_rate, float room_size, float damping, float wet, float dry);
+
+/**
+ * @brief change the settings of a reverb
+ *
+ * @param fx effect from soundlib_reverb_create
+ * @param room_size 0 to 1
+ * @param damping 0 to 1
+ * @param wet level of the reverb
+ * @param dry level of the input
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_reverb_set(CslNativeEffect* fx, float room_size, float damping, float wet, float dry);
+
+/**
+ * @brief free a native effect, remove it from every track and the master bus first
+ *
+ * @param fx effect to destroy, may be NULL
+ */
+void soundlib_native_effect_destroy(CslNativeEffect* fx);
+
+/**
+ * @brief run an effect over a block outside the engine, not while it is on a track
+ *
+ * @param fx effect
+ * @param samples interleaved samples, processed in place
+ * @param num_frames frames in samples
+ * @param num_channels 1 to 8
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_native_effect_process(CslNativeEffect* fx, float* samples, int num_frames, int num_channels);
+
+/**
+ * @brief run a native effect on a track after its registered effects
+ *
+ * @param trackId track id
+ * @param fx effect, owned by the caller. Only put one effect on one track or bus
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_add_native_effect(int trackId, CslNativeEffect* fx);
+
+/**
+ * @brief take a native effect off a track, waits for the audio thread to let go of it
+ *
+ * @param trackId track id
+ * @param fx effect given to soundlib_track_add_native_effect
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_track_remove_native_effect(int trackId, CslNativeEffect* fx);
+
+/**
+ * @brief run a native effect on the master bus after its registered effects
+ *
+ * @param fx effect, owned by the caller
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_add_native_effect(CslNativeEffect* fx);
+
+/**
+ * @brief take a native effect off the master bus, waits for the audio thread to let go of it
+ *
+ * @param fx effect given to soundlib_master_add_native_effect
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_master_remove_native_effect(CslNativeEffect* fx);
+
+/**
+ * @brief run a native effect on a bus, once on everything routed into it
+ *
+ * @param busId bus id
+ * @param fx effect, owned by the caller
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_add_native_effect(int busId, CslNativeEffect* fx);
+
+/**
+ * @brief take a native effect off a bus, waits for the audio thread to let go of it
+ *
+ * @param busId bus id
+ * @param fx native effect given to soundlib_bus_add_native_effect
+ * @return SoundIoErrorNone (0) on success, non-zero on failure.
+ */
+int soundlib_bus_remove_native_effect(int busId, CslNativeEffect* fx);
+
+/* offline analysis */
+
+/**
+ * @enum CslAnalysisFormat
+ * @brief how soundlib_analyze_files writes its results
+ *      JSON is an array with one object per file.
+ *      BINARY is ANALYSIS_FILE_MAGIC and a version, then one record per file, see analysis.c.
+ */
+typedef enum {
+    CSL_ANALYSIS_JSON,
+    CSL_ANALYSIS_BINARY
+} CslAnalysisFormat;
+
+/**
+ * @struct CslAnalysisOptions
+ * @brief Options for soundlib_analyze_files, zero for the defaults.
+ */
+typedef struct {
+    int decode_threads; // files opened (header read, mp3 packets indexed) at once, 0 for half the cores
+    int analysis_threads; // files decoded and analyzed at once, 0 for one per core
+    int queue_depth; // opened files waiting to be analyzed, 0 for two per analysis thread
+    int fft_size; // power of two, 0 for 2048
+    int hop; // frames between transforms, 0 for 512
+} CslAnalysisOptions;
+
+/**
+ * @struct CslAnalysisResult
+ * @brief what soundlib_analyze_files measured in one file
+ */
+typedef struct {
+    int index; // position of the file in paths
+    const char* path;
+    int error; // SoundIoErrorNone, or why the file couldn't be analyzed
+    int sample_rate;
+    int num_channels;
+    double duration; // seconds
+    double integrated_loudness; // LUFS, -INFINITY when every block was gated out
+    double tempo; // beats per minute, 0 when there was no beat
+    double tempo_confidence; // 0 to 1
+    int num_onsets;
+    const double* onsets; // seconds from the start of the file
+} CslAnalysisResult;
+
+/**
+ * @brief receives each result of soundlib_analyze_files on the calling thread
+ *
+ * @param result the file's result, only valid during the call
+ * @param user Pointer passed in by the user
+ */
+typedef void (*CslAnalysisCallback) (
+    const CslAnalysisResult* result,
+    void* user
+);
+
+/**
+ * @brief find onsets, tempo and integrated loudness of many files in parallel
+ *
+ * Files are opened and analyzed on a pool of threads with bounded queues between the
+ * stages. Each file is decoded a hop at a time as it is analyzed and never held whole, so
+ * memory stays at a few open files however many paths there are and however long they are.
+ * Results come out in the order files finish. Blocks until every file is done, files that fail to load
+ * get a result with their error.
+ *
+ * @param paths wav and mp3 files, the type comes from the extension
+ * @param num_paths number of paths
+ * @param options analysis options, NULL for defaults
+ * @param output_path file to write the results to, may be NULL
+ * @param format CSL_ANALYSIS_JSON or CSL_ANALYSIS_BINARY
+ * @param callback called with each result on the calling thread, may be NULL
+ * @param user pointer handed back to the callback
+ * @return SoundIoErrorNone (0) on success, non-zero when the run or the output failed.
+ */
+int soundlib_analyze_files(const char* const* paths, int num_paths, const CslAnalysisOptions* options,
+                           const char* output_path, CslAnalysisFormat format,
+                           CslAnalysisCallback callback, void* user);
+
+///
+/// Apply forward 1D FFT for real-typed array of 1D signal
+/// Repeat 1D FFT `nrows` times. Assume input signal has a shape of [nrows *
+/// nsamples]
+///
+/// @param[in] input Input signal(real-value)
+/// @param[in] fft_len FFT length
+/// @param[in] nsamples The number of samples
+/// @param[in] nrows The number of rows
+/// @param[in] norm_factor Normalization factor(usually 1.0 or
+/// `1/sqrt(nsamples)` )
+/// @param[out] output Output signal(complex-value). The layout of elemens are:
+/// `nrows * ((fft_len / 2) + 1) * 2(real, img)`
+/// @return The number of FFTs processed(i.e. nrows = success). Zero or negative
+/// value = error.
+///
+int rfft_forward_1d_array(const double *input, const int fft_len,
+                          const int nsamples, const int nrows,
+                          const float norm_factor, double *output);
+
+///
+/// rfft_forward_1d_array with the rows split across threads. Every thread
+/// gets its own scratch on the shared cached plan, the output is bit
+/// identical to the serial call. The threads, one per core besides the
+/// caller, are started on the first threaded call and kept for the next.
+///
+/// @param[in] num_threads threads to use including the caller, less than 1
+/// for one per core. Batches of fewer than 32 rows per thread use fewer threads.
+/// @return The number of FFTs processed, same as rfft_forward_1d_array.
+///
+int rfft_forward_1d_array_threaded(const double *input, const int fft_len,
+                                   const int nsamples, const int nrows,
+                                   const float norm_factor, double *output,
+                                   const int num_threads);
+
+///
+/// rfft_forward_1d_array without the copies. Rows are `fft_len` apart for
+/// CSL_FFT_HALFCOMPLEX, or `((fft_len / 2) + 1) * 2` apart for CSL_FFT_PACKED
+/// with each row's signal starting one element in, see CslFftLayout.
+///
+/// @param[in,out] data signals in, spectra out
+/// @return The number of FFTs processed, same as rfft_forward_1d_array.
+///
+int rfft_forward_1d_array_inplace(double *data, const int fft_len,
+                                  const int nrows, const float norm_factor,
+                                  CslFftLayout layout);
+
+///
+/// The inverse of rfft_forward_1d_array_inplace with the same row layout.
+///
+/// @param[in,out] data spectra in, signals out
+/// @return The number of FFTs processed, same as rfft_forward_1d_array.
+///
+int rfft_backward_1d_array_inplace(double *data, const int fft_len,
+                                   const int nrows, const float norm_factor,
+                                   CslFftLayout layout);
+
+///
+/// Apply backward 1D FFT for real-valued signals, the inverse of
+/// rfft_forward_1d_array. Assume input spectra have a shape of [nrows *
+/// ((fft_len / 2) + 1) * 2(real, img)], the layout rfft_forward_1d_array
+/// writes. The imaginary parts of bin 0, and of bin fft_len / 2 for even
+/// lengths, are ignored.
+///
+/// @param[in] input Input spectra(complex-value)
+/// @param[in] fft_len FFT length
+/// @param[in] nrows The number of rows
+/// @param[in] norm_factor Normalization factor(usually `1/fft_len` )
+/// @param[out] output Output signal(real-value), `nrows * fft_len`. May be
+/// input, the rows are then packed down to the front of the buffer.
+/// @return The number of FFTs processed(i.e. nrows = success). Zero or negative
+/// value = error.
+///
+int rfft_backward_1d_array(const double *input, const int fft_len,
+                           const int nrows, const float norm_factor,
+                           double *output);
+
+///
+/// Apply backword 1D FFT for complex-typed array
+/// Repeat 1D IFFT `m` times. Assume input signal has a shape of [nrows *
+/// nsamples]
+///
+/// @param[in] input Input signal(complex-value)
+/// @param[in] nsamples The number of samples
+/// @param[in] nrows The number of rows
+/// @param[in] norm_factor Normalization factor(usually `1/nsamples` )
+/// @param[out] output Output signal(complex-value). The shape of elements are
+/// same as input.
+/// @return The number of FFTs processed(i.e. nrows = success). Zero or negative
+/// value = error.
+///
+int cfft_backward_1d_array(const double *input, const int nsamples,
+                           const int nrows, const float norm_factor,
+                           double *output);
+
+///
+/// rfft_forward_1d_array in single precision
+///
+int rfft_forward_1d_array_float(const float *input, const int fft_len,
+                                const int nsamples, const int nrows,
+                                const float norm_factor, float *output);
+
+///
+/// rfft_forward_1d_array_threaded in single precision
+///
+int rfft_forward_1d_array_float_threaded(const float *input, const int fft_len,
+                                         const int nsamples, const int nrows,
+                                         const float norm_factor, float *output,
+                                         const int num_threads);
+
+///
+/// rfft_backward_1d_array in single precision
+///
+int rfft_backward_1d_array_float(const float *input, const int fft_len,
+                                 const int nrows, const float norm_factor,
+                                 float *output);
+
+///
+/// cfft_backward_1d_array in single precision
+///
+int cfft_backward_1d_array_float(const float *input, const int nsamples,
+                                 const int nrows, const float norm_factor,
+                                 float *output);
 
 #ifdef __cplusplus
 }
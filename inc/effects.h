@@ -1,16 +1,76 @@
 #ifndef EFFECTS_H
 #define EFFECTS_H
 
+#include <stdbool.h>
 #include "csoundlib.h"
 
+#define EFFECTS_CHUNK_FRAMES                      256 // frames converted to float at a time for native effects
+#define EFFECTS_MAX_CHANNELS                      8
+
+/*
+effects built into the library work on floats in place and carry their own state.
+samples are interleaved, num_frames is at most EFFECTS_CHUNK_FRAMES.
+*/
+typedef void (*NativeEffectProcess)(void* context, float* samples, int num_frames, int num_channels);
+
+typedef struct _nativeEffect {
+    NativeEffectProcess process;
+    void* context;
+    const int* tail; // frames it rings on after silent input, CSL_EFFECT_INFINITE_TAIL for ever, NULL for none
+    int latency; // frames its output lags its input
+} nativeEffect;
+
+/* never changed once the audio thread can see it, every edit builds a new chain */
+typedef struct _nativeEffectChain {
+    int num_effects;
+    int latency; // sum over the effects
+    nativeEffect effects[MAX_NUM_EFFECTS];
+    float samples[EFFECTS_CHUNK_FRAMES * EFFECTS_MAX_CHANNELS];
+} nativeEffectChain;
+
+typedef struct _nativeEffectSlot {
+    nativeEffectChain* chain;
+    nativeEffectChain* in_use; // chain the audio thread is running, NULL between periods
+} nativeEffectSlot;
+
 typedef struct {
     TrackAudioAvailableCallback* track_effect_list;
     uint16_t num_effects;
+    nativeEffectSlot native_effects; // run after track_effect_list
 } TrackEffectList;
 
 typedef struct {
     MasterAudioAvailableCallback* master_effect_list;
     uint16_t num_effects;
+    nativeEffectSlot native_effects; // run after master_effect_list
 } MasterEffectList;
 
+/* a CslEffectDescriptor instance, run through a native chain */
+struct _cslEffect {
+    CslEffectDescriptor descriptor;
+    void* instance;
+    bool reset_requested; // atomic, set by soundlib_effect_reset, cleared by the audio thread
+};
+
+/*
+tail is read by the audio thread every period, so effects whose tail follows their settings can
+point at a field they update. latency is fixed, adding or removing an effect with latency on a
+track or bus recompiles the routing graph so its delay compensation follows.
+*/
+int effects_add_native(nativeEffectSlot* slot, NativeEffectProcess process, void* context, const int* tail, int latency);
+
+/* removes every entry with this context */
+int effects_remove_native(nativeEffectSlot* slot, void* context);
+
+void effects_clear_native(nativeEffectSlot* slot);
+
+/* latency of the chain in frames */
+int effects_native_latency(nativeEffectSlot* slot);
+
+/* audio thread: runs the chain over device layout bytes in place, never allocates */
+void effects_run_native(nativeEffectSlot* slot, unsigned char* bytes, size_t num_bytes, CslDataType data_type, int num_channels);
+
+/* audio thread: how long the chain rings, every tail and latency added up, CSL_EFFECT_INFINITE_TAIL if any entry never stops */
+int effects_native_tail(nativeEffectSlot* slot);
+
 #endif
\ No newline at end of file
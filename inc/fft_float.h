@@ -0,0 +1,53 @@
+#ifndef FFT_FLOAT_H
+#define FFT_FLOAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+
+single precision transforms for power of two lengths, next to the double pocketfft plans.
+
+complex data is kept split (all reals, then all imaginaries) inside the transform so every
+butterfly works on four points at once. the passes are stockham radix 4, with one radix 2
+pass at the end for odd powers of two, so nothing is bit reversed. backward transforms are
+forward transforms with real and imaginary swapped on the way in and out.
+
+real transforms of length n run a complex transform of n / 2 on the even samples as reals
+and the odd samples as imaginaries, then split the halves apart with the real_twiddles.
+
+*/
+#define FFT_FLOAT_MIN_COMPLEX                     2
+#define FFT_FLOAT_MIN_REAL                        4
+
+typedef struct _fftFloatStage {
+    int length; // points per sub transform in this pass
+    float* w_re; // w1 w2 w3, length / 4 each
+    float* w_im;
+} fftFloatStage;
+
+typedef struct _fftFloatTables {
+    int length; // points of the transform the caller asked for
+    bool real;
+    int complex_length; // length, or length / 2 for real transforms
+    int num_stages; // radix 4 passes
+    fftFloatStage* stages;
+    float* twiddles; // backs every stage's w_re and w_im
+    float* real_twiddles; // exp(-2 pi i k / length) for k in 0..length / 2, all reals then all imaginaries. real transforms only
+} fftFloatTables;
+
+bool fft_float_supports(int length, bool real);
+
+fftFloatTables* fft_float_tables_create(int length, bool real);
+
+void fft_float_tables_destroy(fftFloatTables* tables);
+
+/* floats of work a transform needs */
+size_t fft_float_work_size(const fftFloatTables* tables);
+
+/* same layouts as soundlib_fft_forward and soundlib_fft_backward. never allocates */
+void fft_float_forward(const fftFloatTables* tables, const float* input, float* output, float fct, float* work);
+
+void fft_float_backward(const fftFloatTables* tables, const float* input, float* output, float fct, float* work);
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "streams.h"
+#include "effects.h"
+
+#define GRAPH_MAX_SENDS                           8 // per track or bus
+#define GRAPH_MAX_THREADS                         8
+#define GRAPH_WORKER_POLL_NS                      1000000 // workers wake this often in case a signal was missed
+#define GRAPH_SPIN_LIMIT                          4000 // pauses the audio thread spends waiting on a level before it sleeps
+#define GRAPH_WAIT_SLEEP_NS                       20000 // sleep between checks once the spin is over
+#define GRAPH_WAIT_DEADLINE_NS                    200000 // longest the audio thread sleeps on a level before leaving its nodes out
+#define GRAPH_BLOCK_FRAMES                        64 // frames processed through the whole graph at a time
+#define GRAPH_MIN_BLOCK_FRAMES                    16
+#define GRAPH_MAX_BLOCK_FRAMES                    EFFECTS_CHUNK_FRAMES
+#define GRAPH_MAX_EVENTS                          256 // scheduled events waiting at once
+#define GRAPH_DELAY_FRAME_BYTES                   (EFFECTS_MAX_CHANNELS * sizeof(double)) // widest frame a compensation delay holds
+
+/*
+
+tracks and buses are the nodes of the routing graph. every node has one output, the master
+bus or another bus, and up to GRAPH_MAX_SENDS sends that copy it into other buses, before or
+after its volume. buses feed buses, so groups can nest, as long as nothing feeds itself.
+
+every routing edit compiles a schedule with kahn's algorithm: nodes nothing feeds, every track
+among them, are level 0 and a bus is one level above the highest of its sources. nothing in a
+level feeds anything else in the same level. each period is cut into blocks of a few dozen
+frames and the whole graph runs one block at a time, each level in two passes:
+
+    process     every node of the level runs its effects. with graph threads set the
+                workers and the audio thread take nodes off the level between them. if
+                the workers fall behind, the rest of the period runs on the audio thread,
+                and a node a worker is still in past a short deadline is left out of the mix
+    mix         the audio thread adds every node of the level into its destinations
+
+then the master effects and volume run on the block. meters and output ready callbacks see
+the whole period once every block is done. a block also ends early at the frame of the next
+scheduled event, so events land on their exact sample.
+
+the schedule is never changed once the audio thread can see it, edits build a new one and
+swap it in like the native effect chains.
+
+effects report their latency, so every node knows how far its output lags the track inputs.
+each output and send is delayed by however much it is ahead of the slowest path into the same
+destination, so everything reaching a bus or the master bus lines up. the delay lines belong to
+the schedule and are allocated when it is compiled, a schedule is compiled on every routing edit
+and whenever an effect with latency is added to or removed from a track or bus.
+
+a node whose input has been silent for longer than its effects' tails is idle: it gives out
+silence, so its effects aren't run and it isn't mixed anywhere. a track's input is flagged
+when it is filled, a bus's is silent until a node that isn't idle is mixed in. track
+callback effects don't declare a tail, a track with any of them is never idle.
+
+*/
+typedef struct _graphSend {
+    int bus_id;
+    float level; // magnitude
+    bool pre_fader; // taken before the node's volume is applied
+} graphSend;
+
+/* where a node goes, edited under the graph lock and copied into the schedule */
+typedef struct _graphRouting {
+    int output_bus; // CSL_MASTER_BUS or a bus id
+    int num_sends;
+    graphSend sends[GRAPH_MAX_SENDS];
+} graphRouting;
+
+typedef struct _busObject {
+    int bus_id;
+    float volume; // magnitude
+    bool mute_enabled;
+    float output_rms_level;
+    graphRouting routing;
+    nativeEffectSlot native_effects;
+    int node_index; // scratch for building a schedule
+    unsigned char buffer[MAX_BUFFER_SIZE_BYTES]; // sum of everything routed here this period
+    size_t write_bytes;
+    bool input_silent; // nothing that wasn't idle was mixed in this period
+    int64_t silent_frames;
+    bool idle;
+} busObject;
+
+/* one destination of a node resolved to its bus, NULL for the master bus */
+typedef struct _graphOutput {
+    busObject* bus;
+    float level;
+    bool pre_fader;
+    int delay_frames; // compensation, lines this path up with the slowest one into the destination
+    unsigned char* delay_line; // delay_frames of GRAPH_DELAY_FRAME_BYTES, NULL without a delay
+    size_t delay_bytes; // ring length in the layout in use, the ring is cleared when it changes
+    size_t delay_pos;
+} graphOutput;
+
+typedef struct _graphNode {
+    struct _trackObj* track; // exactly one of track and bus is set
+    busObject* bus;
+    int num_outputs; // the output then the sends
+    graphOutput outputs[1 + GRAPH_MAX_SENDS];
+    int latency; // frames its output lags the track inputs
+    int max_delay; // longest delay_frames of its outputs
+    int tail; // audio thread, how long its effects and delays ring, worked out once a period
+    uint32_t started; // atomic, generation of the last level it was taken for
+    uint32_t finished; // atomic, generation of the last level it was run for
+} graphNode;
+
+typedef struct _graphSchedule {
+    int num_nodes;
+    graphNode* nodes; // in level order
+    int num_levels;
+    int* level_starts; // num_levels + 1, nodes of level l are level_starts[l] up to level_starts[l + 1]
+    int num_buses;
+    busObject** buses; // cleared at the start of every period, then a period long even with nothing routed in
+    int latency; // frames every path reaches the master bus after the track inputs
+    unsigned char* delay_memory; // every delay line in one block
+} graphSchedule;
+
+/* a change waiting for its frame on the graph clock */
+typedef struct _graphEvent {
+    CslGraphEvent type;
+    int id;
+    float value; // volumes already magnitudes
+    int64_t frame;
+} graphEvent;
+
+/* rebuilds the schedule from the routing of every track and bus */
+int graph_rebuild(void);
+
+/* rebuilds the schedule without a track that is about to be deleted */
+int graph_remove_track(const struct _trackObj* track_p);
+
+busObject* graph_get_bus(int busId);
+
+/* audio thread: runs the track effects block by block, with the mix level by level and the master when mix is set */
+void graph_process(bool mix, int num_channels);
+
+/* stops the workers and frees every bus and the schedule */
+void graph_cleanup(void);
+
+#endif
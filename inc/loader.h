@@ -0,0 +1,27 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdbool.h>
+#include "csoundlib.h"
+
+/* one file being loaded in the background. lives in the active list until its callback returns */
+typedef struct _loadRequest {
+    int load_id;
+    const char* path;
+    CslFileType file_type;
+    CslFileInfo info;
+    int decode_threads;
+    CslLoadProgressCallback progress;
+    CslLoadCompleteCallback callback;
+    void* user;
+    bool cancel;
+    struct _loadRequest* next;
+} loadRequest;
+
+/* file type from the path's extension, false if it is not one we can open */
+bool loader_file_type(const char* path, CslFileType* file_type);
+
+/* load any supported file on the calling thread */
+int loader_read_file(const char* path, CslFileType file_type, CslFileInfo* info, int decode_threads, CslLoadProgressCallback progress, void* user, const bool* cancel);
+
+#endif
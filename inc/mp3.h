@@ -1,7 +1,61 @@
 #ifndef MP3_DRIVER_H
 #define MP3_DRIVER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "csoundlib.h"
 
+#define MP3_OUT_SAMPLE_RATE                       44100
+#define MP3_OUT_CHANNELS                          2
+#define MP3_OUT_BYTES_PER_FRAME                   4 /* stereo S16 */
 
+/* packets decoded and thrown away ahead of a packet whose bit reservoir can't be worked out */
+#define MP3_PRIMING_PACKETS                       4
+/* how far back the reservoir of a packet is followed, 511 bytes never spans more than this */
+#define MP3_MAX_RESERVOIR_PACKETS                 8
+/* input samples fed to the resampler ahead of a segment so its filter history is full */
+#define MP3_RESAMPLER_WARMUP_SAMPLES              256
+/* don't bother splitting anything shorter than this into its own segment */
+#define MP3_MIN_SEGMENT_SAMPLES                   (44100 * 10)
 
-#endif
\ No newline at end of file
+typedef struct _mp3Packet {
+    int64_t pos;      // byte offset of the packet in the file
+    int64_t sample;   // first decoded sample of the packet, counted from the start of the stream
+    int32_t reservoir; // earlier packets holding part of this packet's main data
+    int32_t unused;
+} mp3Packet;
+
+/*
+every packet of the audio stream in order. sample positions are raw decoder output, i.e.
+they still include the encoder delay at the front and the padding at the end.
+*/
+typedef struct _mp3Index {
+    mp3Packet* packets;
+    int num_packets;
+    int64_t total_samples;
+    int64_t encoder_delay;
+    int64_t padding;
+    int sample_rate;
+} mp3Index;
+
+#define MP3_INDEX_MAGIC                           "CSLI"
+#define MP3_INDEX_VERSION                         1
+
+/* an index persisted in the decode cache is this header followed by the packets */
+typedef struct _mp3IndexHeader {
+    char magic[4];
+    uint32_t version;
+    int64_t num_packets;
+    int64_t total_samples;
+    int64_t encoder_delay;
+    int64_t padding;
+    int64_t sample_rate;
+} mp3IndexHeader;
+
+/*
+decode a whole file into info. num_threads below 1 uses one thread per core.
+decoding stops with CSLErrorLoadCancelled once *cancel becomes true (cancel may be NULL).
+*/
+int mp3_decode(const char* path, CslFileInfo* info, int num_threads, CslLoadProgressCallback progress, void* user, const bool* cancel);
+
+#endif
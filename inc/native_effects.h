@@ -0,0 +1,107 @@
+#ifndef NATIVE_EFFECTS_H
+#define NATIVE_EFFECTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csoundlib.h"
+#include "csl_simd.h"
+#include "effects.h"
+
+#define NATIVE_EQ_MAX_BANDS                       8
+#define NATIVE_CHANNEL_GROUPS                     (EFFECTS_MAX_CHANNELS / 4) // channels run four to a vector
+#define NATIVE_CONTROL_FRAMES                     16 // dynamics gain is worked out this often and ramped in between
+#define NATIVE_REVERB_COMBS                       8
+#define NATIVE_REVERB_ALLPASSES                   4
+#define NATIVE_REVERB_SPREAD                      23 // extra comb and allpass length on odd channels, at 44.1 kHz
+#define NATIVE_REVERB_INPUT_GAIN                  0.015f
+#define NATIVE_REVERB_ALLPASS_FEEDBACK            0.5f
+#define NATIVE_TAIL_FLOOR                         1e-6 // -120 dB, a tail ends when what rings on has decayed this far
+
+typedef enum {
+    NATIVE_GAIN,
+    NATIVE_EQ,
+    NATIVE_DYNAMICS,
+    NATIVE_DELAY,
+    NATIVE_REVERB
+} nativeEffectKind;
+
+typedef struct _eqBandParams {
+    bool enabled;
+    CslEqBandType type;
+    float frequency;
+    float q;
+    float gain_db;
+} eqBandParams;
+
+/*
+every setting of every kind, each kind reads the fields it needs. setters write the pending
+copy under a sequence lock and the audio thread copies it out at the start of a period when
+the sequence has moved on, so it never waits and never sees half an edit.
+*/
+typedef struct _nativeParams {
+    float gain_db; // gain, or makeup gain for dynamics
+    eqBandParams bands[NATIVE_EQ_MAX_BANDS];
+    bool gate; // dynamics: gate below the threshold instead of compressing above it
+    float threshold_db;
+    float ratio;
+    float range_db; // gate attenuation
+    float attack_ms;
+    float release_ms;
+    float delay_seconds;
+    float feedback;
+    float room_size; // reverb, 0 to 1
+    float damping; // reverb, 0 to 1
+    float wet;
+    float dry;
+} nativeParams;
+
+/* biquad coefficients, the same in every lane */
+typedef struct _nativeBiquad {
+    cslVec4 b0, b1, b2, a1, a2;
+} nativeBiquad;
+
+typedef struct _reverbChannel {
+    float* combs[NATIVE_REVERB_COMBS];
+    int comb_lengths[NATIVE_REVERB_COMBS];
+    int comb_pos[NATIVE_REVERB_COMBS];
+    float comb_store[NATIVE_REVERB_COMBS]; // damping lowpass state
+    float* allpasses[NATIVE_REVERB_ALLPASSES];
+    int allpass_lengths[NATIVE_REVERB_ALLPASSES];
+    int allpass_pos[NATIVE_REVERB_ALLPASSES];
+} reverbChannel;
+
+struct _cslNativeEffect {
+    nativeEffectKind kind;
+    int sample_rate;
+    nativeParams pending; // written by setters
+    uint32_t sequence; // atomic, odd while pending is being written
+    uint32_t seen; // audio thread, sequence of the params in use
+    nativeParams params; // audio thread copy
+    int tail; // atomic, frames it rings on after silent input with params, CSL_EFFECT_INFINITE_TAIL for ever
+
+    /* gain and dynamics */
+    float gain; // linear gain reached at the end of the last period
+    float envelope; // dynamics detector
+    float attack_coeff;
+    float release_coeff;
+
+    /* eq */
+    int num_bands;
+    nativeBiquad biquads[NATIVE_EQ_MAX_BANDS];
+    cslVec4 z1[NATIVE_EQ_MAX_BANDS][NATIVE_CHANNEL_GROUPS];
+    cslVec4 z2[NATIVE_EQ_MAX_BANDS][NATIVE_CHANNEL_GROUPS];
+
+    /* delay, interleaved at the channel count being processed */
+    float* ring;
+    int ring_frames;
+    int ring_channels; // channels the ring was last filled with, it is cleared when this changes
+    int write_frame;
+    int delay_frames;
+
+    /* reverb */
+    reverbChannel reverb[EFFECTS_MAX_CHANNELS];
+    float comb_feedback;
+    float comb_damp;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PCM_CACHE_H
+#define PCM_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+decoded audio of compressed files is kept on disk as plain wav files named after a
+hash of the source file contents and the parameters it was decoded with. a later load
+of the same file maps the cached wav instead of decoding again.
+*/
+typedef struct _pcmCacheKey {
+    uint64_t content_hash;
+    int sample_rate;
+    int num_channels;
+    int bit_depth;
+} pcmCacheKey;
+
+bool pcm_cache_enabled(void);
+
+int pcm_cache_make_key(const char* path, int sample_rate, int num_channels, int bit_depth, pcmCacheKey* key);
+
+/* returns a read-only mapping of the cached samples or NULL on a miss */
+unsigned char* pcm_cache_map(const pcmCacheKey* key, size_t* data_bytes);
+
+void pcm_cache_unmap(unsigned char* data, size_t data_bytes);
+
+int pcm_cache_store(const pcmCacheKey* key, const unsigned char* data, size_t data_bytes);
+
+/*
+a seek index may be kept beside the samples under the same key. it is opaque to the cache,
+the caller checks what it reads back. the returned copy is freed by the caller.
+*/
+void* pcm_cache_load_index(const pcmCacheKey* key, size_t* num_bytes);
+
+int pcm_cache_store_index(const pcmCacheKey* key, const void* data, size_t num_bytes);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PEAKS_H
+#define PEAKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csoundlib.h"
+
+#define PEAKS_BASE_BLOCK                          32 // frames summarised by one level 0 entry
+#define PEAKS_MAX_LEVELS                          24 // level k summarises PEAKS_BASE_BLOCK << k frames
+#define PEAKS_MAX_CHANNELS                        8
+#define PEAKS_FILE_MAGIC                          "CSLPEAKS"
+#define PEAKS_FILE_VERSION                        1
+
+/* one summary per channel: entries[i * num_channels + ch] */
+typedef struct _peakEntry {
+    float min;
+    float max;
+    float mean_square;
+} peakEntry;
+
+typedef struct _peakLevel {
+    peakEntry* entries;
+    int64_t count;
+    int64_t capacity;
+} peakLevel;
+
+/* running summary of the block currently being filled at each level */
+typedef struct _peakAccumulator {
+    float min[PEAKS_MAX_CHANNELS];
+    float max[PEAKS_MAX_CHANNELS];
+    double sum_squares[PEAKS_MAX_CHANNELS];
+    int64_t frames;
+} peakAccumulator;
+
+struct _cslPeaks {
+    int num_channels;
+    int64_t num_frames;
+    int num_levels;
+    bool growable; // false while attached to a track, the audio thread must never realloc
+    peakLevel levels[PEAKS_MAX_LEVELS];
+    peakAccumulator pending[PEAKS_MAX_LEVELS];
+};
+
+/* feeds samples from the audio thread in small chunks, never allocates */
+void peaks_append_bytes(CslPeaks* peaks, const unsigned char* bytes, size_t num_bytes, CslDataType data_type);
+
+#endif
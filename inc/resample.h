@@ -0,0 +1,36 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdint.h>
+#include "csoundlib.h"
+
+#define RESAMPLE_MAX_CHANNELS                     8
+#define RESAMPLE_MAX_PHASES                       4096 // out_rate / gcd(in_rate, out_rate)
+#define RESAMPLE_CHUNK_FRAMES                     1024 // input frames buffered per call on top of the filter length
+
+/*
+
+polyphase windowed sinc resampler. the conversion ratio is reduced to L/M (up by L, down by M).
+output frame n sits at input position n * M / L. its integer part picks where the filter starts
+in the input history and its remainder (n * M) % L picks one of L precomputed filter phases.
+
+*/
+struct _cslResampler {
+    int in_rate;
+    int out_rate;
+    int num_channels;
+    int up; // L
+    int down; // M
+    int half_taps; // taps on each side of the output position
+    int taps; // 2 * half_taps, a multiple of 4
+    float* coefficients; // up rows of taps
+
+    /* per channel input history, planar */
+    float* history[RESAMPLE_MAX_CHANNELS];
+    int capacity;
+    int num_frames; // frames of valid history
+    int position; // history index of the first tap of the next output frame
+    int phase; // filter phase of the next output frame
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include "track.h"
 #include "hash.h"
 #include "effects.h"
+#include "graph.h"
 #include <soundio/soundio.h>
 
 typedef struct _audioState {
@@ -47,12 +48,25 @@ typedef struct _audioState {
     ht* track_hash_table;
     uint16_t num_tracks;
 
+    /* routing */
+    ht* bus_hash_table;
+    graphSchedule* schedule; // replaced whole on every routing edit
+    graphSchedule* schedule_in_use; // schedule the audio thread is running, NULL between periods
+
     /* solo and mute */
     uint16_t tracks_solod;
     bool solo_engaged;
 
     uint8_t num_channels_audio_file;
 
+    /* timeline */
+    bool timeline_playing; // atomic
+    int64_t timeline_position; // atomic, next frame to play
+
+    /* spectrum analysis */
+    CslStft* master_analyzer; // fed with the master bus after its volume, NULL for none
+    CslStft* master_analyzer_in_use; // analyzer the audio thread is feeding, NULL between periods
+
 } audio_state;
 
 extern audio_state* csoundlib_state;
@@ -0,0 +1,57 @@
+#ifndef STFT_H
+#define STFT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csoundlib.h"
+
+#define STFT_MIN_FFT_SIZE                         16
+#define STFT_MAX_FFT_SIZE                         65536
+#define STFT_BYTES_CHUNK_SAMPLES                  256 // samples converted from bytes at a time on the audio thread
+#define STFT_FRESH                                4 // set on the middle buffer index when it holds an unread spectrum
+
+/*
+
+incoming frames are mixed to mono into a ring of fft_size samples. every hop samples (once
+the ring has filled) the ring is windowed, transformed and folded into the running average.
+
+finished spectra go out through a triple buffer: the writer fills buffers[back] and swaps it
+with middle, the reader swaps middle with front when it is marked fresh. neither side ever
+waits and the reader always sees a whole spectrum.
+
+*/
+struct _cslStft {
+    int fft_size;
+    int hop;
+    int num_bins; // fft_size / 2 + 1
+    float averaging; // weight of the previous average, 0 for none
+    CslFftPlan* plan;
+    float* window; // fft_size, scaled so a full scale sine peaks at 1.0
+    float* ring; // fft_size, mono history
+    int ring_pos; // next sample written
+    int until_frame; // samples left until the next transform
+    float* frame; // fft_size, windowed ring
+    float* spectrum; // num_bins complex values
+    float* average; // num_bins magnitudes
+    float* buffers[3]; // num_bins each
+    int64_t buffer_frames[3]; // transforms done when each buffer was written
+    int64_t num_frames; // transforms done so far
+    int back; // writer only
+    int middle; // atomic, index | STFT_FRESH
+    int front; // reader only
+    bool attached; // atomic, pushed to by a track or the master bus
+};
+
+/* feeds interleaved device layout samples from the audio thread, never allocates */
+void stft_push_bytes(CslStft* stft, const unsigned char* bytes, size_t num_bytes, CslDataType data_type, int num_channels);
+
+/*
+swaps the analyzer in *slot for stft and waits until the audio thread, which marks the one
+it is feeding in *in_use, has let go of the old one.
+*/
+int stft_attach(CslStft** slot, CslStft** in_use, CslStft* stft);
+
+/* audio thread side of stft_attach */
+void stft_feed_attached(CslStft** slot, CslStft** in_use, const unsigned char* bytes, size_t num_bytes, CslDataType data_type, int num_channels);
+
+#endif
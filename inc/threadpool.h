@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef void (*threadPoolJob)(void* arg);
+
+typedef struct _threadPoolTask {
+    threadPoolJob job;
+    void* arg;
+    struct _threadPoolGroup* group;
+    struct _threadPoolTask* next;
+} threadPoolTask;
+
+/*
+a group lets a caller wait on just the jobs it submitted when several users
+share one pool
+*/
+typedef struct _threadPoolGroup {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int pending;
+} threadPoolGroup;
+
+typedef struct _threadPool {
+    pthread_t* threads;
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    threadPoolTask* head;
+    threadPoolTask* tail;
+    bool shutting_down;
+} threadPool;
+
+/* number of online cores, never less than 1 */
+int threadpool_num_cores(void);
+
+threadPool* threadpool_create(int num_threads);
+
+/* group may be NULL if the caller does not need to wait on the job */
+int threadpool_submit(threadPool* pool, threadPoolJob job, void* arg, threadPoolGroup* group);
+
+/* finishes every queued job, then joins and frees the pool */
+void threadpool_destroy(threadPool* pool);
+
+void threadpool_group_init(threadPoolGroup* group);
+void threadpool_group_wait(threadPoolGroup* group);
+void threadpool_group_destroy(threadPoolGroup* group);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "csoundlib.h"
+#include "clip.h"
+#include "track.h"
+
+#define TIMELINE_CHUNK_FRAMES                     256 // frames mixed at a time on the audio thread
+#define TIMELINE_MAX_CHANNELS                     8 // for clips and for the output
+
+typedef struct _timelineRegion {
+    int id;
+    CslClipRegion region; // holds a reference and a pin on region.clip
+    int64_t end; // region.start + region.length
+} timelineRegion;
+
+/*
+
+the regions of one track, sorted by start. the sorted array doubles as an implicit balanced
+interval tree: the root of [lo, hi) is its middle region and subtree_end[mid] is the latest
+end in [lo, hi). a lookup of [from, to) skips any subtree that ends by from and everything
+right of a region that starts at or after to, so it costs O(log n) plus the regions it finds.
+
+a timeline is never changed once the audio thread can see it. every edit builds a new one
+and swaps it into the track, the old one is freed once the audio thread lets go of it.
+
+*/
+typedef struct _trackTimeline {
+    timelineRegion* regions;
+    int64_t* subtree_end; // latest end in the subtree rooted at each region
+    clipReader* readers; // one per region, only used by the audio thread
+    int num_regions;
+    float* read_buffer; // TIMELINE_CHUNK_FRAMES of the widest clip
+    float* mix_buffer; // TIMELINE_CHUNK_FRAMES * TIMELINE_MAX_CHANNELS
+    unsigned char* byte_buffer; // mix_buffer in the session data type
+} trackTimeline;
+
+/*
+mixes num_frames of the track's regions from timeline frame position into its input buffer,
+with num_channels interleaved in the session data type. audio thread only, never allocates.
+*/
+void timeline_render_track(trackObject* track, int64_t position, int num_frames, int num_channels);
+
+#endif
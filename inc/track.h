@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include "streams.h"
 #include "effects.h"
+#include "graph.h"
 
 typedef struct _inputBuffer {
     unsigned char buffer[MAX_BUFFER_SIZE_BYTES];
@@ -35,9 +36,20 @@ typedef struct _trackObj {
     int input_channel_index;
     rmsVals current_rms_levels;
     inputBuffer input_buffer;
+    bool input_silent; // nothing above SILENCE_THRESHOLD reached input_buffer this period
+    int64_t silent_frames; // frames of silent input in a row, up to and including this period
+    bool idle; // silent and past the tail of its effects, so effects and mixing are skipped
+    bool input_callback_writes; // a user input ready callback is set and may have written into input_buffer
     TrackEffectList track_effects;
+    graphRouting routing; // output bus and sends
     TrackAudioAvailableCallback input_ready_callback;
     TrackAudioAvailableCallback output_ready_callback;
+    CslPeaks* recorded_peaks; // waveform of the recorded input, NULL when not recording peaks
+    CslPeaks* recorded_peaks_in_use; // pyramid the audio thread is appending to, NULL between periods
+    struct _trackTimeline* timeline; // regions on the timeline, replaced whole on every edit
+    struct _trackTimeline* timeline_in_use; // timeline the audio thread is rendering, NULL between periods
+    CslStft* analyzer; // fed with the track after its effects, NULL for none
+    CslStft* analyzer_in_use; // analyzer the audio thread is feeding, NULL between periods
 } trackObject;
 
 #include "csoundlib.h"
@@ -2,6 +2,9 @@
 #define WAV_DRIVER_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "csoundlib.h"
 
 typedef struct _wavHeader {
     // RIFF Header
@@ -25,4 +28,30 @@ typedef struct _wavHeader {
     // uint8_t bytes[];    // Remainder of wave file is bytes
 } wavHeader;
 
+#define WAV_HEADER_BYTES                          44
+
+#define WAV_FORMAT_PCM                            0x0001
+#define WAV_FORMAT_IEEE_FLOAT                     0x0003
+#define WAV_FORMAT_EXTENSIBLE                     0xFFFE
+#define WAV_EXTENSIBLE_FMT_BYTES                  40 // fmt chunk size when it carries the extension
+
+/* 
+extensible files store the real format tag in the first two bytes of the subformat GUID.
+the remaining 14 bytes are always the same.
+*/
+#define WAV_SUBFORMAT_GUID_TAIL                   "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71"
+
+#define WAV_READ_CHUNK_BYTES                      (1 << 20) // sample data read per progress update
+
+wavHeader create_wav_header(int numSamples, int sampleRate, int bitDepth, int numChannels);
+
+/*
+reads the header of a wav file into info's sample rate, data type and channels, and leaves
+fp at the first sample of the data chunk for the caller to read and close
+*/
+int wav_open_data(const char* path, CslFileInfo* info, wavHeader* header, FILE** fp);
+
+/* open_wav_file with progress reports and a flag another thread can set to stop reading */
+int wav_read_file(const char* path, CslFileInfo* info, CslLoadProgressCallback progress, void* user, const bool* cancel);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,549 @@
+#include "analysis.h"
+#include "loader.h"
+#include "mp3.h"
+#include "wav.h"
+#include "stft.h"
+#include "threadpool.h"
+#include "errors.h"
+#include <soundio/soundio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool _seriesPush(analysisSeries* series, double value) {
+    if (series->count == series->capacity) {
+        int capacity = series->capacity ? series->capacity * 2 : 1024;
+        double* values = realloc(series->values, capacity * sizeof(double));
+        if (!values) return false;
+        series->values = values;
+        series->capacity = capacity;
+    }
+    series->values[series->count++] = value;
+    return true;
+}
+
+static bool _queueInit(analysisQueue* queue, int capacity, int producers) {
+    queue->jobs = malloc(capacity * sizeof(analysisJob*));
+    if (!queue->jobs) return false;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->producers = producers;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return true;
+}
+
+static void _queueDestroy(analysisQueue* queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->jobs);
+}
+
+/* waits while the queue is full, which is what holds the stage before it back */
+static void _queuePush(analysisQueue* queue, analysisJob* job) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity) pthread_cond_wait(&queue->not_full, &queue->lock);
+    queue->jobs[(queue->head + queue->count) % queue->capacity] = job;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* NULL once the queue is empty and every producer is done */
+static analysisJob* _queuePop(analysisQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && queue->producers > 0) pthread_cond_wait(&queue->not_empty, &queue->lock);
+    analysisJob* job = NULL;
+    if (queue->count > 0) {
+        job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+static void _queueProducerDone(analysisQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->producers--;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static int _sourceOpen(const char* path, CslFileType file_type, int hop, analysisSource* source) {
+    memset(source, 0, sizeof(analysisSource));
+    int err;
+    if (file_type == CSL_WAV) {
+        CslFileInfo info = {0};
+        wavHeader header;
+        err = wav_open_data(path, &info, &header, &source->wav);
+        source->wav_bytes_left = header.data_bytes;
+        source->data_type = info.data_type;
+        source->num_channels = info.num_channels;
+        source->sample_rate = info.sample_rate;
+    }
+    else {
+        err = soundlib_mp3_stream_open(path, &source->mp3);
+        source->data_type = CSL_S16;
+        source->num_channels = MP3_OUT_CHANNELS;
+        get_csl_sample_rate(MP3_OUT_SAMPLE_RATE, &source->sample_rate);
+    }
+    if (err != SoundIoErrorNone) return err;
+    source->bytes = malloc((size_t)hop * source->num_channels * get_bytes_in_buffer(source->data_type, true));
+    return source->bytes ? SoundIoErrorNone : SoundIoErrorNoMem;
+}
+
+static void _sourceClose(analysisSource* source) {
+    if (source->wav) fclose(source->wav);
+    soundlib_mp3_stream_close(source->mp3);
+    free(source->bytes);
+    memset(source, 0, sizeof(analysisSource));
+}
+
+/* decodes the next frames of the file as floats, short at the end of it */
+static int _sourceRead(analysisSource* source, float* samples, int num_frames) {
+    size_t frame_bytes = get_bytes_in_buffer(source->data_type, true) * source->num_channels;
+    int n;
+    if (source->wav) {
+        size_t want = (size_t)num_frames * frame_bytes;
+        if (want > source->wav_bytes_left) want = (source->wav_bytes_left / frame_bytes) * frame_bytes;
+        size_t got = fread(source->bytes, 1, want, source->wav);
+        source->wav_bytes_left -= got;
+        n = (int)(got / frame_bytes);
+    }
+    else {
+        n = soundlib_mp3_stream_read(source->mp3, source->bytes, num_frames);
+    }
+    if (n > 0) {
+        byte_buffer_to_float_buffer(source->bytes, samples, (size_t)n * frame_bytes,
+                                    (size_t)n * source->num_channels, source->data_type, true);
+    }
+    return n;
+}
+
+static void _freeJob(analysisJob* job) {
+    _sourceClose(&job->source);
+    free(job->onsets.values);
+    free(job);
+}
+
+/* the two k weighting stages of BS.1770, worked out for the file's rate */
+static void _kWeighting(double rate, analysisBiquad* shelf, analysisBiquad* highpass) {
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / rate);
+    double vh = pow(10.0, gain / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    memset(shelf, 0, sizeof(analysisBiquad));
+    shelf->b0 = (vh + vb * k / q + k * k) / a0;
+    shelf->b1 = 2.0 * (k * k - vh) / a0;
+    shelf->b2 = (vh - vb * k / q + k * k) / a0;
+    shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+    shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    memset(highpass, 0, sizeof(analysisBiquad));
+    highpass->b0 = 1.0;
+    highpass->b1 = -2.0;
+    highpass->b2 = 1.0;
+    highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+    highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static inline double _biquad(analysisBiquad* f, int ch, double x) {
+    double y = f->b0 * x + f->z1[ch];
+    f->z1[ch] = f->b1 * x - f->a1 * y + f->z2[ch];
+    f->z2[ch] = f->b2 * x - f->a2 * y;
+    return y;
+}
+
+/* BS.1770 channel weights for the usual layouts, surrounds count 1.41 and lfe not at all */
+static double _channelWeight(int ch, int num_channels) {
+    if (num_channels == 5) return (ch >= 3) ? 1.41 : 1.0;
+    if (num_channels == 6) return (ch == 3) ? 0.0 : (ch >= 4) ? 1.41 : 1.0;
+    return 1.0;
+}
+
+static double _integratedLoudness(const analysisSeries* blocks) {
+    double absolute = pow(10.0, (ANALYSIS_ABSOLUTE_GATE + 0.691) / 10.0);
+    double sum = 0.0;
+    int count = 0;
+    for (int i = 0; i < blocks->count; i++) {
+        if (blocks->values[i] > absolute) {
+            sum += blocks->values[i];
+            count++;
+        }
+    }
+    if (count == 0) return -INFINITY;
+    double relative = (sum / count) * pow(10.0, ANALYSIS_RELATIVE_GATE / 10.0);
+    double gate = (relative > absolute) ? relative : absolute;
+    sum = 0.0;
+    count = 0;
+    for (int i = 0; i < blocks->count; i++) {
+        if (blocks->values[i] > gate) {
+            sum += blocks->values[i];
+            count++;
+        }
+    }
+    if (count == 0) return -INFINITY;
+    return -0.691 + 10.0 * log10(sum / count);
+}
+
+static double _localMean(const double* prefix, int count, int m, int radius) {
+    int first = (m - radius < 0) ? 0 : m - radius;
+    int last = (m + radius + 1 > count) ? count : m + radius + 1;
+    return (prefix[last] - prefix[first]) / (double)(last - first);
+}
+
+/* picks onsets out of the flux and finds the tempo from what is left of it above its local mean */
+static bool _onsetsAndTempo(analysisJob* job, const analysisSeries* flux, double frames_per_second, double first_frame_seconds) {
+    int count = flux->count;
+    const double* f = flux->values;
+    job->result.tempo = 0.0;
+    job->result.tempo_confidence = 0.0;
+    if (count == 0) return true;
+
+    double* prefix = malloc((count + 1) * sizeof(double));
+    double* envelope = malloc(count * sizeof(double));
+    if (!prefix || !envelope) {
+        free(prefix);
+        free(envelope);
+        return false;
+    }
+    prefix[0] = 0.0;
+    for (int m = 0; m < count; m++) prefix[m + 1] = prefix[m] + f[m];
+    double mean = prefix[count] / count;
+    int peak_radius = (int)lround(ANALYSIS_ONSET_PEAK_SECONDS * frames_per_second);
+    int mean_radius = (int)lround(ANALYSIS_ONSET_MEAN_SECONDS * frames_per_second);
+    if (peak_radius < 1) peak_radius = 1;
+    if (mean_radius < 1) mean_radius = 1;
+
+    bool ok = true;
+    for (int m = 0; m < count; m++) {
+        double local = _localMean(prefix, count, m, mean_radius);
+        envelope[m] = (f[m] > local) ? f[m] - local : 0.0;
+        if (!ok || f[m] < local + ANALYSIS_ONSET_DELTA * mean || f[m] <= 0.0) continue;
+        /* strictly above what came before so a flat top only counts once */
+        bool peak = true;
+        for (int j = m - peak_radius; peak && j <= m + peak_radius; j++) {
+            if (j < 0 || j >= count || j == m) continue;
+            peak = (j < m) ? f[m] > f[j] : f[m] >= f[j];
+        }
+        if (peak) ok = _seriesPush(&job->onsets, first_frame_seconds + m / frames_per_second);
+    }
+
+    /* beats rarely land on whole frames, smear each one over its neighbours so a fractional period still lines up */
+    double* smoothed = prefix; // the local means are done with
+    for (int m = 0; m < count; m++) {
+        double sum = 0.0;
+        for (int j = -2; j <= 2; j++) {
+            if (m + j >= 0 && m + j < count) sum += (3 - abs(j)) * envelope[m + j];
+        }
+        smoothed[m] = sum / 9.0;
+    }
+    memcpy(envelope, smoothed, count * sizeof(double));
+
+    int min_lag = (int)floor(60.0 * frames_per_second / ANALYSIS_MAX_BPM);
+    int max_lag = (int)ceil(60.0 * frames_per_second / ANALYSIS_MIN_BPM);
+    if (min_lag < 1) min_lag = 1;
+    double energy = 0.0;
+    for (int m = 0; m < count; m++) energy += envelope[m] * envelope[m];
+    double* scores = malloc((max_lag + 2) * sizeof(double));
+    if (!scores) ok = false;
+    /* a steady tone still leaves a faint ripple in the flux, it takes a few onsets to make a beat */
+    if (ok && energy > 0.0 && max_lag + 1 < count && job->onsets.count >= ANALYSIS_MIN_BEAT_ONSETS) {
+        int best = 0;
+        double best_correlation = 0.0;
+        for (int lag = min_lag; lag <= max_lag + 1; lag++) {
+            double correlation = 0.0;
+            for (int m = lag; m < count; m++) correlation += envelope[m] * envelope[m - lag];
+            /* unbiased, then leaning towards moderate tempos so halves and doubles lose out */
+            correlation *= (double)count / (double)(count - lag);
+            double octaves = log2(60.0 * frames_per_second / lag / ANALYSIS_CENTER_BPM);
+            scores[lag] = correlation * exp(-0.5 * octaves * octaves);
+            if (lag <= max_lag && (best == 0 || scores[lag] > scores[best])) {
+                best = lag;
+                best_correlation = correlation;
+            }
+        }
+        /* a parabola through the neighbours puts the peak between whole frames */
+        double lag = best;
+        if (best > min_lag) {
+            double denominator = scores[best - 1] - 2.0 * scores[best] + scores[best + 1];
+            if (denominator < 0.0) lag += 0.5 * (scores[best - 1] - scores[best + 1]) / denominator;
+        }
+        job->result.tempo = 60.0 * frames_per_second / lag;
+        double confidence = best_correlation / energy;
+        job->result.tempo_confidence = (confidence > 1.0) ? 1.0 : confidence;
+    }
+    free(scores);
+    free(prefix);
+    free(envelope);
+    return ok;
+}
+
+/* decodes an opened file hop frames at a time and streams it through the stft and the loudness filters */
+static int _analyzeFile(analysisRun* run, analysisJob* job) {
+    analysisSource* source = &job->source;
+    int rate = get_sample_rate(source->sample_rate);
+    int channels = source->num_channels;
+    if (rate <= 0 || channels < 1) return CSLErrorUnsupportedFormat;
+    int hop = run->hop;
+    int num_bins = run->fft_size / 2 + 1;
+    int64_t num_frames = 0;
+    job->result.sample_rate = rate;
+    job->result.num_channels = channels;
+
+    CslStft* stft = soundlib_stft_create(run->fft_size, hop, CSL_WINDOW_HANN, 0.0f);
+    float* samples = malloc((size_t)hop * channels * sizeof(float));
+    float* magnitudes = malloc(num_bins * sizeof(float));
+    float* previous = malloc(num_bins * sizeof(float));
+    analysisSeries flux = {0};
+    analysisSeries blocks = {0};
+    bool ok = stft && samples && magnitudes && previous;
+
+    analysisBiquad shelf, highpass;
+    _kWeighting(rate, &shelf, &highpass);
+    int loudness_channels = (channels < ANALYSIS_MAX_CHANNELS) ? channels : ANALYSIS_MAX_CHANNELS;
+    double weights[ANALYSIS_MAX_CHANNELS];
+    for (int ch = 0; ch < loudness_channels; ch++) weights[ch] = _channelWeight(ch, channels);
+    int step_frames = (int)lround(rate * ANALYSIS_STEP_SECONDS);
+    double steps[ANALYSIS_BLOCK_STEPS] = {0.0};
+    int64_t num_steps = 0;
+    int step_fill = 0;
+    double step_energy = 0.0;
+    bool first_frame = true;
+
+    while (ok) {
+        int n = _sourceRead(source, samples, hop);
+        if (n <= 0) break;
+        num_frames += n;
+
+        for (int i = 0; ok && i < n; i++) {
+            const float* x = samples + (size_t)i * channels;
+            double energy = 0.0;
+            for (int ch = 0; ch < loudness_channels; ch++) {
+                double y = _biquad(&highpass, ch, _biquad(&shelf, ch, x[ch]));
+                energy += weights[ch] * y * y;
+            }
+            step_energy += energy;
+            if (++step_fill < step_frames) continue;
+            steps[num_steps % ANALYSIS_BLOCK_STEPS] = step_energy;
+            num_steps++;
+            step_fill = 0;
+            step_energy = 0.0;
+            if (num_steps < ANALYSIS_BLOCK_STEPS) continue;
+            double block = 0.0;
+            for (int s = 0; s < ANALYSIS_BLOCK_STEPS; s++) block += steps[s];
+            ok = _seriesPush(&blocks, block / ((double)step_frames * ANALYSIS_BLOCK_STEPS));
+        }
+
+        soundlib_stft_push(stft, samples, n, channels);
+        if (ok && soundlib_stft_read(stft, magnitudes, NULL)) {
+            double sum = 0.0;
+            for (int k = 0; k < num_bins; k++) {
+                float level = log1pf(ANALYSIS_LOG_GAIN * magnitudes[k]);
+                if (!first_frame && level > previous[k]) sum += level - previous[k];
+                previous[k] = level;
+            }
+            first_frame = false;
+            ok = _seriesPush(&flux, sum);
+        }
+    }
+
+    job->result.duration = (double)num_frames / rate;
+    if (ok) {
+        job->result.integrated_loudness = _integratedLoudness(&blocks);
+        /* frame m is the window ending fft_size + m * hop frames in, time it by its middle */
+        double frames_per_second = (double)rate / hop;
+        double first_seconds = 0.5 * run->fft_size / rate;
+        ok = _onsetsAndTempo(job, &flux, frames_per_second, first_seconds);
+    }
+    job->result.num_onsets = job->onsets.count;
+    job->result.onsets = job->onsets.values;
+
+    soundlib_stft_destroy(stft);
+    free(samples);
+    free(magnitudes);
+    free(previous);
+    free(flux.values);
+    free(blocks.values);
+    return ok ? SoundIoErrorNone : SoundIoErrorNoMem;
+}
+
+static void _openStage(void* arg) {
+    analysisRun* run = (analysisRun*)arg;
+    for (;;) {
+        if (__atomic_load_n(&run->failed, __ATOMIC_RELAXED)) break;
+        int index = __atomic_fetch_add(&run->next_path, 1, __ATOMIC_RELAXED);
+        if (index >= run->num_paths) break;
+        analysisJob* job = calloc(1, sizeof(analysisJob));
+        if (!job) {
+            __atomic_store_n(&run->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+        job->index = index;
+        job->path = run->paths[index];
+        job->result.index = index;
+        job->result.path = job->path;
+        job->result.integrated_loudness = -INFINITY;
+        CslFileType file_type;
+        if (!loader_file_type(job->path, &file_type)) {
+            job->result.error = CSLErrorUnsupportedFormat;
+        }
+        else {
+            job->result.error = _sourceOpen(job->path, file_type, run->hop, &job->source);
+        }
+        _queuePush(&run->opened, job);
+    }
+    _queueProducerDone(&run->opened);
+}
+
+static void _analysisStage(void* arg) {
+    analysisRun* run = (analysisRun*)arg;
+    analysisJob* job;
+    while ((job = _queuePop(&run->opened)) != NULL) {
+        if (job->result.error == SoundIoErrorNone) job->result.error = _analyzeFile(run, job);
+        /* the file goes back before the result waits for the writer */
+        _sourceClose(&job->source);
+        _queuePush(&run->finished, job);
+    }
+    _queueProducerDone(&run->finished);
+}
+
+static void _writeJsonString(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (const unsigned char* c = (const unsigned char*)s; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(fp, "\\%c", *c);
+        else if (*c < 0x20) fprintf(fp, "\\u%04x", *c);
+        else fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+static bool _writeJson(FILE* fp, const CslAnalysisResult* r, bool first) {
+    fprintf(fp, "%s{\"index\":%d,\"path\":", first ? "" : ",\n", r->index);
+    _writeJsonString(fp, r->path);
+    fprintf(fp, ",\"error\":%d", r->error);
+    if (r->error == SoundIoErrorNone) {
+        fprintf(fp, ",\"sample_rate\":%d,\"channels\":%d,\"duration\":%.6f,\"loudness\":",
+                r->sample_rate, r->num_channels, r->duration);
+        if (isfinite(r->integrated_loudness)) fprintf(fp, "%.2f", r->integrated_loudness);
+        else fprintf(fp, "null");
+        fprintf(fp, ",\"tempo\":%.2f,\"tempo_confidence\":%.3f,\"onsets\":[", r->tempo, r->tempo_confidence);
+        for (int i = 0; i < r->num_onsets; i++) fprintf(fp, "%s%.4f", i ? "," : "", r->onsets[i]);
+        fprintf(fp, "]");
+    }
+    return fprintf(fp, "}") > 0;
+}
+
+/*
+binary records, native byte order:
+    int32 index, error, sample_rate, num_channels, num_onsets
+    float64 duration, integrated_loudness, tempo, tempo_confidence
+    uint32 path bytes, then the path without its terminator
+    float32 onsets[num_onsets]
+*/
+static bool _writeBinary(FILE* fp, const CslAnalysisResult* r) {
+    int32_t header[5] = {r->index, r->error, r->sample_rate, r->num_channels, r->num_onsets};
+    double values[4] = {r->duration, r->integrated_loudness, r->tempo, r->tempo_confidence};
+    uint32_t path_bytes = (uint32_t)strlen(r->path);
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+              fwrite(values, sizeof(values), 1, fp) == 1 &&
+              fwrite(&path_bytes, sizeof(path_bytes), 1, fp) == 1 &&
+              fwrite(r->path, 1, path_bytes, fp) == path_bytes;
+    for (int i = 0; ok && i < r->num_onsets; i++) {
+        float onset = (float)r->onsets[i];
+        ok = fwrite(&onset, sizeof(onset), 1, fp) == 1;
+    }
+    return ok;
+}
+
+int soundlib_analyze_files(const char* const* paths, int num_paths, const CslAnalysisOptions* options,
+                           const char* output_path, CslAnalysisFormat format,
+                           CslAnalysisCallback callback, void* user) {
+    if (paths == NULL || num_paths < 0) return SoundIoErrorInvalid;
+    if (format != CSL_ANALYSIS_JSON && format != CSL_ANALYSIS_BINARY) return SoundIoErrorInvalid;
+    int cores = threadpool_num_cores();
+    int decode_threads = (options && options->decode_threads > 0) ? options->decode_threads : (cores + 1) / 2;
+    int analysis_threads = (options && options->analysis_threads > 0) ? options->analysis_threads : cores;
+    int queue_depth = (options && options->queue_depth > 0) ? options->queue_depth : ANALYSIS_QUEUE_PER_THREAD * analysis_threads;
+
+    analysisRun run = {0};
+    run.paths = paths;
+    run.num_paths = num_paths;
+    run.fft_size = (options && options->fft_size > 0) ? options->fft_size : ANALYSIS_DEFAULT_FFT_SIZE;
+    run.hop = (options && options->hop > 0) ? options->hop : ANALYSIS_DEFAULT_HOP;
+    if (run.fft_size < STFT_MIN_FFT_SIZE || run.fft_size > STFT_MAX_FFT_SIZE || run.hop > run.fft_size) return SoundIoErrorInvalid;
+
+    FILE* fp = NULL;
+    if (output_path) {
+        fp = fopen(output_path, "wb");
+        if (fp == NULL) return CSLErrorOpeningFile;
+    }
+    if (!_queueInit(&run.opened, queue_depth, decode_threads)) {
+        if (fp) fclose(fp);
+        return SoundIoErrorNoMem;
+    }
+    if (!_queueInit(&run.finished, ANALYSIS_QUEUE_PER_THREAD * analysis_threads, analysis_threads)) {
+        _queueDestroy(&run.opened);
+        if (fp) fclose(fp);
+        return SoundIoErrorNoMem;
+    }
+    threadPool* pool = threadpool_create(decode_threads + analysis_threads);
+    if (!pool) {
+        _queueDestroy(&run.opened);
+        _queueDestroy(&run.finished);
+        if (fp) fclose(fp);
+        return SoundIoErrorNoMem;
+    }
+
+    /* analysis first: an opener with nothing draining its queue would wait forever */
+    threadPoolGroup group;
+    threadpool_group_init(&group);
+    int analyzers = 0;
+    for (int i = 0; i < analysis_threads; i++) {
+        if (threadpool_submit(pool, _analysisStage, &run, &group) == SoundIoErrorNone) analyzers++;
+        else _queueProducerDone(&run.finished);
+    }
+    for (int i = 0; i < decode_threads; i++) {
+        if (analyzers > 0 && threadpool_submit(pool, _openStage, &run, &group) == SoundIoErrorNone) continue;
+        run.failed = true;
+        _queueProducerDone(&run.opened);
+    }
+
+    bool ok = true;
+    if (fp && format == CSL_ANALYSIS_JSON) ok = fprintf(fp, "[\n") > 0;
+    if (fp && format == CSL_ANALYSIS_BINARY) {
+        uint32_t version = ANALYSIS_FILE_VERSION;
+        ok = fwrite(ANALYSIS_FILE_MAGIC, 8, 1, fp) == 1 && fwrite(&version, sizeof(version), 1, fp) == 1;
+    }
+    int written = 0;
+    analysisJob* job;
+    while ((job = _queuePop(&run.finished)) != NULL) {
+        if (fp && ok) ok = (format == CSL_ANALYSIS_JSON) ? _writeJson(fp, &job->result, written == 0) : _writeBinary(fp, &job->result);
+        if (callback) callback(&job->result, user);
+        written++;
+        _freeJob(job);
+    }
+    if (fp && format == CSL_ANALYSIS_JSON && ok) ok = fprintf(fp, "\n]\n") > 0;
+
+    threadpool_group_wait(&group);
+    threadpool_group_destroy(&group);
+    threadpool_destroy(pool);
+    _queueDestroy(&run.opened);
+    _queueDestroy(&run.finished);
+    if (fp) ok = (fclose(fp) == 0) && ok;
+    if (__atomic_load_n(&run.failed, __ATOMIC_RELAXED)) return SoundIoErrorNoMem;
+    return ok ? SoundIoErrorNone : CSLErrorOpeningFile;
+}
@@ -0,0 +1,317 @@
+#include "clip.h"
+#include "loader.h"
+#include "csl_util.h"
+#include <soundio/soundio.h>
+#include <string.h>
+
+/*
+
+every live clip is in one registry so memory pressure can be handled across all of them.
+eviction takes resident, unpinned clips least recently used first.
+
+*/
+static pthread_mutex_t _registryLock = PTHREAD_MUTEX_INITIALIZER;
+static CslClip* _clips = NULL;
+static size_t _residentBytes = 0;
+static size_t _memoryLimit = 0; // 0 for no limit
+static uint64_t _clock = 0;
+
+static int _loadSamples(const char* path, CslFileInfo* info) {
+    CslFileType file_type;
+    if (!loader_file_type(path, &file_type)) return CSLErrorUnsupportedFormat;
+    memset(info, 0, sizeof(CslFileInfo));
+    /* NULL data: the loaders allocate (or map) exactly what the file needs */
+    info->data = NULL;
+    return loader_read_file(path, file_type, info, 0, NULL, NULL, NULL);
+}
+
+static bool _isResident(const CslClip* clip) {
+    return clip->info.data != NULL || clip->compressed != NULL;
+}
+
+static size_t _clipBytes(const CslClip* clip) {
+    return clip->compressed ? clip_codec_bytes(clip->compressed) : clip->info.data_bytes;
+}
+
+static void _evictLocked(CslClip* clip) {
+    _residentBytes -= _clipBytes(clip);
+    if (clip->compressed) {
+        clip_codec_free(clip->compressed);
+        free(clip->compressed);
+        clip->compressed = NULL;
+    }
+    soundlib_release_file_data(&clip->info);
+}
+
+/* swap pcm samples for their compressed form. info->data is released on success */
+static int _compress(CslFileInfo* info, clipCodec** out) {
+    clipCodec* codec = malloc(sizeof(clipCodec));
+    if (!codec) return SoundIoErrorNoMem;
+    int err = clip_codec_encode(info, codec);
+    if (err != SoundIoErrorNone) {
+        free(codec);
+        return err;
+    }
+    soundlib_release_file_data(info);
+    *out = codec;
+    return SoundIoErrorNone;
+}
+
+static void _trimLocked(size_t target_bytes) {
+    while (_residentBytes > target_bytes) {
+        CslClip* oldest = NULL;
+        for (CslClip* clip = _clips; clip != NULL; clip = clip->next) {
+            if (clip->pins > 0 || !_isResident(clip)) continue;
+            if (oldest == NULL || clip->last_used < oldest->last_used) oldest = clip;
+        }
+        if (oldest == NULL) break;
+        _evictLocked(oldest);
+    }
+}
+
+static void _registerClip(CslClip* clip) {
+    clip->refcount = 1;
+    pthread_mutex_lock(&_registryLock);
+    clip->last_used = ++_clock;
+    clip->prev = NULL;
+    clip->next = _clips;
+    if (_clips) _clips->prev = clip;
+    _clips = clip;
+    _residentBytes += _clipBytes(clip);
+    if (_memoryLimit > 0) _trimLocked(_memoryLimit);
+    pthread_mutex_unlock(&_registryLock);
+}
+
+int soundlib_clip_load(const char* path, CslClip** out) {
+    CslClip* clip = calloc(1, sizeof(CslClip));
+    if (!clip) return SoundIoErrorNoMem;
+    clip->path = strdup(path);
+    if (!clip->path) {
+        free(clip);
+        return SoundIoErrorNoMem;
+    }
+    int err = _loadSamples(clip->path, &clip->info);
+    if (err != SoundIoErrorNone) {
+        free(clip->path);
+        free(clip);
+        return err;
+    }
+    clip->info.path = clip->path;
+    _registerClip(clip);
+    *out = clip;
+    return SoundIoErrorNone;
+}
+
+int soundlib_clip_from_file_info(CslFileInfo* info, CslClip** out) {
+    if (info->data_storage == CSL_DATA_USER) return SoundIoErrorInvalid;
+    CslClip* clip = calloc(1, sizeof(CslClip));
+    if (!clip) return SoundIoErrorNoMem;
+    clip->path = info->path ? strdup(info->path) : NULL;
+    clip->info = *info;
+    clip->info.path = clip->path;
+    /* the clip owns the samples now */
+    info->data = NULL;
+    info->data_bytes = 0;
+    info->data_storage = CSL_DATA_USER;
+    _registerClip(clip);
+    *out = clip;
+    return SoundIoErrorNone;
+}
+
+void soundlib_clip_retain(CslClip* clip) {
+    __atomic_add_fetch(&clip->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void soundlib_clip_release(CslClip* clip) {
+    if (clip == NULL) return;
+    if (__atomic_sub_fetch(&clip->refcount, 1, __ATOMIC_ACQ_REL) > 0) return;
+    pthread_mutex_lock(&_registryLock);
+    if (clip->prev) clip->prev->next = clip->next;
+    else _clips = clip->next;
+    if (clip->next) clip->next->prev = clip->prev;
+    if (_isResident(clip)) _evictLocked(clip);
+    pthread_mutex_unlock(&_registryLock);
+    free(clip->path);
+    free(clip);
+}
+
+const CslFileInfo* soundlib_clip_get_info(const CslClip* clip) {
+    return &clip->info;
+}
+
+int soundlib_clip_pin(CslClip* clip, const CslFileInfo** info) {
+    pthread_mutex_lock(&_registryLock);
+    if (!_isResident(clip)) {
+        if (clip->path == NULL) {
+            pthread_mutex_unlock(&_registryLock);
+            return CSLErrorFileNotFound;
+        }
+        /* reload without holding the lock, decoding can take a while */
+        bool compress = clip->compress;
+        pthread_mutex_unlock(&_registryLock);
+        CslFileInfo loaded;
+        clipCodec* compressed = NULL;
+        int err = _loadSamples(clip->path, &loaded);
+        if (err == SoundIoErrorNone && compress) err = _compress(&loaded, &compressed);
+        if (err != SoundIoErrorNone) {
+            soundlib_release_file_data(&loaded);
+            return err;
+        }
+        pthread_mutex_lock(&_registryLock);
+        if (!_isResident(clip)) {
+            loaded.path = clip->path;
+            clip->info = loaded;
+            clip->compressed = compressed;
+            _residentBytes += _clipBytes(clip);
+        }
+        else {
+            /* someone else got there first */
+            soundlib_release_file_data(&loaded);
+            if (compressed) {
+                clip_codec_free(compressed);
+                free(compressed);
+            }
+        }
+    }
+    clip->pins += 1;
+    clip->last_used = ++_clock;
+    if (_memoryLimit > 0) _trimLocked(_memoryLimit);
+    pthread_mutex_unlock(&_registryLock);
+    if (info) *info = &clip->info;
+    return SoundIoErrorNone;
+}
+
+void soundlib_clip_unpin(CslClip* clip) {
+    pthread_mutex_lock(&_registryLock);
+    if (clip->pins > 0) clip->pins -= 1;
+    clip->last_used = ++_clock;
+    if (_memoryLimit > 0) _trimLocked(_memoryLimit);
+    pthread_mutex_unlock(&_registryLock);
+}
+
+void soundlib_clip_set_memory_limit(size_t max_bytes) {
+    pthread_mutex_lock(&_registryLock);
+    _memoryLimit = max_bytes;
+    if (_memoryLimit > 0) _trimLocked(_memoryLimit);
+    pthread_mutex_unlock(&_registryLock);
+}
+
+size_t soundlib_clip_trim_memory(size_t target_bytes) {
+    pthread_mutex_lock(&_registryLock);
+    _trimLocked(target_bytes);
+    size_t resident = _residentBytes;
+    pthread_mutex_unlock(&_registryLock);
+    return resident;
+}
+
+int soundlib_clip_compress(CslClip* clip) {
+    pthread_mutex_lock(&_registryLock);
+    if (clip->compressed) {
+        pthread_mutex_unlock(&_registryLock);
+        return SoundIoErrorNone;
+    }
+    if (clip->info.data_type == CSL_FL32 || clip->info.data_type == CSL_FL64) {
+        pthread_mutex_unlock(&_registryLock);
+        return CSLErrorUnsupportedFormat;
+    }
+    /* tracks read the samples of pinned clips from the audio thread */
+    if (clip->pins > 0) {
+        pthread_mutex_unlock(&_registryLock);
+        return SoundIoErrorInvalid;
+    }
+    clip->compress = true;
+    if (!_isResident(clip)) {
+        /* compressed when it is next loaded */
+        pthread_mutex_unlock(&_registryLock);
+        return SoundIoErrorNone;
+    }
+    /* keep it from being evicted while the encoder reads it */
+    clip->pins += 1;
+    pthread_mutex_unlock(&_registryLock);
+    clipCodec* codec = malloc(sizeof(clipCodec));
+    int err = codec ? clip_codec_encode(&clip->info, codec) : SoundIoErrorNoMem;
+    pthread_mutex_lock(&_registryLock);
+    clip->pins -= 1;
+    if (err == SoundIoErrorNone && clip->pins == 0) {
+        _residentBytes -= clip->info.data_bytes;
+        soundlib_release_file_data(&clip->info);
+        clip->compressed = codec;
+        _residentBytes += _clipBytes(clip);
+        codec = NULL;
+    }
+    else if (err == SoundIoErrorNone) {
+        /* a track picked it up while we were encoding */
+        err = SoundIoErrorInvalid;
+    }
+    pthread_mutex_unlock(&_registryLock);
+    if (codec) {
+        clip_codec_free(codec);
+        free(codec);
+    }
+    return err;
+}
+
+size_t soundlib_clip_get_memory_bytes(const CslClip* clip) {
+    pthread_mutex_lock(&_registryLock);
+    size_t bytes = _isResident(clip) ? _clipBytes(clip) : 0;
+    pthread_mutex_unlock(&_registryLock);
+    return bytes;
+}
+
+/* ********************************************* */
+/* reading                                       */
+/* ********************************************* */
+
+int clip_reader_init(clipReader* reader, CslClip* clip) {
+    reader->clip = clip;
+    reader->cached_block = -1;
+    size_t frame_bytes = get_bytes_in_buffer(clip->info.data_type, true) * clip->info.num_channels;
+    reader->block = malloc(CLIP_CODEC_BLOCK_FRAMES * frame_bytes);
+    return reader->block ? SoundIoErrorNone : SoundIoErrorNoMem;
+}
+
+void clip_reader_destroy(clipReader* reader) {
+    free(reader->block);
+    reader->block = NULL;
+    reader->clip = NULL;
+}
+
+int clip_read_frames(clipReader* reader, int64_t frame, int num_frames, float* out) {
+    const CslClip* clip = reader->clip;
+    const CslFileInfo* info = &clip->info;
+    int num_channels = info->num_channels;
+    size_t frame_bytes = get_bytes_in_buffer(info->data_type, true) * num_channels;
+    if (frame < 0 || frame >= info->num_frames) return 0;
+    if (frame + num_frames > info->num_frames) num_frames = (int)(info->num_frames - frame);
+
+    if (clip->compressed == NULL) {
+        if (info->data == NULL) return 0;
+        return byte_buffer_to_float_buffer(info->data + frame * frame_bytes, out, num_frames * frame_bytes,
+                                           (size_t)num_frames * num_channels, info->data_type, true) / num_channels;
+    }
+    /* one block is decoded at a time and kept for the reads that follow */
+    int done = 0;
+    while (done < num_frames) {
+        int64_t position = frame + done;
+        int block = (int)(position / CLIP_CODEC_BLOCK_FRAMES);
+        if (block != reader->cached_block) {
+            clip_codec_decode_block(clip->compressed, block, reader->block);
+            reader->cached_block = block;
+        }
+        int offset = (int)(position - (int64_t)block * CLIP_CODEC_BLOCK_FRAMES);
+        int n = CLIP_CODEC_BLOCK_FRAMES - offset;
+        if (n > num_frames - done) n = num_frames - done;
+        byte_buffer_to_float_buffer(reader->block + offset * frame_bytes, out + (size_t)done * num_channels,
+                                    n * frame_bytes, (size_t)n * num_channels, info->data_type, true);
+        done += n;
+    }
+    return done;
+}
+
+int soundlib_clip_read_frames(CslClip* clip, int64_t frame, int num_frames, float* out) {
+    clipReader reader;
+    if (clip_reader_init(&reader, clip) != SoundIoErrorNone) return 0;
+    int frames = clip_read_frames(&reader, frame, num_frames, out);
+    clip_reader_destroy(&reader);
+    return frames;
+}
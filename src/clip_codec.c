@@ -0,0 +1,352 @@
+#include "clip_codec.h"
+#include <soundio/soundio.h>
+#include <string.h>
+
+typedef struct _bitWriter {
+    unsigned char* buf;
+    size_t capacity;
+    size_t len;
+    uint64_t acc;
+    int bits;
+    bool failed;
+} bitWriter;
+
+typedef struct _bitReader {
+    const unsigned char* buf;
+    size_t len;
+    size_t pos;
+    uint64_t acc;
+    int bits;
+} bitReader;
+
+/* ********************************************* */
+/* bit io                                        */
+/* ********************************************* */
+
+static void _put(bitWriter* w, uint64_t value, int n) {
+    if (n == 0) return;
+    w->acc = (w->acc << n) | (value & ((n == 64) ? ~0ULL : ((1ULL << n) - 1)));
+    w->bits += n;
+    while (w->bits >= 8) {
+        if (w->len == w->capacity) {
+            size_t capacity = w->capacity ? w->capacity * 2 : 65536;
+            unsigned char* grown = realloc(w->buf, capacity);
+            if (!grown) {
+                w->failed = true;
+                w->bits = 0;
+                return;
+            }
+            w->buf = grown;
+            w->capacity = capacity;
+        }
+        w->bits -= 8;
+        w->buf[w->len++] = (unsigned char)(w->acc >> w->bits);
+    }
+    w->acc &= (1ULL << w->bits) - 1;
+}
+
+static void _alignWriter(bitWriter* w) {
+    if (w->bits > 0) _put(w, 0, 8 - w->bits);
+}
+
+static inline void _refill(bitReader* r) {
+    while (r->bits <= 56) {
+        /* past the end reads zeros, a corrupt block can't read outside the buffer */
+        uint64_t byte = (r->pos < r->len) ? r->buf[r->pos] : 0;
+        r->pos++;
+        r->acc = (r->acc << 8) | byte;
+        r->bits += 8;
+    }
+}
+
+static inline uint64_t _get(bitReader* r, int n) {
+    if (n == 0) return 0;
+    if (r->bits < n) _refill(r);
+    r->bits -= n;
+    return (r->acc >> r->bits) & ((1ULL << n) - 1);
+}
+
+static inline uint64_t _getUnary(bitReader* r) {
+    _refill(r);
+    uint32_t window = (uint32_t)(r->acc >> (r->bits - 32));
+    if (window == 0) {
+        r->bits -= 32;
+        return CLIP_CODEC_ESCAPE_ZEROS;
+    }
+    int zeros = __builtin_clz(window);
+    r->bits -= zeros + 1;
+    return zeros;
+}
+
+/* ********************************************* */
+/* samples                                       */
+/* ********************************************* */
+
+static bool _isIntegerType(CslDataType data_type) {
+    return data_type != CSL_FL32 && data_type != CSL_FL64;
+}
+
+static inline int32_t _readSample(const unsigned char* p, int bytes_in_sample, bool is_signed) {
+    uint32_t v = 0;
+    for (int j = 0; j < bytes_in_sample; j++) v |= (uint32_t)p[j] << (j * 8);
+    int shift = 32 - bytes_in_sample * 8;
+    if (is_signed && shift > 0) return ((int32_t)(v << shift)) >> shift;
+    return (int32_t)v;
+}
+
+static inline void _writeSample(unsigned char* p, int bytes_in_sample, int32_t value) {
+    for (int j = 0; j < bytes_in_sample; j++) p[j] = (unsigned char)((uint32_t)value >> (j * 8));
+}
+
+/* stereo blocks of up to 24 bits carry a flag for coding the right channel as left - right */
+static inline bool _usesSideFlag(int num_channels, int bytes_in_sample) {
+    return num_channels == 2 && bytes_in_sample <= 3;
+}
+
+/* decoded value -> sample. with a side reference the value is left - right */
+static inline void _emitSample(unsigned char* dst, int bytes_in_sample, int32_t value, const unsigned char* left, bool is_signed) {
+    if (left) value = _readSample(left, bytes_in_sample, is_signed) - value;
+    _writeSample(dst, bytes_in_sample, value);
+}
+
+static inline int64_t _predict(int order, int64_t h1, int64_t h2, int64_t h3, int64_t h4) {
+    switch (order) {
+        case 1: return h1;
+        case 2: return 2 * h1 - h2;
+        case 3: return 3 * h1 - 3 * h2 + h3;
+        case 4: return 4 * h1 - 6 * h2 + 4 * h3 - h4;
+        default: return 0;
+    }
+}
+
+static inline int64_t _residual(const int32_t* x, int i, int order) {
+    int64_t h1 = (order >= 1) ? x[i - 1] : 0;
+    int64_t h2 = (order >= 2) ? x[i - 2] : 0;
+    int64_t h3 = (order >= 3) ? x[i - 3] : 0;
+    int64_t h4 = (order >= 4) ? x[i - 4] : 0;
+    return (int64_t)x[i] - _predict(order, h1, h2, h3, h4);
+}
+
+static inline uint64_t _zigzag(int64_t r) {
+    return ((uint64_t)r << 1) ^ (uint64_t)(r >> 63);
+}
+
+/* ********************************************* */
+/* encode                                        */
+/* ********************************************* */
+
+static int _bestOrder(const int32_t* x, int n, uint64_t* cost_out) {
+    int best = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (int order = 0; order <= CLIP_CODEC_MAX_ORDER && order < n; order++) {
+        uint64_t cost = 0;
+        for (int i = order; i < n; i++) cost += _zigzag(_residual(x, i, order));
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = order;
+        }
+    }
+    if (cost_out) *cost_out = best_cost;
+    return best;
+}
+
+static int _riceParameter(const int32_t* x, int start, int end, int order) {
+    uint64_t sum = 0;
+    for (int i = start; i < end; i++) sum += _zigzag(_residual(x, i, order));
+    uint64_t count = (uint64_t)(end - start);
+    int k = 0;
+    while (k < CLIP_CODEC_MAX_RICE && (count << (k + 1)) < sum) k++;
+    return k;
+}
+
+static void _encodeChannel(bitWriter* w, const int32_t* x, int n, int bit_depth) {
+    bitWriter saved = *w;
+    int order = _bestOrder(x, n, NULL);
+    _put(w, order, CLIP_CODEC_MODE_BITS);
+    for (int i = 0; i < order; i++) _put(w, (uint32_t)x[i], CLIP_CODEC_WARMUP_BITS);
+    for (int start = 0; start < n; start += CLIP_CODEC_PARTITION_FRAMES) {
+        int end = (start + CLIP_CODEC_PARTITION_FRAMES < n) ? start + CLIP_CODEC_PARTITION_FRAMES : n;
+        int first = (start < order) ? order : start;
+        int k = (first < end) ? _riceParameter(x, first, end, order) : 0;
+        _put(w, k, CLIP_CODEC_RICE_BITS);
+        for (int i = first; i < end; i++) {
+            uint64_t u = _zigzag(_residual(x, i, order));
+            uint64_t q = u >> k;
+            if (q < CLIP_CODEC_ESCAPE_ZEROS) {
+                _put(w, 1, (int)q + 1);
+                _put(w, u, k);
+            }
+            else {
+                _put(w, 0, CLIP_CODEC_ESCAPE_ZEROS);
+                _put(w, 1, 1);
+                _put(w, u, CLIP_CODEC_ESCAPE_BITS);
+            }
+        }
+    }
+    /* noise doesn't predict, fall back to plain samples if that is smaller */
+    size_t coded_bits = (w->len - saved.len) * 8 + w->bits - saved.bits;
+    size_t verbatim_bits = CLIP_CODEC_MODE_BITS + (size_t)n * bit_depth;
+    if (coded_bits > verbatim_bits && !w->failed) {
+        w->len = saved.len;
+        w->acc = saved.acc;
+        w->bits = saved.bits;
+        _put(w, CLIP_CODEC_VERBATIM, CLIP_CODEC_MODE_BITS);
+        for (int i = 0; i < n; i++) _put(w, (uint32_t)x[i], bit_depth);
+    }
+}
+
+int clip_codec_encode(const CslFileInfo* info, clipCodec* codec) {
+    /* cleared first so clip_codec_free is safe whatever happens */
+    memset(codec, 0, sizeof(clipCodec));
+    if (!_isIntegerType(info->data_type)) return CSLErrorUnsupportedFormat;
+    if (info->data == NULL) return CSLErrorInputMemoryNotAllocated;
+    int num_channels = info->num_channels;
+    int bytes_in_sample = get_bytes_in_sample(info->data_type);
+    int bit_depth = bytes_in_sample * 8;
+    bool is_signed = is_signed_type(info->data_type);
+    size_t frame_bytes = get_bytes_in_buffer(info->data_type, true) * num_channels;
+
+    codec->data_type = info->data_type;
+    codec->num_channels = num_channels;
+    codec->num_frames = info->num_frames;
+    codec->num_blocks = (int)((info->num_frames + CLIP_CODEC_BLOCK_FRAMES - 1) / CLIP_CODEC_BLOCK_FRAMES);
+    codec->block_offsets = malloc((codec->num_blocks + 1) * sizeof(uint64_t));
+    int32_t* x = malloc(2 * CLIP_CODEC_BLOCK_FRAMES * sizeof(int32_t));
+    if (!codec->block_offsets || !x) {
+        free(x);
+        clip_codec_free(codec);
+        return SoundIoErrorNoMem;
+    }
+    int32_t* side = x + CLIP_CODEC_BLOCK_FRAMES;
+    bool try_side = _usesSideFlag(num_channels, bytes_in_sample);
+
+    bitWriter w = {0};
+    for (int block = 0; block < codec->num_blocks && !w.failed; block++) {
+        codec->block_offsets[block] = w.len;
+        int64_t first_frame = (int64_t)block * CLIP_CODEC_BLOCK_FRAMES;
+        int n = (info->num_frames - first_frame < CLIP_CODEC_BLOCK_FRAMES)
+            ? (int)(info->num_frames - first_frame) : CLIP_CODEC_BLOCK_FRAMES;
+        const unsigned char* src = info->data + first_frame * frame_bytes;
+        bool use_side = false;
+        if (try_side) {
+            /* code the right channel as left - right when that predicts better */
+            uint64_t right_cost, side_cost;
+            for (int i = 0; i < n; i++) {
+                int32_t left = _readSample(src + i * frame_bytes, bytes_in_sample, is_signed);
+                x[i] = _readSample(src + i * frame_bytes + bytes_in_sample, bytes_in_sample, is_signed);
+                side[i] = left - x[i];
+            }
+            _bestOrder(x, n, &right_cost);
+            _bestOrder(side, n, &side_cost);
+            use_side = side_cost < right_cost;
+            _put(&w, use_side, 1);
+        }
+        for (int ch = 0; ch < num_channels; ch++) {
+            for (int i = 0; i < n; i++) {
+                x[i] = _readSample(src + i * frame_bytes + ch * bytes_in_sample, bytes_in_sample, is_signed);
+            }
+            if (ch == 1 && use_side) {
+                /* the difference needs one bit more than the samples */
+                _encodeChannel(&w, side, n, bit_depth + 1);
+            }
+            else {
+                _encodeChannel(&w, x, n, bit_depth);
+            }
+        }
+        _alignWriter(&w);
+    }
+    free(x);
+    if (w.failed) {
+        free(w.buf);
+        clip_codec_free(codec);
+        return SoundIoErrorNoMem;
+    }
+    codec->block_offsets[codec->num_blocks] = w.len;
+    /* give back the slack from doubling */
+    unsigned char* exact = realloc(w.buf, w.len ? w.len : 1);
+    codec->bytes = exact ? exact : w.buf;
+    codec->num_bytes = w.len;
+    return SoundIoErrorNone;
+}
+
+/* ********************************************* */
+/* decode                                        */
+/* ********************************************* */
+
+int clip_codec_decode_block(const clipCodec* codec, int block, unsigned char* out) {
+    if (block < 0 || block >= codec->num_blocks) return 0;
+    int num_channels = codec->num_channels;
+    int bytes_in_sample = get_bytes_in_sample(codec->data_type);
+    int bit_depth = bytes_in_sample * 8;
+    bool is_signed = is_signed_type(codec->data_type);
+    size_t frame_bytes = get_bytes_in_buffer(codec->data_type, true) * num_channels;
+    int64_t first_frame = (int64_t)block * CLIP_CODEC_BLOCK_FRAMES;
+    int n = (codec->num_frames - first_frame < CLIP_CODEC_BLOCK_FRAMES)
+        ? (int)(codec->num_frames - first_frame) : CLIP_CODEC_BLOCK_FRAMES;
+
+    bitReader r = {
+        .buf = codec->bytes + codec->block_offsets[block],
+        .len = codec->block_offsets[block + 1] - codec->block_offsets[block],
+        .pos = 0,
+        .acc = 0,
+        .bits = 0
+    };
+    bool use_side = _usesSideFlag(num_channels, bytes_in_sample) && _get(&r, 1);
+    for (int ch = 0; ch < num_channels; ch++) {
+        unsigned char* dst = out + ch * bytes_in_sample;
+        const unsigned char* left = (ch == 1 && use_side) ? out : NULL;
+        int mode = (int)_get(&r, CLIP_CODEC_MODE_BITS);
+        if (mode == CLIP_CODEC_VERBATIM) {
+            for (int i = 0; i < n; i++) {
+                int32_t s;
+                if (left) {
+                    int shift = 32 - (bit_depth + 1);
+                    s = ((int32_t)((uint32_t)_get(&r, bit_depth + 1) << shift)) >> shift;
+                }
+                else {
+                    s = (int32_t)_get(&r, bit_depth);
+                }
+                _emitSample(dst + i * frame_bytes, bytes_in_sample, s, left ? left + i * frame_bytes : NULL, is_signed);
+            }
+            continue;
+        }
+        int order = (mode <= CLIP_CODEC_MAX_ORDER) ? mode : 0;
+        int64_t h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+        for (int i = 0; i < order && i < n; i++) {
+            int32_t s = (int32_t)_get(&r, CLIP_CODEC_WARMUP_BITS);
+            _emitSample(dst + i * frame_bytes, bytes_in_sample, s, left ? left + i * frame_bytes : NULL, is_signed);
+            h4 = h3; h3 = h2; h2 = h1; h1 = s;
+        }
+        for (int start = 0; start < n; start += CLIP_CODEC_PARTITION_FRAMES) {
+            int end = (start + CLIP_CODEC_PARTITION_FRAMES < n) ? start + CLIP_CODEC_PARTITION_FRAMES : n;
+            int first = (start < order) ? order : start;
+            int k = (int)_get(&r, CLIP_CODEC_RICE_BITS);
+            for (int i = first; i < end; i++) {
+                uint64_t q = _getUnary(&r);
+                uint64_t u;
+                if (q < CLIP_CODEC_ESCAPE_ZEROS) {
+                    u = (q << k) | _get(&r, k);
+                }
+                else {
+                    _get(&r, 1);
+                    u = _get(&r, CLIP_CODEC_ESCAPE_BITS);
+                }
+                int64_t residual = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+                int32_t s = (int32_t)(_predict(order, h1, h2, h3, h4) + residual);
+                _emitSample(dst + i * frame_bytes, bytes_in_sample, s, left ? left + i * frame_bytes : NULL, is_signed);
+                h4 = h3; h3 = h2; h2 = h1; h1 = s;
+            }
+        }
+    }
+    return n;
+}
+
+void clip_codec_free(clipCodec* codec) {
+    free(codec->bytes);
+    free(codec->block_offsets);
+    memset(codec, 0, sizeof(clipCodec));
+}
+
+size_t clip_codec_bytes(const clipCodec* codec) {
+    return codec->num_bytes + (codec->num_blocks + 1) * sizeof(uint64_t);
+}
@@ -0,0 +1,640 @@
+#include "convolver.h"
+#include "csl_simd.h"
+#include "effects.h"
+#include "track.h"
+#include "state.h"
+#include "errors.h"
+#include <soundio/soundio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+static bool _isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+/* interleaved (real, imag) pairs into split arrays */
+static void _splitSpectrum(const float* spectrum, float* re, float* im, int num_bins) {
+    int k = 0;
+    for (; k + 4 <= num_bins; k += 4) {
+        cslVec4 r, i;
+        csl_vec4_load_deinterleave(spectrum + 2 * k, &r, &i);
+        csl_vec4_store(re + k, r);
+        csl_vec4_store(im + k, i);
+    }
+    for (; k < num_bins; k++) {
+        re[k] = spectrum[2 * k];
+        im[k] = spectrum[2 * k + 1];
+    }
+}
+
+static void _joinSpectrum(const float* re, const float* im, float* spectrum, int num_bins) {
+    int k = 0;
+    for (; k + 4 <= num_bins; k += 4) {
+        csl_vec4_store_interleave(spectrum + 2 * k, csl_vec4_load(re + k), csl_vec4_load(im + k));
+    }
+    for (; k < num_bins; k++) {
+        spectrum[2 * k] = re[k];
+        spectrum[2 * k + 1] = im[k];
+    }
+}
+
+/* acc += x * h over n bins, n a multiple of 4 */
+static void _multiplyAccumulate(const float* xr, const float* xi, const float* hr, const float* hi,
+                                float* acc_re, float* acc_im, int n) {
+    for (int k = 0; k < n; k += 4) {
+        cslVec4 a_re = csl_vec4_load(acc_re + k), a_im = csl_vec4_load(acc_im + k);
+        cslVec4 x_re = csl_vec4_load(xr + k), x_im = csl_vec4_load(xi + k);
+        cslVec4 h_re = csl_vec4_load(hr + k), h_im = csl_vec4_load(hi + k);
+        a_re = csl_vec4_msub(csl_vec4_madd(a_re, x_re, h_re), x_im, h_im);
+        a_im = csl_vec4_madd(csl_vec4_madd(a_im, x_re, h_im), x_im, h_re);
+        csl_vec4_store(acc_re + k, a_re);
+        csl_vec4_store(acc_im + k, a_im);
+    }
+}
+
+/* the same for two partitions at once, halving the trips through acc */
+static void _multiplyAccumulate2(const float* xr0, const float* xi0, const float* hr0, const float* hi0,
+                                 const float* xr1, const float* xi1, const float* hr1, const float* hi1,
+                                 float* acc_re, float* acc_im, int n) {
+    for (int k = 0; k < n; k += 4) {
+        cslVec4 a_re = csl_vec4_load(acc_re + k), a_im = csl_vec4_load(acc_im + k);
+        cslVec4 x_re = csl_vec4_load(xr0 + k), x_im = csl_vec4_load(xi0 + k);
+        cslVec4 h_re = csl_vec4_load(hr0 + k), h_im = csl_vec4_load(hi0 + k);
+        a_re = csl_vec4_msub(csl_vec4_madd(a_re, x_re, h_re), x_im, h_im);
+        a_im = csl_vec4_madd(csl_vec4_madd(a_im, x_re, h_im), x_im, h_re);
+        x_re = csl_vec4_load(xr1 + k);
+        x_im = csl_vec4_load(xi1 + k);
+        h_re = csl_vec4_load(hr1 + k);
+        h_im = csl_vec4_load(hi1 + k);
+        a_re = csl_vec4_msub(csl_vec4_madd(a_re, x_re, h_re), x_im, h_im);
+        a_im = csl_vec4_madd(csl_vec4_madd(a_im, x_re, h_im), x_im, h_re);
+        csl_vec4_store(acc_re + k, a_re);
+        csl_vec4_store(acc_im + k, a_im);
+    }
+}
+
+static inline float _dot(const float* coefficients, const float* samples, int taps) {
+    cslVec4 acc0 = csl_vec4_zero();
+    cslVec4 acc1 = csl_vec4_zero();
+    int k = 0;
+    for (; k + 8 <= taps; k += 8) {
+        acc0 = csl_vec4_madd(acc0, csl_vec4_load(coefficients + k), csl_vec4_load(samples + k));
+        acc1 = csl_vec4_madd(acc1, csl_vec4_load(coefficients + k + 4), csl_vec4_load(samples + k + 4));
+    }
+    for (; k < taps; k += 4) {
+        acc0 = csl_vec4_madd(acc0, csl_vec4_load(coefficients + k), csl_vec4_load(samples + k));
+    }
+    return csl_vec4_hsum(csl_vec4_add(acc0, acc1));
+}
+
+static bool _initSegment(CslConvolver* c, convolverSegment* seg, const float* ir, int ir_frames) {
+    int block = seg->block_size;
+    seg->num_bins = block + 1;
+    seg->padded_bins = (seg->num_bins + 3) & ~3;
+    seg->posted_block = -1;
+    seg->working_block = -1;
+    seg->done_block = -1;
+    for (int i = 0; i < CONVOLVER_POST_SLOTS; i++) seg->slot_block[i] = -1;
+
+    size_t spectra = (size_t)seg->num_partitions * seg->padded_bins;
+    size_t frames = (size_t)c->num_channels * block;
+    seg->plan = soundlib_fft_plan_create(2 * block, CSL_FFT_REAL);
+    seg->ir_re = calloc(spectra * c->ir_channels, sizeof(float));
+    seg->ir_im = calloc(spectra * c->ir_channels, sizeof(float));
+    seg->spectrum = malloc((size_t)seg->num_bins * 2 * sizeof(float));
+    seg->acc_re = calloc(seg->padded_bins, sizeof(float));
+    seg->acc_im = calloc(seg->padded_bins, sizeof(float));
+    seg->time = malloc(2 * (size_t)block * sizeof(float));
+    bool ok = seg->plan && seg->ir_re && seg->ir_im && seg->spectrum && seg->acc_re && seg->acc_im && seg->time;
+    if (ok && seg->background) {
+        seg->playback = calloc(frames, sizeof(float));
+        for (int i = 0; i < CONVOLVER_POST_SLOTS; i++) {
+            seg->posted[i] = calloc(frames, sizeof(float));
+            seg->ready[i] = calloc(frames, sizeof(float));
+            ok = ok && seg->posted[i] && seg->ready[i];
+        }
+        ok = ok && seg->playback;
+    }
+    for (int ch = 0; ok && ch < c->num_channels; ch++) {
+        convolverChannel* channel = &seg->channels[ch];
+        channel->input = calloc(2 * (size_t)block, sizeof(float));
+        channel->output = calloc(block, sizeof(float));
+        channel->fdl_re = calloc(spectra, sizeof(float));
+        channel->fdl_im = calloc(spectra, sizeof(float));
+        ok = channel->input && channel->output && channel->fdl_re && channel->fdl_im;
+        if (ok) seg->playing[ch] = seg->background ? seg->playback + (size_t)ch * block : channel->output;
+    }
+    if (!ok) return false;
+
+    /* each partition zero padded to the transform length, the padding is what makes it overlap-save */
+    for (int ch = 0; ch < c->ir_channels; ch++) {
+        for (int p = 0; p < seg->num_partitions; p++) {
+            memset(seg->time, 0, 2 * (size_t)block * sizeof(float));
+            int start = seg->ir_start + p * block;
+            int n = (ir_frames - start < block) ? ir_frames - start : block;
+            for (int i = 0; i < n; i++) seg->time[i] = ir[(size_t)(start + i) * c->ir_channels + ch];
+            soundlib_fft_forward_float(seg->plan, seg->time, seg->spectrum, 1.0f);
+            size_t offset = ((size_t)ch * seg->num_partitions + p) * seg->padded_bins;
+            _splitSpectrum(seg->spectrum, seg->ir_re + offset, seg->ir_im + offset, seg->num_bins);
+        }
+    }
+    return true;
+}
+
+static void _freeSegment(convolverSegment* seg) {
+    soundlib_fft_plan_destroy(seg->plan);
+    free(seg->ir_re);
+    free(seg->ir_im);
+    free(seg->spectrum);
+    free(seg->acc_re);
+    free(seg->acc_im);
+    free(seg->time);
+    free(seg->playback);
+    for (int i = 0; i < CONVOLVER_POST_SLOTS; i++) {
+        free(seg->posted[i]);
+        free(seg->ready[i]);
+    }
+    for (int ch = 0; ch < CONVOLVER_MAX_CHANNELS; ch++) {
+        free(seg->channels[ch].input);
+        free(seg->channels[ch].output);
+        free(seg->channels[ch].fdl_re);
+        free(seg->channels[ch].fdl_im);
+    }
+}
+
+/* the channel's input into the newest slot of its fdl */
+static void _transformBlock(convolverSegment* seg, convolverChannel* channel) {
+    soundlib_fft_forward_float(seg->plan, channel->input, seg->spectrum, 1.0f);
+    size_t slot = (size_t)seg->newest * seg->padded_bins;
+    _splitSpectrum(seg->spectrum, channel->fdl_re + slot, channel->fdl_im + slot, seg->num_bins);
+}
+
+/* transforms the block in the second half of the channel's input into its output */
+static void _processBlock(convolverSegment* seg, int ch, int ir_channels) {
+    convolverChannel* channel = &seg->channels[ch];
+    int block = seg->block_size;
+    int bins = seg->padded_bins;
+    int num_partitions = seg->num_partitions;
+
+    _transformBlock(seg, channel);
+
+    /* partition p of the response meets the block from p blocks ago */
+    memset(seg->acc_re, 0, bins * sizeof(float));
+    memset(seg->acc_im, 0, bins * sizeof(float));
+    const float* hr = seg->ir_re + (size_t)(ir_channels == 1 ? 0 : ch) * num_partitions * bins;
+    const float* hi = seg->ir_im + (size_t)(ir_channels == 1 ? 0 : ch) * num_partitions * bins;
+    int p = 0;
+    for (; p + 2 <= num_partitions; p += 2) {
+        int s0 = seg->newest - p;
+        if (s0 < 0) s0 += num_partitions;
+        int s1 = (s0 == 0) ? num_partitions - 1 : s0 - 1;
+        _multiplyAccumulate2(channel->fdl_re + (size_t)s0 * bins, channel->fdl_im + (size_t)s0 * bins,
+                             hr + (size_t)p * bins, hi + (size_t)p * bins,
+                             channel->fdl_re + (size_t)s1 * bins, channel->fdl_im + (size_t)s1 * bins,
+                             hr + (size_t)(p + 1) * bins, hi + (size_t)(p + 1) * bins,
+                             seg->acc_re, seg->acc_im, bins);
+    }
+    if (p < num_partitions) {
+        int s0 = seg->newest - p;
+        if (s0 < 0) s0 += num_partitions;
+        _multiplyAccumulate(channel->fdl_re + (size_t)s0 * bins, channel->fdl_im + (size_t)s0 * bins,
+                            hr + (size_t)p * bins, hi + (size_t)p * bins, seg->acc_re, seg->acc_im, bins);
+    }
+
+    _joinSpectrum(seg->acc_re, seg->acc_im, seg->spectrum, seg->num_bins);
+    soundlib_fft_backward_float(seg->plan, seg->spectrum, seg->time, 1.0f / (float)(2 * block));
+    /* the first half wrapped around, the second half is the linear convolution */
+    memcpy(channel->output, seg->time + block, block * sizeof(float));
+    memcpy(channel->input, channel->input + block, block * sizeof(float));
+}
+
+static void _advance(convolverSegment* seg) {
+    seg->newest = (seg->newest + 1 == seg->num_partitions) ? 0 : seg->newest + 1;
+}
+
+/* runs the oldest block of seg the worker hasn't, false when it has caught up */
+static bool _runBackground(CslConvolver* c, convolverSegment* seg) {
+    int64_t k = __atomic_load_n(&seg->done_block, __ATOMIC_RELAXED) + 1;
+    if (k > __atomic_load_n(&seg->posted_block, __ATOMIC_SEQ_CST)) return false;
+
+    /* mark the block before checking its slot, _postBlock does the same the other way round */
+    int block = seg->block_size;
+    int slot = (int)(k % CONVOLVER_POST_SLOTS);
+    __atomic_store_n(&seg->working_block, k, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&seg->slot_block[slot], __ATOMIC_SEQ_CST) == k) {
+        int active = seg->posted_channels[slot];
+        for (int ch = 0; ch < active; ch++) {
+            memcpy(seg->channels[ch].input + block, seg->posted[slot] + (size_t)ch * block, block * sizeof(float));
+            _processBlock(seg, ch, c->ir_channels);
+            memcpy(seg->ready[slot] + (size_t)ch * block, seg->channels[ch].output, block * sizeof(float));
+        }
+    }
+    else {
+        /* the block never made it into its slot, run it as silence so the fdl stays in step */
+        for (int ch = 0; ch < c->num_channels; ch++) {
+            convolverChannel* channel = &seg->channels[ch];
+            memset(channel->input + block, 0, block * sizeof(float));
+            _transformBlock(seg, channel);
+            memset(channel->input, 0, block * sizeof(float));
+        }
+        memset(seg->ready[slot], 0, (size_t)c->num_channels * block * sizeof(float));
+    }
+    _advance(seg);
+    __atomic_store_n(&seg->done_block, k, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool _anyPosted(CslConvolver* c) {
+    for (int s = 0; s < c->num_segments; s++) {
+        convolverSegment* seg = &c->segments[s];
+        if (seg->background && __atomic_load_n(&seg->posted_block, __ATOMIC_SEQ_CST) >
+                                   __atomic_load_n(&seg->done_block, __ATOMIC_ACQUIRE)) return true;
+    }
+    return false;
+}
+
+static void* _workerLoop(void* arg) {
+    CslConvolver* c = (CslConvolver*)arg;
+    for (;;) {
+        /* segments are in order of block size, so the nearest deadline always goes first */
+        bool ran = false;
+        for (int s = 0; s < c->num_segments && !ran; s++) {
+            if (c->segments[s].background) ran = _runBackground(c, &c->segments[s]);
+        }
+        if (ran) continue;
+
+        pthread_mutex_lock(&c->lock);
+        if (c->quit) {
+            pthread_mutex_unlock(&c->lock);
+            return NULL;
+        }
+        if (!_anyPosted(c)) {
+            /* the audio thread only signals when it gets the lock, so don't sleep on it for long */
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += CONVOLVER_WORKER_POLL_NS;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec += 1;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&c->wake, &c->lock, &until);
+        }
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+static bool _startWorker(CslConvolver* c) {
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wake, NULL);
+    /* an ordinary time shared thread, below the realtime audio thread it feeds */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    struct sched_param param = {.sched_priority = sched_get_priority_min(SCHED_OTHER)};
+    pthread_attr_setschedparam(&attr, &param);
+    c->has_worker = pthread_create(&c->worker, &attr, _workerLoop, c) == 0;
+    pthread_attr_destroy(&attr);
+    if (!c->has_worker) c->has_worker = pthread_create(&c->worker, NULL, _workerLoop, c) == 0;
+    if (!c->has_worker) {
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->wake);
+    }
+    return c->has_worker;
+}
+
+static int _ceilDiv(int a, int b) {
+    return (a + b - 1) / b;
+}
+
+/* lays out the segments after the head, see convolver.h */
+static void _planNonUniform(CslConvolver* c, int ir_frames, int head_block) {
+    int start = head_block;
+    int block = head_block;
+    bool background = false;
+    while (start < ir_frames && c->num_segments < CONVOLVER_MAX_SEGMENTS) {
+        int next = block * CONVOLVER_GROWTH;
+        if (next > CONVOLVER_MAX_BLOCK) next = CONVOLVER_MAX_BLOCK;
+        /* enough partitions to reach the next segment's lag, or the rest at the largest block */
+        int parts = (next == block) ? _ceilDiv(ir_frames - start, block) : (2 * next - start) / block;
+        if (parts > _ceilDiv(ir_frames - start, block)) parts = _ceilDiv(ir_frames - start, block);
+        convolverSegment* seg = &c->segments[c->num_segments++];
+        seg->block_size = block;
+        seg->ir_start = start;
+        seg->background = background;
+        seg->num_partitions = parts;
+        start += parts * block;
+        block = next;
+        background = true;
+    }
+}
+
+static CslConvolver* _create(const float* ir, int ir_frames, int ir_channels, int num_channels, int block_size, bool nonuniform) {
+    if (ir == NULL || ir_frames < 1) return NULL;
+    if (num_channels < 1 || num_channels > CONVOLVER_MAX_CHANNELS) return NULL;
+    if (ir_channels != 1 && ir_channels != num_channels) return NULL;
+    if (!_isPowerOfTwo(block_size) || block_size < CONVOLVER_MIN_BLOCK || block_size > CONVOLVER_MAX_BLOCK) return NULL;
+
+    CslConvolver* c = calloc(1, sizeof(CslConvolver));
+    if (!c) return NULL;
+    c->num_channels = num_channels;
+    c->ir_channels = ir_channels;
+    c->run = block_size;
+    c->wet = 1.0f;
+    c->dry = 0.0f;
+    if (nonuniform) {
+        c->latency = 0;
+        c->head_taps = block_size;
+        c->recent_keep = block_size - 1;
+        _planNonUniform(c, ir_frames, block_size);
+    }
+    else {
+        c->latency = block_size;
+        c->num_segments = 1;
+        c->segments[0].block_size = block_size;
+        c->segments[0].num_partitions = _ceilDiv(ir_frames, block_size);
+    }
+    c->tail = ir_frames;
+    c->history_size = block_size;
+    for (int s = 0; s < c->num_segments; s++) {
+        if (c->segments[s].block_size > c->history_size) c->history_size = c->segments[s].block_size;
+    }
+
+    c->wet_run = malloc(block_size * sizeof(float));
+    bool ok = c->wet_run != NULL;
+    if (ok && c->head_taps > 0) {
+        c->head = calloc((size_t)ir_channels * c->head_taps, sizeof(float));
+        ok = c->head != NULL;
+        for (int ch = 0; ok && ch < ir_channels; ch++) {
+            for (int i = 0; i < c->head_taps && i < ir_frames; i++) {
+                c->head[(size_t)ch * c->head_taps + c->head_taps - 1 - i] = ir[(size_t)i * ir_channels + ch];
+            }
+        }
+    }
+    for (int ch = 0; ok && ch < num_channels; ch++) {
+        c->recent[ch] = calloc((size_t)c->recent_keep + block_size, sizeof(float));
+        c->history[ch] = calloc(c->history_size, sizeof(float));
+        ok = c->recent[ch] && c->history[ch];
+    }
+    bool background = false;
+    for (int s = 0; ok && s < c->num_segments; s++) {
+        ok = _initSegment(c, &c->segments[s], ir, ir_frames);
+        background = background || c->segments[s].background;
+    }
+    if (ok && background) ok = _startWorker(c);
+    if (!ok) {
+        soundlib_convolver_destroy(c);
+        return NULL;
+    }
+    return c;
+}
+
+CslConvolver* soundlib_convolver_create(const float* ir, int ir_frames, int ir_channels, int num_channels, int block_size) {
+    return _create(ir, ir_frames, ir_channels, num_channels, block_size, false);
+}
+
+CslConvolver* soundlib_convolver_create_nonuniform(const float* ir, int ir_frames, int ir_channels, int num_channels, int head_block) {
+    return _create(ir, ir_frames, ir_channels, num_channels, head_block, true);
+}
+
+static CslConvolver* _createFromFile(const CslFileInfo* ir, int num_channels, int block_size, bool nonuniform) {
+    if (ir == NULL || ir->data == NULL || ir->num_frames < 1) return NULL;
+    size_t num_samples = (size_t)ir->num_frames * ir->num_channels;
+    float* samples = malloc(num_samples * sizeof(float));
+    if (!samples) return NULL;
+    byte_buffer_to_float_buffer(ir->data, samples, ir->data_bytes, num_samples, ir->data_type, true);
+    /* a mono response goes on every channel, otherwise the channels have to match */
+    CslConvolver* c = _create(samples, ir->num_frames, ir->num_channels, num_channels, block_size, nonuniform);
+    free(samples);
+    return c;
+}
+
+CslConvolver* soundlib_convolver_create_from_file(const CslFileInfo* ir, int num_channels, int block_size) {
+    return _createFromFile(ir, num_channels, block_size, false);
+}
+
+CslConvolver* soundlib_convolver_create_nonuniform_from_file(const CslFileInfo* ir, int num_channels, int head_block) {
+    return _createFromFile(ir, num_channels, head_block, true);
+}
+
+void soundlib_convolver_destroy(CslConvolver* c) {
+    if (!c) return;
+    if (c->has_worker) {
+        pthread_mutex_lock(&c->lock);
+        c->quit = true;
+        pthread_cond_signal(&c->wake);
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->worker, NULL);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->wake);
+    }
+    for (int s = 0; s < c->num_segments; s++) _freeSegment(&c->segments[s]);
+    free(c->head);
+    free(c->wet_run);
+    for (int ch = 0; ch < CONVOLVER_MAX_CHANNELS; ch++) {
+        free(c->recent[ch]);
+        free(c->history[ch]);
+    }
+    free(c);
+}
+
+void soundlib_convolver_set_mix(CslConvolver* c, float wet, float dry) {
+    __atomic_store(&c->wet, &wet, __ATOMIC_RELAXED);
+    __atomic_store(&c->dry, &dry, __ATOMIC_RELAXED);
+}
+
+int soundlib_convolver_get_latency(const CslConvolver* c) {
+    return c->latency;
+}
+
+int64_t soundlib_convolver_get_missed_deadlines(const CslConvolver* c) {
+    return __atomic_load_n(&c->missed_deadlines, __ATOMIC_RELAXED);
+}
+
+void soundlib_convolver_reset(CslConvolver* c) {
+    /* let the worker finish what it has, it won't start anything else until the next post */
+    for (int s = 0; s < c->num_segments; s++) {
+        convolverSegment* seg = &c->segments[s];
+        while (seg->background && __atomic_load_n(&seg->done_block, __ATOMIC_ACQUIRE) <
+                                      __atomic_load_n(&seg->posted_block, __ATOMIC_SEQ_CST)) {
+            usleep(500);
+        }
+    }
+    for (int s = 0; s < c->num_segments; s++) {
+        convolverSegment* seg = &c->segments[s];
+        size_t spectra = (size_t)seg->num_partitions * seg->padded_bins;
+        size_t frames = (size_t)c->num_channels * seg->block_size;
+        for (int ch = 0; ch < c->num_channels; ch++) {
+            convolverChannel* channel = &seg->channels[ch];
+            memset(channel->input, 0, 2 * (size_t)seg->block_size * sizeof(float));
+            memset(channel->output, 0, (size_t)seg->block_size * sizeof(float));
+            memset(channel->fdl_re, 0, spectra * sizeof(float));
+            memset(channel->fdl_im, 0, spectra * sizeof(float));
+        }
+        if (seg->background) {
+            memset(seg->playback, 0, frames * sizeof(float));
+            for (int i = 0; i < CONVOLVER_POST_SLOTS; i++) memset(seg->ready[i], 0, frames * sizeof(float));
+        }
+        seg->newest = 0;
+    }
+    for (int ch = 0; ch < c->num_channels; ch++) {
+        memset(c->recent[ch], 0, ((size_t)c->recent_keep + c->run) * sizeof(float));
+        memset(c->history[ch], 0, c->history_size * sizeof(float));
+    }
+    /* position keeps counting so block numbers stay ahead of what the worker has seen */
+}
+
+/* hands block k of seg to the worker and takes back block k - 1 */
+static void _postBlock(CslConvolver* c, convolverSegment* seg, int64_t k, int active) {
+    int block = seg->block_size;
+    size_t frames = (size_t)c->num_channels * block;
+    if (k > 0) {
+        int64_t previous = k - 1;
+        if (__atomic_load_n(&seg->done_block, __ATOMIC_ACQUIRE) >= previous) {
+            memcpy(seg->playback, seg->ready[previous % CONVOLVER_POST_SLOTS], frames * sizeof(float));
+        }
+        else {
+            memset(seg->playback, 0, frames * sizeof(float));
+            if (__atomic_load_n(&seg->posted_block, __ATOMIC_RELAXED) == previous) {
+                __atomic_fetch_add(&c->missed_deadlines, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    /* invalidate the slot before looking for the worker in it, so either it sees the slot go or
+       we see it reading. a slot still being read can't be written, drop this block instead and
+       the worker runs it as silence */
+    int slot = (int)(k % CONVOLVER_POST_SLOTS);
+    int64_t held = k - CONVOLVER_POST_SLOTS;
+    __atomic_store_n(&seg->slot_block[slot], -1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&seg->working_block, __ATOMIC_SEQ_CST) == held &&
+        __atomic_load_n(&seg->done_block, __ATOMIC_ACQUIRE) < held) {
+        __atomic_store_n(&seg->slot_block[slot], held, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&c->missed_deadlines, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    size_t start = (size_t)((c->position - block) & (c->history_size - 1));
+    for (int ch = 0; ch < active; ch++) {
+        memcpy(seg->posted[slot] + (size_t)ch * block, c->history[ch] + start, block * sizeof(float));
+    }
+    seg->posted_channels[slot] = active;
+    __atomic_store_n(&seg->slot_block[slot], k, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&seg->posted_block, k, __ATOMIC_SEQ_CST);
+    if (pthread_mutex_trylock(&c->lock) == 0) {
+        pthread_cond_signal(&c->wake);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+/* every segment whose block ended at position */
+static void _blockBoundaries(CslConvolver* c, int active) {
+    for (int s = 0; s < c->num_segments; s++) {
+        convolverSegment* seg = &c->segments[s];
+        int block = seg->block_size;
+        if ((c->position & (block - 1)) != 0) continue;
+        if (seg->background) {
+            _postBlock(c, seg, c->position / block - 1, active);
+            continue;
+        }
+        size_t start = (size_t)((c->position - block) & (c->history_size - 1));
+        for (int ch = 0; ch < active; ch++) {
+            memcpy(seg->channels[ch].input + block, c->history[ch] + start, block * sizeof(float));
+            _processBlock(seg, ch, c->ir_channels);
+        }
+        _advance(seg);
+    }
+}
+
+int soundlib_convolver_process(CslConvolver* c, const float* input, float* output, int num_frames, int num_channels) {
+    if (num_channels < 1) return SoundIoErrorInvalid;
+    float wet, dry;
+    __atomic_load(&c->wet, &wet, __ATOMIC_RELAXED);
+    __atomic_load(&c->dry, &dry, __ATOMIC_RELAXED);
+    int active = (num_channels < c->num_channels) ? num_channels : c->num_channels;
+    int run = c->run;
+    int frame = 0;
+    while (frame < num_frames) {
+        /* up to the next boundary of the smallest block, so every segment's output is contiguous */
+        int phase = (int)(c->position & (run - 1));
+        int n = num_frames - frame;
+        if (n > run - phase) n = run - phase;
+        for (int ch = 0; ch < num_channels; ch++) {
+            const float* src = input + (size_t)frame * num_channels + ch;
+            float* dst = output + (size_t)frame * num_channels + ch;
+            if (ch >= active) {
+                /* channels the convolver wasn't made for pass through */
+                if (dst != src) for (int i = 0; i < n; i++) dst[(size_t)i * num_channels] = src[(size_t)i * num_channels];
+                continue;
+            }
+            float* x = c->recent[ch] + c->recent_keep;
+            for (int i = 0; i < n; i++) x[i] = src[(size_t)i * num_channels];
+            memcpy(c->history[ch] + (c->position & (c->history_size - 1)), x, n * sizeof(float));
+
+            float* y = c->wet_run;
+            if (c->head_taps > 0) {
+                const float* taps = c->head + (size_t)(c->ir_channels == 1 ? 0 : ch) * c->head_taps;
+                for (int i = 0; i < n; i++) y[i] = _dot(taps, c->recent[ch] + i, c->head_taps);
+            }
+            else {
+                memset(y, 0, n * sizeof(float));
+            }
+            for (int s = 0; s < c->num_segments; s++) {
+                convolverSegment* seg = &c->segments[s];
+                const float* out = seg->playing[ch] + (c->position & (seg->block_size - 1));
+                for (int i = 0; i < n; i++) y[i] += out[i];
+            }
+            for (int i = 0; i < n; i++) dst[(size_t)i * num_channels] = wet * y[i] + dry * x[i];
+            if (c->recent_keep > 0) memmove(c->recent[ch], c->recent[ch] + n, c->recent_keep * sizeof(float));
+        }
+        c->position += n;
+        frame += n;
+        if ((c->position & (run - 1)) == 0) _blockBoundaries(c, active);
+    }
+    return SoundIoErrorNone;
+}
+
+static void _convolverEffect(void* context, float* samples, int num_frames, int num_channels) {
+    soundlib_convolver_process((CslConvolver*)context, samples, samples, num_frames, num_channels);
+}
+
+int soundlib_track_add_convolver(int trackId, CslConvolver* c) {
+    if (c == NULL) return SoundIoErrorInvalid;
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return effects_add_native(&track_p->track_effects.native_effects, _convolverEffect, c, &c->tail, c->latency);
+}
+
+int soundlib_track_remove_convolver(int trackId, CslConvolver* c) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return effects_remove_native(&track_p->track_effects.native_effects, c);
+}
+
+int soundlib_master_add_convolver(CslConvolver* c) {
+    if (c == NULL) return SoundIoErrorInvalid;
+    return effects_add_native(&csoundlib_state->master_effects.native_effects, _convolverEffect, c, &c->tail, c->latency);
+}
+
+int soundlib_master_remove_convolver(CslConvolver* c) {
+    return effects_remove_native(&csoundlib_state->master_effects.native_effects, c);
+}
+
+int soundlib_bus_add_convolver(int busId, CslConvolver* c) {
+    if (c == NULL) return SoundIoErrorInvalid;
+    busObject* bus = graph_get_bus(busId);
+    if (bus == NULL) return CSLErrorBusNotFound;
+    return effects_add_native(&bus->native_effects, _convolverEffect, c, &c->tail, c->latency);
+}
+
+int soundlib_bus_remove_convolver(int busId, CslConvolver* c) {
+    busObject* bus = graph_get_bus(busId);
+    if (bus == NULL) return CSLErrorBusNotFound;
+    return effects_remove_native(&bus->native_effects, c);
+}
@@ -104,6 +104,17 @@ InputDtype CSL_FL32_t = {
     .min_size = 0.0
 };
 
+InputDtype CSL_FL64_t = {
+    .dtype = CSL_FL64,
+    .format = SoundIoFormatFloat64LE,
+    .bit_depth = 64,
+    .bytes_in_buffer = 8,
+    .bytes_in_sample = 8,
+    .is_signed = true,
+    .max_size = 1.0,
+    .min_size = 0.0
+};
+
 /* ********************************************* */
 /* ********************************************* */
 
@@ -117,6 +128,8 @@ InputDtype get_dtype(CslDataType in) {
         case CSL_S24: return CSL_S24_t; break;
         case CSL_U32: return CSL_U32_t; break;
         case CSL_S32: return CSL_S32_t; break;
+        case CSL_FL32: return CSL_FL32_t; break;
+        case CSL_FL64: return CSL_FL64_t; break;
         default: return CSL_S32_t;
     }
 }
@@ -131,6 +144,8 @@ size_t get_bytes_in_sample(CslDataType in) {
         case CSL_S24: return CSL_BYTES_IN_SAMPLE_24; break;
         case CSL_U32: return CSL_BYTES_IN_SAMPLE_32; break;
         case CSL_S32: return CSL_BYTES_IN_SAMPLE_32; break;
+        case CSL_FL32: return CSL_BYTES_IN_SAMPLE_32; break;
+        case CSL_FL64: return CSL_BYTES_IN_SAMPLE_64; break;
         default: return 0;
     }
 }
@@ -155,6 +170,8 @@ size_t get_bytes_in_buffer(CslDataType in, bool audio_file) {
         }
         case CSL_U32: return CSL_BYTES_IN_BUFFER_32; break;
         case CSL_S32: return CSL_BYTES_IN_BUFFER_32; break;
+        case CSL_FL32: return CSL_BYTES_IN_BUFFER_32; break;
+        case CSL_FL64: return CSL_BYTES_IN_BUFFER_64; break;
         default: return 0;
     }
 }
@@ -169,6 +186,8 @@ uint8_t get_bit_depth(CslDataType in) {
         case CSL_S24: return 24; break;
         case CSL_U32: return 32; break;
         case CSL_S32: return 32; break;
+        case CSL_FL32: return 32; break;
+        case CSL_FL64: return 64; break;
         default: return 0;
     }
 }
@@ -207,6 +226,8 @@ bool is_signed_type(CslDataType in) {
         case CSL_S24: return true; break;
         case CSL_U32: return false; break;
         case CSL_S32: return true; break;
+        case CSL_FL32: return true; break;
+        case CSL_FL64: return true; break;
         default: return 0;
     }
 }
@@ -215,5 +236,22 @@ int get_sample_rate(CslSampleRate in) {
     switch(in) {
         case CSL_SR44100: return 44100; break;
         case CSL_SR48000: return 48000; break;
+        case CSL_SR22050: return 22050; break;
+        case CSL_SR88200: return 88200; break;
+        case CSL_SR96000: return 96000; break;
+        case CSL_SR192000: return 192000; break;
+        default: return 0;
+    }
+}
+
+bool get_csl_sample_rate(int rate, CslSampleRate* out) {
+    switch(rate) {
+        case 44100: *out = CSL_SR44100; return true;
+        case 48000: *out = CSL_SR48000; return true;
+        case 22050: *out = CSL_SR22050; return true;
+        case 88200: *out = CSL_SR88200; return true;
+        case 96000: *out = CSL_SR96000; return true;
+        case 192000: *out = CSL_SR192000; return true;
+        default: return false;
     }
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "csl_types.h"
 #include "state.h"
+#include "csl_simd.h"
 
 /*
 
@@ -21,6 +22,11 @@ float log_to_mag(float log) {
     return pow(10, (log / 20.0));
 }
 
+size_t user_data_capacity(const CslFileInfo* info) {
+    /* callers from before data_bytes existed sized their buffers for the largest file */
+    return (info->data_bytes > 0) ? info->data_bytes : MAX_AUDIO_FILE_SIZE_BYTES;
+}
+
 float mag_to_log(float mag) {
     return 20.0 * log10(mag);
 }
@@ -38,7 +44,49 @@ float envelope_follower(float input, float attack, float release, float prev_env
     return envelope;
 }
 
-void add_and_scale_audio(const uint8_t *source, uint8_t *destination, float volume, int num_samples) {
+/*
+
+float sessions mix straight on the float samples. there is nothing to unpack or clip,
+full scale is 1.0 and anything over it is left for the device (or the master effects)
+to deal with.
+
+*/
+static void _addAndScaleFloat(const float* source, float* destination, float volume, int num_samples) {
+    cslVec4 vvolume = csl_vec4_set1(volume);
+    int i = 0;
+    for (; i + 4 <= num_samples; i += 4) {
+        cslVec4 sum = csl_vec4_add(csl_vec4_load(source + i), csl_vec4_load(destination + i));
+        csl_vec4_store(destination + i, csl_vec4_mul(sum, vvolume));
+    }
+    for (; i < num_samples; i++) {
+        destination[i] = (source[i] + destination[i]) * volume;
+    }
+}
+
+static void _accumulateFloat(const float* source, float* destination, float gain, int num_samples) {
+    cslVec4 vgain = csl_vec4_set1(gain);
+    int i = 0;
+    for (; i + 4 <= num_samples; i += 4) {
+        csl_vec4_store(destination + i, csl_vec4_madd(csl_vec4_load(destination + i), csl_vec4_load(source + i), vgain));
+    }
+    for (; i < num_samples; i++) {
+        destination[i] += source[i] * gain;
+    }
+}
+
+static void _scaleFloat(float* source, float volume, int num_samples) {
+    cslVec4 vvolume = csl_vec4_set1(volume);
+    int i = 0;
+    for (; i + 4 <= num_samples; i += 4) {
+        csl_vec4_store(source + i, csl_vec4_mul(csl_vec4_load(source + i), vvolume));
+    }
+    for (; i < num_samples; i++) {
+        source[i] *= volume;
+    }
+}
+
+/* destination = (source * source_gain + destination) * volume for the integer types */
+static void _mixIntegers(const uint8_t *source, uint8_t *destination, float source_gain, float volume, int num_samples) {
     CslDataType dtype = csoundlib_state->input_dtype.dtype;
     uint8_t bytes_in_buffer = get_bytes_in_buffer(dtype, false);
     uint8_t bytes_in_sample = get_bytes_in_sample(dtype);
@@ -67,7 +115,7 @@ void add_and_scale_audio(const uint8_t *source, uint8_t *destination, float volu
         }
 
         // Add samples and apply volume scaling
-        int32_t result = (int32_t)((src_sample + dst_sample) * volume);
+        int32_t result = (int32_t)((src_sample * (double)source_gain + dst_sample) * volume);
         
         // Clip the result to max/min bit range
         if (csoundlib_state->input_dtype.is_signed) {
@@ -91,8 +139,47 @@ void add_and_scale_audio(const uint8_t *source, uint8_t *destination, float volu
     }
 }
 
+void add_and_scale_audio(const uint8_t *source, uint8_t *destination, float volume, int num_samples) {
+    CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    if (dtype == CSL_FL32) {
+        _addAndScaleFloat((const float*)source, (float*)destination, volume, num_samples);
+        return;
+    }
+    if (dtype == CSL_FL64) {
+        const double* src = (const double*)source;
+        double* dst = (double*)destination;
+        for (int i = 0; i < num_samples; i++) dst[i] = (src[i] + dst[i]) * volume;
+        return;
+    }
+    _mixIntegers(source, destination, 1.0f, volume, num_samples);
+}
+
+void accumulate_audio(const uint8_t *source, uint8_t *destination, float gain, int num_samples) {
+    CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    if (dtype == CSL_FL32) {
+        _accumulateFloat((const float*)source, (float*)destination, gain, num_samples);
+        return;
+    }
+    if (dtype == CSL_FL64) {
+        const double* src = (const double*)source;
+        double* dst = (double*)destination;
+        for (int i = 0; i < num_samples; i++) dst[i] += src[i] * gain;
+        return;
+    }
+    _mixIntegers(source, destination, gain, 1.0f, num_samples);
+}
+
 void scale_audio(uint8_t *source, float volume, int num_samples) {
     CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    if (dtype == CSL_FL32) {
+        _scaleFloat((float*)source, volume, num_samples);
+        return;
+    }
+    if (dtype == CSL_FL64) {
+        double* src = (double*)source;
+        for (int i = 0; i < num_samples; i++) src[i] *= volume;
+        return;
+    }
     uint8_t bytes_in_buffer = get_bytes_in_buffer(dtype, false);
     uint8_t bytes_in_sample = get_bytes_in_sample(dtype);
     for (int i = 0; i < num_samples; i++) {
@@ -152,7 +239,54 @@ float calculate_rms_level(const unsigned char* source, int num_bytes) {
     return sqrt(rms / (float)num_samples);
 }
 
+bool is_silent_audio(const unsigned char* source, int num_bytes) {
+    CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    switch (dtype) {
+        case CSL_FL32: {
+            const float* samples = (const float*)source;
+            int n = num_bytes / (int)sizeof(float);
+            for (int i = 0; i < n; i++) if (fabsf(samples[i]) >= SILENCE_THRESHOLD) return false;
+            return true;
+        }
+        case CSL_FL64: {
+            const double* samples = (const double*)source;
+            int n = num_bytes / (int)sizeof(double);
+            for (int i = 0; i < n; i++) if (fabs(samples[i]) >= SILENCE_THRESHOLD) return false;
+            return true;
+        }
+        case CSL_S8:
+        case CSL_S16:
+        case CSL_S24:
+        case CSL_S32:
+            /* a signed integer step is far louder than the threshold, silence is zero */
+            for (int i = 0; i < num_bytes; i++) if (source[i] != 0) return false;
+            return true;
+        default: {
+            /* unsigned, silence sits at the midpoint */
+            int bytes_in_buffer = csoundlib_state->input_dtype.bytes_in_buffer;
+            for (int idx = 0; idx < num_bytes; idx += bytes_in_buffer) {
+                if (fabsf(bytes_to_sample(source + idx, dtype)) >= SILENCE_THRESHOLD) return false;
+            }
+            return true;
+        }
+    }
+}
+
+static inline float _floatBytesToSample(const unsigned char* bytes, CslDataType data_type) {
+    if (data_type == CSL_FL32) {
+        float sample;
+        memcpy(&sample, bytes, sizeof(float));
+        return sample;
+    }
+    double sample;
+    memcpy(&sample, bytes, sizeof(double));
+    return (float)sample;
+}
+
 float bytes_to_sample_audio_file(const unsigned char* bytes, CslDataType data_type) {
+    if (data_type == CSL_FL32 || data_type == CSL_FL64) {
+        return _floatBytesToSample(bytes, data_type);
+    }
     if (data_type == CSL_S24 || data_type == CSL_U24) {
         // Combine bytes into a 24-bit integer
         int sample_value =  
@@ -218,6 +352,9 @@ float bytes_to_sample_audio_file(const unsigned char* bytes, CslDataType data_ty
 }
 
 float bytes_to_sample(const unsigned char* bytes, CslDataType data_type) {
+    if (data_type == CSL_FL32 || data_type == CSL_FL64) {
+        return _floatBytesToSample(bytes, data_type);
+    }
     if (data_type == CSL_S24 || data_type == CSL_S32 ||
         data_type == CSL_U24 || data_type == CSL_U32) {
         int sample_value = (int32_t)
@@ -264,6 +401,11 @@ int byte_buffer_to_float_buffer(const unsigned char* byte_buffer, float* float_b
     int bytes_in_buffer = get_bytes_in_buffer(data_type, audio_file);
     int num_samples = num_bytes / bytes_in_buffer;
     if (num_samples > input_max_samples) num_samples = input_max_samples;
+    if (data_type == CSL_FL32) {
+        /* already floats, nothing to convert */
+        memcpy(float_buffer, byte_buffer, num_samples * sizeof(float));
+        return num_samples;
+    }
     int i;
     for (i = 0; i < num_samples; i++) {
         float sample;
@@ -273,3 +415,30 @@ int byte_buffer_to_float_buffer(const unsigned char* byte_buffer, float* float_b
     }
     return i;
 }
+
+void float_buffer_to_byte_buffer(const float* float_buffer, unsigned char* byte_buffer, size_t num_samples, CslDataType data_type) {
+    if (data_type == CSL_FL32) {
+        memcpy(byte_buffer, float_buffer, num_samples * sizeof(float));
+        return;
+    }
+    if (data_type == CSL_FL64) {
+        double* dst = (double*)byte_buffer;
+        for (size_t i = 0; i < num_samples; i++) dst[i] = float_buffer[i];
+        return;
+    }
+    /* the inverse of bytes_to_sample, written in the device layout */
+    size_t bytes_in_buffer = get_bytes_in_buffer(data_type, false);
+    size_t bytes_in_sample = get_bytes_in_sample(data_type);
+    double max_val = (double)get_max_value(data_type);
+    double min_val = (double)get_min_value(data_type);
+    bool is_signed = is_signed_type(data_type);
+    for (size_t i = 0; i < num_samples; i++) {
+        double sample = float_buffer[i];
+        double scaled = (sample > 0 || !is_signed) ? sample * max_val : sample * -min_val;
+        scaled = (scaled > max_val) ? max_val : (scaled < min_val) ? min_val : scaled;
+        int32_t value = (int32_t)lrint(scaled);
+        unsigned char* dst = byte_buffer + i * bytes_in_buffer;
+        for (size_t j = 0; j < bytes_in_sample; j++) dst[j] = (uint8_t)(value >> (j * 8));
+        for (size_t j = bytes_in_sample; j < bytes_in_buffer; j++) dst[j] = 0;
+    }
+}
@@ -1,7 +1,15 @@
 #include "csoundlib.h"
 #include <stdint.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "track.h"
 #include "state.h"
+#include "effects.h"
+
+/* serialises edits of native chains, the audio thread never takes it */
+static pthread_mutex_t _nativeEffectsLock = PTHREAD_MUTEX_INITIALIZER;
 
 int soundlib_register_effect(int trackId, TrackAudioAvailableCallback effect) {
     /* add effect to track */
@@ -20,6 +28,7 @@ int soundlib_register_input_ready_callback(int trackId, TrackAudioAvailableCallb
     trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
     if (track_p == NULL) return CSLErrorTrackNotFound;
     track_p->input_ready_callback = callback;
+    track_p->input_callback_writes = true;
     return SoundIoErrorNone;
 }
 
@@ -41,4 +50,233 @@ int soundlib_register_master_effect(MasterAudioAvailableCallback effect) {
     csoundlib_state->master_effects.master_effect_list[csoundlib_state->master_effects.num_effects] = effect;
     csoundlib_state->master_effects.num_effects += 1;
     return SoundIoErrorNone;
-}
\ No newline at end of file
+}
+
+/* ********************************************* */
+/* effect instances                              */
+/* ********************************************* */
+
+static void _runEffect(void* context, float* samples, int num_frames, int num_channels) {
+    CslEffect* effect = (CslEffect*)context;
+    if (__atomic_exchange_n(&effect->reset_requested, false, __ATOMIC_ACQ_REL) && effect->descriptor.reset) {
+        effect->descriptor.reset(effect->instance);
+    }
+    effect->descriptor.process(effect->instance, samples, num_frames, num_channels);
+}
+
+CslEffect* soundlib_effect_create(const CslEffectDescriptor* descriptor, int sample_rate, void* user) {
+    if (descriptor == NULL || descriptor->process == NULL || sample_rate <= 0) return NULL;
+    if (descriptor->latency < 0 || descriptor->tail < CSL_EFFECT_INFINITE_TAIL) return NULL;
+    CslEffect* effect = calloc(1, sizeof(CslEffect));
+    if (!effect) return NULL;
+    effect->descriptor = *descriptor;
+    if (descriptor->create) {
+        effect->instance = descriptor->create(user, sample_rate);
+        if (!effect->instance) {
+            free(effect);
+            return NULL;
+        }
+    }
+    else {
+        effect->instance = user;
+    }
+    return effect;
+}
+
+void soundlib_effect_destroy(CslEffect* effect) {
+    if (!effect) return;
+    if (effect->descriptor.destroy) effect->descriptor.destroy(effect->instance);
+    free(effect);
+}
+
+void soundlib_effect_reset(CslEffect* effect) {
+    __atomic_store_n(&effect->reset_requested, true, __ATOMIC_RELEASE);
+}
+
+int soundlib_effect_get_latency(const CslEffect* effect) {
+    return effect->descriptor.latency;
+}
+
+int soundlib_effect_get_tail(const CslEffect* effect) {
+    return effect->descriptor.tail;
+}
+
+int soundlib_track_add_effect(int trackId, CslEffect* effect) {
+    if (effect == NULL) return SoundIoErrorInvalid;
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return effects_add_native(&track_p->track_effects.native_effects, _runEffect, effect, &effect->descriptor.tail, effect->descriptor.latency);
+}
+
+int soundlib_track_remove_effect(int trackId, CslEffect* effect) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return effects_remove_native(&track_p->track_effects.native_effects, effect);
+}
+
+int soundlib_master_add_effect(CslEffect* effect) {
+    if (effect == NULL) return SoundIoErrorInvalid;
+    return effects_add_native(&csoundlib_state->master_effects.native_effects, _runEffect, effect, &effect->descriptor.tail, effect->descriptor.latency);
+}
+
+int soundlib_master_remove_effect(CslEffect* effect) {
+    return effects_remove_native(&csoundlib_state->master_effects.native_effects, effect);
+}
+
+int soundlib_bus_add_effect(int busId, CslEffect* effect) {
+    if (effect == NULL) return SoundIoErrorInvalid;
+    busObject* bus = graph_get_bus(busId);
+    if (bus == NULL) return CSLErrorBusNotFound;
+    return effects_add_native(&bus->native_effects, _runEffect, effect, &effect->descriptor.tail, effect->descriptor.latency);
+}
+
+int soundlib_bus_remove_effect(int busId, CslEffect* effect) {
+    busObject* bus = graph_get_bus(busId);
+    if (bus == NULL) return CSLErrorBusNotFound;
+    return effects_remove_native(&bus->native_effects, effect);
+}
+
+/* ********************************************* */
+/* native effects                                */
+/* ********************************************* */
+
+/*
+publishes a new chain and frees the old one. the audio thread marks the chain it is
+running in in_use, the old one stays alive until that moves on.
+*/
+static void _swapChain(nativeEffectSlot* slot, nativeEffectChain* chain) {
+    nativeEffectChain* old = __atomic_exchange_n(&slot->chain, chain, __ATOMIC_SEQ_CST);
+    while (old != NULL && __atomic_load_n(&slot->in_use, __ATOMIC_SEQ_CST) == old) {
+        usleep(500);
+    }
+    free(old);
+}
+
+/* the master bus is after every path, its latency doesn't change how they line up */
+static void _latencyChanged(nativeEffectSlot* slot) {
+    if (slot != &csoundlib_state->master_effects.native_effects) graph_rebuild();
+}
+
+int effects_add_native(nativeEffectSlot* slot, NativeEffectProcess process, void* context, const int* tail, int latency) {
+    pthread_mutex_lock(&_nativeEffectsLock);
+    nativeEffectChain* old = slot->chain;
+    int num_effects = old ? old->num_effects : 0;
+    if (num_effects == MAX_NUM_EFFECTS) {
+        pthread_mutex_unlock(&_nativeEffectsLock);
+        return SoundIoErrorInvalid;
+    }
+    nativeEffectChain* chain = malloc(sizeof(nativeEffectChain));
+    if (!chain) {
+        pthread_mutex_unlock(&_nativeEffectsLock);
+        return SoundIoErrorNoMem;
+    }
+    if (old) memcpy(chain->effects, old->effects, num_effects * sizeof(nativeEffect));
+    chain->effects[num_effects].process = process;
+    chain->effects[num_effects].context = context;
+    chain->effects[num_effects].tail = tail;
+    chain->effects[num_effects].latency = latency;
+    chain->num_effects = num_effects + 1;
+    chain->latency = (old ? old->latency : 0) + latency;
+    _swapChain(slot, chain);
+    pthread_mutex_unlock(&_nativeEffectsLock);
+    if (latency != 0) _latencyChanged(slot);
+    return SoundIoErrorNone;
+}
+
+int effects_remove_native(nativeEffectSlot* slot, void* context) {
+    pthread_mutex_lock(&_nativeEffectsLock);
+    nativeEffectChain* old = slot->chain;
+    if (!old) {
+        pthread_mutex_unlock(&_nativeEffectsLock);
+        return SoundIoErrorInvalid;
+    }
+    nativeEffectChain* chain = malloc(sizeof(nativeEffectChain));
+    if (!chain) {
+        pthread_mutex_unlock(&_nativeEffectsLock);
+        return SoundIoErrorNoMem;
+    }
+    chain->num_effects = 0;
+    chain->latency = 0;
+    for (int i = 0; i < old->num_effects; i++) {
+        if (old->effects[i].context == context) continue;
+        chain->effects[chain->num_effects++] = old->effects[i];
+        chain->latency += old->effects[i].latency;
+    }
+    int removed_latency = old->latency - chain->latency;
+    if (chain->num_effects == old->num_effects) {
+        free(chain);
+        pthread_mutex_unlock(&_nativeEffectsLock);
+        return SoundIoErrorInvalid;
+    }
+    if (chain->num_effects == 0) {
+        free(chain);
+        chain = NULL;
+    }
+    _swapChain(slot, chain);
+    pthread_mutex_unlock(&_nativeEffectsLock);
+    if (removed_latency != 0) _latencyChanged(slot);
+    return SoundIoErrorNone;
+}
+
+void effects_clear_native(nativeEffectSlot* slot) {
+    pthread_mutex_lock(&_nativeEffectsLock);
+    _swapChain(slot, NULL);
+    pthread_mutex_unlock(&_nativeEffectsLock);
+}
+
+int effects_native_latency(nativeEffectSlot* slot) {
+    pthread_mutex_lock(&_nativeEffectsLock);
+    int latency = slot->chain ? slot->chain->latency : 0;
+    pthread_mutex_unlock(&_nativeEffectsLock);
+    return latency;
+}
+
+/* publishes the chain we are about to use, then checks it was not swapped out in between */
+static nativeEffectChain* _pinChain(nativeEffectSlot* slot) {
+    nativeEffectChain* chain;
+    do {
+        chain = __atomic_load_n(&slot->chain, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&slot->in_use, chain, __ATOMIC_SEQ_CST);
+    } while (chain != __atomic_load_n(&slot->chain, __ATOMIC_SEQ_CST));
+    return chain;
+}
+
+void effects_run_native(nativeEffectSlot* slot, unsigned char* bytes, size_t num_bytes, CslDataType data_type, int num_channels) {
+    nativeEffectChain* chain = _pinChain(slot);
+
+    if (chain != NULL && num_channels >= 1 && num_channels <= EFFECTS_MAX_CHANNELS) {
+        size_t bytes_in_buffer = get_bytes_in_buffer(data_type, false);
+        size_t chunk_samples = (size_t)EFFECTS_CHUNK_FRAMES * num_channels;
+        size_t chunk_bytes = chunk_samples * bytes_in_buffer;
+        for (size_t offset = 0; offset < num_bytes; offset += chunk_bytes) {
+            size_t n = (num_bytes - offset < chunk_bytes) ? num_bytes - offset : chunk_bytes;
+            int num_samples = byte_buffer_to_float_buffer(bytes + offset, chain->samples, n, chunk_samples, data_type, false);
+            int num_frames = num_samples / num_channels;
+            for (int i = 0; i < chain->num_effects; i++) {
+                chain->effects[i].process(chain->effects[i].context, chain->samples, num_frames, num_channels);
+            }
+            float_buffer_to_byte_buffer(chain->samples, bytes + offset, (size_t)num_frames * num_channels, data_type);
+        }
+    }
+    __atomic_store_n(&slot->in_use, NULL, __ATOMIC_SEQ_CST);
+}
+
+int effects_native_tail(nativeEffectSlot* slot) {
+    nativeEffectChain* chain = _pinChain(slot);
+    /* each effect rings on what the one before it left ringing, and gives it out latency frames late */
+    int64_t total = 0;
+    for (int i = 0; chain != NULL && i < chain->num_effects; i++) {
+        int tail = (chain->effects[i].tail != NULL) ? __atomic_load_n(chain->effects[i].tail, __ATOMIC_RELAXED) : 0;
+        if (tail < 0) {
+            total = CSL_EFFECT_INFINITE_TAIL;
+            break;
+        }
+        total += (int64_t)tail + chain->effects[i].latency;
+    }
+    __atomic_store_n(&slot->in_use, NULL, __ATOMIC_SEQ_CST);
+    return (total > INT32_MAX) ? CSL_EFFECT_INFINITE_TAIL : (int)total;
+}
@@ -0,0 +1,382 @@
+#include "fft_float.h"
+#include "csl_simd.h"
+#include <math.h>
+#include <stdlib.h>
+
+static bool _isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+bool fft_float_supports(int length, bool real) {
+    if (!_isPowerOfTwo(length)) return false;
+    return length >= (real ? FFT_FLOAT_MIN_REAL : FFT_FLOAT_MIN_COMPLEX);
+}
+
+fftFloatTables* fft_float_tables_create(int length, bool real) {
+    if (!fft_float_supports(length, real)) return NULL;
+    fftFloatTables* t = calloc(1, sizeof(fftFloatTables));
+    if (!t) return NULL;
+    t->length = length;
+    t->real = real;
+    t->complex_length = real ? length / 2 : length;
+
+    int n = t->complex_length;
+    size_t num_twiddles = 0;
+    for (int m = n; m >= 4; m /= 4) {
+        t->num_stages++;
+        num_twiddles += 3 * (size_t)(m / 4);
+    }
+    t->stages = calloc(t->num_stages + 1, sizeof(fftFloatStage));
+    t->twiddles = malloc((2 * num_twiddles + 1) * sizeof(float));
+    if (real) t->real_twiddles = malloc((size_t)(n + 1) * 2 * sizeof(float));
+    if (!t->stages || !t->twiddles || (real && !t->real_twiddles)) {
+        fft_float_tables_destroy(t);
+        return NULL;
+    }
+
+    /* every twiddle straight from sin and cos in double, powers of w1 would drift in float */
+    float* twiddles = t->twiddles;
+    int m = n;
+    for (int s = 0; s < t->num_stages; s++, m /= 4) {
+        fftFloatStage* stage = &t->stages[s];
+        int quarter = m / 4;
+        stage->length = m;
+        stage->w_re = twiddles;
+        stage->w_im = twiddles + 3 * quarter;
+        twiddles += 6 * quarter;
+        for (int k = 1; k <= 3; k++) {
+            for (int p = 0; p < quarter; p++) {
+                double angle = -2.0 * M_PI * (double)(k * p) / (double)m;
+                stage->w_re[(k - 1) * quarter + p] = (float)cos(angle);
+                stage->w_im[(k - 1) * quarter + p] = (float)sin(angle);
+            }
+        }
+    }
+    if (real) {
+        for (int k = 0; k <= n; k++) {
+            double angle = -2.0 * M_PI * (double)k / (double)length;
+            t->real_twiddles[k] = (float)cos(angle);
+            t->real_twiddles[n + 1 + k] = (float)sin(angle);
+        }
+    }
+    return t;
+}
+
+void fft_float_tables_destroy(fftFloatTables* tables) {
+    if (!tables) return;
+    free(tables->twiddles);
+    free(tables->stages);
+    free(tables->real_twiddles);
+    free(tables);
+}
+
+size_t fft_float_work_size(const fftFloatTables* tables) {
+    return 4 * (size_t)tables->complex_length;
+}
+
+/* four complex points, split */
+typedef struct _fftVec {
+    cslVec4 re;
+    cslVec4 im;
+} fftVec;
+
+static inline fftVec _load(const float* re, const float* im) {
+    fftVec v = {csl_vec4_load(re), csl_vec4_load(im)};
+    return v;
+}
+
+static inline void _store(float* re, float* im, fftVec v) {
+    csl_vec4_store(re, v.re);
+    csl_vec4_store(im, v.im);
+}
+
+static inline fftVec _cmul(fftVec a, cslVec4 wr, cslVec4 wi) {
+    fftVec r = {csl_vec4_msub(csl_vec4_mul(a.re, wr), a.im, wi), csl_vec4_madd(csl_vec4_mul(a.re, wi), a.im, wr)};
+    return r;
+}
+
+/*
+one radix 4 butterfly: a b c d are the points a quarter transform apart, outputs are
+    y0 = (a + c) + (b + d)
+    y1 = w1 ((a - c) - i (b - d))
+    y2 = w2 ((a + c) - (b + d))
+    y3 = w3 ((a - c) + i (b - d))
+w holds w1 w2 w3 as (real, imag)
+*/
+static inline void _butterfly4(fftVec a, fftVec b, fftVec c, fftVec d, const cslVec4 w[6], fftVec y[4]) {
+    fftVec apc = {csl_vec4_add(a.re, c.re), csl_vec4_add(a.im, c.im)};
+    fftVec amc = {csl_vec4_sub(a.re, c.re), csl_vec4_sub(a.im, c.im)};
+    fftVec bpd = {csl_vec4_add(b.re, d.re), csl_vec4_add(b.im, d.im)};
+    fftVec bmd = {csl_vec4_sub(b.re, d.re), csl_vec4_sub(b.im, d.im)};
+    fftVec t1 = {csl_vec4_add(amc.re, bmd.im), csl_vec4_sub(amc.im, bmd.re)};
+    fftVec t2 = {csl_vec4_sub(apc.re, bpd.re), csl_vec4_sub(apc.im, bpd.im)};
+    fftVec t3 = {csl_vec4_sub(amc.re, bmd.im), csl_vec4_add(amc.im, bmd.re)};
+    y[0].re = csl_vec4_add(apc.re, bpd.re);
+    y[0].im = csl_vec4_add(apc.im, bpd.im);
+    y[1] = _cmul(t1, w[0], w[1]);
+    y[2] = _cmul(t2, w[2], w[3]);
+    y[3] = _cmul(t3, w[4], w[5]);
+}
+
+static void _radix4Scalar(const fftFloatStage* stage, int stride,
+                          const float* xr, const float* xi, float* yr, float* yi) {
+    int quarter = stage->length / 4;
+    int step = stride * quarter;
+    for (int p = 0; p < quarter; p++) {
+        float w1r = stage->w_re[p], w1i = stage->w_im[p];
+        float w2r = stage->w_re[quarter + p], w2i = stage->w_im[quarter + p];
+        float w3r = stage->w_re[2 * quarter + p], w3i = stage->w_im[2 * quarter + p];
+        for (int q = 0; q < stride; q++) {
+            int in = q + stride * p;
+            float ar = xr[in], ai = xi[in];
+            float br = xr[in + step], bi = xi[in + step];
+            float cr = xr[in + 2 * step], ci = xi[in + 2 * step];
+            float dr = xr[in + 3 * step], di = xi[in + 3 * step];
+            float apc_r = ar + cr, apc_i = ai + ci, amc_r = ar - cr, amc_i = ai - ci;
+            float bpd_r = br + dr, bpd_i = bi + di, bmd_r = br - dr, bmd_i = bi - di;
+            float t1r = amc_r + bmd_i, t1i = amc_i - bmd_r;
+            float t2r = apc_r - bpd_r, t2i = apc_i - bpd_i;
+            float t3r = amc_r - bmd_i, t3i = amc_i + bmd_r;
+            int out = q + stride * 4 * p;
+            yr[out] = apc_r + bpd_r;
+            yi[out] = apc_i + bpd_i;
+            yr[out + stride] = t1r * w1r - t1i * w1i;
+            yi[out + stride] = t1r * w1i + t1i * w1r;
+            yr[out + 2 * stride] = t2r * w2r - t2i * w2i;
+            yi[out + 2 * stride] = t2r * w2i + t2i * w2r;
+            yr[out + 3 * stride] = t3r * w3r - t3i * w3i;
+            yi[out + 3 * stride] = t3r * w3i + t3i * w3r;
+        }
+    }
+}
+
+/* first pass, stride 1: four neighbouring p at a time, the outputs go out through a transpose */
+static void _radix4First(const fftFloatStage* stage, const float* xr, const float* xi, float* yr, float* yi) {
+    int quarter = stage->length / 4;
+    const float* wr = stage->w_re;
+    const float* wi = stage->w_im;
+    for (int p = 0; p < quarter; p += 4) {
+        cslVec4 w[6] = {
+            csl_vec4_load(wr + p), csl_vec4_load(wi + p),
+            csl_vec4_load(wr + quarter + p), csl_vec4_load(wi + quarter + p),
+            csl_vec4_load(wr + 2 * quarter + p), csl_vec4_load(wi + 2 * quarter + p),
+        };
+        fftVec y[4];
+        _butterfly4(_load(xr + p, xi + p),
+                    _load(xr + quarter + p, xi + quarter + p),
+                    _load(xr + 2 * quarter + p, xi + 2 * quarter + p),
+                    _load(xr + 3 * quarter + p, xi + 3 * quarter + p), w, y);
+        csl_vec4_transpose(&y[0].re, &y[1].re, &y[2].re, &y[3].re);
+        csl_vec4_transpose(&y[0].im, &y[1].im, &y[2].im, &y[3].im);
+        _store(yr + 4 * p, yi + 4 * p, y[0]);
+        _store(yr + 4 * p + 4, yi + 4 * p + 4, y[1]);
+        _store(yr + 4 * p + 8, yi + 4 * p + 8, y[2]);
+        _store(yr + 4 * p + 12, yi + 4 * p + 12, y[3]);
+    }
+}
+
+/* later passes, stride of 4 or more: four neighbouring q at a time under one set of twiddles */
+static void _radix4Strided(const fftFloatStage* stage, int stride,
+                           const float* xr, const float* xi, float* yr, float* yi) {
+    int quarter = stage->length / 4;
+    int step = stride * quarter;
+    for (int p = 0; p < quarter; p++) {
+        cslVec4 w[6] = {
+            csl_vec4_set1(stage->w_re[p]), csl_vec4_set1(stage->w_im[p]),
+            csl_vec4_set1(stage->w_re[quarter + p]), csl_vec4_set1(stage->w_im[quarter + p]),
+            csl_vec4_set1(stage->w_re[2 * quarter + p]), csl_vec4_set1(stage->w_im[2 * quarter + p]),
+        };
+        const float* sr = xr + stride * p;
+        const float* si = xi + stride * p;
+        float* dr = yr + stride * 4 * p;
+        float* di = yi + stride * 4 * p;
+        for (int q = 0; q < stride; q += 4) {
+            fftVec y[4];
+            _butterfly4(_load(sr + q, si + q),
+                        _load(sr + step + q, si + step + q),
+                        _load(sr + 2 * step + q, si + 2 * step + q),
+                        _load(sr + 3 * step + q, si + 3 * step + q), w, y);
+            _store(dr + q, di + q, y[0]);
+            _store(dr + stride + q, di + stride + q, y[1]);
+            _store(dr + 2 * stride + q, di + 2 * stride + q, y[2]);
+            _store(dr + 3 * stride + q, di + 3 * stride + q, y[3]);
+        }
+    }
+}
+
+/* the last pass for odd powers of two, sub transforms of 2 points */
+static void _radix2Last(int stride, const float* xr, const float* xi, float* yr, float* yi) {
+    int q = 0;
+    for (; q + 4 <= stride; q += 4) {
+        fftVec a = _load(xr + q, xi + q);
+        fftVec b = _load(xr + stride + q, xi + stride + q);
+        csl_vec4_store(yr + q, csl_vec4_add(a.re, b.re));
+        csl_vec4_store(yi + q, csl_vec4_add(a.im, b.im));
+        csl_vec4_store(yr + stride + q, csl_vec4_sub(a.re, b.re));
+        csl_vec4_store(yi + stride + q, csl_vec4_sub(a.im, b.im));
+    }
+    for (; q < stride; q++) {
+        float ar = xr[q], ai = xi[q], br = xr[stride + q], bi = xi[stride + q];
+        yr[q] = ar + br;
+        yi[q] = ai + bi;
+        yr[stride + q] = ar - br;
+        yi[stride + q] = ai - bi;
+    }
+}
+
+/*
+forward complex transform of the split data in work[0, 2n), work[2n, 4n) is scratch.
+returns where the result ended up, reals followed by n imaginaries.
+*/
+static float* _transform(const fftFloatTables* t, float* work) {
+    int n = t->complex_length;
+    float *xr = work, *xi = work + n, *yr = work + 2 * n, *yi = work + 3 * n;
+    int stride = 1;
+    for (int s = 0; s < t->num_stages; s++) {
+        const fftFloatStage* stage = &t->stages[s];
+        if (stride >= 4) {
+            _radix4Strided(stage, stride, xr, xi, yr, yi);
+        } else if (stage->length >= 16) {
+            _radix4First(stage, xr, xi, yr, yi);
+        } else {
+            _radix4Scalar(stage, stride, xr, xi, yr, yi);
+        }
+        float* tr = xr; xr = yr; yr = tr;
+        float* ti = xi; xi = yi; yi = ti;
+        stride *= 4;
+    }
+    if (stride < n) {
+        _radix2Last(stride, xr, xi, yr, yi);
+        xr = yr;
+    }
+    return xr;
+}
+
+/* (a[j], b[j]) pairs of input into a and b */
+static void _split(const float* input, float* a, float* b, int n) {
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        cslVec4 even, odd;
+        csl_vec4_load_deinterleave(input + 2 * j, &even, &odd);
+        csl_vec4_store(a + j, even);
+        csl_vec4_store(b + j, odd);
+    }
+    for (; j < n; j++) {
+        a[j] = input[2 * j];
+        b[j] = input[2 * j + 1];
+    }
+}
+
+/* the other way around, scaled by fct */
+static void _join(const float* a, const float* b, float* output, int n, float fct) {
+    cslVec4 f = csl_vec4_set1(fct);
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        csl_vec4_store_interleave(output + 2 * j, csl_vec4_mul(csl_vec4_load(a + j), f),
+                                  csl_vec4_mul(csl_vec4_load(b + j), f));
+    }
+    for (; j < n; j++) {
+        output[2 * j] = a[j] * fct;
+        output[2 * j + 1] = b[j] * fct;
+    }
+}
+
+/*
+z = even + i odd, so with Z1 = Z[k] and Z2 = Z[n - k]:
+    E = (Z1 + conj(Z2)) / 2, O = (Z1 - conj(Z2)) / 2, X[k] = E - i w^k O
+*/
+static inline void _realForwardPoint(const fftFloatTables* t, const float* re, const float* im, int k, float* out, float fct) {
+    int n = t->complex_length;
+    int k1 = (k == n) ? 0 : k;
+    int k2 = (k == 0) ? 0 : n - k;
+    float er = 0.5f * (re[k1] + re[k2]), ei = 0.5f * (im[k1] - im[k2]);
+    float o_r = 0.5f * (re[k1] - re[k2]), o_i = 0.5f * (im[k1] + im[k2]);
+    float wr = t->real_twiddles[k], wi = t->real_twiddles[n + 1 + k];
+    out[0] = (er + wr * o_i + wi * o_r) * fct;
+    out[1] = (ei + wi * o_i - wr * o_r) * fct;
+}
+
+static void _realForwardSplit(const fftFloatTables* t, const float* re, const float* im, float* output, float fct) {
+    int n = t->complex_length;
+    const float* w_re = t->real_twiddles;
+    const float* w_im = t->real_twiddles + n + 1;
+    cslVec4 half = csl_vec4_set1(0.5f);
+    cslVec4 f = csl_vec4_set1(fct);
+    _realForwardPoint(t, re, im, 0, output, fct);
+    int k = 1;
+    for (; k + 4 <= n; k += 4) {
+        /* Z[n - k] for the four k, walking down */
+        cslVec4 z1r = csl_vec4_load(re + k), z1i = csl_vec4_load(im + k);
+        cslVec4 z2r = csl_vec4_reverse(csl_vec4_load(re + n - k - 3));
+        cslVec4 z2i = csl_vec4_reverse(csl_vec4_load(im + n - k - 3));
+        cslVec4 er = csl_vec4_mul(half, csl_vec4_add(z1r, z2r)), ei = csl_vec4_mul(half, csl_vec4_sub(z1i, z2i));
+        cslVec4 o_r = csl_vec4_mul(half, csl_vec4_sub(z1r, z2r)), o_i = csl_vec4_mul(half, csl_vec4_add(z1i, z2i));
+        cslVec4 wr = csl_vec4_load(w_re + k), wi = csl_vec4_load(w_im + k);
+        cslVec4 xr = csl_vec4_madd(csl_vec4_madd(er, wr, o_i), wi, o_r);
+        cslVec4 xi = csl_vec4_msub(csl_vec4_madd(ei, wi, o_i), wr, o_r);
+        csl_vec4_store_interleave(output + 2 * k, csl_vec4_mul(xr, f), csl_vec4_mul(xi, f));
+    }
+    for (; k <= n; k++) _realForwardPoint(t, re, im, k, output + 2 * k, fct);
+}
+
+/*
+the inverse of _realForwardSplit, doubled so the unnormalized transform of n points comes out
+scaled by length like the double path:
+    Z[k] = (X1 + conj(X2)) + i conj(w^k) (X1 - conj(X2)) with X1 = X[k], X2 = X[n - k]
+the imaginary parts of X[0] and X[n] are ignored, same as pocketfft
+*/
+static inline void _realBackwardPoint(const fftFloatTables* t, const float* input, int k, float* re, float* im) {
+    int n = t->complex_length;
+    float x1r = input[2 * k], x1i = (k == 0) ? 0.0f : input[2 * k + 1];
+    float x2r = input[2 * (n - k)], x2i = (k == 0) ? 0.0f : -input[2 * (n - k) + 1];
+    float ar = x1r + x2r, ai = x1i + x2i;
+    float br = x1r - x2r, bi = x1i - x2i;
+    float wr = t->real_twiddles[k], wi = t->real_twiddles[n + 1 + k];
+    re[k] = ar - wr * bi + wi * br;
+    im[k] = ai + wr * br + wi * bi;
+}
+
+static void _realBackwardJoin(const fftFloatTables* t, const float* input, float* re, float* im) {
+    int n = t->complex_length;
+    const float* w_re = t->real_twiddles;
+    const float* w_im = t->real_twiddles + n + 1;
+    _realBackwardPoint(t, input, 0, re, im);
+    int k = 1;
+    for (; k + 4 <= n; k += 4) {
+        cslVec4 x1r, x1i, x2r, x2i;
+        csl_vec4_load_deinterleave(input + 2 * k, &x1r, &x1i);
+        csl_vec4_load_deinterleave(input + 2 * (n - k - 3), &x2r, &x2i);
+        x2r = csl_vec4_reverse(x2r);
+        x2i = csl_vec4_reverse(x2i);
+        /* x2 is conjugated, so its imaginary part flips sign in both sums */
+        cslVec4 ar = csl_vec4_add(x1r, x2r), ai = csl_vec4_sub(x1i, x2i);
+        cslVec4 br = csl_vec4_sub(x1r, x2r), bi = csl_vec4_add(x1i, x2i);
+        cslVec4 wr = csl_vec4_load(w_re + k), wi = csl_vec4_load(w_im + k);
+        csl_vec4_store(re + k, csl_vec4_madd(csl_vec4_msub(ar, wr, bi), wi, br));
+        csl_vec4_store(im + k, csl_vec4_madd(csl_vec4_madd(ai, wr, br), wi, bi));
+    }
+    for (; k < n; k++) _realBackwardPoint(t, input, k, re, im);
+}
+
+void fft_float_forward(const fftFloatTables* t, const float* input, float* output, float fct, float* work) {
+    int n = t->complex_length;
+    _split(input, work, work + n, n);
+    float* result = _transform(t, work);
+    if (t->real) {
+        _realForwardSplit(t, result, result + n, output, fct);
+    } else {
+        _join(result, result + n, output, n, fct);
+    }
+}
+
+void fft_float_backward(const fftFloatTables* t, const float* input, float* output, float fct, float* work) {
+    int n = t->complex_length;
+    /* swapping real and imaginary on the way in and out turns the forward passes around */
+    if (t->real) {
+        _realBackwardJoin(t, input, work + n, work);
+    } else {
+        _split(input, work + n, work, n);
+    }
+    float* result = _transform(t, work);
+    _join(result + n, result, output, n, fct);
+}
@@ -0,0 +1,1094 @@
+#include "graph.h"
+#include "track.h"
+#include "state.h"
+#include "errors.h"
+#include "csl_util.h"
+#include <soundio/soundio.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/* serialises routing edits and schedule swaps, the audio thread never takes it */
+static pthread_mutex_t _graphLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* workers sharing the nodes of a level with the audio thread */
+typedef struct _graphWorkers {
+    int num_threads; // atomic
+    pthread_t threads[GRAPH_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool quit; // under lock
+    graphNode* nodes; // atomic, the level being processed
+    int count; // atomic
+    int num_channels; // atomic, channels in the track and bus buffers this period
+    size_t offset; // atomic, where the block starts in the period's buffers
+    size_t num_bytes; // atomic, bytes in the block
+    uint64_t claim; // atomic, level generation << 32 | next node to take
+    int running; // atomic, workers that may be holding a node of the schedule in use
+    int sched_policy; // atomic, the audio thread's scheduling, copied by the workers
+    int sched_priority; // atomic, 0 until the audio thread has published it
+} graphWorkers;
+
+static graphWorkers _workers = {
+    .num_threads = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .quit = false,
+    .nodes = NULL,
+    .count = 0,
+    .num_channels = 0,
+    .offset = 0,
+    .num_bytes = 0,
+    .claim = 0,
+    .running = 0,
+    .sched_policy = SCHED_OTHER,
+    .sched_priority = 0
+};
+
+static uint32_t _generation = 0; // atomic, written by the audio thread, the level being processed
+static bool _schedPublished = false; // audio thread
+static bool _workersLate = false; // audio thread, a level outlasted the spin this period
+
+static int _blockFrames = GRAPH_BLOCK_FRAMES; // atomic
+static int64_t _clock = 0; // atomic, written by the audio thread, the frame the next period starts at
+
+/* events on their way to the audio thread, producers take the lock, the audio thread never does */
+typedef struct _graphEventQueue {
+    pthread_mutex_t lock;
+    graphEvent ring[GRAPH_MAX_EVENTS];
+    uint32_t head; // atomic, next to write
+    uint32_t tail; // atomic, next to read
+} graphEventQueue;
+
+static graphEventQueue _events = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .head = 0,
+    .tail = 0
+};
+
+/* audio thread: events taken off the queue, in frame order */
+static graphEvent _pending[GRAPH_MAX_EVENTS];
+static int _numPending = 0;
+
+/* ********************************************* */
+/* processing                                    */
+/* ********************************************* */
+
+/*
+counts the silent frames and says whether the node can be left alone this block. the ring of
+the last sound starts at the latest where this run of silence did, so it is over once the
+block starts tail frames or more after that.
+*/
+static bool _settleIdle(bool input_silent, int64_t* silent_frames, size_t num_bytes, int num_channels, int tail) {
+    if (!input_silent) {
+        *silent_frames = 0;
+        return false;
+    }
+    int64_t num_frames = num_bytes / ((size_t)csoundlib_state->input_dtype.bytes_in_buffer * num_channels);
+    *silent_frames += num_frames;
+    if (tail == CSL_EFFECT_INFINITE_TAIL) return false;
+    return *silent_frames - num_frames >= tail;
+}
+
+/* what the effects leave ringing still has to come out of the compensation delays */
+static int _nodeTail(const graphNode* node) {
+    int effects_tail;
+    if (node->bus != NULL) effects_tail = effects_native_tail(&node->bus->native_effects);
+    else if (node->track->track_effects.num_effects > 0) effects_tail = CSL_EFFECT_INFINITE_TAIL;
+    else effects_tail = effects_native_tail(&node->track->track_effects.native_effects);
+    if (effects_tail == CSL_EFFECT_INFINITE_TAIL) return CSL_EFFECT_INFINITE_TAIL;
+    return effects_tail + node->max_delay;
+}
+
+/* how much of a buffer holding buffer_bytes falls in the block, 0 when it ends before it */
+static size_t _blockBytes(size_t buffer_bytes, size_t offset, size_t num_bytes) {
+    if (buffer_bytes <= offset) return 0;
+    return (buffer_bytes - offset < num_bytes) ? buffer_bytes - offset : num_bytes;
+}
+
+static void _processNode(graphNode* node, int num_channels, size_t offset, size_t num_bytes) {
+    CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    if (node->bus != NULL) {
+        busObject* bus = node->bus;
+        size_t n = _blockBytes(bus->write_bytes, offset, num_bytes);
+        bus->idle = _settleIdle(bus->input_silent, &bus->silent_frames, n, num_channels, node->tail);
+        if (bus->idle || n == 0) return;
+        effects_run_native(&bus->native_effects, bus->buffer + offset, n, dtype, num_channels);
+        return;
+    }
+    trackObject* track_p = node->track;
+    size_t n = _blockBytes(track_p->input_buffer.write_bytes, offset, num_bytes);
+    track_p->idle = _settleIdle(track_p->input_silent, &track_p->silent_frames, n, num_channels, node->tail);
+    if (track_p->idle || n == 0) return;
+    unsigned char* samples = track_p->input_buffer.buffer + offset;
+    for (int i = 0; i < track_p->track_effects.num_effects; i++) {
+        track_p->track_effects.track_effect_list[i](
+            track_p->track_id,
+            samples,
+            n,
+            dtype,
+            csoundlib_state->sample_rate,
+            csoundlib_state->num_input_channels
+        );
+    }
+    effects_run_native(&track_p->track_effects.native_effects, samples, n, dtype, num_channels);
+}
+
+/*
+takes the node for a level. false when someone else has, or when a worker that missed an
+earlier level's deadline is still in it, then the node sits this block out. a stale worker
+whose level is long gone finds the node started for a newer one and leaves it.
+*/
+static bool _startNode(graphNode* node, uint32_t generation) {
+    uint32_t started = __atomic_load_n(&node->started, __ATOMIC_ACQUIRE);
+    if ((int32_t)(generation - started) <= 0) return false;
+    if (__atomic_load_n(&node->finished, __ATOMIC_ACQUIRE) != started) return false;
+    return __atomic_compare_exchange_n(&node->started, &started, generation, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void _runNode(graphNode* node, uint32_t generation, int num_channels, size_t offset, size_t num_bytes) {
+    if (!_startNode(node, generation)) return;
+    _processNode(node, num_channels, offset, num_bytes);
+    __atomic_store_n(&node->finished, generation, __ATOMIC_RELEASE);
+}
+
+/* the node was run for the level just processed, so its block can be mixed */
+static bool _nodeReady(graphNode* node) {
+    return __atomic_load_n(&node->finished, __ATOMIC_ACQUIRE) == _generation;
+}
+
+/*
+takes nodes off the current level until there are none left. the generation in claim means
+a compare and swap only succeeds for the level nodes and count were read for.
+*/
+static void _work(void) {
+    for (;;) {
+        uint64_t claim = __atomic_load_n(&_workers.claim, __ATOMIC_ACQUIRE);
+        graphNode* nodes = __atomic_load_n(&_workers.nodes, __ATOMIC_RELAXED);
+        int count = __atomic_load_n(&_workers.count, __ATOMIC_RELAXED);
+        int num_channels = __atomic_load_n(&_workers.num_channels, __ATOMIC_RELAXED);
+        size_t offset = __atomic_load_n(&_workers.offset, __ATOMIC_RELAXED);
+        size_t num_bytes = __atomic_load_n(&_workers.num_bytes, __ATOMIC_RELAXED);
+        uint32_t index = (uint32_t)(claim & 0xffffffff);
+        if (index >= (uint32_t)count) return;
+        if (!__atomic_compare_exchange_n(&_workers.claim, &claim, claim + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) continue;
+        _runNode(&nodes[index], (uint32_t)(claim >> 32), num_channels, offset, num_bytes);
+    }
+}
+
+/*
+runs the calling worker at the audio thread's priority once it is known, so the audio thread
+isn't left waiting on a node a normal priority thread was preempted in. without the privilege
+for it the worker stays where it is.
+*/
+static void _matchAudioThread(int* priority) {
+    int wanted = __atomic_load_n(&_workers.sched_priority, __ATOMIC_ACQUIRE);
+    if (wanted == *priority) return;
+    *priority = wanted;
+    struct sched_param param = {.sched_priority = wanted};
+    pthread_setschedparam(pthread_self(), __atomic_load_n(&_workers.sched_policy, __ATOMIC_RELAXED), &param);
+}
+
+static void* _workerThread(void* arg) {
+    (void)arg;
+    int priority = 0;
+    uint32_t seen = (uint32_t)(__atomic_load_n(&_workers.claim, __ATOMIC_ACQUIRE) >> 32);
+    pthread_mutex_lock(&_workers.lock);
+    for (;;) {
+        while (!_workers.quit && (uint32_t)(__atomic_load_n(&_workers.claim, __ATOMIC_ACQUIRE) >> 32) == seen) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += GRAPH_WORKER_POLL_NS;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&_workers.wake, &_workers.lock, &deadline);
+        }
+        if (_workers.quit) break;
+        seen = (uint32_t)(__atomic_load_n(&_workers.claim, __ATOMIC_ACQUIRE) >> 32);
+        pthread_mutex_unlock(&_workers.lock);
+        _matchAudioThread(&priority);
+        __atomic_add_fetch(&_workers.running, 1, __ATOMIC_SEQ_CST);
+        _work();
+        __atomic_sub_fetch(&_workers.running, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&_workers.lock);
+    }
+    pthread_mutex_unlock(&_workers.lock);
+    return NULL;
+}
+
+static inline void _cpuRelax(void) {
+#if defined(__SSE2__) || defined(_M_X64)
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* hands the audio thread's real time priority to the workers, once */
+static void _publishSched(void) {
+    _schedPublished = true;
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) return;
+    if ((policy != SCHED_FIFO && policy != SCHED_RR) || param.sched_priority <= 0) return;
+    __atomic_store_n(&_workers.sched_policy, policy, __ATOMIC_RELAXED);
+    __atomic_store_n(&_workers.sched_priority, param.sched_priority, __ATOMIC_RELEASE);
+}
+
+static int64_t _nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* no node of the level is still running for this generation, the ones still busy from an earlier one sit it out */
+static bool _levelDone(graphNode* nodes, int count) {
+    for (int i = 0; i < count; i++) {
+        if (__atomic_load_n(&nodes[i].started, __ATOMIC_ACQUIRE) == _generation && !_nodeReady(&nodes[i])) return false;
+    }
+    return true;
+}
+
+/*
+the audio thread takes every node the workers haven't claimed, then every one they claimed
+but haven't started. what is left is in the middle of its effects on a worker, and effects
+keep state so it can't be run twice. the audio thread spins for a while, then sleeps in short
+steps until GRAPH_WAIT_DEADLINE_NS. a node still running then is left out of the mix for the
+block, and for every block until its worker is done. a level that outlasts the spin means the
+workers can't keep up, so the rest of the period runs on the audio thread alone.
+*/
+static void _processLevel(graphNode* nodes, int count, int num_channels, size_t offset, size_t num_bytes) {
+    __atomic_store_n(&_generation, _generation + 1, __ATOMIC_RELAXED);
+    if (count < 2 || _workersLate || __atomic_load_n(&_workers.num_threads, __ATOMIC_ACQUIRE) == 0) {
+        for (int i = 0; i < count; i++) _runNode(&nodes[i], _generation, num_channels, offset, num_bytes);
+        return;
+    }
+    if (!_schedPublished) _publishSched();
+    __atomic_store_n(&_workers.nodes, nodes, __ATOMIC_RELAXED);
+    __atomic_store_n(&_workers.count, count, __ATOMIC_RELAXED);
+    __atomic_store_n(&_workers.num_channels, num_channels, __ATOMIC_RELAXED);
+    __atomic_store_n(&_workers.offset, offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&_workers.num_bytes, num_bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&_workers.claim, (uint64_t)_generation << 32, __ATOMIC_RELEASE);
+    /* never block the audio thread on the lock, a missed signal costs a poll period */
+    if (pthread_mutex_trylock(&_workers.lock) == 0) {
+        pthread_cond_broadcast(&_workers.wake);
+        pthread_mutex_unlock(&_workers.lock);
+    }
+    _work();
+    for (int i = 0; i < count; i++) _runNode(&nodes[i], _generation, num_channels, offset, num_bytes);
+    for (int spins = 0; spins < GRAPH_SPIN_LIMIT; spins++) {
+        if (_levelDone(nodes, count)) return;
+        _cpuRelax();
+    }
+    _workersLate = true;
+    int64_t deadline = _nanoseconds() + GRAPH_WAIT_DEADLINE_NS;
+    while (!_levelDone(nodes, count) && _nanoseconds() < deadline) {
+        struct timespec pause = {.tv_sec = 0, .tv_nsec = GRAPH_WAIT_SLEEP_NS};
+        nanosleep(&pause, NULL);
+    }
+}
+
+/*
+adds source into destination through a compensation delay. the ring is exactly the delay long,
+so each stretch of it gives out what is due and takes the new samples in their place.
+*/
+static void _mixDelayed(const unsigned char* source, unsigned char* destination, size_t num_bytes,
+                        graphOutput* output, float gain, int num_channels) {
+    size_t bytes_in_buffer = csoundlib_state->input_dtype.bytes_in_buffer;
+    size_t ring_bytes = (size_t)output->delay_frames * num_channels * bytes_in_buffer;
+    if (output->delay_bytes != ring_bytes) {
+        memset(output->delay_line, 0, ring_bytes);
+        output->delay_bytes = ring_bytes;
+        output->delay_pos = 0;
+    }
+    for (size_t done = 0; done < num_bytes;) {
+        size_t n = ring_bytes - output->delay_pos;
+        if (n > num_bytes - done) n = num_bytes - done;
+        accumulate_audio(output->delay_line + output->delay_pos, destination + done, gain, n / bytes_in_buffer);
+        memcpy(output->delay_line + output->delay_pos, source + done, n);
+        output->delay_pos += n;
+        if (output->delay_pos == ring_bytes) output->delay_pos = 0;
+        done += n;
+    }
+}
+
+/* adds source, the block at offset, into the destination's block */
+static void _mixInto(const unsigned char* source, size_t offset, size_t num_bytes, graphOutput* output, float gain, int num_channels) {
+    unsigned char* destination;
+    size_t* destination_len;
+    if (output->bus != NULL) {
+        destination = output->bus->buffer + offset;
+        destination_len = &output->bus->write_bytes;
+        output->bus->input_silent = false;
+    }
+    else {
+        destination = csoundlib_state->mixed_output_buffer + offset;
+        destination_len = &csoundlib_state->mixed_output_buffer_len;
+    }
+    if (output->delay_line != NULL && num_channels <= EFFECTS_MAX_CHANNELS) {
+        _mixDelayed(source, destination, num_bytes, output, gain, num_channels);
+    }
+    else {
+        accumulate_audio(source, destination, gain, num_bytes / csoundlib_state->input_dtype.bytes_in_buffer);
+    }
+    if (*destination_len < offset + num_bytes) *destination_len = offset + num_bytes;
+}
+
+/* a muted node's delays would hold what it gave out before, start them again silent */
+static void _dropDelays(graphNode* node) {
+    for (int i = 0; i < node->num_outputs; i++) node->outputs[i].delay_bytes = 0;
+}
+
+/* whether a node sounding this period reaches its outputs */
+static bool _nodeMuted(const graphNode* node) {
+    if (node->bus != NULL) return node->bus->mute_enabled;
+    const trackObject* track_p = node->track;
+    return track_p->mute_enabled || (csoundlib_state->solo_engaged && !track_p->solo_enabled);
+}
+
+/* adds the block of a processed node into its output and sends, scaled by its volume */
+static void _mixNode(graphNode* node, int num_channels, size_t offset, size_t num_bytes) {
+    const unsigned char* source;
+    size_t buffer_bytes;
+    float volume;
+    bool idle;
+    if (node->bus != NULL) {
+        source = node->bus->buffer;
+        buffer_bytes = node->bus->write_bytes;
+        volume = node->bus->volume;
+        idle = node->bus->idle;
+    }
+    else {
+        source = node->track->input_buffer.buffer;
+        buffer_bytes = node->track->input_buffer.write_bytes;
+        volume = node->track->volume;
+        idle = node->track->idle;
+    }
+    if (idle) return;
+    if (_nodeMuted(node)) {
+        _dropDelays(node);
+        return;
+    }
+    size_t n = _blockBytes(buffer_bytes, offset, num_bytes);
+    if (n == 0) return;
+    for (int i = 0; i < node->num_outputs; i++) {
+        graphOutput* output = &node->outputs[i];
+        _mixInto(source + offset, offset, n, output, output->pre_fader ? output->level : output->level * volume, num_channels);
+    }
+}
+
+/* the master effects and volume on a block, after everything in it has been mixed */
+static void _processMaster(int num_channels, size_t offset, size_t num_bytes) {
+    size_t n = _blockBytes(csoundlib_state->mixed_output_buffer_len, offset, num_bytes);
+    if (n == 0) return;
+    unsigned char* samples = csoundlib_state->mixed_output_buffer + offset;
+    for (int i = 0; i < csoundlib_state->master_effects.num_effects; i++) {
+        csoundlib_state->master_effects.master_effect_list[i](
+            samples,
+            n,
+            csoundlib_state->input_dtype.dtype,
+            csoundlib_state->sample_rate,
+            csoundlib_state->num_input_channels
+        );
+    }
+    effects_run_native(&csoundlib_state->master_effects.native_effects, samples, n,
+                       csoundlib_state->input_dtype.dtype, num_channels);
+    /* note: THIS IS WHERE MASTER VOLUME SCALING HAPPENS */
+    add_and_scale_audio(samples, samples, csoundlib_state->master_volume, n / csoundlib_state->input_dtype.bytes_in_buffer);
+}
+
+/* once every block is done: meters and output ready callbacks get the whole period */
+static void _finishPeriod(graphSchedule* schedule, bool mix) {
+    for (int i = 0; i < schedule->num_nodes; i++) {
+        graphNode* node = &schedule->nodes[i];
+        if (node->bus != NULL) {
+            busObject* bus = node->bus;
+            if (!mix) continue;
+            if (bus->idle) bus->output_rms_level = 0.0f;
+            else if (!bus->mute_enabled) bus->output_rms_level = calculate_rms_level(bus->buffer, bus->write_bytes) * bus->volume;
+            continue;
+        }
+        trackObject* track_p = node->track;
+        if (mix && track_p->idle) {
+            track_p->current_rms_levels.output_rms_level = 0.0f;
+        }
+        else if (mix && !_nodeMuted(node)) {
+            track_p->current_rms_levels.output_rms_level =
+                    calculate_rms_level(track_p->input_buffer.buffer, track_p->input_buffer.write_bytes) * track_p->volume;
+        }
+        /* give user the effected track output buffer */
+        track_p->output_ready_callback(
+            track_p->track_id,
+            track_p->input_buffer.buffer,
+            track_p->input_buffer.write_bytes,
+            csoundlib_state->input_dtype.dtype,
+            csoundlib_state->sample_rate,
+            csoundlib_state->num_input_channels
+        );
+    }
+}
+
+/* ********************************************* */
+/* events                                        */
+/* ********************************************* */
+
+/* audio thread: moves queued events into the pending list, keeping it in frame order */
+static void _takeEvents(void) {
+    uint32_t tail = __atomic_load_n(&_events.tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&_events.head, __ATOMIC_ACQUIRE);
+    while (tail != head && _numPending < GRAPH_MAX_EVENTS) {
+        const graphEvent* event = &_events.ring[tail % GRAPH_MAX_EVENTS];
+        /* after any already pending for the same frame, so they happen in the order they were sent */
+        int at = _numPending;
+        while (at > 0 && _pending[at - 1].frame > event->frame) {
+            _pending[at] = _pending[at - 1];
+            at--;
+        }
+        _pending[at] = *event;
+        _numPending++;
+        tail++;
+    }
+    __atomic_store_n(&_events.tail, tail, __ATOMIC_RELEASE);
+}
+
+/*
+the node an event is for, found in the schedule the audio thread is running. whatever is in it
+is kept alive until the audio thread lets go of it, the hash tables aren't safe to read here.
+a track or bus deleted since the event was sent isn't in it, so the event is dropped.
+*/
+static graphNode* _eventNode(graphSchedule* schedule, const graphEvent* event) {
+    if (schedule == NULL) return NULL;
+    bool for_track = (event->type == CSL_EVENT_TRACK_VOLUME || event->type == CSL_EVENT_TRACK_MUTE);
+    for (int i = 0; i < schedule->num_nodes; i++) {
+        graphNode* node = &schedule->nodes[i];
+        if (for_track && node->track != NULL && node->track->track_id == event->id) return node;
+        if (!for_track && node->bus != NULL && node->bus->bus_id == event->id) return node;
+    }
+    return NULL;
+}
+
+static void _applyEvent(graphSchedule* schedule, const graphEvent* event) {
+    switch (event->type) {
+        case CSL_EVENT_TRACK_VOLUME:
+        case CSL_EVENT_TRACK_MUTE: {
+            graphNode* node = _eventNode(schedule, event);
+            if (node == NULL) return;
+            if (event->type == CSL_EVENT_TRACK_VOLUME) node->track->volume = event->value;
+            else node->track->mute_enabled = (event->value != 0.0f);
+            return;
+        }
+        case CSL_EVENT_BUS_VOLUME:
+        case CSL_EVENT_BUS_MUTE: {
+            graphNode* node = _eventNode(schedule, event);
+            if (node == NULL) return;
+            if (event->type == CSL_EVENT_BUS_VOLUME) node->bus->volume = event->value;
+            else node->bus->mute_enabled = (event->value != 0.0f);
+            return;
+        }
+        case CSL_EVENT_MASTER_VOLUME:
+            csoundlib_state->master_volume = event->value;
+            return;
+    }
+}
+
+/* applies every pending event due by frame, returns the frames until the next one or -1 for none */
+static int64_t _applyEvents(graphSchedule* schedule, int64_t frame) {
+    int applied = 0;
+    while (applied < _numPending && _pending[applied].frame <= frame) _applyEvent(schedule, &_pending[applied++]);
+    if (applied > 0) {
+        memmove(_pending, _pending + applied, (size_t)(_numPending - applied) * sizeof(graphEvent));
+        _numPending -= applied;
+    }
+    return (_numPending > 0) ? _pending[0].frame - frame : -1;
+}
+
+void graph_process(bool mix, int num_channels) {
+    /* publish what we are about to run, then check it was not swapped out in between */
+    graphSchedule* schedule;
+    do {
+        schedule = __atomic_load_n(&csoundlib_state->schedule, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&csoundlib_state->schedule_in_use, schedule, __ATOMIC_SEQ_CST);
+    } while (schedule != __atomic_load_n(&csoundlib_state->schedule, __ATOMIC_SEQ_CST));
+
+    if (num_channels < 1) num_channels = 1;
+    _workersLate = false;
+    _takeEvents();
+    int64_t clock = __atomic_load_n(&_clock, __ATOMIC_RELAXED);
+    if (schedule == NULL || schedule->num_levels == 0) {
+        _applyEvents(schedule, clock);
+    }
+    else {
+        /* buses and the master run a whole period whatever reaches them so their effect tails ring out */
+        size_t period_bytes = 0;
+        for (int i = 0; i < schedule->num_nodes; i++) {
+            trackObject* track_p = schedule->nodes[i].track;
+            if (track_p != NULL && track_p->input_buffer.write_bytes > period_bytes) period_bytes = track_p->input_buffer.write_bytes;
+        }
+        for (int b = 0; b < schedule->num_buses; b++) {
+            busObject* bus = schedule->buses[b];
+            memset(bus->buffer, 0, bus->write_bytes);
+            bus->write_bytes = period_bytes;
+        }
+        for (int i = 0; i < schedule->num_nodes; i++) schedule->nodes[i].tail = _nodeTail(&schedule->nodes[i]);
+        if (mix && csoundlib_state->mixed_output_buffer_len < period_bytes) csoundlib_state->mixed_output_buffer_len = period_bytes;
+
+        size_t frame_bytes = (size_t)csoundlib_state->input_dtype.bytes_in_buffer * num_channels;
+        size_t block_bytes = (size_t)__atomic_load_n(&_blockFrames, __ATOMIC_RELAXED) * frame_bytes;
+        int num_levels = mix ? schedule->num_levels : 1;
+        for (size_t offset = 0; offset < period_bytes;) {
+            /* cut the block short at the next event so it lands on its frame */
+            int64_t until_event = _applyEvents(schedule, clock + (int64_t)(offset / frame_bytes));
+            size_t num_bytes = (period_bytes - offset < block_bytes) ? period_bytes - offset : block_bytes;
+            if (until_event > 0 && (size_t)until_event * frame_bytes < num_bytes) num_bytes = (size_t)until_event * frame_bytes;
+
+            for (int b = 0; b < schedule->num_buses; b++) schedule->buses[b]->input_silent = true;
+            for (int level = 0; level < num_levels; level++) {
+                graphNode* nodes = schedule->nodes + schedule->level_starts[level];
+                int count = schedule->level_starts[level + 1] - schedule->level_starts[level];
+                _processLevel(nodes, count, num_channels, offset, num_bytes);
+                if (!mix) continue;
+                for (int i = 0; i < count; i++) {
+                    if (_nodeReady(&nodes[i])) _mixNode(&nodes[i], num_channels, offset, num_bytes);
+                }
+            }
+            if (mix) _processMaster(num_channels, offset, num_bytes);
+            offset += num_bytes;
+        }
+        _finishPeriod(schedule, mix);
+        __atomic_store_n(&_clock, clock + (int64_t)(period_bytes / frame_bytes), __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&csoundlib_state->schedule_in_use, NULL, __ATOMIC_SEQ_CST);
+}
+
+/* ********************************************* */
+/* compiling the schedule                        */
+/* ********************************************* */
+
+static void _freeSchedule(graphSchedule* schedule) {
+    if (schedule == NULL) return;
+    free(schedule->delay_memory);
+    free(schedule);
+}
+
+static void _swapSchedule(graphSchedule* schedule) {
+    graphSchedule* old = __atomic_exchange_n(&csoundlib_state->schedule, schedule, __ATOMIC_SEQ_CST);
+    while (old != NULL && __atomic_load_n(&csoundlib_state->schedule_in_use, __ATOMIC_SEQ_CST) == old) {
+        usleep(500);
+    }
+    /* a worker that missed its deadline can still be in one of the old nodes */
+    while (old != NULL && __atomic_load_n(&_workers.running, __ATOMIC_SEQ_CST) > 0) {
+        usleep(500);
+    }
+    _freeSchedule(old);
+}
+
+/* the bus with this id, NULL for the master bus or one that doesn't exist */
+static busObject* _lookupBus(int busId) {
+    if (busId == CSL_MASTER_BUS) return NULL;
+    const char key[50];
+    ht_getkey(busId, key);
+    return (busObject*)ht_get(csoundlib_state->bus_hash_table, key);
+}
+
+/* a bus on its way out isn't a destination any more, the main output falls back to the master bus */
+static void _resolveOutputs(graphNode* node, const graphRouting* routing, const busObject* skip_bus) {
+    busObject* output_bus = _lookupBus(routing->output_bus);
+    node->outputs[0].bus = (output_bus == skip_bus) ? NULL : output_bus;
+    node->outputs[0].level = 1.0f;
+    node->outputs[0].pre_fader = false;
+    node->num_outputs = 1;
+    for (int i = 0; i < routing->num_sends; i++) {
+        busObject* bus = _lookupBus(routing->sends[i].bus_id);
+        if (bus == NULL || bus == skip_bus) continue;
+        graphOutput* output = &node->outputs[node->num_outputs++];
+        output->bus = bus;
+        output->level = routing->sends[i].level;
+        output->pre_fader = routing->sends[i].pre_fader;
+    }
+}
+
+/*
+works out the latency of every node in level order, sources always come first, and gives each
+output the delay that brings it level with the slowest path into its destination. every delay
+line comes out of one block.
+*/
+static int _compensate(graphSchedule* schedule) {
+    int num_nodes = schedule->num_nodes;
+    int* arrival = calloc((size_t)num_nodes, sizeof(int)); // latency of the slowest path into each node
+    if (!arrival) return SoundIoErrorNoMem;
+    for (int i = 0; i < num_nodes; i++) {
+        if (schedule->nodes[i].bus != NULL) schedule->nodes[i].bus->node_index = i;
+    }
+    int master = 0;
+    for (int i = 0; i < num_nodes; i++) {
+        graphNode* node = &schedule->nodes[i];
+        nativeEffectSlot* slot = node->track ? &node->track->track_effects.native_effects : &node->bus->native_effects;
+        node->latency = arrival[i] + effects_native_latency(slot);
+        for (int o = 0; o < node->num_outputs; o++) {
+            int* into = node->outputs[o].bus ? &arrival[node->outputs[o].bus->node_index] : &master;
+            if (node->latency > *into) *into = node->latency;
+        }
+    }
+    size_t total = 0;
+    for (int i = 0; i < num_nodes; i++) {
+        graphNode* node = &schedule->nodes[i];
+        node->max_delay = 0;
+        for (int o = 0; o < node->num_outputs; o++) {
+            graphOutput* output = &node->outputs[o];
+            int into = output->bus ? arrival[output->bus->node_index] : master;
+            output->delay_frames = into - node->latency;
+            if (output->delay_frames > node->max_delay) node->max_delay = output->delay_frames;
+            total += (size_t)output->delay_frames * GRAPH_DELAY_FRAME_BYTES;
+        }
+    }
+    free(arrival);
+    schedule->latency = master;
+    schedule->delay_memory = (total > 0) ? malloc(total) : NULL;
+    if (total > 0 && schedule->delay_memory == NULL) return SoundIoErrorNoMem;
+    unsigned char* line = schedule->delay_memory;
+    for (int i = 0; i < num_nodes; i++) {
+        for (int o = 0; o < schedule->nodes[i].num_outputs; o++) {
+            graphOutput* output = &schedule->nodes[i].outputs[o];
+            output->delay_line = (output->delay_frames > 0) ? line : NULL;
+            output->delay_bytes = 0;
+            output->delay_pos = 0;
+            line += (size_t)output->delay_frames * GRAPH_DELAY_FRAME_BYTES;
+        }
+    }
+    return SoundIoErrorNone;
+}
+
+/*
+builds a schedule leaving out skip_track and skip_bus, which are about to be deleted, and
+swaps it in. fails with CSLErrorRoutingCycle without touching the current schedule when
+some bus feeds itself.
+*/
+static int _rebuild(const trackObject* skip_track, const busObject* skip_bus) {
+    int num_tracks = 0, num_buses = 0;
+    hti it = ht_iterator(csoundlib_state->track_hash_table);
+    while (ht_next(&it)) {
+        if (it.value != skip_track) num_tracks++;
+    }
+    it = ht_iterator(csoundlib_state->bus_hash_table);
+    while (ht_next(&it)) {
+        if (it.value != skip_bus) num_buses++;
+    }
+    int num_nodes = num_tracks + num_buses;
+    if (num_nodes == 0) {
+        _swapSchedule(NULL);
+        return SoundIoErrorNone;
+    }
+
+    /* one block: the schedule, its nodes, level starts and buses */
+    size_t size = sizeof(graphSchedule) + (size_t)num_nodes * sizeof(graphNode)
+                + (size_t)(num_nodes + 1) * sizeof(int) + (size_t)num_buses * sizeof(busObject*);
+    graphSchedule* schedule = malloc(size);
+    graphNode* unordered = malloc((size_t)num_nodes * sizeof(graphNode));
+    int* indegree = calloc((size_t)num_nodes * 3, sizeof(int));
+    if (!schedule || !unordered || !indegree) {
+        free(schedule);
+        free(unordered);
+        free(indegree);
+        return SoundIoErrorNoMem;
+    }
+    schedule->num_nodes = num_nodes;
+    schedule->nodes = (graphNode*)(schedule + 1);
+    schedule->level_starts = (int*)(schedule->nodes + num_nodes);
+    schedule->buses = (busObject**)(schedule->level_starts + num_nodes + 1);
+    schedule->num_buses = num_buses;
+    int* frontier = indegree + num_nodes;
+    int* next = frontier + num_nodes;
+
+    /* tracks first, then buses, each bus remembering its node. nodes start out run for a level already gone */
+    uint32_t generation = __atomic_load_n(&_generation, __ATOMIC_RELAXED);
+    int n = 0;
+    it = ht_iterator(csoundlib_state->track_hash_table);
+    while (ht_next(&it)) {
+        trackObject* track_p = (trackObject*)it.value;
+        if (track_p == skip_track) continue;
+        unordered[n].track = track_p;
+        unordered[n].bus = NULL;
+        unordered[n].started = generation;
+        unordered[n].finished = generation;
+        n++;
+    }
+    it = ht_iterator(csoundlib_state->bus_hash_table);
+    int b = 0;
+    while (ht_next(&it)) {
+        busObject* bus = (busObject*)it.value;
+        if (bus == skip_bus) continue;
+        bus->node_index = n;
+        schedule->buses[b++] = bus;
+        unordered[n].track = NULL;
+        unordered[n].bus = bus;
+        unordered[n].started = generation;
+        unordered[n].finished = generation;
+        n++;
+    }
+    for (int i = 0; i < num_nodes; i++) {
+        graphNode* node = &unordered[i];
+        _resolveOutputs(node, node->track ? &node->track->routing : &node->bus->routing, skip_bus);
+        for (int o = 0; o < node->num_outputs; o++) {
+            if (node->outputs[o].bus != NULL) indegree[node->outputs[o].bus->node_index]++;
+        }
+    }
+
+    /* kahn's algorithm a level at a time */
+    int num_frontier = 0;
+    for (int i = 0; i < num_nodes; i++) {
+        if (indegree[i] == 0) frontier[num_frontier++] = i;
+    }
+    int placed = 0, num_levels = 0;
+    while (num_frontier > 0) {
+        schedule->level_starts[num_levels++] = placed;
+        int num_next = 0;
+        for (int f = 0; f < num_frontier; f++) {
+            graphNode* node = &unordered[frontier[f]];
+            schedule->nodes[placed++] = *node;
+            for (int o = 0; o < node->num_outputs; o++) {
+                if (node->outputs[o].bus == NULL) continue;
+                int target = node->outputs[o].bus->node_index;
+                if (--indegree[target] == 0) next[num_next++] = target;
+            }
+        }
+        memcpy(frontier, next, (size_t)num_next * sizeof(int));
+        num_frontier = num_next;
+    }
+    schedule->level_starts[num_levels] = placed;
+    schedule->num_levels = num_levels;
+    free(unordered);
+    free(indegree);
+    if (placed < num_nodes) {
+        free(schedule);
+        return CSLErrorRoutingCycle;
+    }
+    schedule->delay_memory = NULL;
+    int err = _compensate(schedule);
+    if (err != SoundIoErrorNone) {
+        _freeSchedule(schedule);
+        return err;
+    }
+    _swapSchedule(schedule);
+    return SoundIoErrorNone;
+}
+
+int graph_rebuild(void) {
+    pthread_mutex_lock(&_graphLock);
+    int err = _rebuild(NULL, NULL);
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+int graph_remove_track(const trackObject* track_p) {
+    pthread_mutex_lock(&_graphLock);
+    int err = _rebuild(track_p, NULL);
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+busObject* graph_get_bus(int busId) {
+    return _lookupBus(busId);
+}
+
+/* ********************************************* */
+/* buses                                         */
+/* ********************************************* */
+
+int soundlib_add_bus(int busId) {
+    if (busId == CSL_MASTER_BUS) return SoundIoErrorInvalid;
+    pthread_mutex_lock(&_graphLock);
+    if (_lookupBus(busId) != NULL) {
+        pthread_mutex_unlock(&_graphLock);
+        return SoundIoErrorInvalid;
+    }
+    busObject* bus = calloc(1, sizeof(busObject));
+    if (!bus) {
+        pthread_mutex_unlock(&_graphLock);
+        return SoundIoErrorNoMem;
+    }
+    bus->bus_id = busId;
+    bus->volume = 1.0f;
+    bus->routing.output_bus = CSL_MASTER_BUS;
+    const char key[50];
+    ht_getkey(busId, key);
+    if (ht_set(csoundlib_state->bus_hash_table, key, (void*)bus) == NULL) {
+        free(bus);
+        pthread_mutex_unlock(&_graphLock);
+        return SoundIoErrorNoMem;
+    }
+    int err = _rebuild(NULL, NULL);
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+/* points every route into bus_id back at the master bus and drops the sends to it */
+static void _forgetBus(graphRouting* routing, int busId) {
+    if (routing->output_bus == busId) routing->output_bus = CSL_MASTER_BUS;
+    int kept = 0;
+    for (int i = 0; i < routing->num_sends; i++) {
+        if (routing->sends[i].bus_id != busId) routing->sends[kept++] = routing->sends[i];
+    }
+    routing->num_sends = kept;
+}
+
+int soundlib_delete_bus(int busId) {
+    pthread_mutex_lock(&_graphLock);
+    busObject* bus = _lookupBus(busId);
+    if (bus == NULL) {
+        pthread_mutex_unlock(&_graphLock);
+        return CSLErrorBusNotFound;
+    }
+    /* once this is swapped in the audio thread can't reach the bus */
+    int err = _rebuild(NULL, bus);
+    if (err != SoundIoErrorNone) {
+        pthread_mutex_unlock(&_graphLock);
+        return err;
+    }
+    hti it = ht_iterator(csoundlib_state->track_hash_table);
+    while (ht_next(&it)) _forgetBus(&((trackObject*)it.value)->routing, busId);
+    it = ht_iterator(csoundlib_state->bus_hash_table);
+    while (ht_next(&it)) _forgetBus(&((busObject*)it.value)->routing, busId);
+    effects_clear_native(&bus->native_effects);
+    const char key[50];
+    ht_getkey(busId, key);
+    /* ht remove frees bus */
+    ht_remove(csoundlib_state->bus_hash_table, key);
+    pthread_mutex_unlock(&_graphLock);
+    return SoundIoErrorNone;
+}
+
+/* the bus setters and getters hold the lock so add and delete can't move or free the bus under them */
+int soundlib_set_bus_volume(int busId, float logVolume) {
+    pthread_mutex_lock(&_graphLock);
+    busObject* bus = _lookupBus(busId);
+    int err = SoundIoErrorNone;
+    if (bus == NULL) err = CSLErrorBusNotFound;
+    else bus->volume = log_to_mag(logVolume);
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+static int _setBusMute(int busId, bool mute_enabled) {
+    pthread_mutex_lock(&_graphLock);
+    busObject* bus = _lookupBus(busId);
+    int err = SoundIoErrorNone;
+    if (bus == NULL) err = CSLErrorBusNotFound;
+    else bus->mute_enabled = mute_enabled;
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+int soundlib_bus_mute_enable(int busId) {
+    return _setBusMute(busId, true);
+}
+
+int soundlib_bus_mute_disable(int busId) {
+    return _setBusMute(busId, false);
+}
+
+float soundlib_get_bus_output_rms(int busId) {
+    pthread_mutex_lock(&_graphLock);
+    busObject* bus = _lookupBus(busId);
+    float rms = (bus != NULL) ? bus->output_rms_level : 0.0;
+    pthread_mutex_unlock(&_graphLock);
+    return rms;
+}
+
+bool soundlib_bus_is_idle(int busId) {
+    pthread_mutex_lock(&_graphLock);
+    busObject* bus = _lookupBus(busId);
+    bool idle = (bus != NULL) ? bus->idle : false;
+    pthread_mutex_unlock(&_graphLock);
+    return idle;
+}
+
+/* ********************************************* */
+/* routing                                       */
+/* ********************************************* */
+
+/* the routing of a track or bus, NULL when it doesn't exist */
+static graphRouting* _routing(int id, bool is_bus) {
+    if (is_bus) {
+        busObject* bus = _lookupBus(id);
+        return bus ? &bus->routing : NULL;
+    }
+    const char key[50];
+    ht_getkey(id, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    return track_p ? &track_p->routing : NULL;
+}
+
+/* applies an edit and recompiles, putting the routing back when the result doesn't schedule */
+static int _editRouting(graphRouting* routing, const graphRouting* edited) {
+    graphRouting old = *routing;
+    *routing = *edited;
+    int err = _rebuild(NULL, NULL);
+    if (err != SoundIoErrorNone) *routing = old;
+    return err;
+}
+
+static int _setOutput(int id, bool is_bus, int destBusId) {
+    pthread_mutex_lock(&_graphLock);
+    graphRouting* routing = _routing(id, is_bus);
+    int err = SoundIoErrorNone;
+    if (routing == NULL) err = is_bus ? CSLErrorBusNotFound : CSLErrorTrackNotFound;
+    else if (destBusId != CSL_MASTER_BUS && _lookupBus(destBusId) == NULL) err = CSLErrorBusNotFound;
+    else {
+        graphRouting edited = *routing;
+        edited.output_bus = destBusId;
+        err = _editRouting(routing, &edited);
+    }
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+static int _setSend(int id, bool is_bus, int destBusId, float logLevel, bool pre_fader) {
+    pthread_mutex_lock(&_graphLock);
+    graphRouting* routing = _routing(id, is_bus);
+    int err = SoundIoErrorNone;
+    if (routing == NULL) err = is_bus ? CSLErrorBusNotFound : CSLErrorTrackNotFound;
+    else if (_lookupBus(destBusId) == NULL) err = CSLErrorBusNotFound;
+    else {
+        graphRouting edited = *routing;
+        int i = 0;
+        while (i < edited.num_sends && edited.sends[i].bus_id != destBusId) i++;
+        if (i == GRAPH_MAX_SENDS) err = SoundIoErrorInvalid;
+        else {
+            if (i == edited.num_sends) edited.num_sends++;
+            edited.sends[i].bus_id = destBusId;
+            edited.sends[i].level = log_to_mag(logLevel);
+            edited.sends[i].pre_fader = pre_fader;
+            err = _editRouting(routing, &edited);
+        }
+    }
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+static int _removeSend(int id, bool is_bus, int destBusId) {
+    pthread_mutex_lock(&_graphLock);
+    graphRouting* routing = _routing(id, is_bus);
+    int err = SoundIoErrorNone;
+    if (routing == NULL) err = is_bus ? CSLErrorBusNotFound : CSLErrorTrackNotFound;
+    else {
+        graphRouting edited = *routing;
+        edited.num_sends = 0;
+        for (int i = 0; i < routing->num_sends; i++) {
+            if (routing->sends[i].bus_id != destBusId) edited.sends[edited.num_sends++] = routing->sends[i];
+        }
+        if (edited.num_sends == routing->num_sends) err = SoundIoErrorInvalid;
+        else err = _editRouting(routing, &edited);
+    }
+    pthread_mutex_unlock(&_graphLock);
+    return err;
+}
+
+int soundlib_track_set_output(int trackId, int busId) {
+    return _setOutput(trackId, false, busId);
+}
+
+int soundlib_bus_set_output(int busId, int destBusId) {
+    return _setOutput(busId, true, destBusId);
+}
+
+int soundlib_track_set_send(int trackId, int busId, float logLevel, bool pre_fader) {
+    return _setSend(trackId, false, busId, logLevel, pre_fader);
+}
+
+int soundlib_track_remove_send(int trackId, int busId) {
+    return _removeSend(trackId, false, busId);
+}
+
+int soundlib_bus_set_send(int busId, int destBusId, float logLevel, bool pre_fader) {
+    return _setSend(busId, true, destBusId, logLevel, pre_fader);
+}
+
+int soundlib_bus_remove_send(int busId, int destBusId) {
+    return _removeSend(busId, true, destBusId);
+}
+
+/* ********************************************* */
+/* workers                                       */
+/* ********************************************* */
+
+static void _stopWorkers(void) {
+    int num_threads = _workers.num_threads;
+    if (num_threads == 0) return;
+    __atomic_store_n(&_workers.num_threads, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&_workers.lock);
+    _workers.quit = true;
+    pthread_cond_broadcast(&_workers.wake);
+    pthread_mutex_unlock(&_workers.lock);
+    for (int i = 0; i < num_threads; i++) pthread_join(_workers.threads[i], NULL);
+    _workers.quit = false;
+}
+
+int soundlib_set_graph_threads(int num_threads) {
+    if (num_threads < 0 || num_threads > GRAPH_MAX_THREADS) return SoundIoErrorInvalid;
+    pthread_mutex_lock(&_graphLock);
+    _stopWorkers();
+    int started = 0;
+    while (started < num_threads) {
+        if (pthread_create(&_workers.threads[started], NULL, _workerThread, NULL) != 0) break;
+        started++;
+    }
+    __atomic_store_n(&_workers.num_threads, started, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&_graphLock);
+    return (started == num_threads) ? SoundIoErrorNone : SoundIoErrorSystemResources;
+}
+
+int soundlib_get_graph_latency(void) {
+    pthread_mutex_lock(&_graphLock);
+    int latency = csoundlib_state->schedule ? csoundlib_state->schedule->latency : 0;
+    pthread_mutex_unlock(&_graphLock);
+    return latency + effects_native_latency(&csoundlib_state->master_effects.native_effects);
+}
+
+int soundlib_set_graph_block_size(int num_frames) {
+    if (num_frames < GRAPH_MIN_BLOCK_FRAMES || num_frames > GRAPH_MAX_BLOCK_FRAMES) return SoundIoErrorInvalid;
+    __atomic_store_n(&_blockFrames, num_frames, __ATOMIC_RELAXED);
+    return SoundIoErrorNone;
+}
+
+int64_t soundlib_get_graph_frame(void) {
+    return __atomic_load_n(&_clock, __ATOMIC_RELAXED);
+}
+
+int soundlib_schedule_event(CslGraphEvent type, int id, float value, int64_t frame) {
+    if (type < CSL_EVENT_TRACK_VOLUME || type > CSL_EVENT_MASTER_VOLUME) return SoundIoErrorInvalid;
+    graphEvent event = {.type = type, .id = id, .value = value, .frame = frame};
+    /* volumes go in as magnitudes, like the setters leave them */
+    if (type == CSL_EVENT_TRACK_VOLUME || type == CSL_EVENT_BUS_VOLUME || type == CSL_EVENT_MASTER_VOLUME) {
+        event.value = log_to_mag(value);
+    }
+    pthread_mutex_lock(&_events.lock);
+    uint32_t head = __atomic_load_n(&_events.head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&_events.tail, __ATOMIC_ACQUIRE) == GRAPH_MAX_EVENTS) {
+        pthread_mutex_unlock(&_events.lock);
+        return CSLErrorEventQueueFull;
+    }
+    _events.ring[head % GRAPH_MAX_EVENTS] = event;
+    __atomic_store_n(&_events.head, head + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&_events.lock);
+    return SoundIoErrorNone;
+}
+
+void graph_cleanup(void) {
+    pthread_mutex_lock(&_graphLock);
+    _stopWorkers();
+    _swapSchedule(NULL);
+    hti it = ht_iterator(csoundlib_state->bus_hash_table);
+    while (ht_next(&it)) effects_clear_native(&((busObject*)it.value)->native_effects);
+    /* ht destroy frees every bus */
+    ht_destroy(csoundlib_state->bus_hash_table);
+    csoundlib_state->bus_hash_table = NULL;
+    pthread_mutex_unlock(&_graphLock);
+}
@@ -72,6 +72,7 @@ int soundlib_start_session(
         case CSL_U24: csoundlib_state->input_dtype = CSL_U24_t; break;
         case CSL_U32: csoundlib_state->input_dtype = CSL_U32_t; break;
         case CSL_FL32: csoundlib_state->input_dtype = CSL_FL32_t; break;
+        case CSL_FL64: csoundlib_state->input_dtype = CSL_FL64_t; break;
     } 
 
     struct SoundIo* soundio = soundio_create();
@@ -79,17 +80,27 @@ int soundlib_start_session(
     unsigned char* mixed_output_buffer = (unsigned char*)calloc(MAX_BUFFER_SIZE_BYTES, sizeof(char));
     MasterAudioAvailableCallback* effects = (MasterAudioAvailableCallback*)malloc(MAX_NUM_EFFECTS * sizeof(MasterAudioAvailableCallback));
     ht* hash_table = ht_create();
+    ht* bus_table = ht_create();
 
-    if (soundio && mixed_output_buffer && csoundlib_state && effects) {
+    if (soundio && mixed_output_buffer && csoundlib_state && effects && bus_table) {
         csoundlib_state->soundio = soundio;
         csoundlib_state->mixed_output_buffer = mixed_output_buffer;
         csoundlib_state->environment_initialized = true;
         csoundlib_state->track_hash_table = hash_table;
         csoundlib_state->num_tracks = 0;
+        csoundlib_state->bus_hash_table = bus_table;
+        csoundlib_state->schedule = NULL;
+        csoundlib_state->schedule_in_use = NULL;
         csoundlib_state->master_effects.master_effect_list = effects;
         csoundlib_state->master_effects.num_effects = 0;
+        csoundlib_state->master_effects.native_effects.chain = NULL;
+        csoundlib_state->master_effects.native_effects.in_use = NULL;
         csoundlib_state->output_callback = &master_dummy_callback;
         csoundlib_state->num_channels_audio_file = 2;
+        csoundlib_state->timeline_playing = false;
+        csoundlib_state->timeline_position = 0;
+        csoundlib_state->master_analyzer = NULL;
+        csoundlib_state->master_analyzer_in_use = NULL;
         int backend_err = _connectToBackend();
         int input_dev_err = soundlib_load_input_devices();
         int output_dev_err = soundlib_load_output_devices();
@@ -137,6 +148,8 @@ int soundlib_destroy_session() {
     free(csoundlib_state->mixed_output_buffer);
     csoundlib_state->master_effects.num_effects = 0;
     free(csoundlib_state->master_effects.master_effect_list);
+    effects_clear_native(&csoundlib_state->master_effects.native_effects);
+    graph_cleanup();
 
     if (csoundlib_state->input_memory_allocated) {
         free(csoundlib_state->input_channel_buffers);
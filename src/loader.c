@@ -0,0 +1,131 @@
+#include "loader.h"
+#include "threadpool.h"
+#include "wav.h"
+#include "mp3.h"
+#include <soundio/soundio.h>
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+
+files load on a shared pool with one thread per core, so opening a project costs about
+as long as its slowest file. the pool is created by the first load and lives until
+soundlib_loader_shutdown.
+
+*/
+static pthread_mutex_t _loaderLock = PTHREAD_MUTEX_INITIALIZER;
+static threadPool* _loaderPool = NULL;
+static loadRequest* _activeLoads = NULL;
+static int _nextLoadId = 1;
+
+bool loader_file_type(const char* path, CslFileType* file_type) {
+    const char* extension = strrchr(path, '.');
+    if (extension == NULL) return false;
+    if (strcasecmp(extension, ".wav") == 0 || strcasecmp(extension, ".wave") == 0) {
+        *file_type = CSL_WAV;
+        return true;
+    }
+    if (strcasecmp(extension, ".mp3") == 0) {
+        *file_type = CSL_MP3;
+        return true;
+    }
+    return false;
+}
+
+int loader_read_file(const char* path, CslFileType file_type, CslFileInfo* info, int decode_threads, CslLoadProgressCallback progress, void* user, const bool* cancel) {
+    if (file_type == CSL_WAV) {
+        return wav_read_file(path, info, progress, user, cancel);
+    }
+    return mp3_decode(path, info, decode_threads, progress, user, cancel);
+}
+
+static void _removeLoad(loadRequest* load) {
+    pthread_mutex_lock(&_loaderLock);
+    loadRequest** link = &_activeLoads;
+    while (*link != NULL && *link != load) link = &(*link)->next;
+    if (*link != NULL) *link = load->next;
+    pthread_mutex_unlock(&_loaderLock);
+}
+
+static void _runLoad(void* arg) {
+    loadRequest* load = (loadRequest*)arg;
+    int err;
+    if (__atomic_load_n(&load->cancel, __ATOMIC_RELAXED)) {
+        err = CSLErrorLoadCancelled;
+    }
+    else {
+        err = loader_read_file(load->path, load->file_type, &load->info, load->decode_threads, load->progress, load->user, &load->cancel);
+    }
+    /* out of the list first so a late cancel can't touch a finished load */
+    _removeLoad(load);
+    load->callback(err, &load->info, load->user);
+    free(load);
+}
+
+int soundlib_load_file_async(const char* path, const CslLoadOptions* options, CslLoadCompleteCallback callback, void* user, int* load_id) {
+    if (path == NULL || callback == NULL) return SoundIoErrorInvalid;
+    CslFileType file_type;
+    if (!loader_file_type(path, &file_type)) return CSLErrorUnsupportedFormat;
+
+    loadRequest* load = calloc(1, sizeof(loadRequest));
+    if (!load) return SoundIoErrorNoMem;
+    load->path = path;
+    load->file_type = file_type;
+    load->info.data = options ? options->data : NULL;
+    load->info.data_bytes = options ? options->data_bytes : 0;
+    load->decode_threads = options ? options->decode_threads : 1;
+    load->progress = options ? options->progress : NULL;
+    load->callback = callback;
+    load->user = user;
+    load->cancel = false;
+
+    pthread_mutex_lock(&_loaderLock);
+    if (_loaderPool == NULL) {
+        _loaderPool = threadpool_create(threadpool_num_cores());
+    }
+    if (_loaderPool == NULL) {
+        pthread_mutex_unlock(&_loaderLock);
+        free(load);
+        return SoundIoErrorNoMem;
+    }
+    load->load_id = _nextLoadId++;
+    load->next = _activeLoads;
+    _activeLoads = load;
+    if (load_id) *load_id = load->load_id;
+    int err = threadpool_submit(_loaderPool, _runLoad, load, NULL);
+    if (err != SoundIoErrorNone) {
+        _activeLoads = load->next;
+        free(load);
+    }
+    pthread_mutex_unlock(&_loaderLock);
+    return err;
+}
+
+int soundlib_cancel_load(int load_id) {
+    int err = SoundIoErrorInvalid;
+    pthread_mutex_lock(&_loaderLock);
+    for (loadRequest* load = _activeLoads; load != NULL; load = load->next) {
+        if (load->load_id == load_id) {
+            __atomic_store_n(&load->cancel, true, __ATOMIC_RELAXED);
+            err = SoundIoErrorNone;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_loaderLock);
+    return err;
+}
+
+void soundlib_loader_shutdown(bool cancel_pending) {
+    pthread_mutex_lock(&_loaderLock);
+    if (cancel_pending) {
+        for (loadRequest* load = _activeLoads; load != NULL; load = load->next) {
+            __atomic_store_n(&load->cancel, true, __ATOMIC_RELAXED);
+        }
+    }
+    threadPool* pool = _loaderPool;
+    _loaderPool = NULL;
+    pthread_mutex_unlock(&_loaderLock);
+    /* runs every queued load to completion (cancelled ones finish straight away) */
+    if (pool) threadpool_destroy(pool);
+}
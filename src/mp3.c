@@ -1,20 +1,63 @@
 #include "mp3.h"
 #include "csoundlib.h"
+#include "threadpool.h"
+#include "pcm_cache.h"
+#include "csl_util.h"
 #include <stdio.h>
+#include <pthread.h>
+#include <soundio/soundio.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
 #include <libavutil/opt.h>
 
-void open_mp3_file(const char *path, CslFileInfo* info) {
+typedef struct _mp3Progress {
+    pthread_mutex_t lock;
+    int64_t samples_done;
+    int64_t samples_total;
+    float last_reported;
+    CslLoadProgressCallback callback;
+    void* user;
+    const char* path;
+    const bool* cancel; // set from another thread to stop decoding, may be NULL
+} mp3Progress;
+
+typedef struct _mp3Segment {
+    const char* path;
+    const mp3Index* index;
+    int64_t prime_start;  // first raw sample fed to the resampler
+    int64_t start;        // first raw sample this segment writes
+    int64_t end;          // one past the last raw sample this segment writes
+    unsigned char* out;   // start of the whole output buffer
+    int64_t out_frames;   // length of the whole output in frames
+    mp3Progress* progress;
+    int err;
+} mp3Segment;
+
+static int64_t _gcd(int64_t a, int64_t b) {
+    while (b != 0) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* raw input sample -> output frame. exact whenever (s - encoder_delay) is a multiple of the rate step */
+static int64_t _outputFrame(const mp3Index* index, int64_t s) {
+    return ((s - index->encoder_delay) * MP3_OUT_SAMPLE_RATE) / index->sample_rate;
+}
+
+static int _openDecoder(const char* path, AVFormatContext** format_ctx_out, AVCodecContext** codec_ctx_out, int* stream_index_out) {
     AVFormatContext *format_ctx = NULL;
     if (avformat_open_input(&format_ctx, path, NULL, NULL) < 0) {
         printf("Could not open input file\n");
-        return;
+        return CSLErrorOpeningFile;
     }
     if (avformat_find_stream_info(format_ctx, NULL) < 0) {
         printf("Could not find stream information\n");
-        return;
+        avformat_close_input(&format_ctx);
+        return CSLErrorDecodingFile;
     }
 
     // Find the first audio stream
@@ -27,76 +70,801 @@ void open_mp3_file(const char *path, CslFileInfo* info) {
     }
     if (audio_stream_index == -1) {
         printf("No audio stream found\n");
-        return;
+        avformat_close_input(&format_ctx);
+        return CSLErrorDecodingFile;
     }
 
     // Get codec context
     AVCodecParameters *codecpar = format_ctx->streams[audio_stream_index]->codecpar;
-    AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
+    const AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
     if (!codec) {
         printf("Unsupported codec\n");
-        return;
+        avformat_close_input(&format_ctx);
+        return CSLErrorDecodingFile;
     }
     AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
     avcodec_parameters_to_context(codec_ctx, codecpar);
+    /* we trim encoder delay and padding ourselves so every segment counts samples the same way */
+    codec_ctx->flags2 |= AV_CODEC_FLAG2_SKIP_MANUAL;
+    codec_ctx->pkt_timebase = (AVRational){1, codecpar->sample_rate};
     if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
         printf("Could not open codec\n");
-        return;
+        avcodec_free_context(&codec_ctx);
+        avformat_close_input(&format_ctx);
+        return CSLErrorDecodingFile;
     }
+    *format_ctx_out = format_ctx;
+    *codec_ctx_out = codec_ctx;
+    *stream_index_out = audio_stream_index;
+    return SoundIoErrorNone;
+}
 
+static SwrContext* _createConverter(AVCodecContext* codec_ctx) {
     // Set up resampling context for conversion to PCM
     SwrContext *swr_ctx = swr_alloc();
     if (!swr_ctx) {
         printf("context was not allocated\n");
-        return;
+        return NULL;
     }
 
     AVChannelLayout stereo_layout = (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO;
     AVChannelLayout in_layout = (codec_ctx->ch_layout);
     av_opt_set_chlayout(swr_ctx, "in_chlayout", &in_layout, 0);
-    av_opt_set_chlayout(swr_ctx, "out_chlayout", &stereo_layout, 0);  
+    av_opt_set_chlayout(swr_ctx, "out_chlayout", &stereo_layout, 0);
     av_opt_set_int(swr_ctx, "in_sample_rate", codec_ctx->sample_rate, 0);
-    av_opt_set_int(swr_ctx, "out_sample_rate", 44100, 0);
+    av_opt_set_int(swr_ctx, "out_sample_rate", MP3_OUT_SAMPLE_RATE, 0);
     av_opt_set_sample_fmt(swr_ctx, "in_sample_fmt", codec_ctx->sample_fmt, 0);
     av_opt_set_sample_fmt(swr_ctx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-    int ret = swr_init(swr_ctx);
-    if (ret < 0) {
+    if (swr_init(swr_ctx) < 0) {
         printf("context was not initialized\n");
+        swr_free(&swr_ctx);
+        return NULL;
+    }
+    return swr_ctx;
+}
+
+/*
+layer 3 frames take up to 511 bytes of their main data from the frames before them (the bit
+reservoir), main_data_begin at the start of the side info says how far back. layers 1 and 2
+have no reservoir. returns false for anything that isn't an mpeg audio frame.
+*/
+static bool _parseReservoir(const uint8_t* data, int size, int* main_data_begin, int* main_bytes) {
+    if (size < 4 || data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) return false;
+    int version = (data[1] >> 3) & 3; // 3 mpeg 1, 2 mpeg 2, 0 mpeg 2.5
+    int layer = (data[1] >> 1) & 3; // 1 layer 3, 2 layer 2, 3 layer 1
+    if (version == 1 || layer == 0) return false;
+    if (layer != 1) {
+        *main_data_begin = 0;
+        *main_bytes = 0;
+        return true;
+    }
+    bool crc = (data[1] & 1) == 0;
+    bool mono = ((data[3] >> 6) & 3) == 3;
+    int side_info = (version == 3) ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    int offset = 4 + (crc ? 2 : 0);
+    if (size < offset + side_info) return false;
+    const uint8_t* side = data + offset;
+    *main_data_begin = (version == 3) ? ((side[0] << 1) | (side[1] >> 7)) : side[0];
+    *main_bytes = size - offset - side_info;
+    return true;
+}
+
+/* demux (without decoding) every packet of the stream to learn exact sample positions */
+static int _scanPackets(const char* path, mp3Index* index) {
+    AVFormatContext* format_ctx;
+    AVCodecContext* codec_ctx;
+    int stream_index;
+    int err = _openDecoder(path, &format_ctx, &codec_ctx, &stream_index);
+    if (err != SoundIoErrorNone) return err;
+
+    AVStream* stream = format_ctx->streams[stream_index];
+    AVRational sample_tb = (AVRational){1, stream->codecpar->sample_rate};
+    int capacity = 4096;
+    index->packets = malloc(capacity * sizeof(mp3Packet));
+    index->num_packets = 0;
+    index->total_samples = 0;
+    index->encoder_delay = 0;
+    index->padding = 0;
+    index->sample_rate = stream->codecpar->sample_rate;
+    int recent_main_bytes[MP3_MAX_RESERVOIR_PACKETS] = {0};
+
+    AVPacket* packet = av_packet_alloc();
+    while (index->packets && av_read_frame(format_ctx, packet) >= 0) {
+        if (packet->stream_index == stream_index) {
+            if (index->num_packets == capacity) {
+                capacity *= 2;
+                mp3Packet* grown = realloc(index->packets, capacity * sizeof(mp3Packet));
+                if (!grown) {
+                    free(index->packets);
+                    index->packets = NULL;
+                    av_packet_unref(packet);
+                    break;
+                }
+                index->packets = grown;
+            }
+            int64_t duration = (packet->duration > 0)
+                ? av_rescale_q(packet->duration, stream->time_base, sample_tb)
+                : codec_ctx->frame_size;
+            size_t side_size = 0;
+            uint8_t* skip = av_packet_get_side_data(packet, AV_PKT_DATA_SKIP_SAMPLES, &side_size);
+            if (skip && side_size >= 10) {
+                index->encoder_delay += AV_RL32(skip);
+                index->padding += AV_RL32(skip + 4);
+            }
+            /* count the packets the reservoir reaches back into */
+            int main_data_begin, main_bytes;
+            int reservoir = MP3_PRIMING_PACKETS;
+            if (_parseReservoir(packet->data, packet->size, &main_data_begin, &main_bytes)) {
+                int covered = 0;
+                reservoir = 0;
+                while (covered < main_data_begin && reservoir < MP3_MAX_RESERVOIR_PACKETS &&
+                       reservoir < index->num_packets) {
+                    covered += recent_main_bytes[(index->num_packets - 1 - reservoir) % MP3_MAX_RESERVOIR_PACKETS];
+                    reservoir++;
+                }
+            }
+            else {
+                main_bytes = 0;
+            }
+            recent_main_bytes[index->num_packets % MP3_MAX_RESERVOIR_PACKETS] = main_bytes;
+            index->packets[index->num_packets].pos = packet->pos;
+            index->packets[index->num_packets].sample = index->total_samples;
+            index->packets[index->num_packets].reservoir = reservoir;
+            index->packets[index->num_packets].unused = 0;
+            index->num_packets += 1;
+            index->total_samples += duration;
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avcodec_free_context(&codec_ctx);
+    avformat_close_input(&format_ctx);
+
+    if (!index->packets) return SoundIoErrorNoMem;
+    if (index->encoder_delay + index->padding >= index->total_samples) {
+        free(index->packets);
+        index->packets = NULL;
+        return CSLErrorDecodingFile;
+    }
+    return SoundIoErrorNone;
+}
+
+/* index of the last packet starting at or before raw sample s */
+static int _packetForSample(const mp3Index* index, int64_t s) {
+    int lo = 0, hi = index->num_packets - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (index->packets[mid].sample <= s) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+/*
+first packet to decode so packet p comes out right: its reservoir has to be read, and the packet
+before it decoded properly too since its output overlaps into p's.
+*/
+static int _firstPacketFor(const mp3Index* index, int p) {
+    int first = p - index->packets[p].reservoir;
+    if (p > 0) {
+        int before = p - 1 - index->packets[p - 1].reservoir;
+        if (before < first) first = before;
+    }
+    return (first < 0) ? 0 : first;
+}
+
+static bool _readCachedIndex(const pcmCacheKey* key, mp3Index* index) {
+    size_t num_bytes;
+    unsigned char* data = pcm_cache_load_index(key, &num_bytes);
+    if (!data) return false;
+    mp3IndexHeader header;
+    bool ok = num_bytes >= sizeof(header);
+    if (ok) {
+        memcpy(&header, data, sizeof(header));
+        ok = memcmp(header.magic, MP3_INDEX_MAGIC, 4) == 0 && header.version == MP3_INDEX_VERSION &&
+             header.num_packets > 0 && header.num_packets <= INT32_MAX &&
+             num_bytes == sizeof(header) + header.num_packets * sizeof(mp3Packet) &&
+             header.encoder_delay + header.padding < header.total_samples;
+    }
+    if (ok) {
+        index->packets = malloc(header.num_packets * sizeof(mp3Packet));
+        ok = index->packets != NULL;
+    }
+    if (ok) {
+        memcpy(index->packets, data + sizeof(header), header.num_packets * sizeof(mp3Packet));
+        index->num_packets = (int)header.num_packets;
+        index->total_samples = header.total_samples;
+        index->encoder_delay = header.encoder_delay;
+        index->padding = header.padding;
+        index->sample_rate = (int)header.sample_rate;
+    }
+    free(data);
+    return ok;
+}
+
+static void _storeIndex(const pcmCacheKey* key, const mp3Index* index) {
+    size_t num_bytes = sizeof(mp3IndexHeader) + index->num_packets * sizeof(mp3Packet);
+    unsigned char* data = malloc(num_bytes);
+    if (!data) return;
+    mp3IndexHeader header = {
+        .version = MP3_INDEX_VERSION,
+        .num_packets = index->num_packets,
+        .total_samples = index->total_samples,
+        .encoder_delay = index->encoder_delay,
+        .padding = index->padding,
+        .sample_rate = index->sample_rate
+    };
+    memcpy(header.magic, MP3_INDEX_MAGIC, 4);
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), index->packets, index->num_packets * sizeof(mp3Packet));
+    pcm_cache_store_index(key, data, num_bytes);
+    free(data);
+}
+
+/* the packet index kept in the decode cache, or a scan of the file which is then kept. key may be NULL */
+static int _loadIndex(const char* path, const pcmCacheKey* key, mp3Index* index) {
+    if (key && _readCachedIndex(key, index)) return SoundIoErrorNone;
+    int err = _scanPackets(path, index);
+    if (err == SoundIoErrorNone && key) _storeIndex(key, index);
+    return err;
+}
+
+static int _packetForPosition(const mp3Index* index, int64_t pos) {
+    int lo = 0, hi = index->num_packets - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (index->packets[mid].pos == pos) return mid;
+        if (index->packets[mid].pos < pos) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+static void _reportProgress(mp3Progress* progress, int64_t samples) {
+    if (!progress->callback) return;
+    pthread_mutex_lock(&progress->lock);
+    progress->samples_done += samples;
+    float fraction = (float)progress->samples_done / (float)progress->samples_total;
+    if (fraction > 1.0) fraction = 1.0;
+    /* only call back once per percent so the callback can't slow the decoders down */
+    if (fraction - progress->last_reported >= 0.01 || fraction == 1.0) {
+        progress->last_reported = fraction;
+        progress->callback(progress->path, fraction, progress->user);
+    }
+    pthread_mutex_unlock(&progress->lock);
+}
+
+/* converts `count` samples of `frame` starting at `offset` and writes the part this segment owns */
+static int _convertAndWrite(mp3Segment* seg, SwrContext* swr_ctx, AVCodecContext* codec_ctx,
+                            AVFrame* frame, int offset, int count,
+                            uint8_t** scratch, int* scratch_frames, int64_t* out_pos) {
+    const uint8_t* planes[8] = {0};
+    const uint8_t** in_planes = NULL;
+    if (frame) {
+        int bps = av_get_bytes_per_sample(codec_ctx->sample_fmt);
+        int channels = codec_ctx->ch_layout.nb_channels;
+        if (av_sample_fmt_is_planar(codec_ctx->sample_fmt)) {
+            for (int ch = 0; ch < channels && ch < 8; ch++) {
+                planes[ch] = frame->extended_data[ch] + offset * bps;
+            }
+        }
+        else {
+            planes[0] = frame->extended_data[0] + offset * bps * channels;
+        }
+        in_planes = planes;
+    }
+    int needed = swr_get_out_samples(swr_ctx, count);
+    if (needed > *scratch_frames) {
+        uint8_t* grown = realloc(*scratch, needed * MP3_OUT_BYTES_PER_FRAME);
+        if (!grown) return SoundIoErrorNoMem;
+        *scratch = grown;
+        *scratch_frames = needed;
+    }
+    int converted = swr_convert(swr_ctx, scratch, *scratch_frames, in_planes, count);
+    if (converted < 0) return CSLErrorDecodingFile;
+
+    int64_t out_begin = _outputFrame(seg->index, seg->start);
+    int64_t out_end = _outputFrame(seg->index, seg->end);
+    if (out_end > seg->out_frames) out_end = seg->out_frames;
+    int64_t first = (*out_pos > out_begin) ? *out_pos : out_begin;
+    int64_t last = (*out_pos + converted < out_end) ? *out_pos + converted : out_end;
+    if (last > first) {
+        memcpy(seg->out + first * MP3_OUT_BYTES_PER_FRAME,
+               *scratch + (first - *out_pos) * MP3_OUT_BYTES_PER_FRAME,
+               (last - first) * MP3_OUT_BYTES_PER_FRAME);
+    }
+    *out_pos += converted;
+    return SoundIoErrorNone;
+}
+
+static void _decodeSegment(void* arg) {
+    mp3Segment* seg = (mp3Segment*)arg;
+    const mp3Index* index = seg->index;
+    AVFormatContext* format_ctx;
+    AVCodecContext* codec_ctx;
+    int stream_index;
+    seg->err = _openDecoder(seg->path, &format_ctx, &codec_ctx, &stream_index);
+    if (seg->err != SoundIoErrorNone) return;
+    SwrContext* swr_ctx = _createConverter(codec_ctx);
+    if (!swr_ctx) {
+        seg->err = CSLErrorDecodingFile;
+        avcodec_free_context(&codec_ctx);
+        avformat_close_input(&format_ctx);
         return;
     }
-    // Read frames and decode
+
+    int64_t stream_end = index->total_samples - index->padding;
+    bool runs_to_end = (seg->end >= stream_end);
+    int64_t warmup = (index->sample_rate == MP3_OUT_SAMPLE_RATE) ? 0 : MP3_RESAMPLER_WARMUP_SAMPLES;
+    /* keep feeding the resampler a little past our end so its last outputs are complete */
+    int64_t feed_end = runs_to_end ? stream_end : seg->end + warmup;
+    if (feed_end > stream_end) feed_end = stream_end;
+
+    int first_packet = _firstPacketFor(index, _packetForSample(index, seg->prime_start));
+    if (first_packet > 0) {
+        av_seek_frame(format_ctx, stream_index, index->packets[first_packet].pos, AVSEEK_FLAG_BYTE);
+    }
+
     AVPacket* packet = av_packet_alloc();
-    AVFrame *frame = av_frame_alloc();
-    uint8_t *input_buffer = NULL;
-    int input_buffer_size = 0;
-    int total_frames = 0;
-    while (av_read_frame(format_ctx, packet) >= 0) {
-        if (packet->stream_index == audio_stream_index) {
-            if (avcodec_send_packet(codec_ctx, packet) == 0) {
-                while (avcodec_receive_frame(codec_ctx, frame) == 0) {
-                    // Allocate buffer for converted samples
-                    int input_samples = swr_get_out_samples(swr_ctx, frame->nb_samples);
-                    input_buffer_size = av_samples_alloc(&input_buffer, NULL, 2, input_samples, AV_SAMPLE_FMT_S32, 0);
-                    int converted_samples = swr_convert(swr_ctx, &input_buffer, input_samples, 
-                                                        (const uint8_t **)frame->extended_data, frame->nb_samples);
-                    memcpy(info->data + (total_frames * 2 * 2), input_buffer, converted_samples * 2 * 2);
-                    total_frames += (converted_samples* 2 / 2); // 2 channels 
-                    av_freep(&input_buffer);
+    AVFrame* frame = av_frame_alloc();
+    uint8_t* scratch = NULL;
+    int scratch_frames = 0;
+    int64_t out_pos = _outputFrame(index, seg->prime_start);
+    int packet_idx = -1;
+    bool done = false;
+
+    while (!done && seg->err == SoundIoErrorNone && av_read_frame(format_ctx, packet) >= 0) {
+        if (seg->progress->cancel && __atomic_load_n(seg->progress->cancel, __ATOMIC_RELAXED)) {
+            seg->err = CSLErrorLoadCancelled;
+            av_packet_unref(packet);
+            break;
+        }
+        if (packet->stream_index != stream_index) {
+            av_packet_unref(packet);
+            continue;
+        }
+        /* line up with the index; anything before the first known packet is resync garbage */
+        if (packet_idx < 0) packet_idx = _packetForPosition(index, packet->pos);
+        if (packet_idx < 0 || packet_idx >= index->num_packets) {
+            av_packet_unref(packet);
+            continue;
+        }
+        int64_t packet_sample = index->packets[packet_idx].sample;
+        int64_t packet_end = (packet_idx + 1 < index->num_packets)
+            ? index->packets[packet_idx + 1].sample : index->total_samples;
+        packet_idx += 1;
+        if (packet_sample >= feed_end) {
+            av_packet_unref(packet);
+            break;
+        }
+        packet->pts = packet_sample;
+        packet->dts = packet_sample;
+        if (avcodec_send_packet(codec_ctx, packet) == 0) {
+            while (avcodec_receive_frame(codec_ctx, frame) == 0) {
+                int64_t frame_start = (frame->pts != AV_NOPTS_VALUE) ? frame->pts : packet_sample;
+                int64_t frame_end = frame_start + frame->nb_samples;
+                int64_t keep_start = (frame_start > seg->prime_start) ? frame_start : seg->prime_start;
+                int64_t keep_end = (frame_end < feed_end) ? frame_end : feed_end;
+                if (keep_end > keep_start) {
+                    seg->err = _convertAndWrite(seg, swr_ctx, codec_ctx, frame,
+                                                (int)(keep_start - frame_start), (int)(keep_end - keep_start),
+                                                &scratch, &scratch_frames, &out_pos);
                 }
+                if (frame_end >= feed_end) done = true;
             }
         }
+        if (packet_sample >= seg->start && packet_sample < seg->end) {
+            _reportProgress(seg->progress, packet_end - packet_sample);
+        }
         av_packet_unref(packet);
     }
+    if (runs_to_end && seg->err == SoundIoErrorNone) {
+        /* drain whatever the resampler still holds */
+        seg->err = _convertAndWrite(seg, swr_ctx, codec_ctx, NULL, 0, 0, &scratch, &scratch_frames, &out_pos);
+    }
+
     // Clean up
-    swr_free(&swr_ctx);
+    free(scratch);
+    av_packet_free(&packet);
     av_frame_free(&frame);
+    swr_free(&swr_ctx);
     avcodec_free_context(&codec_ctx);
     avformat_close_input(&format_ctx);
+}
 
+static void _setFileInfo(CslFileInfo* info, const char* path, int64_t num_frames) {
     info->data_type = CSL_S16;
     info->sample_rate = CSL_SR44100;
     info->path = path;
-    info->num_channels = 2;
+    info->num_channels = MP3_OUT_CHANNELS;
     info->file_type = CSL_MP3;
-    info->num_frames = total_frames;
-}
\ No newline at end of file
+    info->num_frames = (int)num_frames;
+    info->data_bytes = num_frames * MP3_OUT_BYTES_PER_FRAME;
+}
+
+/* a second load of the same file maps (or copies out of) the cached decode */
+static bool _loadFromCache(const pcmCacheKey* key, const char* path, CslFileInfo* info) {
+    size_t data_bytes;
+    unsigned char* cached = pcm_cache_map(key, &data_bytes);
+    if (!cached) return false;
+    if (info->data == NULL) {
+        info->data = cached;
+        info->data_storage = CSL_DATA_MAPPED;
+    }
+    else if (data_bytes <= user_data_capacity(info)) {
+        memcpy(info->data, cached, data_bytes);
+        pcm_cache_unmap(cached, data_bytes);
+        info->data_storage = CSL_DATA_USER;
+    }
+    else {
+        /* let the decode path report the error */
+        pcm_cache_unmap(cached, data_bytes);
+        return false;
+    }
+    _setFileInfo(info, path, data_bytes / MP3_OUT_BYTES_PER_FRAME);
+    return true;
+}
+
+int mp3_decode(const char* path, CslFileInfo* info, int num_threads, CslLoadProgressCallback progress_callback, void* user, const bool* cancel) {
+    pcmCacheKey key;
+    bool use_cache = pcm_cache_enabled() &&
+        pcm_cache_make_key(path, MP3_OUT_SAMPLE_RATE, MP3_OUT_CHANNELS, 16, &key) == SoundIoErrorNone;
+    if (use_cache && _loadFromCache(&key, path, info)) {
+        if (progress_callback) progress_callback(path, 1.0, user);
+        return SoundIoErrorNone;
+    }
+
+    mp3Index index;
+    int err = _loadIndex(path, use_cache ? &key : NULL, &index);
+    if (err != SoundIoErrorNone) return err;
+
+    int64_t first = index.encoder_delay;
+    int64_t last = index.total_samples - index.padding;
+    int64_t out_frames = _outputFrame(&index, last);
+
+    /* the scan gives the exact decoded length, so library owned storage is sized exactly */
+    if (info->data == NULL) {
+        info->data = malloc(out_frames * MP3_OUT_BYTES_PER_FRAME);
+        if (!info->data) {
+            free(index.packets);
+            return SoundIoErrorNoMem;
+        }
+        info->data_storage = CSL_DATA_ALLOCATED;
+    }
+    else if ((size_t)(out_frames * MP3_OUT_BYTES_PER_FRAME) > user_data_capacity(info)) {
+        free(index.packets);
+        return CSLErrorBufferTooSmall;
+    }
+    else {
+        info->data_storage = CSL_DATA_USER;
+    }
+
+    /*
+    segment boundaries sit on multiples of the rate step (relative to the first sample)
+    so that every boundary lands on an exact output frame and segments stitch without
+    gaps or overlaps.
+    */
+    int64_t step = index.sample_rate / _gcd(index.sample_rate, MP3_OUT_SAMPLE_RATE);
+    int64_t warmup = 0;
+    if (index.sample_rate != MP3_OUT_SAMPLE_RATE) {
+        warmup = ((MP3_RESAMPLER_WARMUP_SAMPLES + step - 1) / step) * step;
+    }
+
+    if (num_threads < 1) num_threads = threadpool_num_cores();
+    int64_t num_segments = (last - first) / MP3_MIN_SEGMENT_SAMPLES;
+    if (num_segments > num_threads) num_segments = num_threads;
+    if (num_segments < 1) num_segments = 1;
+
+    mp3Progress progress = {
+        .samples_done = 0,
+        .samples_total = last - first,
+        .last_reported = 0.0,
+        .callback = progress_callback,
+        .user = user,
+        .path = path,
+        .cancel = cancel
+    };
+    pthread_mutex_init(&progress.lock, NULL);
+
+    mp3Segment* segments = malloc(num_segments * sizeof(mp3Segment));
+    if (!segments) {
+        free(index.packets);
+        soundlib_release_file_data(info);
+        return SoundIoErrorNoMem;
+    }
+    for (int i = 0; i < num_segments; i++) {
+        int64_t start = first + (((last - first) * i / num_segments) / step) * step;
+        int64_t end = (i == num_segments - 1)
+            ? last : first + (((last - first) * (i + 1) / num_segments) / step) * step;
+        int64_t prime_start = (i == 0) ? first : start - warmup;
+        if (prime_start < first) prime_start = first;
+        segments[i] = (mp3Segment) {
+            .path = path,
+            .index = &index,
+            .prime_start = prime_start,
+            .start = start,
+            .end = end,
+            .out = info->data,
+            .out_frames = out_frames,
+            .progress = &progress,
+            .err = SoundIoErrorNone
+        };
+    }
+
+    if (num_segments == 1) {
+        _decodeSegment(&segments[0]);
+    }
+    else {
+        threadPool* pool = threadpool_create((int)num_segments);
+        if (!pool) {
+            err = SoundIoErrorNoMem;
+        }
+        else {
+            threadPoolGroup group;
+            threadpool_group_init(&group);
+            for (int i = 0; i < num_segments; i++) {
+                if (threadpool_submit(pool, _decodeSegment, &segments[i], &group) != 0) {
+                    _decodeSegment(&segments[i]);
+                }
+            }
+            threadpool_group_wait(&group);
+            threadpool_group_destroy(&group);
+            threadpool_destroy(pool);
+        }
+    }
+    for (int i = 0; i < num_segments && err == SoundIoErrorNone; i++) {
+        err = segments[i].err;
+    }
+
+    free(segments);
+    free(index.packets);
+    pthread_mutex_destroy(&progress.lock);
+    if (err != SoundIoErrorNone) {
+        soundlib_release_file_data(info);
+        return err;
+    }
+    if (progress_callback && progress.last_reported < 1.0) progress_callback(path, 1.0, user);
+
+    _setFileInfo(info, path, out_frames);
+    if (use_cache) pcm_cache_store(&key, info->data, info->data_bytes);
+    return SoundIoErrorNone;
+}
+
+int open_mp3_file(const char *path, CslFileInfo* info) {
+    return mp3_decode(path, info, 1, NULL, NULL, NULL);
+}
+
+int open_mp3_file_parallel(const char *path, CslFileInfo* info, int num_threads, CslLoadProgressCallback progress, void* user) {
+    return mp3_decode(path, info, num_threads, progress, user, NULL);
+}
+
+/* ********************************************* */
+/* streaming                                     */
+/* ********************************************* */
+
+#define MP3_STREAM_SCRATCH_FRAMES                 8192
+
+struct _cslMp3Stream {
+    mp3Index index;
+    AVFormatContext* format_ctx;
+    AVCodecContext* codec_ctx;
+    SwrContext* swr_ctx;
+    int stream_index;
+    AVPacket* packet;
+    AVFrame* frame;
+    int64_t step; // raw samples in one exact step of output frames
+    int64_t out_step; // output frames in that step
+    int64_t warmup; // raw samples fed to the resampler ahead of a seek, a multiple of step
+    int64_t num_frames;
+
+    int packet_idx; // index of the next packet read, -1 until lined up after a seek
+    int64_t prime_start; // raw samples before this are decoded but not converted
+    int64_t out_pos; // output frame the next converted frame lands on
+    int64_t position; // next output frame handed out
+    bool eof;
+    bool drained;
+
+    /* converted frames [scratch_start, scratch_start + scratch_fill) */
+    uint8_t* scratch;
+    int scratch_frames;
+    int scratch_fill;
+    int64_t scratch_start;
+};
+
+static int _streamConvert(CslMp3Stream* s, AVFrame* frame, int offset, int count) {
+    const uint8_t* planes[8] = {0};
+    const uint8_t** in_planes = NULL;
+    if (frame) {
+        int bps = av_get_bytes_per_sample(s->codec_ctx->sample_fmt);
+        int channels = s->codec_ctx->ch_layout.nb_channels;
+        if (av_sample_fmt_is_planar(s->codec_ctx->sample_fmt)) {
+            for (int ch = 0; ch < channels && ch < 8; ch++) {
+                planes[ch] = frame->extended_data[ch] + offset * bps;
+            }
+        }
+        else {
+            planes[0] = frame->extended_data[0] + offset * bps * channels;
+        }
+        in_planes = planes;
+    }
+    int needed = s->scratch_fill + swr_get_out_samples(s->swr_ctx, count);
+    if (needed > s->scratch_frames) {
+        uint8_t* grown = realloc(s->scratch, needed * MP3_OUT_BYTES_PER_FRAME);
+        if (!grown) return SoundIoErrorNoMem;
+        s->scratch = grown;
+        s->scratch_frames = needed;
+    }
+    uint8_t* out = s->scratch + s->scratch_fill * MP3_OUT_BYTES_PER_FRAME;
+    int converted = swr_convert(s->swr_ctx, &out, s->scratch_frames - s->scratch_fill, in_planes, count);
+    if (converted < 0) return CSLErrorDecodingFile;
+    s->scratch_fill += converted;
+    s->out_pos += converted;
+    return SoundIoErrorNone;
+}
+
+/* decodes packets until some frames come out or the stream is used up */
+static int _streamDecode(CslMp3Stream* s) {
+    const mp3Index* index = &s->index;
+    int64_t stream_end = index->total_samples - index->padding;
+    s->scratch_start = s->out_pos;
+    s->scratch_fill = 0;
+    int err = SoundIoErrorNone;
+    while (s->scratch_fill == 0 && err == SoundIoErrorNone) {
+        if (s->eof) {
+            if (s->drained) break;
+            /* whatever the resampler still holds */
+            s->drained = true;
+            err = _streamConvert(s, NULL, 0, 0);
+            continue;
+        }
+        if (av_read_frame(s->format_ctx, s->packet) < 0) {
+            s->eof = true;
+            continue;
+        }
+        AVPacket* packet = s->packet;
+        if (packet->stream_index != s->stream_index) {
+            av_packet_unref(packet);
+            continue;
+        }
+        if (s->packet_idx < 0) s->packet_idx = _packetForPosition(index, packet->pos);
+        if (s->packet_idx < 0 || s->packet_idx >= index->num_packets) {
+            av_packet_unref(packet);
+            continue;
+        }
+        int64_t packet_sample = index->packets[s->packet_idx].sample;
+        s->packet_idx += 1;
+        if (packet_sample >= stream_end) {
+            s->eof = true;
+            av_packet_unref(packet);
+            continue;
+        }
+        packet->pts = packet_sample;
+        packet->dts = packet_sample;
+        if (avcodec_send_packet(s->codec_ctx, packet) == 0) {
+            while (err == SoundIoErrorNone && avcodec_receive_frame(s->codec_ctx, s->frame) == 0) {
+                int64_t frame_start = (s->frame->pts != AV_NOPTS_VALUE) ? s->frame->pts : packet_sample;
+                int64_t frame_end = frame_start + s->frame->nb_samples;
+                int64_t keep_start = (frame_start > s->prime_start) ? frame_start : s->prime_start;
+                int64_t keep_end = (frame_end < stream_end) ? frame_end : stream_end;
+                if (keep_end > keep_start) {
+                    err = _streamConvert(s, s->frame, (int)(keep_start - frame_start), (int)(keep_end - keep_start));
+                }
+            }
+        }
+        av_packet_unref(packet);
+    }
+    return err;
+}
+
+int soundlib_mp3_stream_open(const char* path, CslMp3Stream** out) {
+    *out = NULL;
+    CslMp3Stream* s = calloc(1, sizeof(CslMp3Stream));
+    if (!s) return SoundIoErrorNoMem;
+    pcmCacheKey key;
+    bool use_cache = pcm_cache_enabled() &&
+        pcm_cache_make_key(path, MP3_OUT_SAMPLE_RATE, MP3_OUT_CHANNELS, 16, &key) == SoundIoErrorNone;
+    int err = _loadIndex(path, use_cache ? &key : NULL, &s->index);
+    if (err != SoundIoErrorNone) {
+        free(s);
+        return err;
+    }
+    err = _openDecoder(path, &s->format_ctx, &s->codec_ctx, &s->stream_index);
+    if (err != SoundIoErrorNone) {
+        free(s->index.packets);
+        free(s);
+        return err;
+    }
+    s->swr_ctx = _createConverter(s->codec_ctx);
+    s->packet = av_packet_alloc();
+    s->frame = av_frame_alloc();
+    s->scratch = malloc(MP3_STREAM_SCRATCH_FRAMES * MP3_OUT_BYTES_PER_FRAME);
+    s->scratch_frames = MP3_STREAM_SCRATCH_FRAMES;
+    if (!s->swr_ctx || !s->packet || !s->frame || !s->scratch) {
+        err = s->swr_ctx ? SoundIoErrorNoMem : CSLErrorDecodingFile;
+        soundlib_mp3_stream_close(s);
+        return err;
+    }
+
+    int64_t g = _gcd(s->index.sample_rate, MP3_OUT_SAMPLE_RATE);
+    s->step = s->index.sample_rate / g;
+    s->out_step = MP3_OUT_SAMPLE_RATE / g;
+    if (s->index.sample_rate != MP3_OUT_SAMPLE_RATE) {
+        s->warmup = ((MP3_RESAMPLER_WARMUP_SAMPLES + s->step - 1) / s->step) * s->step;
+    }
+    s->num_frames = _outputFrame(&s->index, s->index.total_samples - s->index.padding);
+    err = soundlib_mp3_stream_seek(s, 0);
+    if (err != SoundIoErrorNone) {
+        soundlib_mp3_stream_close(s);
+        return err;
+    }
+    *out = s;
+    return SoundIoErrorNone;
+}
+
+void soundlib_mp3_stream_close(CslMp3Stream* s) {
+    if (!s) return;
+    free(s->scratch);
+    av_packet_free(&s->packet);
+    av_frame_free(&s->frame);
+    swr_free(&s->swr_ctx);
+    avcodec_free_context(&s->codec_ctx);
+    avformat_close_input(&s->format_ctx);
+    free(s->index.packets);
+    free(s);
+}
+
+int64_t soundlib_mp3_stream_get_num_frames(const CslMp3Stream* s) {
+    return s->num_frames;
+}
+
+int soundlib_mp3_stream_seek(CslMp3Stream* s, int64_t frame) {
+    const mp3Index* index = &s->index;
+    if (frame < 0) frame = 0;
+    if (frame > s->num_frames) frame = s->num_frames;
+
+    /*
+    start converting on a step boundary at or before the frame (less the resampler warmup) so
+    output frames line up exactly with a full decode, then skip forward to the frame
+    */
+    int64_t first = index->encoder_delay;
+    int64_t prime_start = first + (frame / s->out_step) * s->step - s->warmup;
+    if (prime_start < first) prime_start = first;
+    int first_packet = _firstPacketFor(index, _packetForSample(index, prime_start));
+    if (av_seek_frame(s->format_ctx, s->stream_index, index->packets[first_packet].pos, AVSEEK_FLAG_BYTE) < 0) {
+        return CSLErrorDecodingFile;
+    }
+    avcodec_flush_buffers(s->codec_ctx);
+    swr_close(s->swr_ctx);
+    if (swr_init(s->swr_ctx) < 0) return CSLErrorDecodingFile;
+
+    s->packet_idx = -1;
+    s->prime_start = prime_start;
+    s->out_pos = _outputFrame(index, prime_start);
+    s->position = frame;
+    s->eof = false;
+    s->drained = false;
+    s->scratch_start = s->out_pos;
+    s->scratch_fill = 0;
+    return SoundIoErrorNone;
+}
+
+int soundlib_mp3_stream_read(CslMp3Stream* s, unsigned char* out, int num_frames) {
+    int done = 0;
+    while (done < num_frames && s->position < s->num_frames) {
+        int64_t available_end = s->scratch_start + s->scratch_fill;
+        if (available_end > s->num_frames) available_end = s->num_frames;
+        if (s->position < available_end) {
+            int64_t from = (s->position > s->scratch_start) ? s->position : s->scratch_start;
+            int n = (int)(available_end - from);
+            if (n > num_frames - done) n = num_frames - done;
+            memcpy(out + (size_t)done * MP3_OUT_BYTES_PER_FRAME,
+                   s->scratch + (from - s->scratch_start) * MP3_OUT_BYTES_PER_FRAME,
+                   (size_t)n * MP3_OUT_BYTES_PER_FRAME);
+            done += n;
+            s->position = from + n;
+            continue;
+        }
+        if (_streamDecode(s) != SoundIoErrorNone || s->scratch_fill == 0) break;
+    }
+    return done;
+}
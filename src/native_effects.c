@@ -0,0 +1,609 @@
+#include "native_effects.h"
+#include "track.h"
+#include "state.h"
+#include "errors.h"
+#include <soundio/soundio.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* serialises setters, the audio thread never takes it */
+static pthread_mutex_t _paramsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const int _combTunings[NATIVE_REVERB_COMBS] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617};
+static const int _allpassTunings[NATIVE_REVERB_ALLPASSES] = {556, 441, 341, 225};
+
+static float _dbToGain(float db) {
+    return powf(10.0f, db / 20.0f);
+}
+
+/* one pole smoothing coefficient that gets about two thirds of the way in ms */
+static float _timeCoeff(float ms, int sample_rate) {
+    if (ms <= 0.0f) return 0.0f;
+    return expf(-1000.0f / (ms * (float)sample_rate));
+}
+
+/* tails so long they may as well never end count as infinite, so they can't overflow */
+static int _tailFrames(int64_t frames) {
+    return (frames < 0 || frames > INT32_MAX / 4) ? CSL_EFFECT_INFINITE_TAIL : (int)frames;
+}
+
+/* frames until something that keeps gain of itself every step falls to NATIVE_TAIL_FLOOR */
+static int _decaySteps(double gain) {
+    gain = fabs(gain);
+    if (gain >= 1.0) return CSL_EFFECT_INFINITE_TAIL;
+    if (gain <= 0.0) return 0;
+    double steps = ceil(log(NATIVE_TAIL_FLOOR) / log(gain));
+    return (steps > (double)INT32_MAX / 4) ? CSL_EFFECT_INFINITE_TAIL : _tailFrames((int64_t)steps);
+}
+
+/* tails only add up while both are finite */
+static int _addTails(int a, int b) {
+    if (a < 0 || b < 0) return CSL_EFFECT_INFINITE_TAIL;
+    return _tailFrames((int64_t)a + b);
+}
+
+/* ********************************************* */
+/* parameters                                    */
+/* ********************************************* */
+
+static void _beginEdit(CslNativeEffect* fx) {
+    pthread_mutex_lock(&_paramsLock);
+    __atomic_add_fetch(&fx->sequence, 1, __ATOMIC_ACQ_REL);
+}
+
+static void _endEdit(CslNativeEffect* fx) {
+    __atomic_add_fetch(&fx->sequence, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&_paramsLock);
+}
+
+/* rbj cookbook coefficients, returns how long the band rings */
+static int _designBand(nativeBiquad* biquad, const eqBandParams* band, int sample_rate) {
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+    if (band->enabled) {
+        double w0 = 2.0 * M_PI * band->frequency / sample_rate;
+        double cw = cos(w0), sw = sin(w0);
+        double q = (band->q > 0.0f) ? band->q : 0.7071;
+        double alpha = sw / (2.0 * q);
+        double a = pow(10.0, band->gain_db / 40.0);
+        double root = 2.0 * sqrt(a) * alpha;
+        switch (band->type) {
+            case CSL_EQ_PEAK:
+                b0 = 1.0 + alpha * a; b1 = -2.0 * cw; b2 = 1.0 - alpha * a;
+                a0 = 1.0 + alpha / a; a1 = -2.0 * cw; a2 = 1.0 - alpha / a;
+                break;
+            case CSL_EQ_LOW_SHELF:
+                b0 = a * ((a + 1.0) - (a - 1.0) * cw + root);
+                b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cw);
+                b2 = a * ((a + 1.0) - (a - 1.0) * cw - root);
+                a0 = (a + 1.0) + (a - 1.0) * cw + root;
+                a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cw);
+                a2 = (a + 1.0) + (a - 1.0) * cw - root;
+                break;
+            case CSL_EQ_HIGH_SHELF:
+                b0 = a * ((a + 1.0) + (a - 1.0) * cw + root);
+                b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cw);
+                b2 = a * ((a + 1.0) + (a - 1.0) * cw - root);
+                a0 = (a + 1.0) - (a - 1.0) * cw + root;
+                a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cw);
+                a2 = (a + 1.0) - (a - 1.0) * cw - root;
+                break;
+            case CSL_EQ_LOW_PASS:
+                b0 = (1.0 - cw) / 2.0; b1 = 1.0 - cw; b2 = (1.0 - cw) / 2.0;
+                a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+                break;
+            case CSL_EQ_HIGH_PASS:
+                b0 = (1.0 + cw) / 2.0; b1 = -(1.0 + cw); b2 = (1.0 + cw) / 2.0;
+                a0 = 1.0 + alpha; a1 = -2.0 * cw; a2 = 1.0 - alpha;
+                break;
+        }
+    }
+    biquad->b0 = csl_vec4_set1((float)(b0 / a0));
+    biquad->b1 = csl_vec4_set1((float)(b1 / a0));
+    biquad->b2 = csl_vec4_set1((float)(b2 / a0));
+    biquad->a1 = csl_vec4_set1((float)(a1 / a0));
+    biquad->a2 = csl_vec4_set1((float)(a2 / a0));
+
+    /* the slowest pole sets the ring, poles are the roots of z^2 + a1 z + a2 */
+    double p1 = a1 / a0, p2 = a2 / a0;
+    double disc = p1 * p1 - 4.0 * p2;
+    double radius = (disc < 0.0) ? sqrt(p2) : 0.5 * (fabs(p1) + sqrt(disc));
+    return _decaySteps(radius);
+}
+
+/* works out everything that follows from the params, on the audio thread */
+static void _applyParams(CslNativeEffect* fx) {
+    const nativeParams* p = &fx->params;
+    int tail = 0;
+    switch (fx->kind) {
+        case NATIVE_EQ:
+            for (int b = 0; b < fx->num_bands; b++) {
+                tail = _addTails(tail, _designBand(&fx->biquads[b], &p->bands[b], fx->sample_rate));
+            }
+            break;
+        case NATIVE_DYNAMICS:
+            fx->attack_coeff = _timeCoeff(p->attack_ms, fx->sample_rate);
+            fx->release_coeff = _timeCoeff(p->release_ms, fx->sample_rate);
+            /* silent output, but the detector has to settle before it can be left alone */
+            tail = _decaySteps(fx->release_coeff);
+            break;
+        case NATIVE_DELAY: {
+            int frames = (int)lroundf(p->delay_seconds * (float)fx->sample_rate);
+            fx->delay_frames = (frames < 1) ? 1 : (frames >= fx->ring_frames) ? fx->ring_frames - 1 : frames;
+            /* the ring holds delay_frames, each pass round it is scaled by the feedback */
+            int repeats = _decaySteps(p->feedback);
+            tail = (repeats < 0) ? CSL_EFFECT_INFINITE_TAIL : _tailFrames((int64_t)fx->delay_frames * (repeats + 1));
+            break;
+        }
+        case NATIVE_REVERB: {
+            fx->comb_feedback = p->room_size * 0.28f + 0.7f;
+            fx->comb_damp = p->damping * 0.4f;
+            /* the longest comb decays slowest, then it still has to get through the allpasses */
+            const reverbChannel* rc = &fx->reverb[1];
+            int longest = 0, allpasses = 0;
+            for (int c = 0; c < NATIVE_REVERB_COMBS; c++) if (rc->comb_lengths[c] > longest) longest = rc->comb_lengths[c];
+            for (int a = 0; a < NATIVE_REVERB_ALLPASSES; a++) allpasses += rc->allpass_lengths[a];
+            int passes = _decaySteps(fx->comb_feedback);
+            int ring = _decaySteps(NATIVE_REVERB_ALLPASS_FEEDBACK);
+            tail = (passes < 0) ? CSL_EFFECT_INFINITE_TAIL : _addTails(_tailFrames((int64_t)longest * passes), allpasses * ring);
+            break;
+        }
+        default:
+            break;
+    }
+    __atomic_store_n(&fx->tail, tail, __ATOMIC_RELAXED);
+}
+
+/* picks up the latest edit if one has finished since the last period */
+static void _readParams(CslNativeEffect* fx) {
+    uint32_t before = __atomic_load_n(&fx->sequence, __ATOMIC_ACQUIRE);
+    if (before == fx->seen || (before & 1)) return;
+    nativeParams copy;
+    memcpy(&copy, &fx->pending, sizeof(nativeParams));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&fx->sequence, __ATOMIC_RELAXED) != before) return;
+    fx->params = copy;
+    fx->seen = before;
+    _applyParams(fx);
+}
+
+/* ********************************************* */
+/* processing                                    */
+/* ********************************************* */
+
+/* samples * gain, ramping from the old gain over the period when it changed */
+static void _scale(float* samples, int num_frames, int num_channels, float from, float to) {
+    int n = num_frames * num_channels;
+    if (from == to) {
+        cslVec4 g = csl_vec4_set1(to);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) csl_vec4_store(samples + i, csl_vec4_mul(csl_vec4_load(samples + i), g));
+        for (; i < n; i++) samples[i] *= to;
+        return;
+    }
+    float step = (to - from) / (float)num_frames;
+    for (int f = 0; f < num_frames; f++) {
+        float g = from + step * (float)(f + 1);
+        for (int ch = 0; ch < num_channels; ch++) samples[(size_t)f * num_channels + ch] *= g;
+    }
+}
+
+static void _processGain(CslNativeEffect* fx, float* samples, int num_frames, int num_channels) {
+    float target = _dbToGain(fx->params.gain_db);
+    _scale(samples, num_frames, num_channels, fx->gain, target);
+    fx->gain = target;
+}
+
+/* one frame of up to four channels into a vector, the missing lanes are zero */
+static inline cslVec4 _loadFrame(const float* frame, int lanes) {
+    if (lanes == 4) return csl_vec4_load(frame);
+    float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < lanes; i++) tmp[i] = frame[i];
+    return csl_vec4_load(tmp);
+}
+
+static inline void _storeFrame(float* frame, cslVec4 v, int lanes) {
+    if (lanes == 4) {
+        csl_vec4_store(frame, v);
+        return;
+    }
+    float tmp[4];
+    csl_vec4_store(tmp, v);
+    for (int i = 0; i < lanes; i++) frame[i] = tmp[i];
+}
+
+/* the cascade runs across channels: each lane is one channel's filter, four channels a step */
+static void _processEq(CslNativeEffect* fx, float* samples, int num_frames, int num_channels) {
+    for (int group = 0; group * 4 < num_channels; group++) {
+        int lanes = (num_channels - group * 4 < 4) ? num_channels - group * 4 : 4;
+        cslVec4 z1[NATIVE_EQ_MAX_BANDS], z2[NATIVE_EQ_MAX_BANDS];
+        for (int b = 0; b < fx->num_bands; b++) {
+            z1[b] = fx->z1[b][group];
+            z2[b] = fx->z2[b][group];
+        }
+        for (int f = 0; f < num_frames; f++) {
+            float* frame = samples + (size_t)f * num_channels + group * 4;
+            cslVec4 x = _loadFrame(frame, lanes);
+            for (int b = 0; b < fx->num_bands; b++) {
+                const nativeBiquad* q = &fx->biquads[b];
+                /* transposed direct form ii */
+                cslVec4 y = csl_vec4_madd(z1[b], q->b0, x);
+                z1[b] = csl_vec4_msub(csl_vec4_madd(z2[b], q->b1, x), q->a1, y);
+                z2[b] = csl_vec4_msub(csl_vec4_mul(q->b2, x), q->a2, y);
+                x = y;
+            }
+            _storeFrame(frame, x, lanes);
+        }
+        for (int b = 0; b < fx->num_bands; b++) {
+            fx->z1[b][group] = z1[b];
+            fx->z2[b][group] = z2[b];
+        }
+    }
+}
+
+/*
+a peak detector linked across channels. the gain is worked out in db every
+NATIVE_CONTROL_FRAMES and ramped linearly in between, so the logs stay off the per sample path.
+*/
+static void _processDynamics(CslNativeEffect* fx, float* samples, int num_frames, int num_channels) {
+    const nativeParams* p = &fx->params;
+    float makeup = p->gain_db;
+    for (int start = 0; start < num_frames; start += NATIVE_CONTROL_FRAMES) {
+        int n = (num_frames - start < NATIVE_CONTROL_FRAMES) ? num_frames - start : NATIVE_CONTROL_FRAMES;
+        float* block = samples + (size_t)start * num_channels;
+        float envelope = fx->envelope;
+        for (int f = 0; f < n; f++) {
+            float peak = 0.0f;
+            for (int ch = 0; ch < num_channels; ch++) {
+                float x = fabsf(block[(size_t)f * num_channels + ch]);
+                peak = (x > peak) ? x : peak;
+            }
+            float coeff = (peak > envelope) ? fx->attack_coeff : fx->release_coeff;
+            envelope = peak + coeff * (envelope - peak);
+        }
+        fx->envelope = envelope;
+
+        float level = 20.0f * log10f(envelope + 1e-9f);
+        float gain_db = makeup;
+        if (p->gate) {
+            if (level < p->threshold_db) gain_db -= p->range_db;
+        }
+        else if (level > p->threshold_db && p->ratio > 1.0f) {
+            gain_db -= (level - p->threshold_db) * (1.0f - 1.0f / p->ratio);
+        }
+        float target = _dbToGain(gain_db);
+        _scale(block, n, num_channels, fx->gain, target);
+        fx->gain = target;
+    }
+}
+
+/* out = dry * x + wet * ring[read], ring[write] = x + feedback * ring[read], over contiguous runs */
+static void _processDelay(CslNativeEffect* fx, float* samples, int num_frames, int num_channels) {
+    if (fx->ring_channels != num_channels) {
+        memset(fx->ring, 0, (size_t)fx->ring_frames * EFFECTS_MAX_CHANNELS * sizeof(float));
+        fx->ring_channels = num_channels;
+        fx->write_frame = 0;
+    }
+    cslVec4 wet = csl_vec4_set1(fx->params.wet);
+    cslVec4 dry = csl_vec4_set1(fx->params.dry);
+    cslVec4 feedback = csl_vec4_set1(fx->params.feedback);
+    int frame = 0;
+    while (frame < num_frames) {
+        int read_frame = fx->write_frame - fx->delay_frames;
+        if (read_frame < 0) read_frame += fx->ring_frames;
+        /* stop where either end wraps, and at the delay so nothing is read before it is written */
+        int n = num_frames - frame;
+        if (n > fx->ring_frames - fx->write_frame) n = fx->ring_frames - fx->write_frame;
+        if (n > fx->ring_frames - read_frame) n = fx->ring_frames - read_frame;
+        if (n > fx->delay_frames) n = fx->delay_frames;
+        float* x = samples + (size_t)frame * num_channels;
+        float* w = fx->ring + (size_t)fx->write_frame * num_channels;
+        const float* r = fx->ring + (size_t)read_frame * num_channels;
+        int count = n * num_channels;
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            cslVec4 in = csl_vec4_load(x + i), delayed = csl_vec4_load(r + i);
+            csl_vec4_store(w + i, csl_vec4_madd(in, feedback, delayed));
+            csl_vec4_store(x + i, csl_vec4_madd(csl_vec4_mul(dry, in), wet, delayed));
+        }
+        for (; i < count; i++) {
+            float in = x[i], delayed = r[i];
+            w[i] = in + fx->params.feedback * delayed;
+            x[i] = fx->params.dry * in + fx->params.wet * delayed;
+        }
+        fx->write_frame += n;
+        if (fx->write_frame == fx->ring_frames) fx->write_frame = 0;
+        frame += n;
+    }
+}
+
+/*
+freeverb: eight lowpass feedback combs in parallel then four allpasses in series, per
+channel, odd channels a little longer for width. the combs run four at a time.
+*/
+static void _processReverb(CslNativeEffect* fx, float* samples, int num_frames, int num_channels) {
+    cslVec4 feedback = csl_vec4_set1(fx->comb_feedback);
+    cslVec4 damp = csl_vec4_set1(fx->comb_damp);
+    cslVec4 undamp = csl_vec4_set1(1.0f - fx->comb_damp);
+    float wet = fx->params.wet, dry = fx->params.dry;
+    for (int f = 0; f < num_frames; f++) {
+        float* frame = samples + (size_t)f * num_channels;
+        float input = 0.0f;
+        for (int ch = 0; ch < num_channels; ch++) input += frame[ch];
+        cslVec4 in = csl_vec4_set1(input * NATIVE_REVERB_INPUT_GAIN);
+        for (int ch = 0; ch < num_channels; ch++) {
+            reverbChannel* rc = &fx->reverb[ch];
+            float sum = 0.0f;
+            for (int c = 0; c < NATIVE_REVERB_COMBS; c += 4) {
+                float out[4], store[4];
+                for (int k = 0; k < 4; k++) out[k] = rc->combs[c + k][rc->comb_pos[c + k]];
+                cslVec4 o = csl_vec4_load(out);
+                cslVec4 s = csl_vec4_madd(csl_vec4_mul(o, undamp), csl_vec4_load(rc->comb_store + c), damp);
+                csl_vec4_store(rc->comb_store + c, s);
+                csl_vec4_store(store, csl_vec4_madd(in, s, feedback));
+                for (int k = 0; k < 4; k++) {
+                    rc->combs[c + k][rc->comb_pos[c + k]] = store[k];
+                    if (++rc->comb_pos[c + k] == rc->comb_lengths[c + k]) rc->comb_pos[c + k] = 0;
+                }
+                sum += csl_vec4_hsum(o);
+            }
+            for (int a = 0; a < NATIVE_REVERB_ALLPASSES; a++) {
+                float* buffer = rc->allpasses[a];
+                float delayed = buffer[rc->allpass_pos[a]];
+                buffer[rc->allpass_pos[a]] = sum + delayed * NATIVE_REVERB_ALLPASS_FEEDBACK;
+                sum = delayed - sum;
+                if (++rc->allpass_pos[a] == rc->allpass_lengths[a]) rc->allpass_pos[a] = 0;
+            }
+            frame[ch] = dry * frame[ch] + wet * sum;
+        }
+    }
+}
+
+static void _processNative(void* context, float* samples, int num_frames, int num_channels) {
+    CslNativeEffect* fx = (CslNativeEffect*)context;
+    if (num_channels > EFFECTS_MAX_CHANNELS) return;
+    unsigned long fp_state = csl_denormals_off();
+    _readParams(fx);
+    switch (fx->kind) {
+        case NATIVE_GAIN: _processGain(fx, samples, num_frames, num_channels); break;
+        case NATIVE_EQ: _processEq(fx, samples, num_frames, num_channels); break;
+        case NATIVE_DYNAMICS: _processDynamics(fx, samples, num_frames, num_channels); break;
+        case NATIVE_DELAY: _processDelay(fx, samples, num_frames, num_channels); break;
+        case NATIVE_REVERB: _processReverb(fx, samples, num_frames, num_channels); break;
+    }
+    csl_denormals_restore(fp_state);
+}
+
+int soundlib_native_effect_process(CslNativeEffect* fx, float* samples, int num_frames, int num_channels) {
+    if (num_channels < 1 || num_channels > EFFECTS_MAX_CHANNELS) return SoundIoErrorInvalid;
+    _processNative(fx, samples, num_frames, num_channels);
+    return SoundIoErrorNone;
+}
+
+/* ********************************************* */
+/* creation                                      */
+/* ********************************************* */
+
+static CslNativeEffect* _create(nativeEffectKind kind, int sample_rate, const nativeParams* params) {
+    if (sample_rate <= 0) return NULL;
+    CslNativeEffect* fx = calloc(1, sizeof(CslNativeEffect));
+    if (!fx) return NULL;
+    fx->kind = kind;
+    fx->sample_rate = sample_rate;
+    fx->pending = *params;
+    fx->params = *params;
+    fx->gain = (kind == NATIVE_GAIN) ? _dbToGain(params->gain_db) : 1.0f;
+    return fx;
+}
+
+void soundlib_native_effect_destroy(CslNativeEffect* fx) {
+    if (!fx) return;
+    free(fx->ring);
+    for (int ch = 0; ch < EFFECTS_MAX_CHANNELS; ch++) {
+        for (int c = 0; c < NATIVE_REVERB_COMBS; c++) free(fx->reverb[ch].combs[c]);
+        for (int a = 0; a < NATIVE_REVERB_ALLPASSES; a++) free(fx->reverb[ch].allpasses[a]);
+    }
+    free(fx);
+}
+
+CslNativeEffect* soundlib_gain_create(float gain_db) {
+    nativeParams params = {0};
+    params.gain_db = gain_db;
+    /* gain doesn't depend on the rate, any will do */
+    return _create(NATIVE_GAIN, 1, &params);
+}
+
+void soundlib_gain_set(CslNativeEffect* fx, float gain_db) {
+    _beginEdit(fx);
+    fx->pending.gain_db = gain_db;
+    _endEdit(fx);
+}
+
+CslNativeEffect* soundlib_eq_create(int sample_rate, int num_bands) {
+    if (num_bands < 1 || num_bands > NATIVE_EQ_MAX_BANDS) return NULL;
+    nativeParams params = {0};
+    CslNativeEffect* fx = _create(NATIVE_EQ, sample_rate, &params);
+    if (!fx) return NULL;
+    fx->num_bands = num_bands;
+    _applyParams(fx);
+    return fx;
+}
+
+int soundlib_eq_set_band(CslNativeEffect* fx, int band, CslEqBandType type, float frequency, float q, float gain_db) {
+    if (fx->kind != NATIVE_EQ || band < 0 || band >= fx->num_bands) return SoundIoErrorInvalid;
+    if (type < CSL_EQ_PEAK || type > CSL_EQ_HIGH_PASS) return SoundIoErrorInvalid;
+    if (!(frequency > 0.0f && frequency < 0.5f * (float)fx->sample_rate)) return SoundIoErrorInvalid;
+    _beginEdit(fx);
+    eqBandParams* b = &fx->pending.bands[band];
+    b->enabled = true;
+    b->type = type;
+    b->frequency = frequency;
+    b->q = q;
+    b->gain_db = gain_db;
+    _endEdit(fx);
+    return SoundIoErrorNone;
+}
+
+/* a ratio below 1 would expand, a negative range would boost, and the envelope needs times of at least 0 */
+static bool _dynamicsValid(bool gate, float ratio_or_range, float attack_ms, float release_ms) {
+    if (gate ? !(ratio_or_range >= 0.0f) : !(ratio_or_range >= 1.0f)) return false;
+    return attack_ms >= 0.0f && release_ms >= 0.0f;
+}
+
+CslNativeEffect* soundlib_compressor_create(int sample_rate, float threshold_db, float ratio, float attack_ms, float release_ms, float makeup_db) {
+    if (!_dynamicsValid(false, ratio, attack_ms, release_ms)) return NULL;
+    nativeParams params = {0};
+    params.threshold_db = threshold_db;
+    params.ratio = ratio;
+    params.attack_ms = attack_ms;
+    params.release_ms = release_ms;
+    params.gain_db = makeup_db;
+    CslNativeEffect* fx = _create(NATIVE_DYNAMICS, sample_rate, &params);
+    if (fx) _applyParams(fx);
+    return fx;
+}
+
+CslNativeEffect* soundlib_gate_create(int sample_rate, float threshold_db, float range_db, float attack_ms, float release_ms) {
+    if (!_dynamicsValid(true, range_db, attack_ms, release_ms)) return NULL;
+    nativeParams params = {0};
+    params.gate = true;
+    params.threshold_db = threshold_db;
+    params.range_db = range_db;
+    params.attack_ms = attack_ms;
+    params.release_ms = release_ms;
+    CslNativeEffect* fx = _create(NATIVE_DYNAMICS, sample_rate, &params);
+    if (fx) _applyParams(fx);
+    return fx;
+}
+
+int soundlib_dynamics_set(CslNativeEffect* fx, float threshold_db, float ratio_or_range, float attack_ms, float release_ms) {
+    if (fx->kind != NATIVE_DYNAMICS) return SoundIoErrorInvalid;
+    /* gate is fixed when the effect is created */
+    if (!_dynamicsValid(fx->pending.gate, ratio_or_range, attack_ms, release_ms)) return SoundIoErrorInvalid;
+    _beginEdit(fx);
+    fx->pending.threshold_db = threshold_db;
+    if (fx->pending.gate) fx->pending.range_db = ratio_or_range;
+    else fx->pending.ratio = ratio_or_range;
+    fx->pending.attack_ms = attack_ms;
+    fx->pending.release_ms = release_ms;
+    _endEdit(fx);
+    return SoundIoErrorNone;
+}
+
+CslNativeEffect* soundlib_delay_create(int sample_rate, float max_seconds, float delay_seconds, float feedback, float wet, float dry) {
+    if (!(max_seconds > 0.0f) || delay_seconds > max_seconds) return NULL;
+    nativeParams params = {0};
+    params.delay_seconds = delay_seconds;
+    params.feedback = feedback;
+    params.wet = wet;
+    params.dry = dry;
+    CslNativeEffect* fx = _create(NATIVE_DELAY, sample_rate, &params);
+    if (!fx) return NULL;
+    fx->ring_frames = (int)ceilf(max_seconds * (float)sample_rate) + 1;
+    fx->ring = calloc((size_t)fx->ring_frames * EFFECTS_MAX_CHANNELS, sizeof(float));
+    if (!fx->ring) {
+        soundlib_native_effect_destroy(fx);
+        return NULL;
+    }
+    _applyParams(fx);
+    return fx;
+}
+
+int soundlib_delay_set(CslNativeEffect* fx, float delay_seconds, float feedback, float wet, float dry) {
+    if (fx->kind != NATIVE_DELAY) return SoundIoErrorInvalid;
+    _beginEdit(fx);
+    fx->pending.delay_seconds = delay_seconds;
+    fx->pending.feedback = feedback;
+    fx->pending.wet = wet;
+    fx->pending.dry = dry;
+    _endEdit(fx);
+    return SoundIoErrorNone;
+}
+
+CslNativeEffect* soundlib_reverb_create(int sample_rate, float room_size, float damping, float wet, float dry) {
+    nativeParams params = {0};
+    params.room_size = room_size;
+    params.damping = damping;
+    params.wet = wet;
+    params.dry = dry;
+    CslNativeEffect* fx = _create(NATIVE_REVERB, sample_rate, &params);
+    if (!fx) return NULL;
+    /* the tunings are in samples at 44.1 kHz */
+    float scale = (float)sample_rate / 44100.0f;
+    bool ok = true;
+    for (int ch = 0; ok && ch < EFFECTS_MAX_CHANNELS; ch++) {
+        reverbChannel* rc = &fx->reverb[ch];
+        int spread = (ch & 1) ? NATIVE_REVERB_SPREAD : 0;
+        for (int c = 0; ok && c < NATIVE_REVERB_COMBS; c++) {
+            rc->comb_lengths[c] = (int)lroundf((float)(_combTunings[c] + spread) * scale);
+            rc->combs[c] = calloc(rc->comb_lengths[c], sizeof(float));
+            ok = rc->combs[c] != NULL;
+        }
+        for (int a = 0; ok && a < NATIVE_REVERB_ALLPASSES; a++) {
+            rc->allpass_lengths[a] = (int)lroundf((float)(_allpassTunings[a] + spread) * scale);
+            rc->allpasses[a] = calloc(rc->allpass_lengths[a], sizeof(float));
+            ok = rc->allpasses[a] != NULL;
+        }
+    }
+    if (!ok) {
+        soundlib_native_effect_destroy(fx);
+        return NULL;
+    }
+    _applyParams(fx);
+    return fx;
+}
+
+int soundlib_reverb_set(CslNativeEffect* fx, float room_size, float damping, float wet, float dry) {
+    if (fx->kind != NATIVE_REVERB) return SoundIoErrorInvalid;
+    _beginEdit(fx);
+    fx->pending.room_size = room_size;
+    fx->pending.damping = damping;
+    fx->pending.wet = wet;
+    fx->pending.dry = dry;
+    _endEdit(fx);
+    return SoundIoErrorNone;
+}
+
+/* ********************************************* */
+/* tracks, buses and the master bus             */
+/* ********************************************* */
+
+int soundlib_track_add_native_effect(int trackId, CslNativeEffect* fx) {
+    if (fx == NULL) return SoundIoErrorInvalid;
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return effects_add_native(&track_p->track_effects.native_effects, _processNative, fx, &fx->tail, 0);
+}
+
+int soundlib_track_remove_native_effect(int trackId, CslNativeEffect* fx) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return effects_remove_native(&track_p->track_effects.native_effects, fx);
+}
+
+int soundlib_master_add_native_effect(CslNativeEffect* fx) {
+    if (fx == NULL) return SoundIoErrorInvalid;
+    return effects_add_native(&csoundlib_state->master_effects.native_effects, _processNative, fx, &fx->tail, 0);
+}
+
+int soundlib_master_remove_native_effect(CslNativeEffect* fx) {
+    return effects_remove_native(&csoundlib_state->master_effects.native_effects, fx);
+}
+
+int soundlib_bus_add_native_effect(int busId, CslNativeEffect* fx) {
+    if (fx == NULL) return SoundIoErrorInvalid;
+    busObject* bus = graph_get_bus(busId);
+    if (bus == NULL) return CSLErrorBusNotFound;
+    return effects_add_native(&bus->native_effects, _processNative, fx, &fx->tail, 0);
+}
+
+int soundlib_bus_remove_native_effect(int busId, CslNativeEffect* fx) {
+    busObject* bus = graph_get_bus(busId);
+    if (bus == NULL) return CSLErrorBusNotFound;
+    return effects_remove_native(&bus->native_effects, fx);
+}
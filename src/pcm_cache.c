@@ -0,0 +1,405 @@
+#include "pcm_cache.h"
+#include "csoundlib.h"
+#include "wav.h"
+#include <soundio/soundio.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define PCM_CACHE_MAX_PATH                        1024
+#define PCM_CACHE_SUFFIX                          ".pcm.wav"
+#define PCM_CACHE_INDEX_SUFFIX                    ".index"
+#define PCM_CACHE_TEMP_SUFFIX                     ".XXXXXX" // mkstemp template after the entry's name
+#define PCM_CACHE_TEMP_STALE_SECONDS              3600 // a temp file this old was left by a writer that died
+
+#define HASH_PRIME_1                              11400714785074694791ULL
+#define HASH_PRIME_2                              14029467366897019727ULL
+#define HASH_PRIME_3                              1609587929392839161ULL
+#define HASH_PRIME_4                              9650029242287828579ULL
+#define HASH_PRIME_5                              2870177450012600261ULL
+
+typedef struct _cacheEntry {
+    char name[256];
+    off_t size;
+    time_t last_used;
+} cacheEntry;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char cache_directory[PCM_CACHE_MAX_PATH] = {0};
+static size_t cache_max_bytes = 0;
+
+static inline uint64_t _rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t _read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t _read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t _hashRound(uint64_t acc, uint64_t input) {
+    acc += input * HASH_PRIME_2;
+    acc = _rotl64(acc, 31);
+    return acc * HASH_PRIME_1;
+}
+
+static inline uint64_t _hashMerge(uint64_t acc, uint64_t val) {
+    acc ^= _hashRound(0, val);
+    return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+/* xxhash64 style hash: four independent lanes so it runs at memory speed */
+static uint64_t _contentHash(const unsigned char* p, size_t len) {
+    const unsigned char* end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = HASH_PRIME_1 + HASH_PRIME_2;
+        uint64_t v2 = HASH_PRIME_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -HASH_PRIME_1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = _hashRound(v1, _read64(p)); p += 8;
+            v2 = _hashRound(v2, _read64(p)); p += 8;
+            v3 = _hashRound(v3, _read64(p)); p += 8;
+            v4 = _hashRound(v4, _read64(p)); p += 8;
+        } while (p <= limit);
+        h = _rotl64(v1, 1) + _rotl64(v2, 7) + _rotl64(v3, 12) + _rotl64(v4, 18);
+        h = _hashMerge(h, v1);
+        h = _hashMerge(h, v2);
+        h = _hashMerge(h, v3);
+        h = _hashMerge(h, v4);
+    }
+    else {
+        h = HASH_PRIME_5;
+    }
+    h += (uint64_t)len;
+    while (p + 8 <= end) {
+        h ^= _hashRound(0, _read64(p));
+        h = _rotl64(h, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)_read32(p) * HASH_PRIME_1;
+        h = _rotl64(h, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * HASH_PRIME_5;
+        h = _rotl64(h, 11) * HASH_PRIME_1;
+        p++;
+    }
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void _entryPath(const pcmCacheKey* key, const char* suffix, char* path, size_t len) {
+    snprintf(path, len, "%s/%016llx-%d-%d-%d%s",
+             cache_directory, (unsigned long long)key->content_hash,
+             key->sample_rate, key->num_channels, key->bit_depth, suffix);
+}
+
+static bool _hasSuffix(const char* name, const char* suffix) {
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0;
+}
+
+/* a temp file some writer made for an entry, the name of the entry then six characters from mkstemp */
+static bool _isTemp(const char* name) {
+    size_t name_len = strlen(name);
+    size_t temp_len = strlen(PCM_CACHE_TEMP_SUFFIX);
+    if (name_len <= temp_len || name[name_len - temp_len] != '.') return false;
+    char entry[256];
+    if (name_len - temp_len >= sizeof(entry)) return false;
+    memcpy(entry, name, name_len - temp_len);
+    entry[name_len - temp_len] = '\0';
+    return _hasSuffix(entry, PCM_CACHE_SUFFIX) || _hasSuffix(entry, PCM_CACHE_INDEX_SUFFIX);
+}
+
+static int _compareLastUsed(const void* a, const void* b) {
+    const cacheEntry* ea = (const cacheEntry*)a;
+    const cacheEntry* eb = (const cacheEntry*)b;
+    if (ea->last_used < eb->last_used) return -1;
+    if (ea->last_used > eb->last_used) return 1;
+    return 0;
+}
+
+/*
+delete least recently used entries until the cache fits in cache_max_bytes. temp files count
+towards it too, and ones left by a writer that crashed before its rename are deleted once
+they are stale. newer ones may still be written, so they are left alone. call with cache_lock held
+*/
+static void _evict(void) {
+    DIR* dir = opendir(cache_directory);
+    if (!dir) return;
+    time_t now = time(NULL);
+    size_t capacity = 64, count = 0;
+    off_t total = 0;
+    cacheEntry* entries = malloc(capacity * sizeof(cacheEntry));
+    struct dirent* dent;
+    while (entries && (dent = readdir(dir)) != NULL) {
+        if (strlen(dent->d_name) >= sizeof(entries[0].name)) continue;
+        bool temp = _isTemp(dent->d_name);
+        if (!temp && !_hasSuffix(dent->d_name, PCM_CACHE_SUFFIX) && !_hasSuffix(dent->d_name, PCM_CACHE_INDEX_SUFFIX)) continue;
+
+        char path[PCM_CACHE_MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", cache_directory, dent->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        if (temp) {
+            if (now - st.st_mtime < PCM_CACHE_TEMP_STALE_SECONDS) total += st.st_size;
+            else unlink(path);
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            cacheEntry* grown = realloc(entries, capacity * sizeof(cacheEntry));
+            if (!grown) break;
+            entries = grown;
+        }
+        strcpy(entries[count].name, dent->d_name);
+        entries[count].size = st.st_size;
+        /* hits touch the modification time, so it doubles as last use */
+        entries[count].last_used = st.st_mtime;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+    if (!entries) return;
+
+    qsort(entries, count, sizeof(cacheEntry), _compareLastUsed);
+    for (size_t i = 0; i < count && (size_t)total > cache_max_bytes; i++) {
+        char path[PCM_CACHE_MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", cache_directory, entries[i].name);
+        if (unlink(path) == 0) total -= entries[i].size;
+    }
+    free(entries);
+}
+
+int soundlib_set_decode_cache(const char* directory, size_t max_bytes) {
+    pthread_mutex_lock(&cache_lock);
+    if (directory == NULL) {
+        cache_directory[0] = '\0';
+        cache_max_bytes = 0;
+        pthread_mutex_unlock(&cache_lock);
+        return SoundIoErrorNone;
+    }
+    if (strlen(directory) >= PCM_CACHE_MAX_PATH - 64) {
+        pthread_mutex_unlock(&cache_lock);
+        return CSLErrorOpeningFile;
+    }
+    mkdir(directory, 0755);
+    struct stat st;
+    if (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        pthread_mutex_unlock(&cache_lock);
+        return CSLErrorFileNotFound;
+    }
+    strcpy(cache_directory, directory);
+    cache_max_bytes = max_bytes;
+    _evict();
+    pthread_mutex_unlock(&cache_lock);
+    return SoundIoErrorNone;
+}
+
+bool pcm_cache_enabled(void) {
+    pthread_mutex_lock(&cache_lock);
+    bool enabled = cache_directory[0] != '\0';
+    pthread_mutex_unlock(&cache_lock);
+    return enabled;
+}
+
+int pcm_cache_make_key(const char* path, int sample_rate, int num_channels, int bit_depth, pcmCacheKey* key) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return CSLErrorFileNotFound;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return CSLErrorOpeningFile;
+    }
+    unsigned char* bytes = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bytes == MAP_FAILED) return CSLErrorOpeningFile;
+    madvise(bytes, st.st_size, MADV_SEQUENTIAL);
+    key->content_hash = _contentHash(bytes, st.st_size);
+    key->sample_rate = sample_rate;
+    key->num_channels = num_channels;
+    key->bit_depth = bit_depth;
+    munmap(bytes, st.st_size);
+    return SoundIoErrorNone;
+}
+
+unsigned char* pcm_cache_map(const pcmCacheKey* key, size_t* data_bytes) {
+    char path[PCM_CACHE_MAX_PATH];
+    pthread_mutex_lock(&cache_lock);
+    if (cache_directory[0] == '\0') {
+        pthread_mutex_unlock(&cache_lock);
+        return NULL;
+    }
+    _entryPath(key, PCM_CACHE_SUFFIX, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) utimes(path, NULL);
+    pthread_mutex_unlock(&cache_lock);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= WAV_HEADER_BYTES) {
+        close(fd);
+        return NULL;
+    }
+    unsigned char* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    /* only trust entries we wrote ourselves: plain 44 byte header followed by exactly data_bytes */
+    wavHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (strncmp(header.riff_header, "RIFF", 4) != 0 || strncmp(header.data_header, "data", 4) != 0 ||
+        header.sample_rate != key->sample_rate || header.num_channels != key->num_channels ||
+        header.bit_depth != key->bit_depth || header.data_bytes != st.st_size - WAV_HEADER_BYTES) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    *data_bytes = header.data_bytes;
+    return base + WAV_HEADER_BYTES;
+}
+
+void pcm_cache_unmap(unsigned char* data, size_t data_bytes) {
+    munmap(data - WAV_HEADER_BYTES, data_bytes + WAV_HEADER_BYTES);
+}
+
+/*
+entries are written beside their final path and renamed into place so a
+concurrent reader never maps a half written file. mkstemp gives every writer
+its own temp file, since the loader pool can store the same key twice at once
+*/
+static FILE* _openTemp(const char* path, char* tmp_path, size_t tmp_len) {
+    snprintf(tmp_path, tmp_len, "%s" PCM_CACHE_TEMP_SUFFIX, path);
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) return NULL;
+    FILE* fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        close(fd);
+        unlink(tmp_path);
+    }
+    return fp;
+}
+
+int pcm_cache_store(const pcmCacheKey* key, const unsigned char* data, size_t data_bytes) {
+    char path[PCM_CACHE_MAX_PATH];
+    char tmp_path[PCM_CACHE_MAX_PATH];
+    pthread_mutex_lock(&cache_lock);
+    if (cache_directory[0] == '\0' || data_bytes > cache_max_bytes || data_bytes > UINT32_MAX - WAV_HEADER_BYTES) {
+        pthread_mutex_unlock(&cache_lock);
+        return SoundIoErrorNone;
+    }
+    _entryPath(key, PCM_CACHE_SUFFIX, path, sizeof(path));
+    pthread_mutex_unlock(&cache_lock);
+
+    FILE* fp = _openTemp(path, tmp_path, sizeof(tmp_path));
+    if (fp == NULL) return CSLErrorOpeningFile;
+    int frame_bytes = key->num_channels * (key->bit_depth / 8);
+    wavHeader header = create_wav_header(data_bytes / frame_bytes, key->sample_rate, key->bit_depth, key->num_channels);
+    bool ok = fwrite(&header, WAV_HEADER_BYTES, 1, fp) == 1 &&
+              fwrite(data, 1, data_bytes, fp) == data_bytes;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        unlink(tmp_path);
+        return CSLErrorOpeningFile;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    int err = rename(tmp_path, path);
+    if (err == 0) _evict();
+    pthread_mutex_unlock(&cache_lock);
+    if (err != 0) {
+        unlink(tmp_path);
+        return CSLErrorOpeningFile;
+    }
+    return SoundIoErrorNone;
+}
+
+void* pcm_cache_load_index(const pcmCacheKey* key, size_t* num_bytes) {
+    char path[PCM_CACHE_MAX_PATH];
+    pthread_mutex_lock(&cache_lock);
+    if (cache_directory[0] == '\0') {
+        pthread_mutex_unlock(&cache_lock);
+        return NULL;
+    }
+    _entryPath(key, PCM_CACHE_INDEX_SUFFIX, path, sizeof(path));
+    FILE* fp = fopen(path, "rb");
+    if (fp) utimes(path, NULL);
+    pthread_mutex_unlock(&cache_lock);
+    if (fp == NULL) return NULL;
+
+    struct stat st;
+    void* data = NULL;
+    if (fstat(fileno(fp), &st) == 0 && st.st_size > 0) data = malloc(st.st_size);
+    if (data && fread(data, 1, st.st_size, fp) != (size_t)st.st_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    if (data) *num_bytes = st.st_size;
+    return data;
+}
+
+int pcm_cache_store_index(const pcmCacheKey* key, const void* data, size_t num_bytes) {
+    char path[PCM_CACHE_MAX_PATH];
+    char tmp_path[PCM_CACHE_MAX_PATH];
+    pthread_mutex_lock(&cache_lock);
+    if (cache_directory[0] == '\0' || num_bytes > cache_max_bytes) {
+        pthread_mutex_unlock(&cache_lock);
+        return SoundIoErrorNone;
+    }
+    _entryPath(key, PCM_CACHE_INDEX_SUFFIX, path, sizeof(path));
+    pthread_mutex_unlock(&cache_lock);
+
+    FILE* fp = _openTemp(path, tmp_path, sizeof(tmp_path));
+    if (fp == NULL) return CSLErrorOpeningFile;
+    bool ok = fwrite(data, 1, num_bytes, fp) == num_bytes;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        unlink(tmp_path);
+        return CSLErrorOpeningFile;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    int err = rename(tmp_path, path);
+    if (err == 0) _evict();
+    pthread_mutex_unlock(&cache_lock);
+    if (err != 0) {
+        unlink(tmp_path);
+        return CSLErrorOpeningFile;
+    }
+    return SoundIoErrorNone;
+}
+
+void soundlib_release_file_data(CslFileInfo* info) {
+    switch (info->data_storage) {
+        case CSL_DATA_MAPPED: pcm_cache_unmap(info->data, info->data_bytes); break;
+        case CSL_DATA_ALLOCATED: free(info->data); break;
+        case CSL_DATA_USER: return;
+    }
+    info->data = NULL;
+    info->data_bytes = 0;
+    info->data_storage = CSL_DATA_USER;
+}
@@ -0,0 +1,363 @@
+#include "peaks.h"
+#include "csl_simd.h"
+#include "csoundlib.h"
+#include <soundio/soundio.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PEAKS_BUILD_CHUNK_FRAMES                  4096
+#define PEAKS_BYTES_CHUNK_SAMPLES                 256
+
+static void _resetAccumulator(peakAccumulator* acc, int num_channels) {
+    for (int ch = 0; ch < num_channels; ch++) {
+        acc->min[ch] = FLT_MAX;
+        acc->max[ch] = -FLT_MAX;
+        acc->sum_squares[ch] = 0.0;
+    }
+    acc->frames = 0;
+}
+
+static bool _reserve(CslPeaks* peaks, int level, int64_t count) {
+    peakLevel* lvl = &peaks->levels[level];
+    if (count <= lvl->capacity) return true;
+    if (!peaks->growable) return false;
+    int64_t capacity = (lvl->capacity > 0) ? lvl->capacity : 64;
+    while (capacity < count) capacity *= 2;
+    peakEntry* grown = realloc(lvl->entries, capacity * peaks->num_channels * sizeof(peakEntry));
+    if (!grown) return false;
+    lvl->entries = grown;
+    lvl->capacity = capacity;
+    return true;
+}
+
+/*
+entries level ends up with once total frames are appended and finished: every full block plus
+the partial one at the end. finish only goes a level up while the level below has more than
+one entry, so a level above 0 gets nothing until the total is over a block of the level below.
+*/
+static int64_t _levelEntries(int level, int64_t total) {
+    int64_t block = (int64_t)PEAKS_BASE_BLOCK << level;
+    if (level > 0 && total <= block / 2) return 0;
+    return (total + block - 1) / block;
+}
+
+/* frames a pyramid that can't grow has room for, finished summaries included */
+static int64_t _roomFrames(const CslPeaks* peaks) {
+    int64_t room = peaks->levels[0].capacity * PEAKS_BASE_BLOCK;
+    for (int level = 1; level < PEAKS_MAX_LEVELS; level++) {
+        int64_t capacity = peaks->levels[level].capacity;
+        int64_t limit = (capacity > 0) ? capacity * ((int64_t)PEAKS_BASE_BLOCK << level)
+                                       : (int64_t)PEAKS_BASE_BLOCK << (level - 1);
+        if (limit < room) room = limit;
+    }
+    return room;
+}
+
+/* store a finished summary at `level` and fold it into the block being built one level up */
+static void _emit(CslPeaks* peaks, int level, const peakEntry* entry, int64_t frames) {
+    peakLevel* lvl = &peaks->levels[level];
+    if (!_reserve(peaks, level, lvl->count + 1)) return;
+    int num_channels = peaks->num_channels;
+    memcpy(&lvl->entries[lvl->count * num_channels], entry, num_channels * sizeof(peakEntry));
+    /* readers on other threads only look at entries below count */
+    __atomic_store_n(&lvl->count, lvl->count + 1, __ATOMIC_RELEASE);
+    if (level + 1 > peaks->num_levels) peaks->num_levels = level + 1;
+
+    if (level + 1 >= PEAKS_MAX_LEVELS) return;
+    peakAccumulator* parent = &peaks->pending[level + 1];
+    for (int ch = 0; ch < num_channels; ch++) {
+        if (entry[ch].min < parent->min[ch]) parent->min[ch] = entry[ch].min;
+        if (entry[ch].max > parent->max[ch]) parent->max[ch] = entry[ch].max;
+        parent->sum_squares[ch] += (double)entry[ch].mean_square * (double)frames;
+    }
+    parent->frames += frames;
+    if (parent->frames == ((int64_t)PEAKS_BASE_BLOCK << (level + 1))) {
+        peakEntry summary[PEAKS_MAX_CHANNELS];
+        for (int ch = 0; ch < num_channels; ch++) {
+            summary[ch].min = parent->min[ch];
+            summary[ch].max = parent->max[ch];
+            summary[ch].mean_square = (float)(parent->sum_squares[ch] / (double)parent->frames);
+        }
+        int64_t parent_frames = parent->frames;
+        _resetAccumulator(parent, num_channels);
+        _emit(peaks, level + 1, summary, parent_frames);
+    }
+}
+
+/*
+summarise one full level 0 block straight from the interleaved samples. with 1, 2 or 4
+channels every vector lane always holds the same channel, so the whole block is one
+pass of vector min/max/multiply-add and a final fold of the lanes.
+*/
+static void _summariseBlock(const float* samples, int num_channels, peakEntry* entry) {
+    int num_samples = PEAKS_BASE_BLOCK * num_channels;
+    if (num_channels == 1 || num_channels == 2 || num_channels == 4) {
+        cslVec4 vmin = csl_vec4_set1(FLT_MAX);
+        cslVec4 vmax = csl_vec4_set1(-FLT_MAX);
+        cslVec4 vsq = csl_vec4_zero();
+        for (int i = 0; i < num_samples; i += 4) {
+            cslVec4 x = csl_vec4_load(samples + i);
+            vmin = csl_vec4_min(vmin, x);
+            vmax = csl_vec4_max(vmax, x);
+            vsq = csl_vec4_madd(vsq, x, x);
+        }
+        float lane_min[4], lane_max[4], lane_sq[4];
+        csl_vec4_store(lane_min, vmin);
+        csl_vec4_store(lane_max, vmax);
+        csl_vec4_store(lane_sq, vsq);
+        for (int ch = 0; ch < num_channels; ch++) {
+            entry[ch].min = FLT_MAX;
+            entry[ch].max = -FLT_MAX;
+            entry[ch].mean_square = 0.0;
+        }
+        for (int lane = 0; lane < 4; lane++) {
+            int ch = lane % num_channels;
+            if (lane_min[lane] < entry[ch].min) entry[ch].min = lane_min[lane];
+            if (lane_max[lane] > entry[ch].max) entry[ch].max = lane_max[lane];
+            entry[ch].mean_square += lane_sq[lane];
+        }
+        for (int ch = 0; ch < num_channels; ch++) {
+            entry[ch].mean_square /= (float)PEAKS_BASE_BLOCK;
+        }
+    }
+    else {
+        for (int ch = 0; ch < num_channels; ch++) {
+            float mn = FLT_MAX, mx = -FLT_MAX, sq = 0.0;
+            for (int i = ch; i < num_samples; i += num_channels) {
+                float x = samples[i];
+                if (x < mn) mn = x;
+                if (x > mx) mx = x;
+                sq += x * x;
+            }
+            entry[ch].min = mn;
+            entry[ch].max = mx;
+            entry[ch].mean_square = sq / (float)PEAKS_BASE_BLOCK;
+        }
+    }
+}
+
+static void _emitPending(CslPeaks* peaks, int level) {
+    peakAccumulator* acc = &peaks->pending[level];
+    peakEntry entry[PEAKS_MAX_CHANNELS];
+    for (int ch = 0; ch < peaks->num_channels; ch++) {
+        entry[ch].min = acc->min[ch];
+        entry[ch].max = acc->max[ch];
+        entry[ch].mean_square = (float)(acc->sum_squares[ch] / (double)acc->frames);
+    }
+    int64_t frames = acc->frames;
+    _resetAccumulator(acc, peaks->num_channels);
+    _emit(peaks, level, entry, frames);
+}
+
+CslPeaks* soundlib_peaks_create(int num_channels, int64_t reserve_frames) {
+    if (num_channels < 1 || num_channels > PEAKS_MAX_CHANNELS) return NULL;
+    CslPeaks* peaks = calloc(1, sizeof(CslPeaks));
+    if (!peaks) return NULL;
+    peaks->num_channels = num_channels;
+    peaks->growable = true;
+    for (int level = 0; level < PEAKS_MAX_LEVELS; level++) {
+        _resetAccumulator(&peaks->pending[level], num_channels);
+    }
+    /* reserve every level up front, trailing partial blocks included, so appending from the
+       audio thread never has to grow */
+    if (reserve_frames < 1) reserve_frames = 1;
+    for (int level = 0; level < PEAKS_MAX_LEVELS; level++) {
+        int64_t entries = _levelEntries(level, reserve_frames);
+        if (entries == 0) break;
+        if (!_reserve(peaks, level, entries)) {
+            soundlib_peaks_destroy(peaks);
+            return NULL;
+        }
+    }
+    return peaks;
+}
+
+void soundlib_peaks_destroy(CslPeaks* peaks) {
+    if (!peaks) return;
+    for (int level = 0; level < PEAKS_MAX_LEVELS; level++) {
+        free(peaks->levels[level].entries);
+    }
+    free(peaks);
+}
+
+int soundlib_peaks_append(CslPeaks* peaks, const float* samples, int num_frames) {
+    int num_channels = peaks->num_channels;
+    /* a full pyramid that can't grow keeps what it has rather than dropping summaries at random levels */
+    int err = SoundIoErrorNone;
+    if (!peaks->growable) {
+        int64_t room = _roomFrames(peaks) - peaks->num_frames;
+        if (room < num_frames) {
+            num_frames = (room > 0) ? (int)room : 0;
+            err = SoundIoErrorNoMem;
+        }
+    }
+    peakAccumulator* acc = &peaks->pending[0];
+    int i = 0;
+    while (i < num_frames) {
+        if (acc->frames == 0 && num_frames - i >= PEAKS_BASE_BLOCK) {
+            peakEntry entry[PEAKS_MAX_CHANNELS];
+            _summariseBlock(samples + (size_t)i * num_channels, num_channels, entry);
+            _emit(peaks, 0, entry, PEAKS_BASE_BLOCK);
+            i += PEAKS_BASE_BLOCK;
+            continue;
+        }
+        int n = PEAKS_BASE_BLOCK - (int)acc->frames;
+        if (n > num_frames - i) n = num_frames - i;
+        for (int f = i; f < i + n; f++) {
+            for (int ch = 0; ch < num_channels; ch++) {
+                float x = samples[(size_t)f * num_channels + ch];
+                if (x < acc->min[ch]) acc->min[ch] = x;
+                if (x > acc->max[ch]) acc->max[ch] = x;
+                acc->sum_squares[ch] += x * x;
+            }
+        }
+        acc->frames += n;
+        i += n;
+        if (acc->frames == PEAKS_BASE_BLOCK) _emitPending(peaks, 0);
+    }
+    peaks->num_frames += num_frames;
+    return err;
+}
+
+void soundlib_peaks_finish(CslPeaks* peaks) {
+    /* close the partly filled block at every level so the tail of the file shows up too */
+    for (int level = 0; level < PEAKS_MAX_LEVELS; level++) {
+        if (peaks->pending[level].frames > 0) _emitPending(peaks, level);
+        if (peaks->levels[level].count <= 1) break;
+    }
+    for (int level = 0; level < PEAKS_MAX_LEVELS; level++) {
+        _resetAccumulator(&peaks->pending[level], peaks->num_channels);
+    }
+}
+
+void peaks_append_bytes(CslPeaks* peaks, const unsigned char* bytes, size_t num_bytes, CslDataType data_type) {
+    float samples[PEAKS_BYTES_CHUNK_SAMPLES];
+    size_t bytes_in_buffer = get_bytes_in_buffer(data_type, false);
+    size_t chunk_bytes = PEAKS_BYTES_CHUNK_SAMPLES * bytes_in_buffer;
+    for (size_t offset = 0; offset < num_bytes; offset += chunk_bytes) {
+        size_t n = (num_bytes - offset < chunk_bytes) ? num_bytes - offset : chunk_bytes;
+        int num_samples = byte_buffer_to_float_buffer(bytes + offset, samples, n, PEAKS_BYTES_CHUNK_SAMPLES, data_type, false);
+        soundlib_peaks_append(peaks, samples, num_samples / peaks->num_channels);
+    }
+}
+
+int soundlib_peaks_build(const CslFileInfo* info, CslPeaks** out) {
+    if (info->data == NULL) return CSLErrorInputMemoryNotAllocated;
+    CslPeaks* peaks = soundlib_peaks_create(info->num_channels, info->num_frames);
+    if (!peaks) return SoundIoErrorNoMem;
+    float* samples = malloc(PEAKS_BUILD_CHUNK_FRAMES * info->num_channels * sizeof(float));
+    if (!samples) {
+        soundlib_peaks_destroy(peaks);
+        return SoundIoErrorNoMem;
+    }
+    size_t frame_bytes = get_bytes_in_buffer(info->data_type, true) * info->num_channels;
+    for (int64_t frame = 0; frame < info->num_frames; frame += PEAKS_BUILD_CHUNK_FRAMES) {
+        int64_t n = info->num_frames - frame;
+        if (n > PEAKS_BUILD_CHUNK_FRAMES) n = PEAKS_BUILD_CHUNK_FRAMES;
+        int num_samples = byte_buffer_to_float_buffer(
+            info->data + frame * frame_bytes, samples, n * frame_bytes,
+            n * info->num_channels, info->data_type, true);
+        soundlib_peaks_append(peaks, samples, num_samples / info->num_channels);
+    }
+    free(samples);
+    soundlib_peaks_finish(peaks);
+    *out = peaks;
+    return SoundIoErrorNone;
+}
+
+int soundlib_peaks_query(const CslPeaks* peaks, int channel, int64_t start_frame, int64_t end_frame, int width, CslPeak* out) {
+    if (channel < 0 || channel >= peaks->num_channels) return CSLErrorIndexOutOfBounds;
+    if (width < 1 || end_frame <= start_frame) return CSLErrorIndexOutOfBounds;
+
+    /* coarsest level whose blocks are still no wider than one pixel */
+    double frames_per_pixel = (double)(end_frame - start_frame) / (double)width;
+    int level = 0;
+    while (level + 1 < peaks->num_levels &&
+           (double)((int64_t)PEAKS_BASE_BLOCK << (level + 1)) <= frames_per_pixel) {
+        level++;
+    }
+    const peakLevel* lvl = &peaks->levels[level];
+    int64_t count = __atomic_load_n(&lvl->count, __ATOMIC_ACQUIRE);
+    int64_t block = (int64_t)PEAKS_BASE_BLOCK << level;
+    int num_channels = peaks->num_channels;
+
+    for (int px = 0; px < width; px++) {
+        int64_t a = start_frame + (int64_t)(px * frames_per_pixel);
+        int64_t b = start_frame + (int64_t)((px + 1) * frames_per_pixel);
+        int64_t first = a / block;
+        int64_t last = (b + block - 1) / block;
+        if (last <= first) last = first + 1;
+        if (last > count) last = count;
+        if (first < 0 || first >= last) {
+            out[px] = (CslPeak){0.0, 0.0, 0.0};
+            continue;
+        }
+        float mn = FLT_MAX, mx = -FLT_MAX;
+        double ms = 0.0;
+        for (int64_t i = first; i < last; i++) {
+            const peakEntry* e = &lvl->entries[i * num_channels + channel];
+            if (e->min < mn) mn = e->min;
+            if (e->max > mx) mx = e->max;
+            ms += e->mean_square;
+        }
+        out[px].min = mn;
+        out[px].max = mx;
+        out[px].rms = (float)sqrt(ms / (double)(last - first));
+    }
+    return SoundIoErrorNone;
+}
+
+int soundlib_peaks_save(const CslPeaks* peaks, const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) return CSLErrorOpeningFile;
+    uint32_t header[4] = {PEAKS_FILE_VERSION, peaks->num_channels, PEAKS_BASE_BLOCK, peaks->num_levels};
+    int64_t num_frames = peaks->num_frames;
+    bool ok = fwrite(PEAKS_FILE_MAGIC, 8, 1, fp) == 1 &&
+              fwrite(header, sizeof(header), 1, fp) == 1 &&
+              fwrite(&num_frames, sizeof(num_frames), 1, fp) == 1;
+    for (int level = 0; ok && level < peaks->num_levels; level++) {
+        int64_t count = peaks->levels[level].count;
+        ok = fwrite(&count, sizeof(count), 1, fp) == 1 &&
+             fwrite(peaks->levels[level].entries, sizeof(peakEntry) * peaks->num_channels, count, fp) == (size_t)count;
+    }
+    ok = (fclose(fp) == 0) && ok;
+    return ok ? SoundIoErrorNone : CSLErrorOpeningFile;
+}
+
+int soundlib_peaks_load(const char* path, CslPeaks** out) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) return CSLErrorFileNotFound;
+    char magic[8];
+    uint32_t header[4];
+    int64_t num_frames;
+    if (fread(magic, 8, 1, fp) != 1 || memcmp(magic, PEAKS_FILE_MAGIC, 8) != 0 ||
+        fread(header, sizeof(header), 1, fp) != 1 || header[0] != PEAKS_FILE_VERSION ||
+        header[2] != PEAKS_BASE_BLOCK || header[3] > PEAKS_MAX_LEVELS ||
+        fread(&num_frames, sizeof(num_frames), 1, fp) != 1) {
+        fclose(fp);
+        return CSLErrorOpeningFile;
+    }
+    CslPeaks* peaks = soundlib_peaks_create(header[1], 0);
+    if (!peaks) {
+        fclose(fp);
+        return SoundIoErrorNoMem;
+    }
+    peaks->num_frames = num_frames;
+    bool ok = true;
+    for (int level = 0; ok && level < (int)header[3]; level++) {
+        int64_t count;
+        ok = fread(&count, sizeof(count), 1, fp) == 1 && count >= 0 && _reserve(peaks, level, count) &&
+             fread(peaks->levels[level].entries, sizeof(peakEntry) * peaks->num_channels, count, fp) == (size_t)count;
+        if (ok) peaks->levels[level].count = count;
+    }
+    fclose(fp);
+    if (!ok) {
+        soundlib_peaks_destroy(peaks);
+        return CSLErrorOpeningFile;
+    }
+    peaks->num_levels = header[3];
+    *out = peaks;
+    return SoundIoErrorNone;
+}
@@ -21,8 +21,12 @@
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "pocketfft.h"
+#include "fft_float.h"
+#include "threadpool.h"
 
 // Assume C99 compiler
 //#include "npy_config.h"
@@ -784,14 +788,12 @@ NOINLINE static void pass11 (size_t ido, size_t l1, const cmplx * restrict cc,
 
 NOINLINE static int passg (size_t ido, size_t ip, size_t l1,
   cmplx * restrict cc, cmplx * restrict ch, const cmplx * restrict wa,
-  const cmplx * restrict csarr, const int sign)
+  const cmplx * restrict csarr, const int sign, cmplx * restrict wal)
   {
   const size_t cdim=ip;
   size_t ipph = (ip+1)/2;
   size_t idl1 = ido*l1;
 
-  cmplx * restrict wal=RALLOC(cmplx,ip);
-  if (!wal) return -1;
   wal[0]=(cmplx){1.,0.};
   for (size_t i=1; i<ip; ++i)
     wal[i]=(cmplx){csarr[i].r,sign*csarr[i].i};
@@ -851,7 +853,6 @@ NOINLINE static int passg (size_t ido, size_t ip, size_t l1,
         }
       }
     }
-  DEALLOC(wal);
 
   // shuffling and twiddling
   if (ido==1)
@@ -886,14 +887,17 @@ NOINLINE static int passg (size_t ido, size_t ip, size_t l1,
 #undef CX2
 #undef CX
 
+/* work holds CFFTP_WORK(length) doubles: len complex for the passes and up to len for passg */
+#define CFFTP_WORK(len) (4*(len))
+
 NOINLINE WARN_UNUSED_RESULT static int pass_all(cfftp_plan plan, cmplx c[], double fct,
-  const int sign)
+  const int sign, double *work)
   {
   if (plan->length==1) return 0;
   size_t len=plan->length;
   size_t l1=1, nf=plan->nfct;
-  cmplx *ch = RALLOC(cmplx, len);
-  if (!ch) return -1;
+  cmplx *ch = (cmplx *)work;
+  cmplx *wal = ch+len;
   cmplx *p1=c, *p2=ch;
 
   for(size_t k1=0; k1<nf; k1++)
@@ -917,8 +921,8 @@ NOINLINE WARN_UNUSED_RESULT static int pass_all(cfftp_plan plan, cmplx c[], doub
     else if(ip==11) pass11(ido, l1, p1, p2, plan->fct[k1].tw, sign);
     else
       {
-      if (passg(ido, ip, l1, p1, p2, plan->fct[k1].tw, plan->fct[k1].tws, sign))
-        { DEALLOC(ch); return -1; }
+      if (passg(ido, ip, l1, p1, p2, plan->fct[k1].tw, plan->fct[k1].tws, sign, wal))
+        return -1;
       SWAP(p1,p2,cmplx *);
       }
     SWAP(p1,p2,cmplx *);
@@ -942,7 +946,6 @@ NOINLINE WARN_UNUSED_RESULT static int pass_all(cfftp_plan plan, cmplx c[], doub
         c[i].r *= fct;
         c[i].i *= fct;
         }
-  DEALLOC(ch);
   return 0;
   }
 
@@ -961,12 +964,12 @@ NOINLINE WARN_UNUSED_RESULT static int pass_all(cfftp_plan plan, cmplx c[], doub
 #undef PMC
 
 NOINLINE WARN_UNUSED_RESULT
-static int cfftp_forward(cfftp_plan plan, double c[], double fct)
-  { return pass_all(plan,(cmplx *)c, fct, -1); }
+static int cfftp_forward(cfftp_plan plan, double c[], double fct, double *work)
+  { return pass_all(plan,(cmplx *)c, fct, -1, work); }
 
 NOINLINE WARN_UNUSED_RESULT
-static int cfftp_backward(cfftp_plan plan, double c[], double fct)
-  { return pass_all(plan,(cmplx *)c, fct, 1); }
+static int cfftp_backward(cfftp_plan plan, double c[], double fct, double *work)
+  { return pass_all(plan,(cmplx *)c, fct, 1, work); }
 
 NOINLINE WARN_UNUSED_RESULT
 static int cfftp_factorize (cfftp_plan plan)
@@ -1715,14 +1718,16 @@ static void copy_and_norm(double *c, double *p1, size_t n, double fct)
         c[i] *= fct;
   }
 
+/* work holds RFFTP_WORK(length) doubles */
+#define RFFTP_WORK(len) (len)
+
 WARN_UNUSED_RESULT
-static int rfftp_forward(rfftp_plan plan, double c[], double fct)
+static int rfftp_forward(rfftp_plan plan, double c[], double fct, double *work)
   {
   if (plan->length==1) return 0;
   size_t n=plan->length;
   size_t l1=n, nf=plan->nfct;
-  double *ch = RALLOC(double, n);
-  if (!ch) return -1;
+  double *ch = work;
   double *p1=c, *p2=ch;
 
   for(size_t k1=0; k1<nf;++k1)
@@ -1747,18 +1752,16 @@ static int rfftp_forward(rfftp_plan plan, double c[], double fct)
     SWAP (p1,p2,double *);
     }
   copy_and_norm(c,p1,n,fct);
-  DEALLOC(ch);
   return 0;
   }
 
 WARN_UNUSED_RESULT
-static int rfftp_backward(rfftp_plan plan, double c[], double fct)
+static int rfftp_backward(rfftp_plan plan, double c[], double fct, double *work)
   {
   if (plan->length==1) return 0;
   size_t n=plan->length;
   size_t l1=1, nf=plan->nfct;
-  double *ch = RALLOC(double, n);
-  if (!ch) return -1;
+  double *ch = work;
   double *p1=c, *p2=ch;
 
   for(size_t k=0; k<nf; k++)
@@ -1779,7 +1782,6 @@ static int rfftp_backward(rfftp_plan plan, double c[], double fct)
     l1*=ip;
     }
   copy_and_norm(c,p1,n,fct);
-  DEALLOC(ch);
   return 0;
   }
 
@@ -1945,8 +1947,10 @@ NOINLINE static fftblue_plan make_fftblue_plan (size_t length)
   plan->plan=make_cfftp_plan(plan->n2);
   if (!plan->plan)
     { DEALLOC(tmp); DEALLOC(plan->mem); DEALLOC(plan); return NULL; }
-  if (cfftp_forward(plan->plan,plan->bkf,1.)!=0)
-    { DEALLOC(tmp); DEALLOC(plan->mem); DEALLOC(plan); return NULL; }
+  double *work = RALLOC(double, CFFTP_WORK(plan->n2));
+  if (!work || cfftp_forward(plan->plan,plan->bkf,1.,work)!=0)
+    { DEALLOC(work); DEALLOC(tmp); DEALLOC(plan->mem); DEALLOC(plan); return NULL; }
+  DEALLOC(work);
   DEALLOC(tmp);
 
   return plan;
@@ -1959,15 +1963,18 @@ NOINLINE static void destroy_fftblue_plan (fftblue_plan plan)
   DEALLOC(plan);
   }
 
+/* work holds FFTBLUE_WORK(n2) doubles: a_k and the work of the length n2 transforms */
+#define FFTBLUE_WORK(n2) (2*(n2)+CFFTP_WORK(n2))
+
 NOINLINE WARN_UNUSED_RESULT
-static int fftblue_fft(fftblue_plan plan, double c[], int isign, double fct)
+static int fftblue_fft(fftblue_plan plan, double c[], int isign, double fct, double *work)
   {
   size_t n=plan->n;
   size_t n2=plan->n2;
   double *bk  = plan->bk;
   double *bkf = plan->bkf;
-  double *akf = RALLOC(double, 2*n2);
-  if (!akf) return -1;
+  double *akf = work;
+  double *cwork = work+2*n2;
 
 /* initialize a_k and FFT it */
   if (isign>0)
@@ -1985,8 +1992,8 @@ static int fftblue_fft(fftblue_plan plan, double c[], int isign, double fct)
   for (size_t m=2*n; m<2*n2; ++m)
     akf[m]=0;
 
-  if (cfftp_forward (plan->plan,akf,fct)!=0)
-    { DEALLOC(akf); return -1; }
+  if (cfftp_forward (plan->plan,akf,fct,cwork)!=0)
+    return -1;
 
 /* do the convolution */
   if (isign>0)
@@ -2005,8 +2012,8 @@ static int fftblue_fft(fftblue_plan plan, double c[], int isign, double fct)
       }
 
 /* inverse FFT */
-  if (cfftp_backward (plan->plan,akf,1.)!=0)
-    { DEALLOC(akf); return -1; }
+  if (cfftp_backward (plan->plan,akf,1.,cwork)!=0)
+    return -1;
 
 /* multiply by b_k */
   if (isign>0)
@@ -2021,24 +2028,25 @@ static int fftblue_fft(fftblue_plan plan, double c[], int isign, double fct)
       c[m]   = bk[m]  *akf[m] + bk[m+1]*akf[m+1];
       c[m+1] =-bk[m+1]*akf[m] + bk[m]  *akf[m+1];
       }
-  DEALLOC(akf);
   return 0;
   }
 
 WARN_UNUSED_RESULT
-static int cfftblue_backward(fftblue_plan plan, double c[], double fct)
-  { return fftblue_fft(plan,c,1,fct); }
+static int cfftblue_backward(fftblue_plan plan, double c[], double fct, double *work)
+  { return fftblue_fft(plan,c,1,fct,work); }
 
 WARN_UNUSED_RESULT
-static int cfftblue_forward(fftblue_plan plan, double c[], double fct)
-  { return fftblue_fft(plan,c,-1,fct); }
+static int cfftblue_forward(fftblue_plan plan, double c[], double fct, double *work)
+  { return fftblue_fft(plan,c,-1,fct,work); }
+
+/* work holds RFFTBLUE_WORK(n, n2) doubles */
+#define RFFTBLUE_WORK(n,n2) (2*(n)+FFTBLUE_WORK(n2))
 
 WARN_UNUSED_RESULT
-static int rfftblue_backward(fftblue_plan plan, double c[], double fct)
+static int rfftblue_backward(fftblue_plan plan, double c[], double fct, double *work)
   {
   size_t n=plan->n;
-  double *tmp = RALLOC(double,2*n);
-  if (!tmp) return -1;
+  double *tmp = work;
   tmp[0]=c[0];
   tmp[1]=0.;
   memcpy (tmp+2,c+1, (n-1)*sizeof(double));
@@ -2048,30 +2056,27 @@ static int rfftblue_backward(fftblue_plan plan, double c[], double fct)
     tmp[2*n-m]=tmp[m];
     tmp[2*n-m+1]=-tmp[m+1];
     }
-  if (fftblue_fft(plan,tmp,1,fct)!=0)
-    { DEALLOC(tmp); return -1; }
+  if (fftblue_fft(plan,tmp,1,fct,work+2*n)!=0)
+    return -1;
   for (size_t m=0; m<n; ++m)
     c[m] = tmp[2*m];
-  DEALLOC(tmp);
   return 0;
   }
 
 WARN_UNUSED_RESULT
-static int rfftblue_forward(fftblue_plan plan, double c[], double fct)
+static int rfftblue_forward(fftblue_plan plan, double c[], double fct, double *work)
   {
   size_t n=plan->n;
-  double *tmp = RALLOC(double,2*n);
-  if (!tmp) return -1;
+  double *tmp = work;
   for (size_t m=0; m<n; ++m)
     {
     tmp[2*m] = c[m];
     tmp[2*m+1] = 0.;
     }
-  if (fftblue_fft(plan,tmp,-1,fct)!=0)
-    { DEALLOC(tmp); return -1; }
+  if (fftblue_fft(plan,tmp,-1,fct,work+2*n)!=0)
+    return -1;
   c[0] = tmp[0];
   memcpy (c+1, tmp+2, (n-1)*sizeof(double));
-  DEALLOC(tmp);
   return 0;
   }
 
@@ -2119,20 +2124,28 @@ static void destroy_cfft_plan (cfft_plan plan)
   DEALLOC(plan);
   }
 
-WARN_UNUSED_RESULT static int cfft_backward(cfft_plan plan, double c[], double fct)
+/* doubles of work a transform with this plan needs */
+static size_t cfft_work_size(cfft_plan plan)
+  {
+  if (plan->packplan)
+    return CFFTP_WORK(plan->packplan->length);
+  return FFTBLUE_WORK(plan->blueplan->n2);
+  }
+
+WARN_UNUSED_RESULT static int cfft_backward(cfft_plan plan, double c[], double fct, double *work)
   {
   if (plan->packplan)
-    return cfftp_backward(plan->packplan,c,fct);
+    return cfftp_backward(plan->packplan,c,fct,work);
   // if (plan->blueplan)
-  return cfftblue_backward(plan->blueplan,c,fct);
+  return cfftblue_backward(plan->blueplan,c,fct,work);
   }
 
-WARN_UNUSED_RESULT static int cfft_forward(cfft_plan plan, double c[], double fct)
+WARN_UNUSED_RESULT static int cfft_forward(cfft_plan plan, double c[], double fct, double *work)
   {
   if (plan->packplan)
-    return cfftp_forward(plan->packplan,c,fct);
+    return cfftp_forward(plan->packplan,c,fct,work);
   // if (plan->blueplan)
-  return cfftblue_forward(plan->blueplan,c,fct);
+  return cfftblue_forward(plan->blueplan,c,fct,work);
   }
 
 typedef struct rfft_plan_i
@@ -2179,20 +2192,28 @@ static void destroy_rfft_plan (rfft_plan plan)
   DEALLOC(plan);
   }
 
-WARN_UNUSED_RESULT static int rfft_backward(rfft_plan plan, double c[], double fct)
+/* doubles of work a transform with this plan needs */
+static size_t rfft_work_size(rfft_plan plan)
+  {
+  if (plan->packplan)
+    return RFFTP_WORK(plan->packplan->length);
+  return RFFTBLUE_WORK(plan->blueplan->n, plan->blueplan->n2);
+  }
+
+WARN_UNUSED_RESULT static int rfft_backward(rfft_plan plan, double c[], double fct, double *work)
   {
   if (plan->packplan)
-    return rfftp_backward(plan->packplan,c,fct);
+    return rfftp_backward(plan->packplan,c,fct,work);
   else // if (plan->blueplan)
-    return rfftblue_backward(plan->blueplan,c,fct);
+    return rfftblue_backward(plan->blueplan,c,fct,work);
   }
 
-WARN_UNUSED_RESULT static int rfft_forward(rfft_plan plan, double c[], double fct)
+WARN_UNUSED_RESULT static int rfft_forward(rfft_plan plan, double c[], double fct, double *work)
   {
   if (plan->packplan)
-    return rfftp_forward(plan->packplan,c,fct);
+    return rfftp_forward(plan->packplan,c,fct,work);
   else // if (plan->blueplan)
-    return rfftblue_forward(plan->blueplan,c,fct);
+    return rfftblue_forward(plan->blueplan,c,fct,work);
   }
 
 #if 0
@@ -2390,75 +2411,430 @@ PyMODINIT_FUNC PyInit__pocketfft_internal(void)
 }
 #endif
 
-// C API
-int rfft_forward_1d_array(const double *input, const int fft_len, const int nsamples, const int nrows, const float norm_factor, double *output)
+// plan cache
+
+/*
+plans only hold twiddles and factors, they are never written while transforming, so one
+plan per (length, type) is shared by every handle. each handle brings its own work buffer.
+cached plans live until soundlib_fft_clear_plan_cache finds them unused.
+
+power of two lengths also get single precision tables (fft_float.c). other lengths run the
+float entry points through the double plan, converting in the handle's dwork.
+*/
+typedef struct fft_cache_entry
+  {
+  size_t length;
+  CslFftType type;
+  int refcount; // handles using the plan, guarded by fft_cache_lock
+  rfft_plan rplan;
+  cfft_plan cplan;
+  size_t work_size;
+  fftFloatTables *ftables;
+  struct fft_cache_entry *next;
+  } fft_cache_entry;
+
+struct _cslFftPlan
+  {
+  fft_cache_entry *entry;
+  double *work;
+  float *fwork; // fft_float_work_size floats when the entry has ftables
+  double *dwork; // 2 * length + 2 doubles when it doesn't
+  };
+
+static pthread_mutex_t fft_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static fft_cache_entry *fft_cache = NULL;
+
+static fft_cache_entry *acquire_cached_plan (size_t length, CslFftType type)
+  {
+  pthread_mutex_lock(&fft_cache_lock);
+  fft_cache_entry *entry = fft_cache;
+  while (entry && (entry->length!=length || entry->type!=type))
+    entry = entry->next;
+  if (!entry)
+    {
+    /* planning happens under the lock so two threads never build the same plan twice */
+    entry = RALLOC(fft_cache_entry,1);
+    if (entry)
+      {
+      entry->length = length;
+      entry->type = type;
+      entry->refcount = 0;
+      entry->rplan = NULL;
+      entry->cplan = NULL;
+      entry->ftables = NULL;
+      if (type==CSL_FFT_REAL)
+        {
+        entry->rplan = make_rfft_plan(length);
+        if (entry->rplan) entry->work_size = rfft_work_size(entry->rplan);
+        }
+      else
+        {
+        entry->cplan = make_cfft_plan(length);
+        if (entry->cplan) entry->work_size = cfft_work_size(entry->cplan);
+        }
+      if (entry->rplan || entry->cplan)
+        {
+        /* a power of two that can't get float tables still works through dwork */
+        if (fft_float_supports((int)length, type==CSL_FFT_REAL))
+          entry->ftables = fft_float_tables_create((int)length, type==CSL_FFT_REAL);
+        }
+      if (!entry->rplan && !entry->cplan)
+        DEALLOC(entry);
+      else
+        {
+        entry->next = fft_cache;
+        fft_cache = entry;
+        }
+      }
+    }
+  if (entry) entry->refcount++;
+  pthread_mutex_unlock(&fft_cache_lock);
+  return entry;
+  }
+
+static void release_cached_plan (fft_cache_entry *entry)
+  {
+  pthread_mutex_lock(&fft_cache_lock);
+  entry->refcount--;
+  pthread_mutex_unlock(&fft_cache_lock);
+  }
+
+CslFftPlan* soundlib_fft_plan_create(int length, CslFftType type)
 {
-    rfft_plan plan=NULL;
-    int fail = 0;
+    if (length < 1 || (type != CSL_FFT_REAL && type != CSL_FFT_COMPLEX)) return NULL;
+    CslFftPlan *plan = RALLOC(CslFftPlan, 1);
+    if (!plan) return NULL;
+    plan->entry = acquire_cached_plan((size_t)length, type);
+    if (!plan->entry) {
+        DEALLOC(plan);
+        return NULL;
+    }
+    /* never zero sized, so a length 1 plan still gets a valid pointer */
+    plan->work = RALLOC(double, plan->entry->work_size + 1);
+    plan->fwork = NULL;
+    plan->dwork = NULL;
+    if (plan->entry->ftables)
+        plan->fwork = RALLOC(float, fft_float_work_size(plan->entry->ftables));
+    else
+        plan->dwork = RALLOC(double, 2 * (size_t)length + 2);
+    if (!plan->work || (!plan->fwork && !plan->dwork)) {
+        soundlib_fft_plan_destroy(plan);
+        return NULL;
+    }
+    return plan;
+}
 
-    if ((fft_len < 1) || (nsamples < 1) || (nrows < 1) || (input == NULL) || (output == NULL)) {
-      // Invalid parameter.
-      return -1;
+void soundlib_fft_plan_destroy(CslFftPlan* plan)
+{
+    if (!plan) return;
+    release_cached_plan(plan->entry);
+    DEALLOC(plan->work);
+    DEALLOC(plan->fwork);
+    DEALLOC(plan->dwork);
+    DEALLOC(plan);
+}
+
+int soundlib_fft_plan_length(const CslFftPlan* plan)
+{
+    return (int)plan->entry->length;
+}
+
+int soundlib_fft_forward_inplace(CslFftPlan* plan, double* data, CslFftLayout layout, double fct)
+{
+    fft_cache_entry *entry = plan->entry;
+    size_t npts = entry->length;
+    if (entry->type == CSL_FFT_COMPLEX) return cfft_forward(entry->cplan, data, fct, plan->work);
+    if (layout == CSL_FFT_HALFCOMPLEX) return rfft_forward(entry->rplan, data, fct, plan->work);
+    /* pocketfft leaves r0 r1 i1 ... in place, one along from data[0] so r0 gets its zero imaginary part */
+    size_t rstep = (npts / 2 + 1) * 2;
+    if (rfft_forward(entry->rplan, data + 1, fct, plan->work) != 0) return -1;
+    data[0] = data[1];
+    data[1] = 0.0;
+    if (npts % 2 == 0) data[rstep - 1] = 0.0;
+    return 0;
+}
+
+int soundlib_fft_backward_inplace(CslFftPlan* plan, double* data, CslFftLayout layout, double fct)
+{
+    fft_cache_entry *entry = plan->entry;
+    if (entry->type == CSL_FFT_COMPLEX) return cfft_backward(entry->cplan, data, fct, plan->work);
+    if (layout == CSL_FFT_HALFCOMPLEX) return rfft_backward(entry->rplan, data, fct, plan->work);
+    /* i0 is dropped by moving r0 over it, i(n/2) for even lengths is past the end of the signal */
+    data[1] = data[0];
+    return rfft_backward(entry->rplan, data + 1, fct, plan->work);
+}
+
+int soundlib_fft_forward(CslFftPlan* plan, const double* input, double* output, double fct)
+{
+    fft_cache_entry *entry = plan->entry;
+    size_t npts = entry->length;
+    if (entry->type == CSL_FFT_COMPLEX) {
+        if (output != input) memcpy(output, input, 2 * npts * sizeof(double));
+        return cfft_forward(entry->cplan, output, fct, plan->work);
     }
+    memmove(output + 1, input, npts * sizeof(double));
+    return soundlib_fft_forward_inplace(plan, output, CSL_FFT_PACKED, fct);
+}
 
-    //PyArrayObject *data = (PyArrayObject *)PyArray_FromAny(a1,
-    //        PyArray_DescrFromType(NPY_DOUBLE), 1, 0,
-    //        NPY_ARRAY_DEFAULT | NPY_ARRAY_ENSUREARRAY | NPY_ARRAY_FORCECAST,
-    //        NULL);
-    //if (!data) return NULL;
+int soundlib_fft_backward(CslFftPlan* plan, const double* input, double* output, double fct)
+{
+    fft_cache_entry *entry = plan->entry;
+    size_t npts = entry->length;
+    if (entry->type == CSL_FFT_COMPLEX) {
+        if (output != input) memcpy(output, input, 2 * npts * sizeof(double));
+        return cfft_backward(entry->cplan, output, fct, plan->work);
+    }
+    /* drop the imaginary parts pocketfft doesn't store: i0, and i(n/2) for even lengths */
+    double r0 = input[0];
+    memmove(output + 1, input + 2, (npts - 1) * sizeof(double));
+    output[0] = r0;
+    return rfft_backward(entry->rplan, output, fct, plan->work);
+}
 
-    int npts = fft_len;
+/* number of reals in the spectrum and in the signal of a plan */
+static size_t spectrum_size (const fft_cache_entry *entry)
+  {
+  return (entry->type==CSL_FFT_REAL) ? (entry->length/2+1)*2 : 2*entry->length;
+  }
 
-    //npy_intp *tdim=(npy_intp *)malloc(ndim*sizeof(npy_intp));
-    //if (!tdim)
-    //  { Py_XDECREF(data); return NULL; }
-    //for (int d=0; d<ndim-1; ++d)
-    //  tdim[d] = odim[d];
-    //tdim[ndim-1] = npts/2 + 1;
-    //PyArrayObject *ret = (PyArrayObject *)PyArray_Empty(ndim,
-    //        tdim, PyArray_DescrFromType(NPY_CDOUBLE), 0);
-    //free(tdim);
-    //if (!ret) fail=1;
+static size_t signal_size (const fft_cache_entry *entry)
+  {
+  return (entry->type==CSL_FFT_REAL) ? entry->length : 2*entry->length;
+  }
 
-    int num_output_complex_points = npts / 2 + 1;
+int soundlib_fft_forward_float(CslFftPlan* plan, const float* input, float* output, float fct)
+{
+    fft_cache_entry *entry = plan->entry;
+    if (entry->ftables) {
+        fft_float_forward(entry->ftables, input, output, fct, plan->fwork);
+        return 0;
+    }
+    size_t nin = signal_size(entry), nout = spectrum_size(entry);
+    for (size_t i = 0; i < nin; i++) plan->dwork[i] = input[i];
+    if (soundlib_fft_forward(plan, plan->dwork, plan->dwork, fct) != 0) return -1;
+    for (size_t i = 0; i < nout; i++) output[i] = (float)plan->dwork[i];
+    return 0;
+}
 
-    int rstep = num_output_complex_points * 2;  // output stride
+int soundlib_fft_backward_float(CslFftPlan* plan, const float* input, float* output, float fct)
+{
+    fft_cache_entry *entry = plan->entry;
+    if (entry->ftables) {
+        fft_float_backward(entry->ftables, input, output, fct, plan->fwork);
+        return 0;
+    }
+    size_t nin = spectrum_size(entry), nout = signal_size(entry);
+    for (size_t i = 0; i < nin; i++) plan->dwork[i] = input[i];
+    if (soundlib_fft_backward(plan, plan->dwork, plan->dwork, fct) != 0) return -1;
+    for (size_t i = 0; i < nout; i++) output[i] = (float)plan->dwork[i];
+    return 0;
+}
 
-    int nrepeats = nrows;
-    double *rptr = output;
-    const double *dptr = input;
+static void stop_fft_pool (void);
 
-    plan = make_rfft_plan(npts);
-    if (!plan) fail=1;
+void soundlib_fft_clear_plan_cache(void)
+{
+    stop_fft_pool();
+    pthread_mutex_lock(&fft_cache_lock);
+    fft_cache_entry **link = &fft_cache;
+    while (*link) {
+        fft_cache_entry *entry = *link;
+        if (entry->refcount > 0) {
+            link = &entry->next;
+            continue;
+        }
+        *link = entry->next;
+        if (entry->rplan) destroy_rfft_plan(entry->rplan);
+        if (entry->cplan) destroy_cfft_plan(entry->cplan);
+        fft_float_tables_destroy(entry->ftables);
+        DEALLOC(entry);
+    }
+    pthread_mutex_unlock(&fft_cache_lock);
+}
 
-    double fct = norm_factor;
+// batched rows
 
-    //printf("npts = %d, norm = %f\n", npts, norm_factor);
-    //printf("rstep = %d\n", rstep);
-    //printf("nrepeats = %d\n", nrepeats);
+/*
+rows are split into contiguous runs, one per thread. every run gets its own handle on the
+cached plan, so threads share twiddles but not scratch. each row goes through exactly the
+code the serial path uses, so the results are bit identical whatever the thread count.
+*/
+#define FFT_BATCH_MIN_ROWS 32 // fewer rows per thread than this aren't worth a thread
 
-    int nprocessed = 0;
-    if (!fail)
-      for (int i = 0; i < nrepeats; i++) {
-          rptr[rstep-1] = 0.0;
-          memcpy((char *)(rptr+1), dptr, npts*sizeof(double));
-          if (rfft_forward(plan, rptr+1, fct)!=0) {fail=1; break;}
-          rptr[0] = rptr[1];
-          rptr[1] = 0.0;
-          rptr += rstep;
-          //dptr += npts;
-          dptr += nsamples;
-          nprocessed++;
-    }
-    if (plan) destroy_rfft_plan(plan);
+/*
+threads every batched call shares, one per core besides the caller, started on the first call
+that wants them. each call waits on its own group, so concurrent calls don't wait on each other.
+*/
+static pthread_mutex_t fft_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static threadPool *fft_pool = NULL;
+
+/* queued runs finish first, the next batched call starts the threads again */
+static void stop_fft_pool (void)
+  {
+  pthread_mutex_lock(&fft_pool_lock);
+  threadPool *pool = fft_pool;
+  fft_pool = NULL;
+  pthread_mutex_unlock(&fft_pool_lock);
+  if (pool) threadpool_destroy(pool);
+  }
 
-    if (fail) {
-      return nprocessed;
+typedef struct fft_batch_run
+  {
+  const char *input;
+  char *output;
+  size_t in_stride; // bytes between rows
+  size_t out_stride;
+  int fft_len;
+  int num_rows;
+  int done; // rows transformed before the first failure
+  float fct;
+  int single;
+  int backward; // spectra in, signals out
+  } fft_batch_run;
+
+static void run_rfft_rows (void *arg)
+  {
+  fft_batch_run *run = (fft_batch_run *)arg;
+  run->done = 0;
+  CslFftPlan *plan = soundlib_fft_plan_create(run->fft_len, CSL_FFT_REAL);
+  if (!plan) return;
+  for (int i = 0; i < run->num_rows; i++)
+    {
+    const void *in = run->input + (size_t)i * run->in_stride;
+    void *out = run->output + (size_t)i * run->out_stride;
+    int err;
+    if (run->backward)
+      err = run->single
+        ? soundlib_fft_backward_float(plan, (const float *)in, (float *)out, run->fct)
+        : soundlib_fft_backward(plan, (const double *)in, (double *)out, run->fct);
+    else
+      err = run->single
+        ? soundlib_fft_forward_float(plan, (const float *)in, (float *)out, run->fct)
+        : soundlib_fft_forward(plan, (const double *)in, (double *)out, run->fct);
+    if (err != 0) break;
+    run->done++;
     }
+  soundlib_fft_plan_destroy(plan);
+  }
 
-    return nrows;
+/*
+backward rows read packed spectra fft_len / 2 + 1 complex values apart and write signals
+fft_len apart. a signal row never reaches past the start of the next spectrum row, so going
+through the rows in order works in place. that only holds serially, so backward callers
+pass one thread.
+*/
+static int rfft_rows (const void *input, int fft_len, int nsamples, int nrows, float norm_factor, void *output, int num_threads, int single, int backward)
+  {
+  if ((fft_len < 1) || (nsamples < 1) || (nrows < 1) || (input == NULL) || (output == NULL))
+    return -1;
+
+  if (num_threads < 1) num_threads = threadpool_num_cores();
+  int num_runs = nrows / FFT_BATCH_MIN_ROWS;
+  if (num_runs > num_threads) num_runs = num_threads;
+  if (num_runs < 1) num_runs = 1;
+
+  fft_batch_run *runs = RALLOC(fft_batch_run, num_runs);
+  if (!runs) return 0;
+  size_t elem = single ? sizeof(float) : sizeof(double);
+  size_t signal_stride = (size_t)nsamples * elem;
+  size_t spectrum_stride = (size_t)(fft_len / 2 + 1) * 2 * elem;
+  size_t in_stride = backward ? spectrum_stride : signal_stride;
+  size_t out_stride = backward ? signal_stride : spectrum_stride;
+  for (int r = 0; r < num_runs; r++)
+    {
+    int first = (int)((int64_t)nrows * r / num_runs);
+    int last = (int)((int64_t)nrows * (r + 1) / num_runs);
+    runs[r].input = (const char *)input + (size_t)first * in_stride;
+    runs[r].output = (char *)output + (size_t)first * out_stride;
+    runs[r].in_stride = in_stride;
+    runs[r].out_stride = out_stride;
+    runs[r].fft_len = fft_len;
+    runs[r].num_rows = last - first;
+    runs[r].done = 0;
+    runs[r].fct = norm_factor;
+    runs[r].single = single;
+    runs[r].backward = backward;
+    }
+
+  /* the caller takes the first run itself, the pool only holds the rest */
+  if (num_runs > 1)
+    {
+    threadPoolGroup group;
+    threadpool_group_init(&group);
+    /* submitted under the lock so clearing the cache can't destroy the pool in between */
+    pthread_mutex_lock(&fft_pool_lock);
+    if (!fft_pool)
+      {
+      int num_cores = threadpool_num_cores();
+      fft_pool = threadpool_create((num_cores > 1) ? num_cores - 1 : 1);
+      }
+    for (int r = 1; r < num_runs; r++)
+      if (!fft_pool || threadpool_submit(fft_pool, run_rfft_rows, &runs[r], &group) != 0) run_rfft_rows(&runs[r]);
+    pthread_mutex_unlock(&fft_pool_lock);
+    run_rfft_rows(&runs[0]);
+    threadpool_group_wait(&group);
+    threadpool_group_destroy(&group);
+    }
+  else
+    for (int r = 0; r < num_runs; r++) run_rfft_rows(&runs[r]);
+
+  /* like the serial path, count rows up to the first one that failed */
+  int nprocessed = 0;
+  for (int r = 0; r < num_runs; r++)
+    {
+    nprocessed += runs[r].done;
+    if (runs[r].done < runs[r].num_rows) break;
+    }
+  DEALLOC(runs);
+  return nprocessed;
+  }
+
+// C API
+int rfft_forward_1d_array(const double *input, const int fft_len, const int nsamples, const int nrows, const float norm_factor, double *output)
+{
+    return rfft_rows(input, fft_len, nsamples, nrows, norm_factor, output, 1, 0, 0);
+}
+
+int rfft_forward_1d_array_threaded(const double *input, const int fft_len, const int nsamples, const int nrows, const float norm_factor, double *output, const int num_threads)
+{
+    return rfft_rows(input, fft_len, nsamples, nrows, norm_factor, output, num_threads, 0, 0);
+}
+
+/* in place rows, nothing is copied so there is nothing to gain from a per row plan loop in rfft_rows */
+static int rfft_rows_inplace (double *data, int fft_len, int nrows, float norm_factor, CslFftLayout layout, int backward)
+  {
+  if ((fft_len < 1) || (nrows < 1) || (data == NULL)) return -1;
+  CslFftPlan *plan = soundlib_fft_plan_create(fft_len, CSL_FFT_REAL);
+  if (!plan) return 0;
+  size_t stride = (layout == CSL_FFT_HALFCOMPLEX) ? (size_t)fft_len : (size_t)(fft_len / 2 + 1) * 2;
+  int nprocessed = 0;
+  for (int i = 0; i < nrows; i++)
+    {
+    double *row = data + (size_t)i * stride;
+    int err = backward
+      ? soundlib_fft_backward_inplace(plan, row, layout, norm_factor)
+      : soundlib_fft_forward_inplace(plan, row, layout, norm_factor);
+    if (err != 0) break;
+    nprocessed++;
+    }
+  soundlib_fft_plan_destroy(plan);
+  return nprocessed;
+  }
+
+int rfft_forward_1d_array_inplace(double *data, const int fft_len, const int nrows, const float norm_factor, CslFftLayout layout)
+{
+    return rfft_rows_inplace(data, fft_len, nrows, norm_factor, layout, 0);
+}
+
+int rfft_backward_1d_array_inplace(double *data, const int fft_len, const int nrows, const float norm_factor, CslFftLayout layout)
+{
+    return rfft_rows_inplace(data, fft_len, nrows, norm_factor, layout, 1);
 }
 
+int rfft_backward_1d_array(const double *input, const int fft_len, const int nrows, const float norm_factor, double *output)
+{
+    return rfft_rows(input, fft_len, fft_len, nrows, norm_factor, output, 1, 0, 1);
+}
 
 int cfft_backward_1d_array(const double *input, const int ncolumns, const int nrows, const float norm_factor, double *output)
 {
@@ -2470,38 +2846,55 @@ int cfft_backward_1d_array(const double *input, const int ncolumns, const int nr
         return -1;
     }
 
-    int npts = ncolumns;
-    cfft_plan plan=NULL;
+    CslFftPlan *plan = soundlib_fft_plan_create(ncolumns, CSL_FFT_COMPLEX);
+    if (!plan) return -1;
 
-    int nrepeats = nrows;
-    const double *dptr = input;
-    int fail=0;
-    double fct = norm_factor;
-    //Py_BEGIN_ALLOW_THREADS;
-    //NPY_SIGINT_ON;
-    plan = make_cfft_plan(npts);
-    if (!plan) fail=1;
+    int fail = 0;
+    for (int i = 0; i < nrows; i++) {
+        size_t offset = (size_t)i * ncolumns * 2;
+        if (soundlib_fft_backward(plan, input + offset, output + offset, norm_factor) != 0) { fail = 1; break; }
+    }
+    soundlib_fft_plan_destroy(plan);
+    if (fail) {
+      return -1;
+    }
 
-    double *out_ptr = output;
+    return nrows;
+}
 
-    if (!fail)
-      for (int i = 0; i < nrepeats; i++) {
-          //printf("i = %d(%d), ncols = %d, nrows = %d\n", i, nrepeats, ncolumns, nrows);
-          memcpy(out_ptr, dptr, sizeof(double) * 2 * npts);
-          int res = cfft_backward(plan, out_ptr, fct); // in-place
-          if (res!=0) { fail=1; break; }
-          dptr += npts*2;
-          out_ptr += npts*2;
-      }
-    if (plan) destroy_cfft_plan(plan);
-    //NPY_SIGINT_OFF;
-    //Py_END_ALLOW_THREADS;
+int rfft_forward_1d_array_float(const float *input, const int fft_len, const int nsamples, const int nrows, const float norm_factor, float *output)
+{
+    return rfft_rows(input, fft_len, nsamples, nrows, norm_factor, output, 1, 1, 0);
+}
+
+int rfft_forward_1d_array_float_threaded(const float *input, const int fft_len, const int nsamples, const int nrows, const float norm_factor, float *output, const int num_threads)
+{
+    return rfft_rows(input, fft_len, nsamples, nrows, norm_factor, output, num_threads, 1, 0);
+}
+
+int rfft_backward_1d_array_float(const float *input, const int fft_len, const int nrows, const float norm_factor, float *output)
+{
+    return rfft_rows(input, fft_len, fft_len, nrows, norm_factor, output, 1, 1, 1);
+}
+
+int cfft_backward_1d_array_float(const float *input, const int ncolumns, const int nrows, const float norm_factor, float *output)
+{
+    if (!input || !output) {
+        return -1;
+    }
+
+    CslFftPlan *plan = soundlib_fft_plan_create(ncolumns, CSL_FFT_COMPLEX);
+    if (!plan) return -1;
+
+    int fail = 0;
+    for (int i = 0; i < nrows; i++) {
+        size_t offset = (size_t)i * ncolumns * 2;
+        if (soundlib_fft_backward_float(plan, input + offset, output + offset, norm_factor) != 0) { fail = 1; break; }
+    }
+    soundlib_fft_plan_destroy(plan);
     if (fail) {
-      //Py_XDECREF(data);
-      //return PyErr_NoMemory();
       return -1;
     }
-    //return (PyObject *)data;
 
-    return nrepeats;
+    return nrows;
 }
@@ -0,0 +1,223 @@
+#include "resample.h"
+#include "csl_simd.h"
+#include <soundio/soundio.h>
+#include <math.h>
+#include <string.h>
+
+typedef struct _resampleQuality {
+    int half_width; // zero crossings on each side of the sinc
+    double beta; // kaiser window shape
+    double rolloff; // cutoff as a fraction of the lower nyquist
+} resampleQuality;
+
+static const resampleQuality _qualities[] = {
+    [CSL_RESAMPLE_DRAFT] = {8, 6.0, 0.90},
+    [CSL_RESAMPLE_NORMAL] = {16, 8.6, 0.94},
+    [CSL_RESAMPLE_HIGH] = {32, 10.0, 0.97},
+};
+
+static int _gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* zeroth order modified bessel function of the first kind */
+static double _besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+static void _buildCoefficients(CslResampler* r, const resampleQuality* q, double ratio) {
+    double cutoff = q->rolloff * ratio;
+    double window_norm = _besselI0(q->beta);
+    for (int phase = 0; phase < r->up; phase++) {
+        float* row = r->coefficients + (size_t)phase * r->taps;
+        double frac = (double)phase / (double)r->up;
+        double sum = 0.0;
+        for (int k = 0; k < r->taps; k++) {
+            double t = (double)(k - (r->half_taps - 1)) - frac;
+            double u = t / (double)r->half_taps;
+            double h = 0.0;
+            if (u > -1.0 && u < 1.0) {
+                double x = M_PI * cutoff * t;
+                double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(x) / x;
+                h = cutoff * sinc * _besselI0(q->beta * sqrt(1.0 - u * u)) / window_norm;
+            }
+            row[k] = (float)h;
+            sum += h;
+        }
+        /* unity gain at dc for every phase, otherwise the phases ripple against each other */
+        for (int k = 0; k < r->taps; k++) row[k] = (float)(row[k] / sum);
+    }
+}
+
+static inline float _dot(const float* coefficients, const float* samples, int taps) {
+    cslVec4 acc0 = csl_vec4_zero();
+    cslVec4 acc1 = csl_vec4_zero();
+    int k = 0;
+    for (; k + 8 <= taps; k += 8) {
+        acc0 = csl_vec4_madd(acc0, csl_vec4_load(coefficients + k), csl_vec4_load(samples + k));
+        acc1 = csl_vec4_madd(acc1, csl_vec4_load(coefficients + k + 4), csl_vec4_load(samples + k + 4));
+    }
+    for (; k < taps; k += 4) {
+        acc0 = csl_vec4_madd(acc0, csl_vec4_load(coefficients + k), csl_vec4_load(samples + k));
+    }
+    return csl_vec4_hsum(csl_vec4_add(acc0, acc1));
+}
+
+CslResampler* soundlib_resampler_create(int in_rate, int out_rate, int num_channels, CslResampleQuality quality) {
+    if (in_rate <= 0 || out_rate <= 0) return NULL;
+    if (num_channels < 1 || num_channels > RESAMPLE_MAX_CHANNELS) return NULL;
+    if (quality < CSL_RESAMPLE_DRAFT || quality > CSL_RESAMPLE_HIGH) return NULL;
+    int g = _gcd(in_rate, out_rate);
+    if (out_rate / g > RESAMPLE_MAX_PHASES) return NULL;
+
+    CslResampler* r = calloc(1, sizeof(CslResampler));
+    if (!r) return NULL;
+    r->in_rate = in_rate;
+    r->out_rate = out_rate;
+    r->num_channels = num_channels;
+    r->up = out_rate / g;
+    r->down = in_rate / g;
+
+    /* when going down the filter has to get wider to keep the same transition band in output terms */
+    const resampleQuality* q = &_qualities[quality];
+    double ratio = (r->up < r->down) ? (double)r->up / (double)r->down : 1.0;
+    r->half_taps = (int)ceil(q->half_width / ratio);
+    r->half_taps += r->half_taps & 1;
+    r->taps = 2 * r->half_taps;
+
+    r->coefficients = malloc((size_t)r->up * r->taps * sizeof(float));
+    r->capacity = r->taps + RESAMPLE_CHUNK_FRAMES;
+    bool ok = r->coefficients != NULL;
+    for (int ch = 0; ok && ch < num_channels; ch++) {
+        r->history[ch] = malloc(r->capacity * sizeof(float));
+        ok = r->history[ch] != NULL;
+    }
+    if (!ok) {
+        soundlib_resampler_destroy(r);
+        return NULL;
+    }
+    _buildCoefficients(r, q, ratio);
+    soundlib_resampler_reset(r);
+    return r;
+}
+
+void soundlib_resampler_destroy(CslResampler* r) {
+    if (!r) return;
+    for (int ch = 0; ch < RESAMPLE_MAX_CHANNELS; ch++) free(r->history[ch]);
+    free(r->coefficients);
+    free(r);
+}
+
+void soundlib_resampler_reset(CslResampler* r) {
+    /* half_taps - 1 frames of silence ahead of the input keep output frame 0 lined up with input frame 0 */
+    for (int ch = 0; ch < r->num_channels; ch++) {
+        memset(r->history[ch], 0, r->capacity * sizeof(float));
+    }
+    r->num_frames = r->half_taps - 1;
+    r->position = 0;
+    r->phase = 0;
+}
+
+int soundlib_resampler_process(CslResampler* r, const float* input, int in_frames, int* in_used, float* output, int out_frames) {
+    int num_channels = r->num_channels;
+    int used = 0;
+    int produced = 0;
+    while (true) {
+        while (produced < out_frames && r->position + r->taps <= r->num_frames) {
+            const float* row = r->coefficients + (size_t)r->phase * r->taps;
+            for (int ch = 0; ch < num_channels; ch++) {
+                output[(size_t)produced * num_channels + ch] = _dot(row, r->history[ch] + r->position, r->taps);
+            }
+            produced++;
+            r->phase += r->down;
+            r->position += r->phase / r->up;
+            r->phase %= r->up;
+        }
+        if (produced == out_frames || used == in_frames) break;
+
+        /* drop history the filter has moved past, then take in as much input as fits */
+        if (r->position > 0) {
+            int keep = r->num_frames - r->position;
+            for (int ch = 0; ch < num_channels; ch++) {
+                memmove(r->history[ch], r->history[ch] + r->position, keep * sizeof(float));
+            }
+            r->num_frames = keep;
+            r->position = 0;
+        }
+        int n = r->capacity - r->num_frames;
+        if (n > in_frames - used) n = in_frames - used;
+        const float* src = input + (size_t)used * num_channels;
+        for (int ch = 0; ch < num_channels; ch++) {
+            float* dst = r->history[ch] + r->num_frames;
+            for (int i = 0; i < n; i++) dst[i] = src[(size_t)i * num_channels + ch];
+        }
+        r->num_frames += n;
+        used += n;
+    }
+    if (in_used) *in_used = used;
+    return produced;
+}
+
+int soundlib_resample_file(const CslFileInfo* info, CslSampleRate sample_rate, CslResampleQuality quality, CslFileInfo* out) {
+    if (info->data == NULL) return CSLErrorInputMemoryNotAllocated;
+    int in_rate = get_sample_rate(info->sample_rate);
+    int out_rate = get_sample_rate(sample_rate);
+    int num_channels = info->num_channels;
+    CslResampler* r = soundlib_resampler_create(in_rate, out_rate, num_channels, quality);
+    if (!r) return SoundIoErrorInvalid;
+
+    int64_t total = ((int64_t)info->num_frames * r->up + r->down - 1) / r->down;
+    float* data = malloc((size_t)total * num_channels * sizeof(float));
+    float* chunk = malloc((size_t)RESAMPLE_CHUNK_FRAMES * num_channels * sizeof(float));
+    if (!data || !chunk) {
+        free(data);
+        free(chunk);
+        soundlib_resampler_destroy(r);
+        return SoundIoErrorNoMem;
+    }
+
+    size_t frame_bytes = get_bytes_in_buffer(info->data_type, true) * num_channels;
+    int64_t written = 0;
+    for (int64_t frame = 0; frame < info->num_frames && written < total; frame += RESAMPLE_CHUNK_FRAMES) {
+        int n = (info->num_frames - frame < RESAMPLE_CHUNK_FRAMES) ? (int)(info->num_frames - frame) : RESAMPLE_CHUNK_FRAMES;
+        byte_buffer_to_float_buffer(info->data + frame * frame_bytes, chunk, n * frame_bytes,
+                                    (size_t)n * num_channels, info->data_type, true);
+        int offset = 0;
+        while (offset < n && written < total) {
+            int used;
+            written += soundlib_resampler_process(r, chunk + (size_t)offset * num_channels, n - offset, &used,
+                                                  data + written * num_channels, (int)(total - written));
+            offset += used;
+        }
+    }
+    /* push silence through to get the last half filter length of output */
+    memset(chunk, 0, (size_t)RESAMPLE_CHUNK_FRAMES * num_channels * sizeof(float));
+    while (written < total) {
+        written += soundlib_resampler_process(r, chunk, RESAMPLE_CHUNK_FRAMES, NULL,
+                                              data + written * num_channels, (int)(total - written));
+    }
+    free(chunk);
+    soundlib_resampler_destroy(r);
+
+    out->data_type = CSL_FL32;
+    out->sample_rate = sample_rate;
+    out->file_type = info->file_type;
+    out->path = info->path;
+    out->num_frames = (int)total;
+    out->num_channels = num_channels;
+    out->data = (unsigned char*)data;
+    out->data_bytes = (size_t)total * num_channels * sizeof(float);
+    out->data_storage = CSL_DATA_ALLOCATED;
+    return SoundIoErrorNone;
+}
@@ -0,0 +1,192 @@
+#include "stft.h"
+#include "track.h"
+#include "state.h"
+#include "errors.h"
+#include <soundio/soundio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void _buildWindow(float* window, int n, CslWindowType type) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        /* periodic windows, so overlapping hops add up flat */
+        double x = 2.0 * M_PI * (double)i / (double)n;
+        double w;
+        switch (type) {
+            case CSL_WINDOW_HANN: w = 0.5 - 0.5 * cos(x); break;
+            case CSL_WINDOW_HAMMING: w = 0.54 - 0.46 * cos(x); break;
+            case CSL_WINDOW_BLACKMAN: w = 0.42 - 0.5 * cos(x) + 0.08 * cos(2.0 * x); break;
+            default: w = 1.0; break;
+        }
+        window[i] = (float)w;
+        sum += w;
+    }
+    /* a sine splits between the positive and negative bins, so twice the coherent gain */
+    for (int i = 0; i < n; i++) window[i] = (float)(window[i] * 2.0 / sum);
+}
+
+CslStft* soundlib_stft_create(int fft_size, int hop, CslWindowType window, float averaging) {
+    if (fft_size < STFT_MIN_FFT_SIZE || fft_size > STFT_MAX_FFT_SIZE) return NULL;
+    if (hop < 1) return NULL;
+    if (window < CSL_WINDOW_RECTANGULAR || window > CSL_WINDOW_BLACKMAN) return NULL;
+    if (!(averaging >= 0.0f && averaging < 1.0f)) return NULL;
+
+    CslStft* stft = calloc(1, sizeof(CslStft));
+    if (!stft) return NULL;
+    stft->fft_size = fft_size;
+    stft->hop = hop;
+    stft->num_bins = fft_size / 2 + 1;
+    stft->averaging = averaging;
+    stft->plan = soundlib_fft_plan_create(fft_size, CSL_FFT_REAL);
+    stft->window = malloc(fft_size * sizeof(float));
+    stft->ring = calloc(fft_size, sizeof(float));
+    stft->frame = malloc(fft_size * sizeof(float));
+    stft->spectrum = malloc(stft->num_bins * 2 * sizeof(float));
+    stft->average = calloc(stft->num_bins, sizeof(float));
+    bool ok = stft->plan && stft->window && stft->ring && stft->frame && stft->spectrum && stft->average;
+    for (int i = 0; ok && i < 3; i++) {
+        stft->buffers[i] = calloc(stft->num_bins, sizeof(float));
+        ok = stft->buffers[i] != NULL;
+    }
+    if (!ok) {
+        soundlib_stft_destroy(stft);
+        return NULL;
+    }
+    _buildWindow(stft->window, fft_size, window);
+    stft->until_frame = fft_size;
+    stft->back = 0;
+    stft->middle = 1;
+    stft->front = 2;
+    return stft;
+}
+
+void soundlib_stft_destroy(CslStft* stft) {
+    if (!stft) return;
+    soundlib_fft_plan_destroy(stft->plan);
+    free(stft->window);
+    free(stft->ring);
+    free(stft->frame);
+    free(stft->spectrum);
+    free(stft->average);
+    for (int i = 0; i < 3; i++) free(stft->buffers[i]);
+    free(stft);
+}
+
+int soundlib_stft_get_num_bins(const CslStft* stft) {
+    return stft->num_bins;
+}
+
+static void _transform(CslStft* stft) {
+    int n = stft->fft_size;
+    /* oldest sample first: the ring from the write position round to just before it */
+    int tail = n - stft->ring_pos;
+    for (int i = 0; i < tail; i++) stft->frame[i] = stft->ring[stft->ring_pos + i] * stft->window[i];
+    for (int i = 0; i < stft->ring_pos; i++) stft->frame[tail + i] = stft->ring[i] * stft->window[tail + i];
+    soundlib_fft_forward_float(stft->plan, stft->frame, stft->spectrum, 1.0f);
+
+    float keep = stft->averaging;
+    float* out = stft->buffers[stft->back];
+    for (int k = 0; k < stft->num_bins; k++) {
+        float re = stft->spectrum[2 * k], im = stft->spectrum[2 * k + 1];
+        float magnitude = sqrtf(re * re + im * im);
+        stft->average[k] = keep * stft->average[k] + (1.0f - keep) * magnitude;
+        out[k] = stft->average[k];
+    }
+    stft->num_frames++;
+    stft->buffer_frames[stft->back] = stft->num_frames;
+    int previous = __atomic_exchange_n(&stft->middle, stft->back | STFT_FRESH, __ATOMIC_ACQ_REL);
+    stft->back = previous & ~STFT_FRESH;
+}
+
+int soundlib_stft_push(CslStft* stft, const float* samples, int num_frames, int num_channels) {
+    if (num_channels < 1) return SoundIoErrorInvalid;
+    float scale = 1.0f / (float)num_channels;
+    int frame = 0;
+    while (frame < num_frames) {
+        /* up to the next transform or the end of the ring, whichever comes first */
+        int n = num_frames - frame;
+        if (n > stft->until_frame) n = stft->until_frame;
+        if (n > stft->fft_size - stft->ring_pos) n = stft->fft_size - stft->ring_pos;
+        float* dst = stft->ring + stft->ring_pos;
+        const float* src = samples + (size_t)frame * num_channels;
+        if (num_channels == 1) {
+            memcpy(dst, src, n * sizeof(float));
+        }
+        else {
+            for (int i = 0; i < n; i++) {
+                float sum = 0.0f;
+                for (int ch = 0; ch < num_channels; ch++) sum += src[(size_t)i * num_channels + ch];
+                dst[i] = sum * scale;
+            }
+        }
+        stft->ring_pos += n;
+        if (stft->ring_pos == stft->fft_size) stft->ring_pos = 0;
+        stft->until_frame -= n;
+        frame += n;
+        if (stft->until_frame == 0) {
+            _transform(stft);
+            stft->until_frame = stft->hop;
+        }
+    }
+    return SoundIoErrorNone;
+}
+
+bool soundlib_stft_read(CslStft* stft, float* magnitudes, int64_t* frame_count) {
+    bool fresh = (__atomic_load_n(&stft->middle, __ATOMIC_ACQUIRE) & STFT_FRESH) != 0;
+    if (fresh) {
+        int previous = __atomic_exchange_n(&stft->middle, stft->front, __ATOMIC_ACQ_REL);
+        stft->front = previous & ~STFT_FRESH;
+    }
+    memcpy(magnitudes, stft->buffers[stft->front], stft->num_bins * sizeof(float));
+    if (frame_count) *frame_count = stft->buffer_frames[stft->front];
+    return fresh;
+}
+
+void stft_push_bytes(CslStft* stft, const unsigned char* bytes, size_t num_bytes, CslDataType data_type, int num_channels) {
+    float samples[STFT_BYTES_CHUNK_SAMPLES];
+    if (num_channels < 1 || num_channels > STFT_BYTES_CHUNK_SAMPLES) return;
+    size_t bytes_in_buffer = get_bytes_in_buffer(data_type, false);
+    /* whole frames per chunk so the mono mix never straddles two chunks */
+    int chunk_samples = (STFT_BYTES_CHUNK_SAMPLES / num_channels) * num_channels;
+    size_t chunk_bytes = chunk_samples * bytes_in_buffer;
+    for (size_t offset = 0; offset < num_bytes; offset += chunk_bytes) {
+        size_t n = (num_bytes - offset < chunk_bytes) ? num_bytes - offset : chunk_bytes;
+        int num_samples = byte_buffer_to_float_buffer(bytes + offset, samples, n, chunk_samples, data_type, false);
+        soundlib_stft_push(stft, samples, num_samples / num_channels, num_channels);
+    }
+}
+
+int stft_attach(CslStft** slot, CslStft** in_use, CslStft* stft) {
+    if (stft != NULL && __atomic_exchange_n(&stft->attached, true, __ATOMIC_ACQ_REL)) return SoundIoErrorInvalid;
+    CslStft* old = __atomic_exchange_n(slot, stft, __ATOMIC_SEQ_CST);
+    while (old != NULL && __atomic_load_n(in_use, __ATOMIC_SEQ_CST) == old) {
+        usleep(500);
+    }
+    if (old != NULL) __atomic_store_n(&old->attached, false, __ATOMIC_RELEASE);
+    return SoundIoErrorNone;
+}
+
+void stft_feed_attached(CslStft** slot, CslStft** in_use, const unsigned char* bytes, size_t num_bytes, CslDataType data_type, int num_channels) {
+    /* publish what we are about to feed, then check it was not swapped out in between */
+    CslStft* stft;
+    do {
+        stft = __atomic_load_n(slot, __ATOMIC_SEQ_CST);
+        __atomic_store_n(in_use, stft, __ATOMIC_SEQ_CST);
+    } while (stft != __atomic_load_n(slot, __ATOMIC_SEQ_CST));
+    if (stft != NULL) stft_push_bytes(stft, bytes, num_bytes, data_type, num_channels);
+    __atomic_store_n(in_use, NULL, __ATOMIC_SEQ_CST);
+}
+
+int soundlib_track_attach_stft(int trackId, CslStft* stft) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    return stft_attach(&track_p->analyzer, &track_p->analyzer_in_use, stft);
+}
+
+int soundlib_master_attach_stft(CslStft* stft) {
+    return stft_attach(&csoundlib_state->master_analyzer, &csoundlib_state->master_analyzer_in_use, stft);
+}
@@ -9,18 +9,20 @@
 #include "wav.h"
 #include "errors.h"
 #include "track.h"
+#include "peaks.h"
+#include "timeline.h"
+#include "stft.h"
+#include "graph.h"
 #include <fcntl.h>
 
 static int _createInputStream(int device_index, float microphone_latency);
 static int _createOutputStream(int device_index, float microphone_latency);
 static void _processInputStreams(int* max_fill_samples);
-static void _copyInputBuffersToOutputBuffers();
-static void _processAudioEffects();
 static void _processInputReadyCallback();
-static void _processOutputReadyCallback();
 static void _processMasterOutputReadyCallback();
-static void _processMasterEffects();
-static void _processMasterOutputVolume();
+static void _processTimeline(int num_frames);
+static int _bufferChannels();
+static void _processAnalyzers(size_t master_bytes);
 
 extern audio_state* csoundlib_state;
 
@@ -148,45 +150,44 @@ static void _outputStreamWriteCallback(struct SoundIoOutStream *outstream, int f
     memset(csoundlib_state->mixed_output_buffer, 0, MAX_BUFFER_SIZE_BYTES);
     csoundlib_state->mixed_output_buffer_len = 0;
 
-    /* clear track input buffers*/
+    /* clear track input buffers, nothing is ever left past write_bytes. whatever fills them this period sets it again */
     hti it = ht_iterator(csoundlib_state->track_hash_table);
     while (ht_next(&it)) {
         trackObject* track_p = (trackObject*)it.value;
-        memset(track_p->input_buffer.buffer, 0, MAX_BUFFER_SIZE_BYTES);
+        memset(track_p->input_buffer.buffer, 0, track_p->input_buffer.write_bytes);
+        track_p->input_buffer.write_bytes = 0;
+        track_p->input_silent = true;
     }
 
     /* put input streams into track input buffers */
     _processInputStreams(&max_fill_samples);
 
-    /* give user the raw input buffer */
-    _processInputReadyCallback();
-
-    /* process any registered effects for each input buffer */
-    _processAudioEffects();
-
-    /* give user the effected track output buffer */
-    _processOutputReadyCallback();
+    int read_count_samples = min_int(frame_count_max, max_fill_samples);
+    /* handle case of no input streams */
+    if (read_count_samples == 0) read_count_samples = frame_count_min;
 
-    /* now copy input buffer to output scaled by volume */
-    /* note: THIS IS WHERE VOLUME SCALING HAPPENS */
-    if (csoundlib_state->stream_type == CSL_REALTIME) {
-        _copyInputBuffersToOutputBuffers();
+    /* lay the clips on the timeline into track input buffers */
+    if (csoundlib_state->stream_type == CSL_AUDIO_FILE) {
+        _processTimeline(read_count_samples);
     }
 
-    /* send output buffer to effect units */
-    _processMasterEffects();
+    /* give user the raw input buffer */
+    _processInputReadyCallback();
 
-    _processMasterOutputVolume();
+    /* run each track's effects, mix tracks and buses into the master buffer through the */
+    /* routing graph and run the master effects, a block at a time, then the output ready callbacks */
+    /* note: THIS IS WHERE VOLUME SCALING HAPPENS */
+    graph_process(csoundlib_state->stream_type == CSL_REALTIME || csoundlib_state->timeline_playing, _bufferChannels());
 
-    int read_count_samples = min_int(frame_count_max, max_fill_samples);
-    /* handle case of no input streams */
-    if (read_count_samples == 0) read_count_samples = frame_count_min;
     /* there is data to be read to output */
     frames_left = read_count_samples;
 
     /* give user the mixed output buffer */
     _processMasterOutputReadyCallback(frames_left * csoundlib_state->num_channels_audio_file * csoundlib_state->input_dtype.bytes_in_buffer);
 
+    /* feed spectrum analyzers on tracks and master */
+    _processAnalyzers(frames_left * csoundlib_state->num_channels_audio_file * csoundlib_state->input_dtype.bytes_in_buffer);
+
     /* set master output rms level */
     csoundlib_state->current_rms_ouput = calculate_rms_level(csoundlib_state->mixed_output_buffer, frame_count_max * outstream->bytes_per_frame);
     unsigned char* mixed_read_ptr = csoundlib_state->mixed_output_buffer;
@@ -378,6 +379,7 @@ static void _processInputStreams(int* max_fill_samples) {
 
             /* calculate rms value for this particular input channel */
             float input_rms_val = calculate_rms_level(read_ptr, fill_bytes);
+            bool silent = is_silent_audio(read_ptr, fill_bytes);
 
             hti it = ht_iterator(csoundlib_state->track_hash_table);
             while (ht_next(&it)) {
@@ -396,6 +398,24 @@ static void _processInputStreams(int* max_fill_samples) {
                         fill_bytes / csoundlib_state->input_dtype.bytes_in_buffer
                     );
                     track_p->input_buffer.write_bytes = fill_bytes;
+                    track_p->input_silent = silent;
+
+                    /* keep the waveform of the recording up to date. publish the pyramid
+                       before touching it so a detach waits for us to let go */
+                    CslPeaks* peaks;
+                    do {
+                        peaks = __atomic_load_n(&track_p->recorded_peaks, __ATOMIC_SEQ_CST);
+                        __atomic_store_n(&track_p->recorded_peaks_in_use, peaks, __ATOMIC_SEQ_CST);
+                    } while (peaks != __atomic_load_n(&track_p->recorded_peaks, __ATOMIC_SEQ_CST));
+                    if (peaks != NULL) {
+                        peaks_append_bytes(
+                            peaks,
+                            track_p->input_buffer.buffer,
+                            fill_bytes,
+                            csoundlib_state->input_dtype.dtype
+                        );
+                    }
+                    __atomic_store_n(&track_p->recorded_peaks_in_use, NULL, __ATOMIC_SEQ_CST);
                 } 
             }
             soundio_ring_buffer_advance_read_ptr(ring_buffer, fill_bytes);
@@ -403,45 +423,10 @@ static void _processInputStreams(int* max_fill_samples) {
     }
 }
 
-static void _copyInputBuffersToOutputBuffers() {
-    hti it = ht_iterator(csoundlib_state->track_hash_table);
-    while (ht_next(&it)) {
-        trackObject* track_p = (trackObject*)it.value;
-        if (!track_p->mute_enabled && (!csoundlib_state->solo_engaged || 
-                (csoundlib_state->solo_engaged && track_p->solo_enabled))) {
-            /* this needs to be scaled by volume for each track */
-            add_and_scale_audio(
-                (uint8_t*)(track_p->input_buffer.buffer),
-                (uint8_t*)(csoundlib_state->mixed_output_buffer),
-                track_p->volume,
-                track_p->input_buffer.write_bytes / csoundlib_state->input_dtype.bytes_in_buffer
-            );
-            if (csoundlib_state->mixed_output_buffer_len < track_p->input_buffer.write_bytes) {
-                csoundlib_state->mixed_output_buffer_len = track_p->input_buffer.write_bytes;
-            }
-            track_p->current_rms_levels.output_rms_level = 
-                    calculate_rms_level(
-                        track_p->input_buffer.buffer,
-                        track_p->input_buffer.write_bytes) * track_p->volume;
-        }
-    }
-}
-
-static void _processAudioEffects() {
-    hti it = ht_iterator(csoundlib_state->track_hash_table);
-    while (ht_next(&it)) {
-        trackObject* track_p = (trackObject*)it.value;
-        for (int i = 0; i < track_p->track_effects.num_effects; i++) {
-            track_p->track_effects.track_effect_list[i](
-                track_p->track_id,
-                track_p->input_buffer.buffer, 
-                track_p->input_buffer.write_bytes,
-                csoundlib_state->input_dtype.dtype,
-                csoundlib_state->sample_rate,
-                csoundlib_state->num_input_channels
-            );
-        }
-    }
+static int _bufferChannels() {
+    /* track buffers hold one input channel in realtime, the file's channels otherwise */
+    if (csoundlib_state->stream_type == CSL_AUDIO_FILE) return csoundlib_state->num_channels_audio_file;
+    return 1;
 }
 
 static void _processInputReadyCallback() {
@@ -463,21 +448,10 @@ static void _processInputReadyCallback() {
             csoundlib_state->sample_rate,
             input_channels
         );
-    }
-}
-
-static void _processOutputReadyCallback() {
-    hti it = ht_iterator(csoundlib_state->track_hash_table);
-    while (ht_next(&it)) {
-        trackObject* track_p = (trackObject*)it.value;
-        track_p->output_ready_callback(
-            track_p->track_id,
-            track_p->input_buffer.buffer,
-            track_p->input_buffer.write_bytes,
-            csoundlib_state->input_dtype.dtype,
-            csoundlib_state->sample_rate,
-            csoundlib_state->num_input_channels
-        );
+        /* the callback may have filled the buffer itself */
+        if (track_p->input_callback_writes && track_p->input_silent) {
+            track_p->input_silent = is_silent_audio(track_p->input_buffer.buffer, track_p->input_buffer.write_bytes);
+        }
     }
 }
 
@@ -498,24 +472,33 @@ static void _processMasterOutputReadyCallback(size_t num_bytes) {
     );
 }
 
-static void _processMasterEffects() {
-    for (int i = 0; i < csoundlib_state->master_effects.num_effects; i++) {
-        csoundlib_state->master_effects.master_effect_list[i](
-            csoundlib_state->mixed_output_buffer,
-            csoundlib_state->mixed_output_buffer_len,
-            csoundlib_state->input_dtype.dtype,
-            csoundlib_state->sample_rate,
-            csoundlib_state->num_input_channels
-        );
+static void _processAnalyzers(size_t master_bytes) {
+    int num_channels = _bufferChannels();
+    size_t bytes = (csoundlib_state->stream_type == CSL_AUDIO_FILE) ? master_bytes : csoundlib_state->mixed_output_buffer_len;
+    CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    hti it = ht_iterator(csoundlib_state->track_hash_table);
+    while (ht_next(&it)) {
+        trackObject* track_p = (trackObject*)it.value;
+        stft_feed_attached(&track_p->analyzer, &track_p->analyzer_in_use,
+                           track_p->input_buffer.buffer, track_p->input_buffer.write_bytes, dtype, num_channels);
     }
+    stft_feed_attached(&csoundlib_state->master_analyzer, &csoundlib_state->master_analyzer_in_use,
+                       csoundlib_state->mixed_output_buffer, bytes, dtype, num_channels);
 }
 
-static void _processMasterOutputVolume()
-{
-    add_and_scale_audio(
-        (uint8_t*)(csoundlib_state->mixed_output_buffer),
-        (uint8_t*)(csoundlib_state->mixed_output_buffer),
-        csoundlib_state->master_volume,
-        csoundlib_state->mixed_output_buffer_len / csoundlib_state->input_dtype.bytes_in_buffer
-    );
-}
\ No newline at end of file
+static void _processTimeline(int num_frames) {
+    if (!__atomic_load_n(&csoundlib_state->timeline_playing, __ATOMIC_ACQUIRE)) return;
+    int num_channels = csoundlib_state->num_channels_audio_file;
+    int max_frames = MAX_BUFFER_SIZE_BYTES / (num_channels * csoundlib_state->input_dtype.bytes_in_buffer);
+    if (num_frames > max_frames) num_frames = max_frames;
+
+    int64_t position = __atomic_load_n(&csoundlib_state->timeline_position, __ATOMIC_ACQUIRE);
+    hti it = ht_iterator(csoundlib_state->track_hash_table);
+    while (ht_next(&it)) {
+        trackObject* track_p = (trackObject*)it.value;
+        timeline_render_track(track_p, position, num_frames, num_channels);
+    }
+    /* a seek from another thread during the period wins over moving on */
+    __atomic_compare_exchange_n(&csoundlib_state->timeline_position, &position, position + num_frames,
+                                false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,117 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <soundio/soundio.h>
+
+static void* _workerLoop(void* arg) {
+    threadPool* pool = (threadPool*)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->head == NULL && !pool->shutting_down) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        if (pool->head == NULL && pool->shutting_down) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        threadPoolTask* task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->job(task->arg);
+
+        if (task->group) {
+            pthread_mutex_lock(&task->group->lock);
+            task->group->pending -= 1;
+            if (task->group->pending == 0) pthread_cond_broadcast(&task->group->done);
+            pthread_mutex_unlock(&task->group->lock);
+        }
+        free(task);
+    }
+}
+
+int threadpool_num_cores(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+}
+
+threadPool* threadpool_create(int num_threads) {
+    if (num_threads < 1) num_threads = threadpool_num_cores();
+    threadPool* pool = malloc(sizeof(threadPool));
+    if (!pool) return NULL;
+    pool->threads = malloc(num_threads * sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pool->num_threads = 0;
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->shutting_down = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, _workerLoop, pool) != 0) break;
+        pool->num_threads += 1;
+    }
+    if (pool->num_threads == 0) {
+        threadpool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int threadpool_submit(threadPool* pool, threadPoolJob job, void* arg, threadPoolGroup* group) {
+    threadPoolTask* task = malloc(sizeof(threadPoolTask));
+    if (!task) return SoundIoErrorNoMem;
+    task->job = job;
+    task->arg = arg;
+    task->group = group;
+    task->next = NULL;
+    if (group) {
+        pthread_mutex_lock(&group->lock);
+        group->pending += 1;
+        pthread_mutex_unlock(&group->lock);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) pool->tail->next = task;
+    else pool->head = task;
+    pool->tail = task;
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    return SoundIoErrorNone;
+}
+
+void threadpool_destroy(threadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    free(pool->threads);
+    free(pool);
+}
+
+void threadpool_group_init(threadPoolGroup* group) {
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->done, NULL);
+    group->pending = 0;
+}
+
+void threadpool_group_wait(threadPoolGroup* group) {
+    pthread_mutex_lock(&group->lock);
+    while (group->pending > 0) {
+        pthread_cond_wait(&group->done, &group->lock);
+    }
+    pthread_mutex_unlock(&group->lock);
+}
+
+void threadpool_group_destroy(threadPoolGroup* group) {
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->done);
+}
@@ -0,0 +1,336 @@
+#include "timeline.h"
+#include "state.h"
+#include "csl_util.h"
+#include <soundio/soundio.h>
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_mutex_t _editLock = PTHREAD_MUTEX_INITIALIZER;
+static int _nextRegionId = 1;
+
+static void _destroyTimeline(trackTimeline* timeline) {
+    if (!timeline) return;
+    for (int i = 0; i < timeline->num_regions; i++) {
+        CslClip* clip = timeline->regions[i].region.clip;
+        if (timeline->readers) clip_reader_destroy(&timeline->readers[i]);
+        soundlib_clip_unpin(clip);
+        soundlib_clip_release(clip);
+    }
+    free(timeline->regions);
+    free(timeline->subtree_end);
+    free(timeline->readers);
+    free(timeline->read_buffer);
+    free(timeline->mix_buffer);
+    free(timeline->byte_buffer);
+    free(timeline);
+}
+
+static int _compareRegions(const void* a, const void* b) {
+    const timelineRegion* ra = a;
+    const timelineRegion* rb = b;
+    if (ra->region.start != rb->region.start) return (ra->region.start < rb->region.start) ? -1 : 1;
+    return ra->id - rb->id;
+}
+
+/* fills subtree_end for the implicit tree over regions [lo, hi) and returns its latest end */
+static int64_t _buildSubtreeEnds(trackTimeline* timeline, int lo, int hi) {
+    if (lo >= hi) return INT64_MIN;
+    int mid = lo + (hi - lo) / 2;
+    int64_t end = timeline->regions[mid].end;
+    int64_t left = _buildSubtreeEnds(timeline, lo, mid);
+    int64_t right = _buildSubtreeEnds(timeline, mid + 1, hi);
+    if (left > end) end = left;
+    if (right > end) end = right;
+    timeline->subtree_end[mid] = end;
+    return end;
+}
+
+/*
+builds a timeline from a list of regions. every clip is retained and pinned for as long as
+the timeline lives, regions that fail to pin are rolled back and the build fails.
+*/
+static int _buildTimeline(const timelineRegion* regions, int num_regions, trackTimeline** out) {
+    *out = NULL;
+    if (num_regions == 0) return SoundIoErrorNone;
+
+    trackTimeline* timeline = calloc(1, sizeof(trackTimeline));
+    if (!timeline) return SoundIoErrorNoMem;
+    timeline->regions = malloc(num_regions * sizeof(timelineRegion));
+    timeline->subtree_end = malloc(num_regions * sizeof(int64_t));
+    timeline->readers = calloc(num_regions, sizeof(clipReader));
+    if (!timeline->regions || !timeline->subtree_end || !timeline->readers) {
+        _destroyTimeline(timeline);
+        return SoundIoErrorNoMem;
+    }
+    memcpy(timeline->regions, regions, num_regions * sizeof(timelineRegion));
+    qsort(timeline->regions, num_regions, sizeof(timelineRegion), _compareRegions);
+
+    int max_channels = 1;
+    for (int i = 0; i < num_regions; i++) {
+        CslClip* clip = timeline->regions[i].region.clip;
+        int err = soundlib_clip_pin(clip, NULL);
+        if (err == SoundIoErrorNone) {
+            soundlib_clip_retain(clip);
+            timeline->num_regions = i + 1;
+            err = clip_reader_init(&timeline->readers[i], clip);
+        }
+        if (err != SoundIoErrorNone) {
+            _destroyTimeline(timeline);
+            return err;
+        }
+        int num_channels = soundlib_clip_get_info(clip)->num_channels;
+        if (num_channels > max_channels) max_channels = num_channels;
+    }
+
+    _buildSubtreeEnds(timeline, 0, num_regions);
+
+    timeline->read_buffer = malloc(TIMELINE_CHUNK_FRAMES * max_channels * sizeof(float));
+    timeline->mix_buffer = malloc(TIMELINE_CHUNK_FRAMES * TIMELINE_MAX_CHANNELS * sizeof(float));
+    timeline->byte_buffer = malloc(TIMELINE_CHUNK_FRAMES * TIMELINE_MAX_CHANNELS * CSL_BYTES_IN_BUFFER_64);
+    if (!timeline->read_buffer || !timeline->mix_buffer || !timeline->byte_buffer) {
+        _destroyTimeline(timeline);
+        return SoundIoErrorNoMem;
+    }
+    *out = timeline;
+    return SoundIoErrorNone;
+}
+
+/*
+publishes a new timeline on the track and frees the old one. the audio thread marks the
+timeline it is rendering in timeline_in_use, the old one stays alive until that moves on.
+*/
+static void _swapTimeline(trackObject* track, trackTimeline* timeline) {
+    trackTimeline* old = __atomic_exchange_n(&track->timeline, timeline, __ATOMIC_SEQ_CST);
+    while (old != NULL && __atomic_load_n(&track->timeline_in_use, __ATOMIC_SEQ_CST) == old) {
+        usleep(500);
+    }
+    _destroyTimeline(old);
+}
+
+static trackObject* _getTrack(int trackId) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    return (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+}
+
+static int _checkRegion(const CslClipRegion* region) {
+    if (region == NULL || region->clip == NULL) return SoundIoErrorInvalid;
+    const CslFileInfo* info = soundlib_clip_get_info(region->clip);
+    if (region->start < 0 || region->source_offset < 0 || region->length <= 0) return SoundIoErrorInvalid;
+    if (region->source_offset + region->length > info->num_frames) return SoundIoErrorInvalid;
+    if (region->fade_in < 0 || region->fade_out < 0) return SoundIoErrorInvalid;
+    if (region->fade_in + region->fade_out > region->length) return SoundIoErrorInvalid;
+    if (info->num_channels < 1 || info->num_channels > TIMELINE_MAX_CHANNELS) return CSLErrorUnsupportedFormat;
+    /* clips are played frame for frame, convert them with soundlib_resample_file first */
+    if (info->sample_rate != csoundlib_state->sample_rate) return CSLErrorUnsupportedFormat;
+    return SoundIoErrorNone;
+}
+
+/* ********************************************* */
+/* editing                                       */
+/* ********************************************* */
+
+int soundlib_track_add_region(int trackId, const CslClipRegion* region, int* region_id) {
+    trackObject* track_p = _getTrack(trackId);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    int err = _checkRegion(region);
+    if (err != SoundIoErrorNone) return err;
+
+    pthread_mutex_lock(&_editLock);
+    const trackTimeline* old = track_p->timeline;
+    int num_regions = old ? old->num_regions : 0;
+    timelineRegion* regions = malloc((num_regions + 1) * sizeof(timelineRegion));
+    if (!regions) {
+        pthread_mutex_unlock(&_editLock);
+        return SoundIoErrorNoMem;
+    }
+    if (num_regions > 0) memcpy(regions, old->regions, num_regions * sizeof(timelineRegion));
+    timelineRegion* added = &regions[num_regions];
+    added->id = _nextRegionId;
+    added->region = *region;
+    added->end = region->start + region->length;
+
+    trackTimeline* timeline;
+    err = _buildTimeline(regions, num_regions + 1, &timeline);
+    free(regions);
+    if (err == SoundIoErrorNone) {
+        _swapTimeline(track_p, timeline);
+        if (region_id) *region_id = _nextRegionId;
+        _nextRegionId++;
+    }
+    pthread_mutex_unlock(&_editLock);
+    return err;
+}
+
+int soundlib_track_remove_region(int trackId, int region_id) {
+    trackObject* track_p = _getTrack(trackId);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+
+    pthread_mutex_lock(&_editLock);
+    const trackTimeline* old = track_p->timeline;
+    int found = -1;
+    for (int i = 0; old && i < old->num_regions; i++) {
+        if (old->regions[i].id == region_id) {
+            found = i;
+            break;
+        }
+    }
+    if (found < 0) {
+        pthread_mutex_unlock(&_editLock);
+        return SoundIoErrorInvalid;
+    }
+    int num_regions = old->num_regions - 1;
+    timelineRegion* regions = malloc((num_regions + 1) * sizeof(timelineRegion));
+    if (!regions) {
+        pthread_mutex_unlock(&_editLock);
+        return SoundIoErrorNoMem;
+    }
+    memcpy(regions, old->regions, found * sizeof(timelineRegion));
+    memcpy(regions + found, old->regions + found + 1, (num_regions - found) * sizeof(timelineRegion));
+
+    trackTimeline* timeline;
+    int err = _buildTimeline(regions, num_regions, &timeline);
+    free(regions);
+    if (err == SoundIoErrorNone) _swapTimeline(track_p, timeline);
+    pthread_mutex_unlock(&_editLock);
+    return err;
+}
+
+int soundlib_track_clear_regions(int trackId) {
+    trackObject* track_p = _getTrack(trackId);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    pthread_mutex_lock(&_editLock);
+    _swapTimeline(track_p, NULL);
+    pthread_mutex_unlock(&_editLock);
+    return SoundIoErrorNone;
+}
+
+int soundlib_track_get_num_regions(int trackId) {
+    trackObject* track_p = _getTrack(trackId);
+    if (track_p == NULL) return 0;
+    pthread_mutex_lock(&_editLock);
+    int num_regions = track_p->timeline ? track_p->timeline->num_regions : 0;
+    pthread_mutex_unlock(&_editLock);
+    return num_regions;
+}
+
+/* ********************************************* */
+/* transport                                     */
+/* ********************************************* */
+
+void soundlib_start_timeline(void) {
+    __atomic_store_n(&csoundlib_state->timeline_playing, true, __ATOMIC_RELEASE);
+}
+
+void soundlib_stop_timeline(void) {
+    __atomic_store_n(&csoundlib_state->timeline_playing, false, __ATOMIC_RELEASE);
+}
+
+void soundlib_set_timeline_position(int64_t frame) {
+    __atomic_store_n(&csoundlib_state->timeline_position, frame < 0 ? 0 : frame, __ATOMIC_RELEASE);
+}
+
+int64_t soundlib_get_timeline_position(void) {
+    return __atomic_load_n(&csoundlib_state->timeline_position, __ATOMIC_ACQUIRE);
+}
+
+/* ********************************************* */
+/* rendering                                     */
+/* ********************************************* */
+
+static inline float _regionGain(const CslClipRegion* region, int64_t offset) {
+    float gain = region->gain;
+    if (offset < region->fade_in) {
+        gain *= (float)offset / (float)region->fade_in;
+    }
+    int64_t left = region->length - offset;
+    if (left < region->fade_out) {
+        gain *= (float)left / (float)region->fade_out;
+    }
+    return gain;
+}
+
+/* adds frames [from, to) of one region into the chunk mix starting at mix frame offset */
+static void _mixRegion(trackTimeline* timeline, int index, int64_t from, int64_t to, float* mix, int num_channels) {
+    const timelineRegion* r = &timeline->regions[index];
+    const CslClipRegion* region = &r->region;
+    int clip_channels = r->region.clip->info.num_channels;
+    int n = clip_read_frames(&timeline->readers[index], region->source_offset + (from - region->start),
+                             (int)(to - from), timeline->read_buffer);
+    const float* src = timeline->read_buffer;
+    bool fading = (from - region->start < region->fade_in) || (r->end - to < region->fade_out);
+    for (int f = 0; f < n; f++) {
+        float gain = fading ? _regionGain(region, from - region->start + f) : region->gain;
+        float* dst = mix + (size_t)f * num_channels;
+        const float* frame = src + (size_t)f * clip_channels;
+        if (clip_channels == 1) {
+            for (int ch = 0; ch < num_channels; ch++) dst[ch] += frame[0] * gain;
+        }
+        else if (num_channels == 1) {
+            float sum = 0.0f;
+            for (int ch = 0; ch < clip_channels; ch++) sum += frame[ch];
+            dst[0] += sum * gain / (float)clip_channels;
+        }
+        else {
+            int shared = (clip_channels < num_channels) ? clip_channels : num_channels;
+            for (int ch = 0; ch < shared; ch++) dst[ch] += frame[ch] * gain;
+        }
+    }
+}
+
+/* mixes every region of the subtree [lo, hi) that sounds in [position, end) */
+static void _mixOverlapping(trackTimeline* timeline, int lo, int hi, int64_t position, int64_t end, int num_channels, bool* sounding) {
+    float* mix = timeline->mix_buffer;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        /* nothing in this subtree is still playing at position */
+        if (timeline->subtree_end[mid] <= position) return;
+        _mixOverlapping(timeline, lo, mid, position, end, num_channels, sounding);
+        const timelineRegion* r = &timeline->regions[mid];
+        /* this region and everything right of it start after the chunk */
+        if (r->region.start >= end) return;
+        if (r->end > position) {
+            if (!*sounding) memset(mix, 0, (size_t)(end - position) * num_channels * sizeof(float));
+            *sounding = true;
+            int64_t from = (r->region.start > position) ? r->region.start : position;
+            int64_t to = (r->end < end) ? r->end : end;
+            _mixRegion(timeline, mid, from, to, mix + (from - position) * num_channels, num_channels);
+        }
+        lo = mid + 1;
+    }
+}
+
+/* returns false when no region reaches the chunk, mix_buffer is left alone then */
+static bool _renderChunk(trackTimeline* timeline, int64_t position, int num_frames, int num_channels) {
+    bool sounding = false;
+    _mixOverlapping(timeline, 0, timeline->num_regions, position, position + num_frames, num_channels, &sounding);
+    return sounding;
+}
+
+void timeline_render_track(trackObject* track, int64_t position, int num_frames, int num_channels) {
+    /* publish what we are about to read, then check it was not swapped out in between */
+    trackTimeline* timeline;
+    do {
+        timeline = __atomic_load_n(&track->timeline, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&track->timeline_in_use, timeline, __ATOMIC_SEQ_CST);
+    } while (timeline != __atomic_load_n(&track->timeline, __ATOMIC_SEQ_CST));
+    if (timeline == NULL) return;
+    if (num_channels > TIMELINE_MAX_CHANNELS) num_channels = TIMELINE_MAX_CHANNELS;
+
+    CslDataType dtype = csoundlib_state->input_dtype.dtype;
+    size_t bytes_in_buffer = csoundlib_state->input_dtype.bytes_in_buffer;
+    unsigned char* out = track->input_buffer.buffer;
+    for (int done = 0; done < num_frames; done += TIMELINE_CHUNK_FRAMES) {
+        int n = (num_frames - done < TIMELINE_CHUNK_FRAMES) ? num_frames - done : TIMELINE_CHUNK_FRAMES;
+        int num_samples = n * num_channels;
+        /* the track buffer is already cleared, a chunk between regions stays silent */
+        if (!_renderChunk(timeline, position + done, n, num_channels)) continue;
+        track->input_silent = false;
+        float_buffer_to_byte_buffer(timeline->mix_buffer, timeline->byte_buffer, num_samples, dtype);
+        add_and_scale_audio(timeline->byte_buffer, out + (size_t)done * num_channels * bytes_in_buffer, 1.0, num_samples);
+    }
+    /* exactly this period, the graph clock advances by the longest track buffer */
+    track->input_buffer.write_bytes = (size_t)num_frames * num_channels * bytes_in_buffer;
+
+    __atomic_store_n(&track->timeline_in_use, NULL, __ATOMIC_SEQ_CST);
+}
@@ -2,6 +2,9 @@
 #include "state.h"
 #include "errors.h"
 #include "csl_util.h"
+#include "peaks.h"
+#include "stft.h"
+#include <unistd.h>
 
 static inline void dummy_callback(
     int trackId,
@@ -26,10 +29,22 @@ int soundlib_add_track(int trackId) {
             .current_rms_levels = {0.0, 0.0},
             .input_buffer.buffer = {0},
             .input_buffer.write_bytes = 0,
+            .input_silent = false,
+            .silent_frames = 0,
+            .idle = false,
+            .input_callback_writes = false,
             .track_effects.track_effect_list = allocated_effects,
             .track_effects.num_effects = 0,
+            .track_effects.native_effects = {NULL, NULL},
+            .routing = {.output_bus = CSL_MASTER_BUS, .num_sends = 0},
             .input_ready_callback = &dummy_callback,
-            .output_ready_callback = &dummy_callback
+            .output_ready_callback = &dummy_callback,
+            .recorded_peaks = NULL,
+            .recorded_peaks_in_use = NULL,
+            .timeline = NULL,
+            .timeline_in_use = NULL,
+            .analyzer = NULL,
+            .analyzer_in_use = NULL
         };
     *tp = track;
 
@@ -38,7 +53,7 @@ int soundlib_add_track(int trackId) {
     const char key[50];
     ht_getkey(trackId, key);
     ht_set(csoundlib_state->track_hash_table, key, (void*)(tp));
-    return SoundIoErrorNone;
+    return graph_rebuild();
 }
 
 int soundlib_delete_track(int trackId) {
@@ -46,9 +61,15 @@ int soundlib_delete_track(int trackId) {
     ht_getkey(trackId, key);
     trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
     if (track_p == NULL) return CSLErrorTrackNotFound;
+    int err = graph_remove_track(track_p);
+    if (err != SoundIoErrorNone) return err;
 
     track_p->track_effects.num_effects = 0;
     free(track_p->track_effects.track_effect_list);
+    soundlib_track_record_peaks(track_p->track_id, NULL);
+    soundlib_track_clear_regions(track_p->track_id);
+    stft_attach(&track_p->analyzer, &track_p->analyzer_in_use, NULL);
+    effects_clear_native(&track_p->track_effects.native_effects);
 
     /* ht remove frees track_p */
     ht_remove(csoundlib_state->track_hash_table, key);
@@ -59,9 +80,15 @@ int soundlib_delete_track(int trackId) {
 static int _deleteTrack(const char* key) {
     trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
     if (track_p == NULL) return CSLErrorTrackNotFound;
+    int err = graph_remove_track(track_p);
+    if (err != SoundIoErrorNone) return err;
 
     track_p->track_effects.num_effects = 0;
     free(track_p->track_effects.track_effect_list);
+    soundlib_track_record_peaks(track_p->track_id, NULL);
+    soundlib_track_clear_regions(track_p->track_id);
+    stft_attach(&track_p->analyzer, &track_p->analyzer_in_use, NULL);
+    effects_clear_native(&track_p->track_effects.native_effects);
 
     /* ht remove frees track_p */
     ht_remove(csoundlib_state->track_hash_table, key);
@@ -103,6 +130,14 @@ float soundlib_get_track_output_rms(int trackId) {
     return track_p->current_rms_levels.output_rms_level;
 }
 
+bool soundlib_track_is_idle(int trackId) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return false;
+    return track_p->idle;
+}
+
 int soundlib_solo_enable(int trackId) {
     const char key[50];
     ht_getkey(trackId, key);
@@ -155,6 +190,24 @@ int soundlib_set_track_volume(int trackId, float logVolume) {
     return SoundIoErrorNone;
 }
 
+int soundlib_track_record_peaks(int trackId, CslPeaks* peaks) {
+    const char key[50];
+    ht_getkey(trackId, key);
+    trackObject* track_p = (trackObject*)ht_get(csoundlib_state->track_hash_table, key);
+    if (track_p == NULL) return CSLErrorTrackNotFound;
+    if (peaks != NULL) {
+        if (peaks->num_channels != 1) return SoundIoErrorInvalid;
+        /* the audio thread appends to it from now on, so it has to stay where it is */
+        peaks->growable = false;
+    }
+    /* the caller may free the old pyramid once we return, so wait for the audio thread to let go */
+    CslPeaks* old = __atomic_exchange_n(&track_p->recorded_peaks, peaks, __ATOMIC_SEQ_CST);
+    while (old != NULL && __atomic_load_n(&track_p->recorded_peaks_in_use, __ATOMIC_SEQ_CST) == old) {
+        usleep(500);
+    }
+    return SoundIoErrorNone;
+}
+
 void soundlib_set_master_volume(float logVolume) {
     csoundlib_state->master_volume = log_to_mag(logVolume);
 }
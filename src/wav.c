@@ -2,7 +2,10 @@
 #include <stdio.h>
 #include "csoundlib.h"
 #include "errors.h"
+#include "csl_util.h"
 #include <string.h>
+#include <stdbool.h>
+#include <soundio/soundio.h>
 
 typedef struct _writeArgs {
     FILE* fp;
@@ -10,7 +13,7 @@ typedef struct _writeArgs {
     int num_bytes;
 } writeArgs;
 
-static wavHeader _createWavHeader(int numSamples, int sampleRate, int bitDepth, int numChannels) {
+wavHeader create_wav_header(int numSamples, int sampleRate, int bitDepth, int numChannels) {
     wavHeader header;
     header.riff_header[0] = 'R'; header.riff_header[1] = 'I'; header.riff_header[2] = 'F'; header.riff_header[3] = 'F';
     header.wav_size = 36 + numSamples * numChannels * (bitDepth / 8);
@@ -28,72 +31,185 @@ static wavHeader _createWavHeader(int numSamples, int sampleRate, int bitDepth,
     return header;
 }
 
+static int _readFmtChunk(FILE* fp, uint32_t chunk_size, wavHeader* header) {
+    if (chunk_size < 16) return CSLErrorUnsupportedFormat;
+    fread(&header->audio_format, sizeof(header->audio_format), 1, fp);
+    fread(&header->num_channels, sizeof(header->num_channels), 1, fp);
+    fread(&header->sample_rate, sizeof(header->sample_rate), 1, fp);
+    fread(&header->byte_rate, sizeof(header->byte_rate), 1, fp);
+    fread(&header->sample_alignment, sizeof(header->sample_alignment), 1, fp);
+    fread(&header->bit_depth, sizeof(header->bit_depth), 1, fp);
+    uint32_t read_bytes = 16;
+
+    if (header->audio_format == WAV_FORMAT_EXTENSIBLE) {
+        if (chunk_size < WAV_EXTENSIBLE_FMT_BYTES) return CSLErrorUnsupportedFormat;
+        uint16_t extension_size, valid_bits;
+        uint32_t channel_mask;
+        unsigned char subformat[16];
+        fread(&extension_size, sizeof(extension_size), 1, fp);
+        fread(&valid_bits, sizeof(valid_bits), 1, fp);
+        fread(&channel_mask, sizeof(channel_mask), 1, fp);
+        if (fread(subformat, sizeof(subformat), 1, fp) != 1) return CSLErrorOpeningFile;
+        read_bytes = WAV_EXTENSIBLE_FMT_BYTES;
+        if (memcmp(subformat + 2, WAV_SUBFORMAT_GUID_TAIL, 14) != 0) return CSLErrorUnsupportedFormat;
+        header->audio_format = subformat[0] | (subformat[1] << 8);
+    }
+    /* skip whatever is left of the chunk, chunks are padded to an even size */
+    fseek(fp, (chunk_size - read_bytes) + (chunk_size & 1), SEEK_CUR);
+    return SoundIoErrorNone;
+}
+
+static size_t _readData(FILE* fp, unsigned char* data, size_t num_bytes, const char* path, CslLoadProgressCallback progress, void* user, const bool* cancel) {
+    if (!progress && !cancel) return fread(data, sizeof(unsigned char), num_bytes, fp);
+    size_t read_bytes = 0;
+    while (read_bytes < num_bytes) {
+        if (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)) break;
+        size_t n = num_bytes - read_bytes;
+        if (n > WAV_READ_CHUNK_BYTES) n = WAV_READ_CHUNK_BYTES;
+        size_t got = fread(data + read_bytes, sizeof(unsigned char), n, fp);
+        read_bytes += got;
+        if (progress) progress(path, (float)read_bytes / (float)num_bytes, user);
+        if (got < n) break;
+    }
+    return read_bytes;
+}
+
 int open_wav_file(const char* path, CslFileInfo* info) {
+    return wav_read_file(path, info, NULL, NULL, NULL);
+}
+
+int wav_open_data(const char* path, CslFileInfo* info, wavHeader* header_out, FILE** fp_out) {
     FILE* fp = fopen(path, "rb");
     if (fp == NULL) return CSLErrorFileNotFound;
-    info->path = path;
-    info->file_type = CSL_WAV;
 
     wavHeader header;
     fread(&header.riff_header, sizeof(header.riff_header), 1, fp);
     fread(&header.wav_size, sizeof(header.wav_size), 1, fp);
     fread(&header.wave_header, sizeof(header.wave_header), 1, fp);
-    fread(&header.fmt_header, sizeof(header.fmt_header), 1, fp);
-    fread(&header.fmt_chunk_size, sizeof(header.fmt_chunk_size), 1, fp);
-    fread(&header.audio_format, sizeof(header.audio_format), 1, fp);
-    fread(&header.num_channels, sizeof(header.num_channels), 1, fp);
-    fread(&header.sample_rate, sizeof(header.sample_rate), 1, fp);
-    fread(&header.byte_rate, sizeof(header.byte_rate), 1, fp);
-    fread(&header.sample_alignment, sizeof(header.sample_alignment), 1, fp);
-    fread(&header.bit_depth, sizeof(header.bit_depth), 1, fp);
-
-    while (fread(&header.data_header, sizeof(header.data_header), 1, fp)) {
-        fread(&header.data_bytes, sizeof(header.data_bytes), 1, fp);
-        if (strncmp(header.data_header, "data", 4) == 0) {
+    if (strncmp(header.riff_header, "RIFF", 4) != 0 || strncmp(header.wave_header, "WAVE", 4) != 0) {
+        fclose(fp);
+        return CSLErrorUnsupportedFormat;
+    }
+
+    /* the fmt chunk is not always first, so walk the chunks until data shows up */
+    bool found_fmt = false;
+    bool found_data = false;
+    char chunk_id[4];
+    uint32_t chunk_size;
+    while (fread(chunk_id, sizeof(chunk_id), 1, fp) && fread(&chunk_size, sizeof(chunk_size), 1, fp)) {
+        if (strncmp(chunk_id, "fmt ", 4) == 0) {
+            memcpy(header.fmt_header, chunk_id, 4);
+            header.fmt_chunk_size = chunk_size;
+            int err = _readFmtChunk(fp, chunk_size, &header);
+            if (err != SoundIoErrorNone) {
+                fclose(fp);
+                return err;
+            }
+            found_fmt = true;
+        }
+        else if (strncmp(chunk_id, "data", 4) == 0) {
+            memcpy(header.data_header, chunk_id, 4);
+            header.data_bytes = chunk_size;
+            found_data = true;
             break;
-        } else {
+        }
+        else {
             // Skip unknown chunk by seeking forward
-            fseek(fp, header.data_bytes, SEEK_CUR);
+            fseek(fp, chunk_size + (chunk_size & 1), SEEK_CUR);
         }
     }
-    // found data. now read into buffer
-    fread(info->data, sizeof(unsigned char), header.data_bytes, fp);
-
-    fclose(fp);
-
-    if (header.sample_rate == 44100) {
-        info->sample_rate = CSL_SR44100;
-    }
-    else if (header.sample_rate == 48000) {
-        info->sample_rate = CSL_SR48000;
+    if (!found_fmt || !found_data || header.num_channels == 0) {
+        fclose(fp);
+        return CSLErrorUnsupportedFormat;
     }
-    else {
+
+    if (!get_csl_sample_rate(header.sample_rate, &info->sample_rate)) {
+        fclose(fp);
         return CSLErrorSettingSampleRate;
     }
 
     /*
 
-    8 bit (or lower) WAV files are always unsigned. 9 bit or higher are always signed
+    8 bit (or lower) WAV files are always unsigned. 9 bit or higher are always signed.
+    float files are 32 or 64 bit and are kept as they are.
     
     */
-    if (header.bit_depth == 8) {
-        info->data_type = CSL_U8;
-    }
-    else if (header.bit_depth == 16) {
-        info->data_type = CSL_S16;
-    }
-    else if (header.bit_depth == 24) {
-        info->data_type = CSL_S24;
+    if (header.audio_format == WAV_FORMAT_IEEE_FLOAT) {
+        if (header.bit_depth == 32) {
+            info->data_type = CSL_FL32;
+        }
+        else if (header.bit_depth == 64) {
+            info->data_type = CSL_FL64;
+        }
+        else {
+            fclose(fp);
+            return CSLErrorSettingBitDepth;
+        }
     }
-    else if (header.bit_depth == 32) {
-        info->data_type = CSL_S32;
+    else if (header.audio_format == WAV_FORMAT_PCM) {
+        if (header.bit_depth == 8) {
+            info->data_type = CSL_U8;
+        }
+        else if (header.bit_depth == 16) {
+            info->data_type = CSL_S16;
+        }
+        else if (header.bit_depth == 24) {
+            info->data_type = CSL_S24;
+        }
+        else if (header.bit_depth == 32) {
+            info->data_type = CSL_S32;
+        }
+        else {
+            fclose(fp);
+            return CSLErrorSettingBitDepth;
+        }
     }
     else {
-        return CSLErrorSettingBitDepth;
+        fclose(fp);
+        return CSLErrorUnsupportedFormat;
     }
 
     info->num_channels = header.num_channels;
+    *header_out = header;
+    *fp_out = fp;
+    return SoundIoErrorNone;
+}
+
+int wav_read_file(const char* path, CslFileInfo* info, CslLoadProgressCallback progress, void* user, const bool* cancel) {
+    wavHeader header;
+    FILE* fp;
+    int err = wav_open_data(path, info, &header, &fp);
+    if (err != SoundIoErrorNone) return err;
+    info->path = path;
+    info->file_type = CSL_WAV;
+    info->data_storage = CSL_DATA_USER;
+
+    if (info->data == NULL) {
+        info->data = malloc(header.data_bytes);
+        if (info->data == NULL) {
+            fclose(fp);
+            return SoundIoErrorNoMem;
+        }
+        info->data_storage = CSL_DATA_ALLOCATED;
+    }
+    else if (header.data_bytes > user_data_capacity(info)) {
+        fclose(fp);
+        return CSLErrorBufferTooSmall;
+    }
+    // found data. now read into buffer
+    info->data_bytes = _readData(fp, info->data, header.data_bytes, path, progress, user, cancel);
+
+    fclose(fp);
+    if (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+        soundlib_release_file_data(info);
+        return CSLErrorLoadCancelled;
+    }
+
     /* each frame has N samples where N is number of channels */
     /* this value divided by sample rate is the number of seconds in the track */
-    info->num_frames = header.data_bytes / (header.num_channels * (header.bit_depth / 8));
-}
\ No newline at end of file
+    /* a truncated file keeps the frames that were actually read, never the tail the header promised */
+    size_t frame_bytes = header.num_channels * (header.bit_depth / 8);
+    info->num_frames = info->data_bytes / frame_bytes;
+    info->data_bytes = info->num_frames * frame_bytes;
+    return SoundIoErrorNone;
+}